@@ -14,6 +14,7 @@
 
 #include "vulkan/vulkan.h"
 #include "VulkanTools.h"
+#include "VulkanMemoryAllocator.hpp"
 
 namespace vks
 {	
@@ -25,7 +26,8 @@ namespace vks
 	{
 		VkDevice device;
 		VkBuffer buffer = VK_NULL_HANDLE;
-		VkDeviceMemory memory = VK_NULL_HANDLE;
+		/** @brief Range of a (shared) device memory block backing this buffer */
+		vks::Allocation allocation;
 		VkDescriptorBufferInfo descriptor;
 		VkDeviceSize size = 0;
 		VkDeviceSize alignment = 0;
@@ -42,25 +44,33 @@ namespace vks
 		* @param size (Optional) Size of the memory range to map. Pass VK_WHOLE_SIZE to map the complete buffer range.
 		* @param offset (Optional) Byte offset from beginning
 		* 
-		* @return VkResult of the buffer mapping call
+		* @note Host visible memory blocks are persistently mapped by the allocator, so this only hands out a pointer
+		*
+		* @return VK_SUCCESS if the buffer's memory is host visible and the range lies inside the buffer's allocation
 		*/
 		VkResult map(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0)
 		{
-			return vkMapMemory(device, memory, offset, size, 0, &mapped);
+			if (!allocation.mapped)
+			{
+				return VK_ERROR_MEMORY_MAP_FAILED;
+			}
+			// The whole block is mapped, so only check the range against this buffer's part of it
+			if ((offset > allocation.size) || ((size != VK_WHOLE_SIZE) && (size > allocation.size - offset)))
+			{
+				return VK_ERROR_MEMORY_MAP_FAILED;
+			}
+			mapped = static_cast<uint8_t*>(allocation.mapped) + offset;
+			return VK_SUCCESS;
 		}
 
 		/**
 		* Unmap a mapped memory range
 		*
-		* @note Does not return a result as vkUnmapMemory can't fail
+		* @note The memory block itself stays mapped until it is released by the allocator
 		*/
 		void unmap()
 		{
-			if (mapped)
-			{
-				vkUnmapMemory(device, memory);
-				mapped = nullptr;
-			}
+			mapped = nullptr;
 		}
 
 		/** 
@@ -72,7 +82,7 @@ namespace vks
 		*/
 		VkResult bind(VkDeviceSize offset = 0)
 		{
-			return vkBindBufferMemory(device, buffer, memory, offset);
+			return vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset + offset);
 		}
 
 		/**
@@ -116,9 +126,9 @@ namespace vks
 		{
 			VkMappedMemoryRange mappedRange = {};
 			mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-			mappedRange.memory = memory;
-			mappedRange.offset = offset;
-			mappedRange.size = size;
+			mappedRange.memory = allocation.memory;
+			mappedRange.offset = allocation.offset + offset;
+			mappedRange.size = (size == VK_WHOLE_SIZE) ? allocation.size - offset : size;
 			return vkFlushMappedMemoryRanges(device, 1, &mappedRange);
 		}
 
@@ -136,9 +146,9 @@ namespace vks
 		{
 			VkMappedMemoryRange mappedRange = {};
 			mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-			mappedRange.memory = memory;
-			mappedRange.offset = offset;
-			mappedRange.size = size;
+			mappedRange.memory = allocation.memory;
+			mappedRange.offset = allocation.offset + offset;
+			mappedRange.size = (size == VK_WHOLE_SIZE) ? allocation.size - offset : size;
 			return vkInvalidateMappedMemoryRanges(device, 1, &mappedRange);
 		}
 
@@ -151,10 +161,7 @@ namespace vks
 			{
 				vkDestroyBuffer(device, buffer, nullptr);
 			}
-			if (memory)
-			{
-				vkFreeMemory(device, memory, nullptr);
-			}
+			allocation.free();
 		}
 
 	};
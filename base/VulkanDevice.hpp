@@ -15,6 +15,7 @@
 #include <algorithm>
 #include <exception>
 #include "VulkanBuffer.hpp"
+#include "VulkanMemoryAllocator.hpp"
 #include "VulkanTools.h"
 #include "vulkan/vulkan.h"
 
@@ -38,10 +39,15 @@ struct VulkanDevice {
   std::vector<VkQueueFamilyProperties> queueFamilyProperties;
   /** @brief List of extensions supported by the device */
   std::vector<std::string> supportedExtensions;
+  /** @brief List of extensions enabled on the logical device */
+  std::vector<std::string> enabledExtensions;
 
   /** @brief Default command pool for the graphics queue family index */
   VkCommandPool commandPool = VK_NULL_HANDLE;
 
+  /** @brief Sub-allocates device memory for buffers, images and attachments */
+  vks::MemoryAllocator memoryAllocator;
+
   /** @brief Set to true when the debug marker extension is detected */
   bool enableDebugMarkers = false;
 
@@ -106,6 +112,7 @@ struct VulkanDevice {
     if (commandPool) {
       vkDestroyCommandPool(logicalDevice, commandPool, nullptr);
     }
+    memoryAllocator.destroy();
     if (logicalDevice) {
       vkDestroyDevice(logicalDevice, nullptr);
     }
@@ -318,8 +325,11 @@ struct VulkanDevice {
                                      &logicalDevice);
 
     if (result == VK_SUCCESS) {
+      this->enabledExtensions.assign(deviceExtensions.begin(),
+                                     deviceExtensions.end());
       // Create a default command pool for graphics command buffers
       commandPool = createCommandPool(queueFamilyIndices.graphics);
+      memoryAllocator.create(logicalDevice, properties, memoryProperties);
     }
 
     this->enabledFeatures = enabledFeatures;
@@ -327,6 +337,49 @@ struct VulkanDevice {
     return result;
   }
 
+  /**
+   * Sub-allocate device memory from the device's memory allocator
+   *
+   * @param memReqs Memory requirements of the buffer or image
+   * @param memoryPropertyFlags Memory properties the allocation must have
+   * @param linear True for buffers and linear tiled images, false for optimal
+   * tiled images (keeps both apart according to bufferImageGranularity)
+   * @param allocation Pointer to the allocation handle acquired by the function
+   *
+   * @return VkResult of the allocation
+   */
+  VkResult allocateMemory(const VkMemoryRequirements& memReqs,
+                          VkMemoryPropertyFlags memoryPropertyFlags,
+                          bool linear,
+                          vks::Allocation* allocation) {
+    return memoryAllocator.allocate(
+        memReqs, getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags),
+        linear, allocation);
+  }
+
+  /**
+   * Sub-allocate and bind the memory for an image
+   *
+   * @param image Image to allocate the memory for
+   * @param memoryPropertyFlags Memory properties the allocation must have
+   * @param allocation Pointer to the allocation handle acquired by the function
+   * @param (Optional) linearTiling Set to true if the image was created with
+   * VK_IMAGE_TILING_LINEAR (Defaults to false)
+   *
+   * @return VkResult of the bind call
+   */
+  VkResult allocateImageMemory(VkImage image,
+                               VkMemoryPropertyFlags memoryPropertyFlags,
+                               vks::Allocation* allocation,
+                               bool linearTiling = false) {
+    VkMemoryRequirements memReqs;
+    vkGetImageMemoryRequirements(logicalDevice, image, &memReqs);
+    VK_CHECK_RESULT(allocateMemory(memReqs, memoryPropertyFlags, linearTiling,
+                                   allocation));
+    return vkBindImageMemory(logicalDevice, image, allocation->memory,
+                             allocation->offset);
+  }
+
   /**
    * Create a buffer on the device
    *
@@ -337,6 +390,10 @@ struct VulkanDevice {
    * @param size Size of the buffer in byes
    * @param buffer Pointer to the buffer handle acquired by the function
    * @param memory Pointer to the memory handle acquired by the function
+   *
+   * @note Uses a dedicated allocation that the caller maps itself and releases
+   * with freeMemory, prefer the vks::Allocation overload to sub-allocate the
+   * memory
    * @param data Pointer to the data that should be copied to the buffer after
    * creation (optional, if not set, no data is copied over)
    *
@@ -364,8 +421,8 @@ struct VulkanDevice {
     // Find a memory type index that fits the properties of the buffer
     memAlloc.memoryTypeIndex =
         getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
-    VK_CHECK_RESULT(
-        vkAllocateMemory(logicalDevice, &memAlloc, nullptr, memory));
+    // Counted by the allocator against maxMemoryAllocationCount
+    VK_CHECK_RESULT(memoryAllocator.allocateDedicated(memAlloc, memory));
 
     // If a pointer to the buffer data has been passed, map the buffer and copy
     // over the data
@@ -392,6 +449,73 @@ struct VulkanDevice {
     return VK_SUCCESS;
   }
 
+  /**
+   * Free the memory of a buffer created with the VkDeviceMemory overload of
+   * createBuffer
+   */
+  void freeMemory(VkDeviceMemory memory) {
+    memoryAllocator.freeDedicated(memory);
+  }
+
+  /**
+   * Create a buffer on the device backed by a sub-allocation
+   *
+   * @param usageFlags Usage flag bitmask for the buffer (i.e. index, vertex,
+   * uniform buffer)
+   * @param memoryPropertyFlags Memory properties for this buffer (i.e. device
+   * local, host visible, coherent)
+   * @param size Size of the buffer in byes
+   * @param buffer Pointer to the buffer handle acquired by the function
+   * @param allocation Pointer to the allocation handle acquired by the function
+   * @param data Pointer to the data that should be copied to the buffer after
+   * creation (optional, if not set, no data is copied over)
+   *
+   * @return VK_SUCCESS if buffer handle and memory have been created and
+   * (optionally passed) data has been copied
+   */
+  VkResult createBuffer(VkBufferUsageFlags usageFlags,
+                        VkMemoryPropertyFlags memoryPropertyFlags,
+                        VkDeviceSize size,
+                        VkBuffer* buffer,
+                        vks::Allocation* allocation,
+                        void* data = nullptr) {
+    // Create the buffer handle
+    VkBufferCreateInfo bufferCreateInfo =
+        vks::initializers::bufferCreateInfo(usageFlags, size);
+    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VK_CHECK_RESULT(
+        vkCreateBuffer(logicalDevice, &bufferCreateInfo, nullptr, buffer));
+
+    // Place the buffer inside one of the allocator's memory blocks
+    VkMemoryRequirements memReqs;
+    vkGetBufferMemoryRequirements(logicalDevice, *buffer, &memReqs);
+    VK_CHECK_RESULT(
+        allocateMemory(memReqs, memoryPropertyFlags, true, allocation));
+
+    // If a pointer to the buffer data has been passed, copy it over through
+    // the block's persistent mapping
+    if (data != nullptr) {
+      assert(allocation->mapped);
+      memcpy(allocation->mapped, data, size);
+      // If host coherency hasn't been requested, do a manual flush to make
+      // writes visible
+      if ((memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0) {
+        VkMappedMemoryRange mappedRange =
+            vks::initializers::mappedMemoryRange();
+        mappedRange.memory = allocation->memory;
+        mappedRange.offset = allocation->offset;
+        mappedRange.size = allocation->size;
+        vkFlushMappedMemoryRanges(logicalDevice, 1, &mappedRange);
+      }
+    }
+
+    // Attach the memory to the buffer object
+    VK_CHECK_RESULT(vkBindBufferMemory(logicalDevice, *buffer,
+                                       allocation->memory, allocation->offset));
+
+    return VK_SUCCESS;
+  }
+
   /**
    * Create a buffer on the device
    *
@@ -420,19 +544,14 @@ struct VulkanDevice {
     VK_CHECK_RESULT(vkCreateBuffer(logicalDevice, &bufferCreateInfo, nullptr,
                                    &buffer->buffer));
 
-    // Create the memory backing up the buffer handle
+    // Place the buffer inside one of the allocator's memory blocks
     VkMemoryRequirements memReqs;
-    VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
     vkGetBufferMemoryRequirements(logicalDevice, buffer->buffer, &memReqs);
-    memAlloc.allocationSize = memReqs.size;
-    // Find a memory type index that fits the properties of the buffer
-    memAlloc.memoryTypeIndex =
-        getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
-    VK_CHECK_RESULT(
-        vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &buffer->memory));
+    VK_CHECK_RESULT(allocateMemory(memReqs, memoryPropertyFlags, true,
+                                   &buffer->allocation));
 
     buffer->alignment = memReqs.alignment;
-    buffer->size = memAlloc.allocationSize;
+    buffer->size = memReqs.size;
     buffer->usageFlags = usageFlags;
     buffer->memoryPropertyFlags = memoryPropertyFlags;
 
@@ -597,5 +716,18 @@ struct VulkanDevice {
     return (std::find(supportedExtensions.begin(), supportedExtensions.end(),
                       extension) != supportedExtensions.end());
   }
+
+  /**
+   * Check if an extension has been enabled on the logical device
+   *
+   * @param extension Name of the extension to check
+   *
+   * @return True if the extension was passed to (or added by)
+   * createLogicalDevice
+   */
+  bool extensionEnabled(std::string extension) {
+    return (std::find(enabledExtensions.begin(), enabledExtensions.end(),
+                      extension) != enabledExtensions.end());
+  }
 };
 }  // namespace vks
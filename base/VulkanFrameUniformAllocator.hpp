@@ -0,0 +1,127 @@
+/*
+* Per frame uniform ring buffer
+*
+* Hands out uniform data from one persistently mapped buffer that is split into a region per frame in flight,
+* allocations are bound through a single VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC descriptor using dynamic offsets
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <assert.h>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.hpp"
+#include "VulkanBuffer.hpp"
+
+namespace vks
+{
+	/**
+	* @brief Linear allocator for uniform data that is rewritten every frame
+	*
+	* @note The region of a frame is reset by beginFrame, so the frame's previous submission must have completed (e.g. after VulkanExampleBase::prepareFrame)
+	* @note Dynamic offsets are only valid for the frame they were allocated in, command buffers binding them must be recorded per frame or reuse the same offsets every frame
+	*/
+	class FrameUniformAllocator
+	{
+	private:
+		vks::VulkanDevice *device = nullptr;
+		vks::Buffer buffer;
+		VkDeviceSize alignment = 0;
+		VkDeviceSize frameSize = 0;
+		uint32_t frameCount = 0;
+		uint32_t frameIndex = 0;
+		VkDeviceSize head = 0;
+
+	public:
+		/**
+		* Create the buffer backing all frames
+		*
+		* @param device Device to create the buffer on
+		* @param frameSize Number of bytes available to each frame (rounded up to the device's uniform buffer offset alignment)
+		* @param frameCount Number of frames that can be in flight at the same time
+		*/
+		void create(vks::VulkanDevice *device, VkDeviceSize frameSize, uint32_t frameCount)
+		{
+			this->device = device;
+			this->frameCount = frameCount;
+			alignment = std::max<VkDeviceSize>(device->properties.limits.minUniformBufferOffsetAlignment, 1);
+			this->frameSize = (frameSize + alignment - 1) / alignment * alignment;
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&buffer,
+				this->frameSize * frameCount));
+			VK_CHECK_RESULT(buffer.map());
+			frameIndex = 0;
+			head = 0;
+		}
+
+		void destroy()
+		{
+			buffer.destroy();
+		}
+
+		/** @brief Start allocating from the region of the given frame, discarding everything previously allocated in it */
+		void beginFrame(uint32_t frameIndex)
+		{
+			assert(frameIndex < frameCount);
+			this->frameIndex = frameIndex;
+			head = 0;
+		}
+
+		/**
+		* Reserve uniform data in the current frame's region
+		*
+		* @param size Size of the data in bytes
+		* @param dynamicOffset Returns the dynamic offset to pass to vkCmdBindDescriptorSets for this allocation
+		*
+		* @return Host pointer to write the data to
+		*/
+		void* allocate(VkDeviceSize size, uint32_t *dynamicOffset)
+		{
+			if (head + size > frameSize)
+			{
+				vks::tools::exitFatal("Frame uniform allocator is out of memory, increase its frame size", -1);
+			}
+			const VkDeviceSize offset = frameIndex * frameSize + head;
+			head += (size + alignment - 1) / alignment * alignment;
+			*dynamicOffset = static_cast<uint32_t>(offset);
+			return static_cast<uint8_t*>(buffer.mapped) + offset;
+		}
+
+		/** @brief Copy data into the current frame's region and return its dynamic offset */
+		template<typename T>
+		uint32_t push(const T &data)
+		{
+			uint32_t dynamicOffset;
+			memcpy(allocate(sizeof(T), &dynamicOffset), &data, sizeof(T));
+			return dynamicOffset;
+		}
+
+		/**
+		* Get a descriptor for binding allocations as VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC
+		*
+		* @param range Size of the uniform block in the shader, allocations bound through the descriptor must be at least this large
+		*/
+		VkDescriptorBufferInfo getDescriptor(VkDeviceSize range) const
+		{
+			assert(range <= device->properties.limits.maxUniformBufferRange);
+			VkDescriptorBufferInfo descriptor{};
+			descriptor.buffer = buffer.buffer;
+			descriptor.offset = 0;
+			descriptor.range = range;
+			return descriptor;
+		}
+
+		/** @brief Number of bytes allocated in the current frame (including alignment padding) */
+		VkDeviceSize getUsedSize() const
+		{
+			return head;
+		}
+	};
+}
@@ -0,0 +1,369 @@
+/*
+* GPU driven frustum culling
+*
+* Tests per object bounding boxes against the frustum planes in a compute shader (data/shaders/base/cull.comp) that writes
+* the indirect draw commands of the visible objects, so command buffers consume the culling result through indirect draws
+* and don't have to be recorded again when the visibility changes
+* The SPIR-V is not shipped with the sources, generate cull.comp.spv with data/shaders/base/generate-spirv.bat (glslangValidator)
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstring>
+#include <assert.h>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanInitializers.hpp"
+#include "VulkanDevice.hpp"
+#include "VulkanBuffer.hpp"
+#include "VulkanUploadBatch.hpp"
+#include "frustum.hpp"
+
+namespace vks
+{
+	/**
+	* @brief Compute shader culling stage writing VkDrawIndexedIndirectCommands for the visible objects
+	*
+	* With VK_KHR_draw_indirect_count enabled on the device the visible commands are compacted and drawn with the count written by the shader,
+	* otherwise every object keeps its command and culled objects get an instance count of zero
+	*
+	* @note Every frame in flight has its own uniform, command and result region, a frame's previous submission must have completed before update is called for it
+	*/
+	class GpuCulling
+	{
+	public:
+		/** @brief Bounds and draw parameters of an object, matches the Object struct of the shader (std430) */
+		struct Object
+		{
+			glm::vec3 boundsMin;
+			uint32_t indexCount;
+			glm::vec3 boundsMax;
+			uint32_t firstIndex;
+			int32_t vertexOffset;
+			uint32_t firstInstance;
+			uint32_t instanceCount;
+			uint32_t padding;
+		};
+		static_assert(sizeof(Object) == 48, "GpuCulling::Object has to match the std430 layout of the shader");
+
+	private:
+		struct UniformData
+		{
+			glm::vec4 planes[6];
+			uint32_t objectCount;
+			uint32_t maxObjects;
+		};
+
+		vks::VulkanDevice *device = nullptr;
+		uint32_t maxObjects = 0;
+		uint32_t frameCount = 0;
+		uint32_t objectCount = 0;
+
+		vks::Buffer objectBuffer;
+		// One region per frame in flight in each of these
+		vks::Buffer uniformBuffer;
+		vks::Buffer commandBuffer;
+		vks::Buffer resultBuffer;
+		VkDeviceSize uniformStride = 0;
+		VkDeviceSize commandStride = 0;
+		VkDeviceSize resultStride = 0;
+
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> descriptorSets;
+
+		PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount = nullptr;
+
+		static VkDeviceSize alignUp(VkDeviceSize size, VkDeviceSize alignment)
+		{
+			alignment = std::max<VkDeviceSize>(alignment, 4);
+			return (size + alignment - 1) / alignment * alignment;
+		}
+
+		const uint32_t *results(uint32_t frameIndex) const
+		{
+			assert(frameIndex < frameCount);
+			return reinterpret_cast<const uint32_t*>(static_cast<const uint8_t*>(resultBuffer.mapped) + frameIndex * resultStride);
+		}
+
+	public:
+		// True if the visible commands are compacted and drawn with vkCmdDrawIndexedIndirectCountKHR
+		bool compact = false;
+
+		/**
+		* Create the buffers and the compute pipeline
+		*
+		* @param device Device to create the resources on, VK_KHR_draw_indirect_count is used if it has been enabled on it
+		* @param maxObjects Maximum number of objects passed to setObjects
+		* @param frameCount Number of frames that can be in flight at the same time
+		* @param shaderStage Compute shader stage of cull.comp.spv (e.g. from VulkanExampleBase::loadShader)
+		* @param pipelineCache Pipeline cache to create the pipeline with
+		*/
+		void create(vks::VulkanDevice *device, uint32_t maxObjects, uint32_t frameCount, VkPipelineShaderStageCreateInfo shaderStage, VkPipelineCache pipelineCache)
+		{
+			assert(maxObjects > 0);
+			this->device = device;
+			this->maxObjects = maxObjects;
+			this->frameCount = frameCount;
+			objectCount = 0;
+
+			compact = device->extensionEnabled(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+			if (compact)
+			{
+				cmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(device->logicalDevice, "vkCmdDrawIndexedIndirectCountKHR"));
+				compact = (cmdDrawIndexedIndirectCount != nullptr);
+			}
+
+			const VkPhysicalDeviceLimits &limits = device->properties.limits;
+			uniformStride = alignUp(sizeof(UniformData), limits.minUniformBufferOffsetAlignment);
+			commandStride = alignUp(maxObjects * sizeof(VkDrawIndexedIndirectCommand), limits.minStorageBufferOffsetAlignment);
+			// Draw count followed by the visibility mask
+			resultStride = alignUp((1 + (maxObjects + 31) / 32) * sizeof(uint32_t), limits.minStorageBufferOffsetAlignment);
+
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&objectBuffer,
+				maxObjects * sizeof(Object)));
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&uniformBuffer,
+				uniformStride * frameCount));
+			VK_CHECK_RESULT(uniformBuffer.map());
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&commandBuffer,
+				commandStride * frameCount));
+			// Host visible, so the draw count and visibility can be read back after a frame has completed
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&resultBuffer,
+				resultStride * frameCount));
+			VK_CHECK_RESULT(resultBuffer.map());
+			memset(resultBuffer.mapped, 0, resultStride * frameCount);
+			for (uint32_t i = 0; i < frameCount; i++)
+			{
+				UniformData uniformData{};
+				uniformData.maxObjects = maxObjects;
+				memcpy(static_cast<uint8_t*>(uniformBuffer.mapped) + i * uniformStride, &uniformData, sizeof(UniformData));
+			}
+
+			// Descriptors
+			std::vector<VkDescriptorPoolSize> poolSizes = {
+				vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frameCount),
+				vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * frameCount),
+			};
+			VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, frameCount);
+			VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			};
+			VkDescriptorSetLayoutCreateInfo descriptorLayoutInfo = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutInfo, nullptr, &descriptorSetLayout));
+
+			descriptorSets.resize(frameCount);
+			std::vector<VkDescriptorSetLayout> setLayouts(frameCount, descriptorSetLayout);
+			VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, setLayouts.data(), frameCount);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, descriptorSets.data()));
+			for (uint32_t i = 0; i < frameCount; i++)
+			{
+				VkDescriptorBufferInfo uniformInfo = { uniformBuffer.buffer, i * uniformStride, sizeof(UniformData) };
+				VkDescriptorBufferInfo objectInfo = { objectBuffer.buffer, 0, VK_WHOLE_SIZE };
+				VkDescriptorBufferInfo commandInfo = { commandBuffer.buffer, i * commandStride, maxObjects * sizeof(VkDrawIndexedIndirectCommand) };
+				VkDescriptorBufferInfo resultInfo = { resultBuffer.buffer, i * resultStride, resultStride };
+				std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+					vks::initializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformInfo),
+					vks::initializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &objectInfo),
+					vks::initializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &commandInfo),
+					vks::initializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &resultInfo),
+				};
+				vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+			}
+
+			// Pipeline, the shader's COMPACT specialization constant selects the output mode
+			VkPipelineLayoutCreateInfo pipelineLayoutInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+			const VkBool32 compactConstant = compact ? VK_TRUE : VK_FALSE;
+			VkSpecializationMapEntry specializationEntry = vks::initializers::specializationMapEntry(0, 0, sizeof(VkBool32));
+			VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(1, &specializationEntry, sizeof(VkBool32), &compactConstant);
+			shaderStage.pSpecializationInfo = &specializationInfo;
+			VkComputePipelineCreateInfo pipelineInfo = vks::initializers::computePipelineCreateInfo(pipelineLayout);
+			pipelineInfo.stage = shaderStage;
+			VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline));
+		}
+
+		void destroy()
+		{
+			if (!device)
+			{
+				return;
+			}
+			vkDestroyPipeline(device->logicalDevice, pipeline, nullptr);
+			vkDestroyPipelineLayout(device->logicalDevice, pipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayout, nullptr);
+			vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+			objectBuffer.destroy();
+			uniformBuffer.destroy();
+			commandBuffer.destroy();
+			resultBuffer.destroy();
+			descriptorSets.clear();
+			device = nullptr;
+		}
+
+		/**
+		* Upload the objects to cull, the number of objects takes effect with the next update of each frame
+		*
+		* @param objects World space bounds and draw parameters of the objects
+		* @param count Number of objects (at most maxObjects)
+		* @param copyQueue Queue to upload the objects on
+		*
+		* @note The objects are shared by all frames, so no frame using them may be in flight
+		*/
+		void setObjects(const Object *objects, uint32_t count, VkQueue copyQueue)
+		{
+			assert(count <= maxObjects);
+			objectCount = count;
+			if (count > 0)
+			{
+				vks::UploadBatch uploads(device, copyQueue, 0);
+				uploads.copyToBuffer(objectBuffer.buffer, objects, count * sizeof(Object));
+				uploads.flush();
+			}
+		}
+
+		/** @brief Write the frustum planes and object count the culling of the given frame uses */
+		void update(uint32_t frameIndex, const vks::Frustum &frustum)
+		{
+			assert(frameIndex < frameCount);
+			UniformData uniformData{};
+			for (uint32_t i = 0; i < 6; i++)
+			{
+				uniformData.planes[i] = frustum.planes[i];
+			}
+			uniformData.objectCount = objectCount;
+			uniformData.maxObjects = maxObjects;
+			memcpy(static_cast<uint8_t*>(uniformBuffer.mapped) + frameIndex * uniformStride, &uniformData, sizeof(UniformData));
+		}
+
+		/**
+		* Record the culling dispatch, the commands only depend on the frame index and can be recorded once
+		*
+		* @param cmdBuffer Command buffer to record to, outside of a render pass and before the draws of the same frame
+		* @param frameIndex Frame whose uniform, command and result region are used
+		*/
+		void recordCulling(VkCommandBuffer cmdBuffer, uint32_t frameIndex)
+		{
+			assert(frameIndex < frameCount);
+			vkCmdFillBuffer(cmdBuffer, resultBuffer.buffer, frameIndex * resultStride, resultStride, 0);
+			VkMemoryBarrier clearBarrier = vks::initializers::memoryBarrier();
+			clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+			vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+			vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[frameIndex], 0, nullptr);
+			// The shader skips objects beyond the current object count
+			vkCmdDispatch(cmdBuffer, (maxObjects + 63) / 64, 1, 1);
+
+			VkMemoryBarrier cullBarrier = vks::initializers::memoryBarrier();
+			cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+			vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &cullBarrier, 0, nullptr, 0, nullptr);
+		}
+
+		/**
+		* Record the indirect draws of the visible objects, pipeline, vertex and index buffers have to be bound by the caller
+		*
+		* @note Without multiDrawIndirect enabled every object is a separate indirect draw, firstInstance requires drawIndirectFirstInstance to be enabled
+		*/
+		void draw(VkCommandBuffer cmdBuffer, uint32_t frameIndex)
+		{
+			assert(frameIndex < frameCount);
+			const VkDeviceSize offset = frameIndex * commandStride;
+			const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+			if (compact)
+			{
+				cmdDrawIndexedIndirectCount(cmdBuffer, commandBuffer.buffer, offset, resultBuffer.buffer, frameIndex * resultStride, maxObjects, stride);
+			}
+			else if (device->enabledFeatures.multiDrawIndirect == VK_TRUE)
+			{
+				vkCmdDrawIndexedIndirect(cmdBuffer, commandBuffer.buffer, offset, maxObjects, stride);
+			}
+			else
+			{
+				for (uint32_t i = 0; i < maxObjects; i++)
+				{
+					vkCmdDrawIndexedIndirect(cmdBuffer, commandBuffer.buffer, offset + i * stride, 1, stride);
+				}
+			}
+		}
+
+		/** @brief Number of visible objects written by the last completed culling of the given frame */
+		uint32_t getDrawCount(uint32_t frameIndex) const
+		{
+			return results(frameIndex)[0];
+		}
+
+		/**
+		* Read back the visibility written by the last completed culling of the given frame
+		*
+		* @param visibilityMask Returns one bit per object in the layout of vks::Frustum::checkBoxes, to compare the GPU result with the CPU
+		*/
+		void getVisibility(uint32_t frameIndex, std::vector<uint32_t> &visibilityMask) const
+		{
+			const uint32_t *mask = results(frameIndex) + 1;
+			visibilityMask.assign(mask, mask + (objectCount + 31) / 32);
+		}
+
+		/**
+		* Cull the objects once and compare the visibility with vks::Frustum::checkBoxes, e.g. to validate the shader on a new device
+		*
+		* @param objects Objects last passed to setObjects
+		* @param frustum Frustum to cull against
+		* @param queue Queue to submit the culling to, must belong to the queue family of the device's command pool and support compute
+		*
+		* @return Number of objects the GPU and the CPU disagree on
+		*
+		* @note Uses the regions of frame 0 and waits for the culling to complete, so no frame may be in flight
+		*/
+		uint32_t verify(const Object *objects, const vks::Frustum &frustum, VkQueue queue)
+		{
+			update(0, frustum);
+			VkCommandBuffer cmdBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			recordCulling(cmdBuffer, 0);
+			device->flushCommandBuffer(cmdBuffer, queue);
+
+			std::vector<uint32_t> gpuMask, cpuMask;
+			getVisibility(0, gpuMask);
+			vks::BoxBounds bounds;
+			for (uint32_t i = 0; i < objectCount; i++)
+			{
+				bounds.push_back(objects[i].boundsMin, objects[i].boundsMax);
+			}
+			frustum.checkBoxes(bounds, cpuMask);
+
+			uint32_t mismatches = 0;
+			for (size_t i = 0; i < cpuMask.size(); i++)
+			{
+				for (uint32_t bits = cpuMask[i] ^ gpuMask[i]; bits; bits &= bits - 1)
+				{
+					mismatches++;
+				}
+			}
+			return mismatches;
+		}
+	};
+}
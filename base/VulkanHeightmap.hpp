@@ -1,6 +1,10 @@
 /*
 * Heightmap terrain generator
 *
+* Generates either a single mesh for the whole heightmap or a tiled terrain of chunks with per chunk culling and
+* geomipmapping levels of detail (see HeightMap::createChunks), large raw heightmaps can be streamed chunk by chunk
+* from a memory mapped file (see HeightMap::openStreaming)
+*
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
@@ -9,22 +13,139 @@
 #include <glm/glm.hpp>
 #include <glm/glm.hpp>
 #include <gli/gli.hpp>
+#include <vector>
+#include <chrono>
 
 #include "vulkan/vulkan.h"
 #include "VulkanDevice.hpp"
 #include "VulkanBuffer.hpp"
+#include "VulkanUploadBatch.hpp"
+#include "VulkanMeshOptimizer.hpp"
+#include "VulkanModelCache.hpp"
+#include "frustum.hpp"
+#include "jobsystem.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define VKS_HEIGHTMAP_SSE
+#include <emmintrin.h>
+#endif
 
 namespace vks 
 {
 	class HeightMap
 	{
 	private:
-		uint16_t *heightdata;
+		uint16_t *heightdata = nullptr;
 		uint32_t dim;
 		uint32_t scale;
+		uint32_t patchsize = 0;
+		glm::vec3 meshScale = glm::vec3(1.0f);
+		// Heights of the single mesh's vertices, kept for queryHeights
+		std::vector<float> heightField;
+
+		// Scratch data for chunk culling
+		vks::BoxBounds chunkBounds;
+		std::vector<uint32_t> chunkVisibility;
+
+		/** @brief Height at continuous patch coordinates, taken from the nearest heightmap texel */
+		float sampleHeight(float x, float y)
+		{
+			const int32_t tx = std::max(0, std::min(static_cast<int32_t>(x * scale + 0.5f), static_cast<int32_t>(dim) - 1));
+			const int32_t ty = std::max(0, std::min(static_cast<int32_t>(y * scale + 0.5f), static_cast<int32_t>(dim) - 1));
+			return heightdata[tx + ty * dim] / 65535.0f * heightScale;
+		}
+
+		/**
+		* Create the index buffer shared by all chunks with one pattern per level of detail and stitch mask
+		* The coarsest level has no coarser neighbours and only needs the unstitched pattern
+		*/
+		void createChunkPatterns(vks::UploadBatch *uploads)
+		{
+			chunkLodLevels = 1;
+			while ((1u << (chunkLodLevels - 1)) < chunkSize)
+			{
+				chunkLodLevels++;
+			}
+			std::vector<uint32_t> indices;
+			chunkPatterns.assign(chunkLodLevels * 16, ChunkPattern{ 0, 0 });
+			for (uint32_t lod = 0; lod < chunkLodLevels; lod++)
+			{
+				for (uint32_t stitchMask = 0; stitchMask < ((lod + 1 < chunkLodLevels) ? 16u : 1u); stitchMask++)
+				{
+					ChunkPattern &pattern = chunkPatterns[lod * 16 + stitchMask];
+					pattern.firstIndex = static_cast<uint32_t>(indices.size());
+					appendChunkPattern(indices, 1u << lod, stitchMask);
+					pattern.indexCount = static_cast<uint32_t>(indices.size()) - pattern.firstIndex;
+				}
+			}
+
+			std::vector<uint16_t> shortIndices(indices.size());
+			chunkIndexType = vks::meshopt::packIndices16(indices.data(), indices.size(), 0, shortIndices.data()) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+			const void *indexData = (chunkIndexType == VK_INDEX_TYPE_UINT16) ? static_cast<const void*>(shortIndices.data()) : static_cast<const void*>(indices.data());
+			const VkDeviceSize chunkIndexBufferSize = indices.size() * ((chunkIndexType == VK_INDEX_TYPE_UINT16) ? sizeof(uint16_t) : sizeof(uint32_t));
+			chunkIndexBuffer.destroy();
+			device->createBuffer(
+				VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&chunkIndexBuffer,
+				chunkIndexBufferSize);
+			uploads->copyToBuffer(chunkIndexBuffer.buffer, indexData, chunkIndexBufferSize);
+		}
+
+		/**
+		* Append the triangles of one chunk level of detail pattern
+		* Blocks of 2x2 quads are triangulated as fans around their center, on stitched edges the fan skips the edge's middle vertex so the edge matches the next coarser level
+		*/
+		void appendChunkPattern(std::vector<uint32_t> &indices, uint32_t step, uint32_t stitchMask)
+		{
+			const uint32_t stride = chunkSize + 1;
+			if (step == chunkSize)
+			{
+				indices.push_back(0);
+				indices.push_back(chunkSize * stride);
+				indices.push_back(chunkSize + chunkSize * stride);
+				indices.push_back(chunkSize + chunkSize * stride);
+				indices.push_back(chunkSize);
+				indices.push_back(0);
+				return;
+			}
+			for (uint32_t by = 0; by < chunkSize; by += 2 * step)
+			{
+				for (uint32_t bx = 0; bx < chunkSize; bx += 2 * step)
+				{
+					// Perimeter of the block, the middle vertices of the sides are at odd positions
+					const uint32_t px[8] = { bx, bx + step, bx + 2 * step, bx + 2 * step, bx + 2 * step, bx + step, bx, bx };
+					const uint32_t py[8] = { by, by, by, by + step, by + 2 * step, by + 2 * step, by + 2 * step, by + step };
+					const bool skip[4] = {
+						(by == 0) && (stitchMask & chunkEdgeTop),
+						(bx + 2 * step == chunkSize) && (stitchMask & chunkEdgeRight),
+						(by + 2 * step == chunkSize) && (stitchMask & chunkEdgeBottom),
+						(bx == 0) && (stitchMask & chunkEdgeLeft)
+					};
+					uint32_t perimeter[8];
+					uint32_t count = 0;
+					for (uint32_t i = 0; i < 8; i++)
+					{
+						if ((i % 2 == 1) && skip[i / 2])
+						{
+							continue;
+						}
+						perimeter[count++] = px[i] + py[i] * stride;
+					}
+					const uint32_t center = (bx + step) + (by + step) * stride;
+					for (uint32_t i = 0; i < count; i++)
+					{
+						indices.push_back(center);
+						indices.push_back(perimeter[(i + 1) % count]);
+						indices.push_back(perimeter[i]);
+					}
+				}
+			}
+		}
 
 		vks::VulkanDevice *device = nullptr;
 		VkQueue copyQueue = VK_NULL_HANDLE;
+		vks::UploadBatch *uploadBatch = nullptr;
 	public:
 		enum Topology { topologyTriangles, topologyQuads };
 
@@ -43,17 +164,94 @@ namespace vks
 		size_t vertexBufferSize = 0;
 		size_t indexBufferSize = 0;
 		uint32_t indexCount = 0;
+		// Type to bind the index buffer with, patches with less than 64k vertices use 16 bit indices
+		VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+
+		/*
+			Tiled terrain (see createChunks)
+		*/
+		// Sides of a chunk, a set bit in a stitch mask means the neighbour on that side uses the next coarser level of detail
+		enum ChunkEdge { chunkEdgeTop = 1, chunkEdgeRight = 2, chunkEdgeBottom = 4, chunkEdgeLeft = 8 };
 
-		HeightMap(vks::VulkanDevice *device, VkQueue copyQueue)
+		struct Chunk {
+			glm::vec3 min;
+			glm::vec3 max;
+			// First vertex of the chunk in chunkVertexBuffer, passed as vertexOffset
+			int32_t vertexOffset;
+			uint32_t lod;
+			uint32_t stitchMask;
+			bool visible;
+		};
+		std::vector<Chunk> chunks;
+		uint32_t chunkCount = 0;
+		uint32_t chunkSize = 0;
+		uint32_t chunkLodLevels = 0;
+
+		// Index range of a level of detail and stitch mask combination in chunkIndexBuffer, stored at lod * 16 + stitchMask
+		struct ChunkPattern {
+			uint32_t firstIndex;
+			uint32_t indexCount;
+		};
+		std::vector<ChunkPattern> chunkPatterns;
+
+		vks::Buffer chunkVertexBuffer;
+		vks::Buffer chunkIndexBuffer;
+		VkIndexType chunkIndexType = VK_INDEX_TYPE_UINT32;
+
+		// Chunks use level of detail n while the camera is further than lodDistance * 2^(n-1) away from their bounds
+		float lodDistance = 32.0f;
+
+		// Streaming: chunks closer than streamingDistance are built, resident chunks are evicted least recently used first to stay below streamingBudget bytes
+		float streamingDistance = 512.0f;
+		VkDeviceSize streamingBudget = 256 * 1024 * 1024;
+		// Maximum number of chunks being built at the same time
+		uint32_t maxPendingChunks = 8;
+
+		struct StreamingStatistics {
+			uint32_t residentChunks = 0;
+			uint32_t pendingChunks = 0;
+			VkDeviceSize residentBytes = 0;
+			// Totals since openStreaming
+			uint64_t evictedChunks = 0;
+			// Time from requesting a chunk to its upload, of the last chunk and averaged over all chunks
+			double lastBuildLatency = 0.0;
+			double averageBuildLatency = 0.0;
+		} streamingStatistics;
+
+		// Results of the last updateChunks call, compared against the triangles of the single mesh generated by loadFromFile
+		struct ChunkStatistics {
+			uint32_t visibleChunks = 0;
+			uint32_t culledChunks = 0;
+			uint64_t triangles = 0;
+			uint64_t monolithicTriangles = 0;
+		} chunkStatistics;
+
+		/**
+		* @param device Device to create the vertex and index buffers on
+		* @param copyQueue Queue used for the memory staging copy commands (must support transfer)
+		* @param (Optional) uploadBatch Upload batch to record the buffer copies into instead of uploading right away (defaults to nullptr)
+		*/
+		HeightMap(vks::VulkanDevice *device, VkQueue copyQueue, vks::UploadBatch *uploadBatch = nullptr)
 		{
 			this->device = device;
 			this->copyQueue = copyQueue;
+			this->uploadBatch = uploadBatch;
 		};
 
 		~HeightMap()
 		{
+			for (auto &streamed : streamedChunks)
+			{
+				if (streamed.job)
+				{
+					jobSystem->wait(streamed.job);
+				}
+				streamed.vertices.destroy();
+			}
 			vertexBuffer.destroy();
 			indexBuffer.destroy();
+			chunkVertexBuffer.destroy();
+			chunkIndexBuffer.destroy();
 			delete[] heightdata;
 		}
 
@@ -66,10 +264,105 @@ namespace vks
 			return *(heightdata + (rpos.x + rpos.y * dim) * scale) / 65535.0f * heightScale;
 		}
 
+		/**
+		* Bilinearly interpolated terrain surface at world space positions, for placing objects on or colliding with the mesh generated by loadFromFile
+		* Only reads data that is constant after loading, so any number of threads can query at the same time
+		*
+		* @param positions World space positions, only x and z are used (positions outside of the terrain are clamped to its border)
+		* @param count Number of positions
+		* @param heights Returns the world space y coordinate of the surface at each position (heights go towards negative y like the mesh's)
+		* @param (Optional) normals Returns the surface normals, oriented like the vertex normals before their mapping to [0, 1] (defaults to nullptr)
+		*/
+		void queryHeights(const glm::vec3 *positions, uint32_t count, float *heights, glm::vec3 *normals = nullptr) const
+		{
+			assert(!heightField.empty());
+			// World position to patch coordinates, the inverse of the vertex placement
+			const float toPatchX = 0.5f / meshScale.x;
+			const float toPatchZ = 0.5f / meshScale.z;
+			const float patchOffset = (patchsize - 1) * 0.5f;
+			const float patchMax = static_cast<float>(patchsize - 1);
+			const float *field = heightField.data();
+			uint32_t i = 0;
+#if defined(VKS_HEIGHTMAP_SSE)
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 one = _mm_set1_ps(1.0f);
+			// Cells start at most at patchsize - 2, so the upper neighbours are always inside of the field
+			const __m128 cellMax = _mm_set1_ps(static_cast<float>(patchsize - 2));
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128 px = _mm_set_ps(positions[i + 3].x, positions[i + 2].x, positions[i + 1].x, positions[i].x);
+				__m128 pz = _mm_set_ps(positions[i + 3].z, positions[i + 2].z, positions[i + 1].z, positions[i].z);
+				px = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(toPatchX)), _mm_set1_ps(patchOffset)), zero), _mm_set1_ps(patchMax));
+				pz = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(toPatchZ)), _mm_set1_ps(patchOffset)), zero), _mm_set1_ps(patchMax));
+				// Coordinates are positive, so truncation is floor
+				const __m128 cx = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(px)), cellMax);
+				const __m128 cz = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(pz)), cellMax);
+				const __m128 fx = _mm_sub_ps(px, cx);
+				const __m128 fz = _mm_sub_ps(pz, cz);
+
+				// SSE2 has no gather, the four corners of each cell are loaded one lane at a time
+				alignas(16) float cellX[4], cellZ[4];
+				_mm_store_ps(cellX, cx);
+				_mm_store_ps(cellZ, cz);
+				alignas(16) float corners[4][4];
+				for (uint32_t lane = 0; lane < 4; lane++)
+				{
+					const float *h = field + static_cast<uint32_t>(cellX[lane]) + static_cast<uint32_t>(cellZ[lane]) * patchsize;
+					corners[0][lane] = h[0];
+					corners[1][lane] = h[1];
+					corners[2][lane] = h[patchsize];
+					corners[3][lane] = h[patchsize + 1];
+				}
+				const __m128 h00 = _mm_load_ps(corners[0]);
+				const __m128 h10 = _mm_load_ps(corners[1]);
+				const __m128 h01 = _mm_load_ps(corners[2]);
+				const __m128 h11 = _mm_load_ps(corners[3]);
+				const __m128 top = _mm_add_ps(h00, _mm_mul_ps(_mm_sub_ps(h10, h00), fx));
+				const __m128 bottom = _mm_add_ps(h01, _mm_mul_ps(_mm_sub_ps(h11, h01), fx));
+				const __m128 height = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fz));
+				_mm_storeu_ps(&heights[i], _mm_sub_ps(zero, height));
+				if (normals)
+				{
+					// Height gradient in world units
+					const __m128 slopeX = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(h10, h00), _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(h11, h01), _mm_sub_ps(h10, h00)), fz)), _mm_set1_ps(toPatchX));
+					const __m128 slopeZ = _mm_mul_ps(_mm_sub_ps(bottom, top), _mm_set1_ps(toPatchZ));
+					const __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(slopeX, slopeX), _mm_mul_ps(slopeZ, slopeZ)), one)));
+					alignas(16) float nx[4], ny[4], nz[4];
+					_mm_store_ps(nx, _mm_sub_ps(zero, _mm_mul_ps(slopeX, invLength)));
+					_mm_store_ps(ny, invLength);
+					_mm_store_ps(nz, _mm_sub_ps(zero, _mm_mul_ps(slopeZ, invLength)));
+					for (uint32_t lane = 0; lane < 4; lane++)
+					{
+						normals[i + lane] = glm::vec3(nx[lane], ny[lane], nz[lane]);
+					}
+				}
+			}
+#endif
+			for (; i < count; i++)
+			{
+				const float px = std::max(0.0f, std::min(positions[i].x * toPatchX + patchOffset, patchMax));
+				const float pz = std::max(0.0f, std::min(positions[i].z * toPatchZ + patchOffset, patchMax));
+				const uint32_t cx = std::min(static_cast<uint32_t>(px), patchsize - 2);
+				const uint32_t cz = std::min(static_cast<uint32_t>(pz), patchsize - 2);
+				const float fx = px - cx;
+				const float fz = pz - cz;
+				const float *h = field + cx + cz * patchsize;
+				const float top = h[0] + (h[1] - h[0]) * fx;
+				const float bottom = h[patchsize] + (h[patchsize + 1] - h[patchsize]) * fx;
+				heights[i] = -(top + (bottom - top) * fz);
+				if (normals)
+				{
+					const float slopeX = ((h[1] - h[0]) + ((h[patchsize + 1] - h[patchsize]) - (h[1] - h[0])) * fz) * toPatchX;
+					const float slopeZ = (bottom - top) * toPatchZ;
+					normals[i] = glm::normalize(glm::vec3(-slopeX, 1.0f, -slopeZ));
+				}
+			}
+		}
+
 #if defined(__ANDROID__)
-		void loadFromFile(const std::string filename, uint32_t patchsize, glm::vec3 scale, Topology topology, AAssetManager* assetManager)
+		void loadFromFile(const std::string filename, uint32_t patchsize, glm::vec3 scale, Topology topology, AAssetManager* assetManager, vks::JobSystem *jobSystem = nullptr)
 #else
-		void loadFromFile(const std::string filename, uint32_t patchsize, glm::vec3 scale, Topology topology)
+		void loadFromFile(const std::string filename, uint32_t patchsize, glm::vec3 scale, Topology topology, vks::JobSystem *jobSystem = nullptr)
 #endif
 		{
 			assert(device);
@@ -88,51 +381,12 @@ namespace vks
 #else
 			gli::texture2d heightTex(gli::load(filename));
 #endif
-			dim = static_cast<uint32_t>(heightTex.extent().x);
-			heightdata = new uint16_t[dim * dim];
-			memcpy(heightdata, heightTex.data(), heightTex.size());
-			this->scale = dim / patchsize;
-			this->heightScale = scale.y;
+			setHeights(static_cast<const uint16_t*>(heightTex.data()), static_cast<uint32_t>(heightTex.extent().x), patchsize, scale);
 
 			// Generate vertices
 
-			Vertex * vertices = new Vertex[patchsize * patchsize * 4];
-
-			const float wx = 2.0f;
-			const float wy = 2.0f;
-
-			for (uint32_t x = 0; x < patchsize; x++)
-			{
-				for (uint32_t y = 0; y < patchsize; y++)
-				{
-					uint32_t index = (x + y * patchsize);
-					vertices[index].pos[0] = (x * wx + wx / 2.0f - (float)patchsize * wx / 2.0f) * scale.x;
-					vertices[index].pos[1] = -getHeight(x, y);
-					vertices[index].pos[2] = (y * wy + wy / 2.0f - (float)patchsize * wy / 2.0f) * scale.z;
-					vertices[index].uv = glm::vec2((float)x / patchsize, (float)y / patchsize) * uvScale;
-				}
-			}
-
-			for (uint32_t y = 0; y < patchsize; y++)
-			{
-				for (uint32_t x = 0; x < patchsize; x++)
-				{
-					float dx = getHeight(x < patchsize - 1 ? x + 1 : x, y) - getHeight(x > 0 ? x - 1 : x, y);
-					if (x == 0 || x == patchsize - 1)
-						dx *= 2.0f;
-
-					float dy = getHeight(x, y < patchsize - 1 ? y + 1 : y) - getHeight(x, y > 0 ? y - 1 : y);
-					if (y == 0 || y == patchsize - 1)
-						dy *= 2.0f;
-
-					glm::vec3 A = glm::vec3(1.0f, 0.0f, dx);
-					glm::vec3 B = glm::vec3(0.0f, 1.0f, dy);
-
-					glm::vec3 normal = (glm::normalize(glm::cross(A, B)) + 1.0f) * 0.5f;
-
-					vertices[x + y * patchsize].normal = glm::vec3(normal.x, normal.z, normal.y);
-				}
-			}
+			Vertex * vertices = new Vertex[patchsize * patchsize];
+			generateVertices(vertices, jobSystem);
 
 			// Generate indices
 
@@ -188,26 +442,18 @@ namespace vks
 
 			assert(indexBufferSize > 0);
 
-			vertexBufferSize = (patchsize * patchsize * 4) * sizeof(Vertex);
-
-			// Generate Vulkan buffers
-
-			vks::Buffer vertexStaging, indexStaging;
+			std::vector<uint16_t> shortIndices(indexCount);
+			indexType = VK_INDEX_TYPE_UINT32;
+			if (vks::meshopt::packIndices16(indices, indexCount, 0, shortIndices.data()))
+			{
+				indexType = VK_INDEX_TYPE_UINT16;
+				indexBufferSize = indexCount * sizeof(uint16_t);
+			}
+			const void *indexData = (indexType == VK_INDEX_TYPE_UINT16) ? static_cast<const void*>(shortIndices.data()) : static_cast<const void*>(indices);
 
-			// Create staging buffers
-			device->createBuffer(
-				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				&vertexStaging,
-				vertexBufferSize,
-				vertices);
+			vertexBufferSize = (patchsize * patchsize) * sizeof(Vertex);
 
-			device->createBuffer(
-				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				&indexStaging,
-				indexBufferSize,
-				indices);
+			// Generate Vulkan buffers
 
 			// Device local (target) buffer
 			device->createBuffer(
@@ -222,33 +468,619 @@ namespace vks
 				&indexBuffer,
 				indexBufferSize);
 
-			// Copy from staging buffers
-			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-			VkBufferCopy copyRegion = {};
-
-			copyRegion.size = vertexBufferSize;
-			vkCmdCopyBuffer(
-				copyCmd,
-				vertexStaging.buffer,
-				vertexBuffer.buffer,
-				1,
-				&copyRegion);
-
-			copyRegion.size = indexBufferSize;
-			vkCmdCopyBuffer(
-				copyCmd,
-				indexStaging.buffer,
-				indexBuffer.buffer,
-				1,
-				&copyRegion);
-
-			device->flushCommandBuffer(copyCmd, copyQueue, true);
-
-			vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
-			vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
+			// Copy through the upload batch's staging memory
+			vks::UploadBatch localBatch(device, copyQueue, 0);
+			vks::UploadBatch *uploads = uploadBatch ? uploadBatch : &localBatch;
+			uploads->copyToBuffer(vertexBuffer.buffer, vertices, vertexBufferSize);
+			uploads->copyToBuffer(indexBuffer.buffer, indexData, indexBufferSize);
+			localBatch.flush();
+
+			delete[] vertices;
+			delete[] indices;
+		}
+
+		/**
+		* Take a copy of the raw heights the vertices are generated from, called by loadFromFile
+		*
+		* @param data dim x dim unsigned 16 bit heights, stored row by row
+		* @param dim Number of texels along each side
+		* @param patchsize Number of vertices along each side of the generated mesh
+		* @param scale Horizontal (x, z) and height (y) scale
+		*/
+		void setHeights(const uint16_t *data, uint32_t dim, uint32_t patchsize, glm::vec3 scale)
+		{
+			delete[] heightdata;
+			this->dim = dim;
+			heightdata = new uint16_t[static_cast<size_t>(dim) * dim];
+			memcpy(heightdata, data, static_cast<size_t>(dim) * dim * sizeof(uint16_t));
+			this->scale = dim / patchsize;
+			this->heightScale = scale.y;
+			this->patchsize = patchsize;
+			this->meshScale = scale;
+		}
+
+		/**
+		* Fill the vertices of the single mesh row by row, rows are split across the job system's workers
+		* Heights are converted to floats once, normals are central differences of the row and its neighbours
+		* Only needs the heights passed to setHeights, so it can also run without a device (see benchmarks/heightmap.cpp)
+		*
+		* @param vertices Returns patchsize x patchsize vertices, row by row
+		* @param (Optional) jobSystem Job system to split the rows across (defaults to nullptr, generating all rows on the calling thread)
+		*
+		* @note Also fills the height field read by queryHeights
+		*/
+		void generateVertices(Vertex *vertices, vks::JobSystem *jobSystem = nullptr)
+		{
+			const uint32_t size = patchsize;
+			heightField.resize(size * size);
+			std::vector<float> &heights = heightField;
+
+			// Heightmap texel for each patch column, same as getHeight
+			std::vector<uint32_t> texels(size);
+			for (uint32_t x = 0; x < size; x++)
+			{
+				texels[x] = (std::min(x * scale, dim - 1) / scale) * scale;
+			}
+			const float heightFactor = heightScale / 65535.0f;
+			auto convertRows = [this, &heights, &texels, size, heightFactor](uint32_t first, uint32_t last)
+			{
+				for (uint32_t y = first; y < last; y++)
+				{
+					const uint16_t *src = heightdata + texels[y] * dim;
+					float *dst = &heights[y * size];
+					for (uint32_t x = 0; x < size; x++)
+					{
+						dst[x] = src[texels[x]] * heightFactor;
+					}
+				}
+			};
+
+			auto generateRows = [this, vertices, &heights, size](uint32_t first, uint32_t last)
+			{
+				// Normal components of the current row, the stored normal is mapped from [-1, 1] to [0, 1]
+				std::vector<float> nx(size), ny(size), nz(size);
+				for (uint32_t y = first; y < last; y++)
+				{
+					const float *row = &heights[y * size];
+					const float *above = &heights[(y > 0 ? y - 1 : y) * size];
+					const float *below = &heights[(y < size - 1 ? y + 1 : y) * size];
+					// Differences at the borders only span one texel and are doubled
+					const float dyScale = (y == 0 || y == size - 1) ? 2.0f : 1.0f;
+					for (uint32_t x = 0; x < size; x++)
+					{
+						nx[x] = row[x < size - 1 ? x + 1 : x] - row[x > 0 ? x - 1 : x];
+						nz[x] = (below[x] - above[x]) * dyScale;
+					}
+					nx[0] *= 2.0f;
+					nx[size - 1] *= 2.0f;
+
+					// normalize(cross((1, 0, dx), (0, 1, dy))) = (-dx, -dy, 1) / length
+					uint32_t x = 0;
+#if defined(VKS_HEIGHTMAP_SSE)
+					const __m128 one = _mm_set1_ps(1.0f);
+					const __m128 half = _mm_set1_ps(0.5f);
+					for (; x + 4 <= size; x += 4)
+					{
+						const __m128 dx = _mm_loadu_ps(&nx[x]);
+						const __m128 dy = _mm_loadu_ps(&nz[x]);
+						const __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), one)));
+						_mm_storeu_ps(&nx[x], _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(dx, invLength)), half));
+						_mm_storeu_ps(&nz[x], _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(dy, invLength)), half));
+						_mm_storeu_ps(&ny[x], _mm_mul_ps(_mm_add_ps(invLength, one), half));
+					}
+#endif
+					for (; x < size; x++)
+					{
+						const float invLength = 1.0f / sqrtf(nx[x] * nx[x] + nz[x] * nz[x] + 1.0f);
+						nx[x] = (1.0f - nx[x] * invLength) * 0.5f;
+						nz[x] = (1.0f - nz[x] * invLength) * 0.5f;
+						ny[x] = (invLength + 1.0f) * 0.5f;
+					}
+
+					const float posZ = (y * 2.0f + 1.0f - static_cast<float>(size)) * meshScale.z;
+					const float uvY = static_cast<float>(y) / size * uvScale;
+					Vertex *dst = &vertices[y * size];
+					for (uint32_t x = 0; x < size; x++)
+					{
+						dst[x].pos = glm::vec3((x * 2.0f + 1.0f - static_cast<float>(size)) * meshScale.x, -row[x], posZ);
+						dst[x].normal = glm::vec3(nx[x], ny[x], nz[x]);
+						dst[x].uv = glm::vec2(static_cast<float>(x) / size * uvScale, uvY);
+					}
+				}
+			};
+
+			// Normals read the neighbouring rows, so all heights have to be converted first
+			if (jobSystem)
+			{
+				jobSystem->parallelFor(size, convertRows);
+				jobSystem->parallelFor(size, generateRows);
+			}
+			else
+			{
+				convertRows(0, size);
+				generateRows(0, size);
+			}
+		}
+
+		/**
+		* Build the tiled terrain, chunkCount x chunkCount chunks covering the same area as the mesh generated by loadFromFile
+		* Every chunk stores its own vertices, all chunks share one index buffer with the triangulation of each level of detail and stitch mask combination
+		*
+		* @param chunkCount Number of chunks along each side
+		* @param chunkSize Number of quads along each side of a chunk at full detail (power of two, at most 128)
+		*
+		* @note Must be called after loadFromFile, the chunks are drawn with drawChunks after selecting their levels with updateChunks
+		*/
+		void createChunks(uint32_t chunkCount, uint32_t chunkSize)
+		{
+			assert(heightdata);
+			assert((chunkSize >= 1) && (chunkSize <= 128) && ((chunkSize & (chunkSize - 1)) == 0));
+			this->chunkCount = chunkCount;
+			this->chunkSize = chunkSize;
+
+			// Sample the heights on the full detail grid of all chunks, the grid spans the same patch coordinates as the single mesh
+			const uint32_t gridSize = chunkCount * chunkSize + 1;
+			const float gridStep = static_cast<float>(patchsize - 1) / static_cast<float>(gridSize - 1);
+			std::vector<float> heights(gridSize * gridSize);
+			for (uint32_t y = 0; y < gridSize; y++)
+			{
+				for (uint32_t x = 0; x < gridSize; x++)
+				{
+					heights[x + y * gridSize] = sampleHeight(x * gridStep, y * gridStep);
+				}
+			}
+
+			const uint32_t chunkVertexCount = (chunkSize + 1) * (chunkSize + 1);
+			std::vector<Vertex> vertices(chunkCount * chunkCount * chunkVertexCount);
+			chunks.resize(chunkCount * chunkCount);
+			for (uint32_t cy = 0; cy < chunkCount; cy++)
+			{
+				for (uint32_t cx = 0; cx < chunkCount; cx++)
+				{
+					Chunk &chunk = chunks[cx + cy * chunkCount];
+					chunk.vertexOffset = static_cast<int32_t>((cx + cy * chunkCount) * chunkVertexCount);
+					chunk.min = glm::vec3(FLT_MAX);
+					chunk.max = glm::vec3(-FLT_MAX);
+					chunk.lod = 0;
+					chunk.stitchMask = 0;
+					chunk.visible = true;
+					for (uint32_t ly = 0; ly <= chunkSize; ly++)
+					{
+						for (uint32_t lx = 0; lx <= chunkSize; lx++)
+						{
+							const uint32_t x = cx * chunkSize + lx;
+							const uint32_t y = cy * chunkSize + ly;
+							const float patchX = x * gridStep;
+							const float patchY = y * gridStep;
+							Vertex &vertex = vertices[chunk.vertexOffset + lx + ly * (chunkSize + 1)];
+							// Same placement as the vertices of the single mesh, which sit at patch coordinates 0 to patchsize - 1
+							vertex.pos = glm::vec3((patchX * 2.0f + 1.0f - static_cast<float>(patchsize)) * meshScale.x, -heights[x + y * gridSize], (patchY * 2.0f + 1.0f - static_cast<float>(patchsize)) * meshScale.z);
+							vertex.uv = glm::vec2(patchX / patchsize, patchY / patchsize) * uvScale;
+
+							float dx = (heights[std::min(x + 1, gridSize - 1) + y * gridSize] - heights[(x > 0 ? x - 1 : x) + y * gridSize]) / gridStep;
+							if (x == 0 || x == gridSize - 1)
+								dx *= 2.0f;
+							float dy = (heights[x + std::min(y + 1, gridSize - 1) * gridSize] - heights[x + (y > 0 ? y - 1 : y) * gridSize]) / gridStep;
+							if (y == 0 || y == gridSize - 1)
+								dy *= 2.0f;
+							const glm::vec3 normal = (glm::normalize(glm::cross(glm::vec3(1.0f, 0.0f, dx), glm::vec3(0.0f, 1.0f, dy))) + 1.0f) * 0.5f;
+							vertex.normal = glm::vec3(normal.x, normal.z, normal.y);
+
+							chunk.min = glm::min(chunk.min, vertex.pos);
+							chunk.max = glm::max(chunk.max, vertex.pos);
+						}
+					}
+				}
+			}
+
+			const VkDeviceSize chunkVertexBufferSize = vertices.size() * sizeof(Vertex);
+			chunkVertexBuffer.destroy();
+			device->createBuffer(
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&chunkVertexBuffer,
+				chunkVertexBufferSize);
+
+			vks::UploadBatch localBatch(device, copyQueue, 0);
+			vks::UploadBatch *uploads = uploadBatch ? uploadBatch : &localBatch;
+			uploads->copyToBuffer(chunkVertexBuffer.buffer, vertices.data(), chunkVertexBufferSize);
+			createChunkPatterns(uploads);
+			localBatch.flush();
+		}
+
+		/**
+		* Cull the chunks against the frustum and select their levels of detail by camera distance, see chunkStatistics for the results
+		* Neighbouring chunks differ by at most one level, the finer chunk stitches its edge to the coarser one
+		*
+		* @param cameraPosition Camera position in the space of the terrain's vertices
+		* @param frustum Frustum in the same space
+		*/
+		void updateChunks(const glm::vec3 &cameraPosition, const vks::Frustum &frustum)
+		{
+			chunkBounds.clear();
+			for (auto &chunk : chunks)
+			{
+				chunkBounds.push_back(chunk.min, chunk.max);
+				const glm::vec3 closest = glm::clamp(cameraPosition, chunk.min, chunk.max);
+				const float distance = glm::length(closest - cameraPosition);
+				chunk.lod = 0;
+				while ((chunk.lod + 1 < chunkLodLevels) && (distance > lodDistance * static_cast<float>(1u << chunk.lod)))
+				{
+					chunk.lod++;
+				}
+			}
+			frustum.checkBoxes(chunkBounds, chunkVisibility);
+
+			// Refine chunks that are more than one level coarser than a neighbour, repeated until no chunk changes
+			bool changed = true;
+			while (changed)
+			{
+				changed = false;
+				for (uint32_t cy = 0; cy < chunkCount; cy++)
+				{
+					for (uint32_t cx = 0; cx < chunkCount; cx++)
+					{
+						Chunk &chunk = chunks[cx + cy * chunkCount];
+						uint32_t finestNeighbour = chunk.lod;
+						if (cy > 0) finestNeighbour = std::min(finestNeighbour, chunks[cx + (cy - 1) * chunkCount].lod);
+						if (cx + 1 < chunkCount) finestNeighbour = std::min(finestNeighbour, chunks[cx + 1 + cy * chunkCount].lod);
+						if (cy + 1 < chunkCount) finestNeighbour = std::min(finestNeighbour, chunks[cx + (cy + 1) * chunkCount].lod);
+						if (cx > 0) finestNeighbour = std::min(finestNeighbour, chunks[cx - 1 + cy * chunkCount].lod);
+						if (chunk.lod > finestNeighbour + 1)
+						{
+							chunk.lod = finestNeighbour + 1;
+							changed = true;
+						}
+					}
+				}
+			}
+
+			chunkStatistics = {};
+			chunkStatistics.monolithicTriangles = static_cast<uint64_t>(patchsize - 1) * (patchsize - 1) * 2;
+			for (uint32_t cy = 0; cy < chunkCount; cy++)
+			{
+				for (uint32_t cx = 0; cx < chunkCount; cx++)
+				{
+					const uint32_t i = cx + cy * chunkCount;
+					Chunk &chunk = chunks[i];
+					chunk.stitchMask = 0;
+					if ((cy > 0) && (chunks[i - chunkCount].lod > chunk.lod)) chunk.stitchMask |= chunkEdgeTop;
+					if ((cx + 1 < chunkCount) && (chunks[i + 1].lod > chunk.lod)) chunk.stitchMask |= chunkEdgeRight;
+					if ((cy + 1 < chunkCount) && (chunks[i + chunkCount].lod > chunk.lod)) chunk.stitchMask |= chunkEdgeBottom;
+					if ((cx > 0) && (chunks[i - 1].lod > chunk.lod)) chunk.stitchMask |= chunkEdgeLeft;
+					chunk.visible = ((chunkVisibility[i / 32] & (1u << (i % 32))) != 0) && (streamedChunks.empty() || (streamedChunks[i].state == StreamedChunk::stateResident));
+					if (chunk.visible)
+					{
+						chunkStatistics.visibleChunks++;
+						chunkStatistics.triangles += chunkPatterns[chunk.lod * 16 + chunk.stitchMask].indexCount / 3;
+					}
+					else
+					{
+						chunkStatistics.culledChunks++;
+					}
+				}
+			}
+		}
+
+		/**
+		* Draw the visible chunks with the levels selected by the last updateChunks call, the vertices are bound to binding 0
+		*
+		* @note Chunk visibility and levels change with the camera, so the command buffer has to be recorded after every updateChunks call
+		*/
+		void drawChunks(VkCommandBuffer commandBuffer)
+		{
+			const VkDeviceSize offsets[1] = { 0 };
+			if (streamedChunks.empty())
+			{
+				vkCmdBindVertexBuffers(commandBuffer, 0, 1, &chunkVertexBuffer.buffer, offsets);
+			}
+			vkCmdBindIndexBuffer(commandBuffer, chunkIndexBuffer.buffer, 0, chunkIndexType);
+			for (size_t i = 0; i < chunks.size(); i++)
+			{
+				const Chunk &chunk = chunks[i];
+				if (chunk.visible)
+				{
+					// Streamed chunks have a vertex buffer each
+					if (!streamedChunks.empty())
+					{
+						vkCmdBindVertexBuffers(commandBuffer, 0, 1, &streamedChunks[i].vertices.buffer, offsets);
+					}
+					const ChunkPattern &pattern = chunkPatterns[chunk.lod * 16 + chunk.stitchMask];
+					vkCmdDrawIndexed(commandBuffer, pattern.indexCount, 1, pattern.firstIndex, chunk.vertexOffset, 0);
+				}
+			}
+		}
+
+		/**
+		* Stream the terrain from a memory mapped raw heightmap instead of loading all of it, only chunks near the camera are built (see updateStreaming)
+		* The terrain is placed like the mesh loadFromFile generates with a patch size of dim
+		*
+		* @param filename Raw heightmap with dim x dim unsigned 16 bit heights, stored row by row or in square tiles
+		* @param dim Number of texels along each side
+		* @param scale Horizontal (x, z) and height (y) scale, same as for loadFromFile
+		* @param chunkSize Number of quads along each side of a chunk (power of two, at most 128), if dim - 1 isn't a multiple of it the last row and column of chunks are clamped to the border of the heightmap
+		* @param (Optional) tileSize Side length of the tiles the file is stored in (dim must be a multiple of it), 0 for row major files
+		* @param (Optional) jobSystem Job system to build chunks on, has to outlive the height map (defaults to nullptr, building on the calling thread)
+		*
+		* @return False if the file can't be mapped or is smaller than dim x dim heights
+		*/
+		bool openStreaming(const std::string &filename, uint32_t dim, glm::vec3 scale, uint32_t chunkSize, uint32_t tileSize = 0, vks::JobSystem *jobSystem = nullptr)
+		{
+			assert(device);
+			assert((chunkSize >= 1) && (chunkSize <= 128) && ((chunkSize & (chunkSize - 1)) == 0));
+			assert((tileSize == 0) || (dim % tileSize == 0));
+			if (!streamFile.open(filename) || (streamFile.size() < static_cast<size_t>(dim) * dim * sizeof(uint16_t)))
+			{
+				streamFile.close();
+				return false;
+			}
+			this->dim = dim;
+			this->scale = 1;
+			this->patchsize = dim;
+			this->heightScale = scale.y;
+			this->meshScale = scale;
+			this->chunkSize = chunkSize;
+			this->streamTileSize = tileSize;
+			this->jobSystem = jobSystem;
+			// Rounded up so the border is covered, vertices of the last chunks that lie outside of the heightmap collapse onto its edge
+			chunkCount = (dim - 1 + chunkSize - 1) / chunkSize;
+
+			// Bounds cover the whole height range until a chunk has been built
+			chunks.resize(chunkCount * chunkCount);
+			streamedChunks = std::vector<StreamedChunk>(chunks.size());
+			pendingChunks.clear();
+			for (uint32_t i = 0; i < chunks.size(); i++)
+			{
+				Chunk &chunk = chunks[i];
+				const float x0 = static_cast<float>((i % chunkCount) * chunkSize);
+				const float y0 = static_cast<float>((i / chunkCount) * chunkSize);
+				const float x1 = std::min(x0 + chunkSize, static_cast<float>(dim - 1));
+				const float y1 = std::min(y0 + chunkSize, static_cast<float>(dim - 1));
+				chunk.min = glm::vec3((x0 * 2.0f + 1.0f - dim) * scale.x, -heightScale, (y0 * 2.0f + 1.0f - dim) * scale.z);
+				chunk.max = glm::vec3((x1 * 2.0f + 1.0f - dim) * scale.x, 0.0f, (y1 * 2.0f + 1.0f - dim) * scale.z);
+				chunk.vertexOffset = 0;
+				chunk.lod = 0;
+				chunk.stitchMask = 0;
+				chunk.visible = false;
+			}
+			streamingStatistics = {};
+			summedBuildLatency = 0.0;
+			builtChunks = 0;
+
+			vks::UploadBatch localBatch(device, copyQueue, 0);
+			createChunkPatterns(uploadBatch ? uploadBatch : &localBatch);
+			localBatch.flush();
+			return true;
+		}
+
+		/**
+		* Upload finished chunks, cull and select levels of detail (see updateChunks), then evict and request chunks by distance to the camera
+		*
+		* @note Evicted vertex buffers are destroyed right away, so the previous frame drawing the chunks must have completed
+		*/
+		void updateStreaming(const glm::vec3 &cameraPosition, const vks::Frustum &frustum)
+		{
+			streamFrame++;
+			vks::UploadBatch localBatch(device, copyQueue, 0);
+			vks::UploadBatch *uploads = uploadBatch ? uploadBatch : &localBatch;
+
+			// Upload chunks whose build job has completed
+			for (size_t p = 0; p < pendingChunks.size();)
+			{
+				const uint32_t index = pendingChunks[p];
+				StreamedChunk &streamed = streamedChunks[index];
+				if (streamed.job && !jobSystem->isComplete(streamed.job))
+				{
+					p++;
+					continue;
+				}
+				streamed.job = nullptr;
+				const VkDeviceSize size = streamed.buildVertices.size() * sizeof(Vertex);
+				device->createBuffer(
+					VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+					&streamed.vertices,
+					size);
+				uploads->copyToBuffer(streamed.vertices.buffer, streamed.buildVertices.data(), size);
+				std::vector<Vertex>().swap(streamed.buildVertices);
+				chunks[index].min = streamed.buildMin;
+				chunks[index].max = streamed.buildMax;
+				streamed.state = StreamedChunk::stateResident;
+				streamed.lastUsedFrame = streamFrame;
+				streamingStatistics.residentBytes += size;
+				streamingStatistics.lastBuildLatency = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - streamed.requestTime).count();
+				summedBuildLatency += streamingStatistics.lastBuildLatency;
+				builtChunks++;
+				pendingChunks[p] = pendingChunks.back();
+				pendingChunks.pop_back();
+			}
+			localBatch.flush();
+
+			updateChunks(cameraPosition, frustum);
+
+			// Visible chunks and chunks in streaming range are kept, missing ones in range are requested nearest first
+			std::vector<std::pair<float, uint32_t>> requests;
+			for (uint32_t i = 0; i < chunks.size(); i++)
+			{
+				StreamedChunk &streamed = streamedChunks[i];
+				if (chunks[i].visible)
+				{
+					streamed.lastUsedFrame = streamFrame;
+				}
+				const glm::vec3 closest = glm::clamp(cameraPosition, chunks[i].min, chunks[i].max);
+				const float distance = glm::length(closest - cameraPosition);
+				if (distance > streamingDistance)
+				{
+					continue;
+				}
+				if (streamed.state == StreamedChunk::stateResident)
+				{
+					streamed.lastUsedFrame = streamFrame;
+				}
+				else if (streamed.state == StreamedChunk::stateUnloaded)
+				{
+					requests.push_back(std::make_pair(distance, i));
+				}
+			}
+			std::sort(requests.begin(), requests.end());
+
+			const VkDeviceSize chunkBytes = (chunkSize + 1) * (chunkSize + 1) * sizeof(Vertex);
+			for (auto &request : requests)
+			{
+				if (pendingChunks.size() >= maxPendingChunks)
+				{
+					break;
+				}
+				bool fits = true;
+				while (streamingStatistics.residentBytes + (pendingChunks.size() + 1) * chunkBytes > streamingBudget)
+				{
+					if (!evictStreamedChunk())
+					{
+						fits = false;
+						break;
+					}
+				}
+				if (!fits)
+				{
+					break;
+				}
+				const uint32_t index = request.second;
+				StreamedChunk &streamed = streamedChunks[index];
+				streamed.state = StreamedChunk::stateBuilding;
+				streamed.requestTime = std::chrono::high_resolution_clock::now();
+				pendingChunks.push_back(index);
+				if (jobSystem && (jobSystem->getWorkerCount() > 1))
+				{
+					streamed.job = jobSystem->createJob([this, index] { buildStreamedChunk(index); });
+					jobSystem->run(streamed.job);
+				}
+				else
+				{
+					buildStreamedChunk(index);
+				}
+			}
+
+			streamingStatistics.residentChunks = 0;
+			for (auto &streamed : streamedChunks)
+			{
+				if (streamed.state == StreamedChunk::stateResident)
+				{
+					streamingStatistics.residentChunks++;
+				}
+			}
+			streamingStatistics.pendingChunks = static_cast<uint32_t>(pendingChunks.size());
+			streamingStatistics.averageBuildLatency = (builtChunks > 0) ? summedBuildLatency / builtChunks : 0.0;
+		}
+
+	private:
+		/*
+			Streaming state (see openStreaming)
+		*/
+		vks::modelcache::MappedFile streamFile;
+		uint32_t streamTileSize = 0;
+		vks::JobSystem *jobSystem = nullptr;
+		uint64_t streamFrame = 0;
+
+		struct StreamedChunk {
+			enum State { stateUnloaded, stateBuilding, stateResident };
+			State state = stateUnloaded;
+			vks::Buffer vertices;
+			uint64_t lastUsedFrame = 0;
+			// Written by the build job, read once the job has completed
+			vks::Job *job = nullptr;
+			std::vector<Vertex> buildVertices;
+			glm::vec3 buildMin;
+			glm::vec3 buildMax;
+			std::chrono::high_resolution_clock::time_point requestTime;
+		};
+		std::vector<StreamedChunk> streamedChunks;
+		std::vector<uint32_t> pendingChunks;
+		double summedBuildLatency = 0.0;
+		uint64_t builtChunks = 0;
+
+		/** @brief Height of a texel of the memory mapped heightmap */
+		float streamedHeight(int32_t x, int32_t y) const
+		{
+			x = std::max(0, std::min(x, static_cast<int32_t>(dim) - 1));
+			y = std::max(0, std::min(y, static_cast<int32_t>(dim) - 1));
+			size_t texel = static_cast<size_t>(x) + static_cast<size_t>(y) * dim;
+			if (streamTileSize > 0)
+			{
+				// Tiles are stored row by row, texels inside of a tile too
+				const size_t tilesPerRow = dim / streamTileSize;
+				const size_t tile = (x / streamTileSize) + (y / streamTileSize) * tilesPerRow;
+				texel = tile * streamTileSize * streamTileSize + (x % streamTileSize) + (y % streamTileSize) * streamTileSize;
+			}
+			uint16_t height;
+			memcpy(&height, streamFile.data() + texel * sizeof(uint16_t), sizeof(uint16_t));
+			return height / 65535.0f * heightScale;
+		}
+
+		/** @brief Generate the vertices of a streamed chunk, runs on a job system worker and only reads the mapped file */
+		void buildStreamedChunk(uint32_t index)
+		{
+			StreamedChunk &streamed = streamedChunks[index];
+			const int32_t x0 = static_cast<int32_t>((index % chunkCount) * chunkSize);
+			const int32_t y0 = static_cast<int32_t>((index / chunkCount) * chunkSize);
+			streamed.buildVertices.resize((chunkSize + 1) * (chunkSize + 1));
+			streamed.buildMin = glm::vec3(FLT_MAX);
+			streamed.buildMax = glm::vec3(-FLT_MAX);
+			for (uint32_t ly = 0; ly <= chunkSize; ly++)
+			{
+				for (uint32_t lx = 0; lx <= chunkSize; lx++)
+				{
+					// Chunks of the last row and column may reach past the border, their outer quads are degenerate
+					const int32_t x = std::min(x0 + static_cast<int32_t>(lx), static_cast<int32_t>(dim) - 1);
+					const int32_t y = std::min(y0 + static_cast<int32_t>(ly), static_cast<int32_t>(dim) - 1);
+					Vertex &vertex = streamed.buildVertices[lx + ly * (chunkSize + 1)];
+					vertex.pos = glm::vec3((x * 2.0f + 1.0f - static_cast<float>(dim)) * meshScale.x, -streamedHeight(x, y), (y * 2.0f + 1.0f - static_cast<float>(dim)) * meshScale.z);
+					vertex.uv = glm::vec2(static_cast<float>(x) / dim, static_cast<float>(y) / dim) * uvScale;
+					float dx = streamedHeight(x + 1, y) - streamedHeight(x - 1, y);
+					if (x == 0 || x == static_cast<int32_t>(dim) - 1)
+						dx *= 2.0f;
+					float dy = streamedHeight(x, y + 1) - streamedHeight(x, y - 1);
+					if (y == 0 || y == static_cast<int32_t>(dim) - 1)
+						dy *= 2.0f;
+					const glm::vec3 normal = (glm::normalize(glm::cross(glm::vec3(1.0f, 0.0f, dx), glm::vec3(0.0f, 1.0f, dy))) + 1.0f) * 0.5f;
+					vertex.normal = glm::vec3(normal.x, normal.z, normal.y);
+					streamed.buildMin = glm::min(streamed.buildMin, vertex.pos);
+					streamed.buildMax = glm::max(streamed.buildMax, vertex.pos);
+				}
+			}
+		}
+
+		/** @brief Release the vertex buffer of the least recently used resident chunk that wasn't needed in the current frame, returns false if there is none */
+		bool evictStreamedChunk()
+		{
+			uint32_t oldest = UINT32_MAX;
+			for (uint32_t i = 0; i < streamedChunks.size(); i++)
+			{
+				const StreamedChunk &streamed = streamedChunks[i];
+				if ((streamed.state == StreamedChunk::stateResident) && (streamed.lastUsedFrame < streamFrame) && ((oldest == UINT32_MAX) || (streamed.lastUsedFrame < streamedChunks[oldest].lastUsedFrame)))
+				{
+					oldest = i;
+				}
+			}
+			if (oldest == UINT32_MAX)
+			{
+				return false;
+			}
+			// Chunks used in the current frame are never picked, this only keeps visible consistent with the resident chunks
+			Chunk &chunk = chunks[oldest];
+			if (chunk.visible)
+			{
+				chunk.visible = false;
+				chunkStatistics.visibleChunks--;
+				chunkStatistics.culledChunks++;
+				chunkStatistics.triangles -= chunkPatterns[chunk.lod * 16 + chunk.stitchMask].indexCount / 3;
+			}
+			StreamedChunk &streamed = streamedChunks[oldest];
+			streamingStatistics.residentBytes -= streamed.vertices.size;
+			streamed.vertices.destroy();
+			streamed.vertices = vks::Buffer();
+			streamed.state = StreamedChunk::stateUnloaded;
+			streamingStatistics.evictedChunks++;
+			return true;
 		}
 	};
 }
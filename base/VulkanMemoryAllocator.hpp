@@ -0,0 +1,461 @@
+/*
+* Vulkan device memory allocator
+*
+* Sub-allocates buffers and images from large per memory type blocks instead of
+* calling vkAllocateMemory once per resource
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	class MemoryAllocator;
+	struct MemoryBlock;
+
+	/**
+	* @brief Range of a device memory block owned by a single buffer or image
+	* @note Resources must be bound at (memory, offset), not at offset 0
+	*/
+	struct Allocation
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		uint32_t memoryTypeIndex = 0;
+		/** @brief Host address of the first byte for host visible memory (blocks stay mapped for their whole lifetime) */
+		void* mapped = nullptr;
+		MemoryAllocator* allocator = nullptr;
+		MemoryBlock* block = nullptr;
+
+		/** @brief Return the range to the allocator it was taken from and reset this handle */
+		void free();
+	};
+
+	/** @brief Single VkDeviceMemory object that allocations are placed in */
+	struct MemoryBlock
+	{
+		struct Range
+		{
+			VkDeviceSize offset;
+			VkDeviceSize size;
+		};
+
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		void* mapped = nullptr;
+		/** @brief Block only holds linear (buffers, linear images) or only optimal tiled resources, see bufferImageGranularity */
+		bool linear = true;
+		/** @brief Block was created for a single large resource and is released together with it */
+		bool dedicated = false;
+		uint32_t allocationCount = 0;
+		VkDeviceSize usedSize = 0;
+		/** @brief Free ranges sorted by offset, neighbouring ranges are always merged */
+		std::vector<Range> freeRanges;
+
+		/**
+		* Find the best fitting free range for an allocation
+		*
+		* @param size Size of the allocation
+		* @param alignment Required alignment of the allocation's offset
+		* @param offset Pointer to the offset of the allocation inside the block
+		*
+		* @return True if the block had enough contiguous space left
+		*/
+		bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize *offset)
+		{
+			size_t bestIndex = freeRanges.size();
+			VkDeviceSize bestWaste = ~0ull;
+			for (size_t i = 0; i < freeRanges.size(); i++)
+			{
+				const Range &range = freeRanges[i];
+				VkDeviceSize alignedOffset = (range.offset + alignment - 1) / alignment * alignment;
+				VkDeviceSize end = range.offset + range.size;
+				if (alignedOffset + size > end)
+				{
+					continue;
+				}
+				VkDeviceSize waste = range.size - size;
+				if (waste < bestWaste)
+				{
+					bestWaste = waste;
+					bestIndex = i;
+					if (waste == 0)
+					{
+						break;
+					}
+				}
+			}
+			if (bestIndex == freeRanges.size())
+			{
+				return false;
+			}
+
+			// Split the range, padding in front of the aligned offset stays free
+			Range range = freeRanges[bestIndex];
+			*offset = (range.offset + alignment - 1) / alignment * alignment;
+			Range front = { range.offset, *offset - range.offset };
+			Range back = { *offset + size, range.offset + range.size - (*offset + size) };
+			freeRanges.erase(freeRanges.begin() + bestIndex);
+			if (back.size > 0)
+			{
+				freeRanges.insert(freeRanges.begin() + bestIndex, back);
+			}
+			if (front.size > 0)
+			{
+				freeRanges.insert(freeRanges.begin() + bestIndex, front);
+			}
+
+			allocationCount++;
+			usedSize += size;
+			return true;
+		}
+
+		/** @brief Return a range to the free list and merge it with its neighbours */
+		void free(VkDeviceSize offset, VkDeviceSize size)
+		{
+			auto next = std::lower_bound(freeRanges.begin(), freeRanges.end(), offset, [](const Range &range, VkDeviceSize offset) { return range.offset < offset; });
+			auto it = freeRanges.insert(next, { offset, size });
+			// Merge with following range
+			if ((it + 1 != freeRanges.end()) && (it->offset + it->size == (it + 1)->offset))
+			{
+				it->size += (it + 1)->size;
+				freeRanges.erase(it + 1);
+			}
+			// Merge with preceding range
+			if ((it != freeRanges.begin()) && ((it - 1)->offset + (it - 1)->size == it->offset))
+			{
+				(it - 1)->size += it->size;
+				freeRanges.erase(it);
+			}
+
+			allocationCount--;
+			usedSize -= size;
+		}
+	};
+
+	/**
+	* @brief Block based sub-allocator for device memory
+	*
+	* Keeps a list of large blocks per memory type and places allocations with a best fit
+	* search over each block's free list. Linear and optimal tiled resources are kept in
+	* separate blocks if the device reports a bufferImageGranularity larger than one, so
+	* they can never share a granularity page. Allocations larger than half a block get
+	* a dedicated VkDeviceMemory.
+	*/
+	class MemoryAllocator
+	{
+	public:
+		struct Stats
+		{
+			uint32_t blockCount = 0;
+			uint32_t allocationCount = 0;
+			uint32_t freeRangeCount = 0;
+			VkDeviceSize blockBytes = 0;
+			VkDeviceSize usedBytes = 0;
+			VkDeviceSize largestFreeRange = 0;
+		};
+
+	private:
+		VkDevice device = VK_NULL_HANDLE;
+		VkPhysicalDeviceMemoryProperties memoryProperties;
+		VkDeviceSize bufferImageGranularity = 1;
+		VkDeviceSize nonCoherentAtomSize = 1;
+		uint32_t maxMemoryAllocationCount = 4096;
+		/** @brief Number of live vkAllocateMemory allocations */
+		uint32_t deviceAllocationCount = 0;
+		/** @brief Blocks per memory type index */
+		std::vector<std::vector<std::unique_ptr<MemoryBlock>>> blocks;
+		std::mutex mutex;
+
+		VkDeviceSize getBlockSize(uint32_t memoryTypeIndex)
+		{
+			// Don't let a single block take up a large part of small heaps
+			VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+			return std::min(preferredBlockSize, std::max(heapSize / 8, (VkDeviceSize)1024 * 1024));
+		}
+
+		VkResult createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, bool linear, bool dedicated, MemoryBlock **block)
+		{
+			if (deviceAllocationCount >= maxMemoryAllocationCount)
+			{
+				return VK_ERROR_TOO_MANY_OBJECTS;
+			}
+
+			VkMemoryAllocateInfo memAlloc = {};
+			memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			memAlloc.allocationSize = size;
+			memAlloc.memoryTypeIndex = memoryTypeIndex;
+
+			std::unique_ptr<MemoryBlock> newBlock(new MemoryBlock());
+			VkResult result = vkAllocateMemory(device, &memAlloc, nullptr, &newBlock->memory);
+			if (result != VK_SUCCESS)
+			{
+				return result;
+			}
+			deviceAllocationCount++;
+
+			// Host visible blocks are mapped once, allocations hand out pointers into the mapping
+			if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+			{
+				VK_CHECK_RESULT(vkMapMemory(device, newBlock->memory, 0, VK_WHOLE_SIZE, 0, &newBlock->mapped));
+			}
+
+			newBlock->size = size;
+			newBlock->linear = linear;
+			newBlock->dedicated = dedicated;
+			newBlock->freeRanges.push_back({ 0, size });
+			*block = newBlock.get();
+			blocks[memoryTypeIndex].push_back(std::move(newBlock));
+			return VK_SUCCESS;
+		}
+
+		void destroyBlock(MemoryBlock *block)
+		{
+			if (block->mapped)
+			{
+				vkUnmapMemory(device, block->memory);
+			}
+			vkFreeMemory(device, block->memory, nullptr);
+			deviceAllocationCount--;
+		}
+
+		/** @brief Statistics of a memory type, the mutex must be held */
+		Stats getStatsLocked(uint32_t memoryTypeIndex)
+		{
+			Stats stats;
+			for (auto &block : blocks[memoryTypeIndex])
+			{
+				stats.blockCount++;
+				stats.allocationCount += block->allocationCount;
+				stats.freeRangeCount += static_cast<uint32_t>(block->freeRanges.size());
+				stats.blockBytes += block->size;
+				stats.usedBytes += block->usedSize;
+				for (auto &range : block->freeRanges)
+				{
+					stats.largestFreeRange = std::max(stats.largestFreeRange, range.size);
+				}
+			}
+			return stats;
+		}
+
+	public:
+		/** @brief Size of newly created blocks (heaps smaller than 8 blocks use an eighth of the heap size) */
+		VkDeviceSize preferredBlockSize = 64 * 1024 * 1024;
+
+		/**
+		* Setup the allocator for a logical device
+		*
+		* @param device Logical device to allocate memory from
+		* @param properties Properties of the physical device (for the alignment related limits)
+		* @param memoryProperties Memory types and heaps of the physical device
+		*/
+		void create(VkDevice device, const VkPhysicalDeviceProperties &properties, const VkPhysicalDeviceMemoryProperties &memoryProperties)
+		{
+			this->device = device;
+			this->memoryProperties = memoryProperties;
+			bufferImageGranularity = std::max(properties.limits.bufferImageGranularity, (VkDeviceSize)1);
+			nonCoherentAtomSize = std::max(properties.limits.nonCoherentAtomSize, (VkDeviceSize)1);
+			maxMemoryAllocationCount = properties.limits.maxMemoryAllocationCount;
+			blocks.resize(memoryProperties.memoryTypeCount);
+		}
+
+		/** @brief Release all blocks, allocations still referencing them become invalid */
+		void destroy()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto &typeBlocks : blocks)
+			{
+				for (auto &block : typeBlocks)
+				{
+					destroyBlock(block.get());
+				}
+				typeBlocks.clear();
+			}
+		}
+
+		/**
+		* Sub-allocate memory for a resource
+		*
+		* @param memReqs Memory requirements of the buffer or image
+		* @param memoryTypeIndex Memory type to allocate from (see VulkanDevice::getMemoryType)
+		* @param linear True for buffers and linear tiled images, false for optimal tiled images
+		* @param allocation Pointer to the allocation handle filled by the function
+		*
+		* @return VK_SUCCESS if the allocation could be placed
+		*/
+		VkResult allocate(const VkMemoryRequirements &memReqs, uint32_t memoryTypeIndex, bool linear, Allocation *allocation)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			VkDeviceSize size = memReqs.size;
+			VkDeviceSize alignment = std::max(memReqs.alignment, (VkDeviceSize)1);
+			// Non-coherent ranges are flushed in multiples of nonCoherentAtomSize, so they must not share an atom
+			if ((memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0)
+			{
+				alignment = std::max(alignment, nonCoherentAtomSize);
+				size = (size + nonCoherentAtomSize - 1) / nonCoherentAtomSize * nonCoherentAtomSize;
+			}
+			// Without a granularity restriction, linear and optimal resources may share blocks
+			if (bufferImageGranularity == 1)
+			{
+				linear = true;
+			}
+
+			MemoryBlock *block = nullptr;
+			VkDeviceSize offset = 0;
+			VkDeviceSize blockSize = getBlockSize(memoryTypeIndex);
+
+			if (size > blockSize / 2)
+			{
+				VkResult result = createBlock(memoryTypeIndex, size, linear, true, &block);
+				if (result != VK_SUCCESS)
+				{
+					return result;
+				}
+				block->allocate(size, alignment, &offset);
+			}
+			else
+			{
+				for (auto &candidate : blocks[memoryTypeIndex])
+				{
+					if (!candidate->dedicated && (candidate->linear == linear) && candidate->allocate(size, alignment, &offset))
+					{
+						block = candidate.get();
+						break;
+					}
+				}
+				if (!block)
+				{
+					VkResult result = createBlock(memoryTypeIndex, blockSize, linear, false, &block);
+					if (result != VK_SUCCESS)
+					{
+						return result;
+					}
+					block->allocate(size, alignment, &offset);
+				}
+			}
+
+			allocation->memory = block->memory;
+			allocation->offset = offset;
+			allocation->size = size;
+			allocation->memoryTypeIndex = memoryTypeIndex;
+			allocation->mapped = block->mapped ? static_cast<uint8_t*>(block->mapped) + offset : nullptr;
+			allocation->allocator = this;
+			allocation->block = block;
+			return VK_SUCCESS;
+		}
+
+		/** @brief Return an allocation to its block, empty blocks are released except for the last one of each memory type */
+		void free(Allocation &allocation)
+		{
+			if (!allocation.block)
+			{
+				return;
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+
+			MemoryBlock *block = allocation.block;
+			block->free(allocation.offset, allocation.size);
+			if (block->allocationCount == 0)
+			{
+				auto &typeBlocks = blocks[allocation.memoryTypeIndex];
+				size_t sharedBlocks = std::count_if(typeBlocks.begin(), typeBlocks.end(), [](const std::unique_ptr<MemoryBlock> &b) { return !b->dedicated; });
+				// Keep one empty shared block around to avoid reallocating on alternating alloc/free
+				if (block->dedicated || (sharedBlocks > 1))
+				{
+					destroyBlock(block);
+					typeBlocks.erase(std::find_if(typeBlocks.begin(), typeBlocks.end(), [block](const std::unique_ptr<MemoryBlock> &b) { return b.get() == block; }));
+				}
+			}
+			allocation = Allocation();
+		}
+
+		/**
+		* Allocate a dedicated VkDeviceMemory outside of the blocks, for resources whose owner maps and frees the memory itself
+		*
+		* @param memAlloc Allocation size and memory type
+		* @param memory Pointer to the memory handle acquired by the function
+		*
+		* @note Counts against maxMemoryAllocationCount like the blocks, release with freeDedicated
+		*
+		* @return VkResult of the allocation
+		*/
+		VkResult allocateDedicated(const VkMemoryAllocateInfo &memAlloc, VkDeviceMemory *memory)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (deviceAllocationCount >= maxMemoryAllocationCount)
+			{
+				return VK_ERROR_TOO_MANY_OBJECTS;
+			}
+			VkResult result = vkAllocateMemory(device, &memAlloc, nullptr, memory);
+			if (result == VK_SUCCESS)
+			{
+				deviceAllocationCount++;
+			}
+			return result;
+		}
+
+		/** @brief Free memory acquired through allocateDedicated */
+		void freeDedicated(VkDeviceMemory memory)
+		{
+			if (memory == VK_NULL_HANDLE)
+			{
+				return;
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			vkFreeMemory(device, memory, nullptr);
+			deviceAllocationCount--;
+		}
+
+		/** @brief Get block and allocation statistics for a single memory type */
+		Stats getStats(uint32_t memoryTypeIndex)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return getStatsLocked(memoryTypeIndex);
+		}
+
+		/** @brief Print per memory type statistics (only types that have blocks) */
+		void printStats(std::ostream &stream = std::cout)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stream << "Device memory allocations: " << deviceAllocationCount << " of " << maxMemoryAllocationCount << std::endl;
+			stream << "type | blocks | allocations | block MiB | used MiB | free ranges | largest free KiB" << std::endl;
+			stream << std::fixed << std::setprecision(2);
+			for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+			{
+				Stats stats = getStatsLocked(i);
+				if (stats.blockCount == 0)
+				{
+					continue;
+				}
+				stream << std::setw(4) << i << " | "
+					<< std::setw(6) << stats.blockCount << " | "
+					<< std::setw(11) << stats.allocationCount << " | "
+					<< std::setw(9) << (double)stats.blockBytes / (1024.0 * 1024.0) << " | "
+					<< std::setw(8) << (double)stats.usedBytes / (1024.0 * 1024.0) << " | "
+					<< std::setw(11) << stats.freeRangeCount << " | "
+					<< std::setw(16) << (double)stats.largestFreeRange / 1024.0 << std::endl;
+			}
+		}
+	};
+
+	inline void Allocation::free()
+	{
+		if (allocator)
+		{
+			allocator->free(*this);
+		}
+	}
+}
@@ -0,0 +1,410 @@
+/*
+* Mesh optimization
+*
+* Load time reordering of triangle lists for post transform vertex cache efficiency (Tipsify), reduced overdraw
+* (cluster sorting) and vertex fetch locality (vertex remapping), plus a simple FIFO cache simulation to measure the results
+* and conversion of index ranges to 16 bit indices
+*
+* See "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" (Sander, Nehab, Barczak, 2007)
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+namespace vks
+{
+	namespace meshopt
+	{
+		/** @brief Number of entries of the simulated post transform vertex cache, small enough to be a pessimistic estimate for current GPUs */
+		const uint32_t defaultCacheSize = 16;
+
+		/** @brief Results of a vertex cache simulation */
+		struct VertexCacheStatistics
+		{
+			/** @brief Number of vertex shader invocations */
+			uint32_t transformedVertices = 0;
+			/** @brief Average cache miss ratio, transformed vertices per triangle (0.5 is the optimum for regular meshes, 3 the worst case) */
+			float acmr = 0.0f;
+			/** @brief Average transform to vertex ratio, transformed vertices per referenced vertex (1 is the optimum) */
+			float atvr = 0.0f;
+		};
+
+		/**
+		* Simulate a FIFO post transform vertex cache for a triangle list
+		*
+		* @param indices Triangle list indices
+		* @param indexCount Number of indices (multiple of 3)
+		* @param vertexCount Number of vertices referenced by the indices (all indices must be smaller)
+		* @param (Optional) cacheSize Number of cache entries
+		*/
+		inline VertexCacheStatistics analyzeVertexCache(const uint32_t *indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize = defaultCacheSize)
+		{
+			VertexCacheStatistics statistics;
+			if (indexCount == 0)
+			{
+				return statistics;
+			}
+			// A vertex is in the cache if less than cacheSize misses happened since it was loaded
+			std::vector<uint32_t> cacheTimestamps(vertexCount, 0);
+			std::vector<bool> referenced(vertexCount, false);
+			uint32_t timestamp = cacheSize + 1;
+			uint32_t referencedVertices = 0;
+			for (size_t i = 0; i < indexCount; i++)
+			{
+				const uint32_t index = indices[i];
+				if (timestamp - cacheTimestamps[index] > cacheSize)
+				{
+					cacheTimestamps[index] = timestamp++;
+					statistics.transformedVertices++;
+				}
+				if (!referenced[index])
+				{
+					referenced[index] = true;
+					referencedVertices++;
+				}
+			}
+			statistics.acmr = static_cast<float>(statistics.transformedVertices) / static_cast<float>(indexCount / 3);
+			statistics.atvr = static_cast<float>(statistics.transformedVertices) / static_cast<float>(referencedVertices);
+			return statistics;
+		}
+
+		/**
+		* Reorder the triangles of a triangle list for the post transform vertex cache (Tipsify)
+		*
+		* @param indices Triangle list indices, reordered in place
+		* @param indexCount Number of indices (multiple of 3)
+		* @param vertexCount Number of vertices referenced by the indices (all indices must be smaller)
+		* @param (Optional) cacheSize Number of cache entries to optimize for
+		* @param (Optional) clusters Returns the first triangle of each cluster, clusters start where the algorithm ran into a dead end and had to jump to an unrelated part of the mesh
+		*/
+		inline void optimizeVertexCache(uint32_t *indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize = defaultCacheSize, std::vector<uint32_t> *clusters = nullptr)
+		{
+			const size_t triangleCount = indexCount / 3;
+			if (clusters)
+			{
+				clusters->clear();
+			}
+			if (triangleCount == 0)
+			{
+				return;
+			}
+
+			// Triangles adjacent to each vertex, as one array with per vertex offsets
+			std::vector<uint32_t> liveTriangles(vertexCount, 0);
+			for (size_t i = 0; i < indexCount; i++)
+			{
+				liveTriangles[indices[i]]++;
+			}
+			std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+			for (uint32_t v = 0; v < vertexCount; v++)
+			{
+				adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+			}
+			std::vector<uint32_t> adjacency(indexCount);
+			std::vector<uint32_t> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (size_t i = 0; i < indexCount; i++)
+			{
+				adjacency[adjacencyFill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+
+			const std::vector<uint32_t> source(indices, indices + indexCount);
+			std::vector<bool> emitted(triangleCount, false);
+			std::vector<uint32_t> cacheTimestamps(vertexCount, 0);
+			std::vector<uint32_t> deadEnds;
+			std::vector<uint32_t> candidates;
+			uint32_t timestamp = cacheSize + 1;
+			uint32_t cursor = 0;
+			size_t outputTriangle = 0;
+
+			// Start at the first vertex that is used at all
+			while ((cursor < vertexCount) && (liveTriangles[cursor] == 0))
+			{
+				cursor++;
+			}
+			int64_t fanningVertex = cursor;
+			if (clusters)
+			{
+				clusters->push_back(0);
+			}
+
+			while (fanningVertex >= 0)
+			{
+				const uint32_t vertex = static_cast<uint32_t>(fanningVertex);
+				candidates.clear();
+				// Emit all remaining triangles around the fanning vertex
+				for (uint32_t a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; a++)
+				{
+					const uint32_t triangle = adjacency[a];
+					if (emitted[triangle])
+					{
+						continue;
+					}
+					for (uint32_t c = 0; c < 3; c++)
+					{
+						const uint32_t v = source[triangle * 3 + c];
+						indices[outputTriangle * 3 + c] = v;
+						deadEnds.push_back(v);
+						candidates.push_back(v);
+						liveTriangles[v]--;
+						if (timestamp - cacheTimestamps[v] > cacheSize)
+						{
+							cacheTimestamps[v] = timestamp++;
+						}
+					}
+					emitted[triangle] = true;
+					outputTriangle++;
+				}
+
+				// Next fanning vertex is the candidate that stays in the cache longest while its remaining triangles are emitted
+				fanningVertex = -1;
+				int64_t bestPriority = -1;
+				for (auto v : candidates)
+				{
+					if (liveTriangles[v] == 0)
+					{
+						continue;
+					}
+					int64_t priority = 0;
+					if (timestamp - cacheTimestamps[v] + 2 * liveTriangles[v] <= cacheSize)
+					{
+						priority = timestamp - cacheTimestamps[v];
+					}
+					if (priority > bestPriority)
+					{
+						bestPriority = priority;
+						fanningVertex = v;
+					}
+				}
+
+				if (fanningVertex < 0)
+				{
+					// Dead end, continue with the most recently emitted vertex that still has triangles or the next one in input order
+					while (!deadEnds.empty() && (fanningVertex < 0))
+					{
+						const uint32_t v = deadEnds.back();
+						deadEnds.pop_back();
+						if (liveTriangles[v] > 0)
+						{
+							fanningVertex = v;
+						}
+					}
+					while ((cursor < vertexCount) && (fanningVertex < 0))
+					{
+						if (liveTriangles[cursor] > 0)
+						{
+							fanningVertex = cursor;
+						}
+						cursor++;
+					}
+					if (clusters && (fanningVertex >= 0))
+					{
+						clusters->push_back(static_cast<uint32_t>(outputTriangle));
+					}
+				}
+			}
+		}
+
+		/**
+		* Reorder the clusters of a cache optimized triangle list so that outward facing parts are drawn first, reducing overdraw from most view directions
+		*
+		* @param indices Triangle list indices, reordered in place
+		* @param indexCount Number of indices (multiple of 3)
+		* @param positions Pointer to the position (3 floats) of the first vertex
+		* @param vertexStride Distance between the positions of two vertices in bytes
+		* @param clusters First triangle of each cluster as returned by optimizeVertexCache
+		*
+		* @note Front faces are assumed to be wound counter clockwise
+		* @note Triangles are only moved as whole clusters, so the vertex cache efficiency of the input is kept
+		*/
+		inline void optimizeOverdraw(uint32_t *indices, size_t indexCount, const float *positions, size_t vertexStride, const std::vector<uint32_t> &clusters)
+		{
+			const size_t triangleCount = indexCount / 3;
+			if ((triangleCount == 0) || (clusters.size() < 2))
+			{
+				return;
+			}
+			const uint8_t *positionData = reinterpret_cast<const uint8_t*>(positions);
+			auto position = [&](uint32_t index) {
+				return reinterpret_cast<const float*>(positionData + index * vertexStride);
+			};
+
+			struct Cluster
+			{
+				uint32_t firstTriangle;
+				uint32_t triangleCount;
+				float centroid[3];
+				float normal[3];
+				float sortKey;
+			};
+			std::vector<Cluster> sortedClusters(clusters.size());
+			float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+			float meshArea = 0.0f;
+			for (size_t c = 0; c < clusters.size(); c++)
+			{
+				Cluster &cluster = sortedClusters[c];
+				cluster.firstTriangle = clusters[c];
+				cluster.triangleCount = static_cast<uint32_t>(((c + 1 < clusters.size()) ? clusters[c + 1] : triangleCount) - clusters[c]);
+				float area = 0.0f;
+				memset(cluster.centroid, 0, sizeof(cluster.centroid));
+				memset(cluster.normal, 0, sizeof(cluster.normal));
+				for (uint32_t t = cluster.firstTriangle; t < cluster.firstTriangle + cluster.triangleCount; t++)
+				{
+					const float *p0 = position(indices[t * 3]);
+					const float *p1 = position(indices[t * 3 + 1]);
+					const float *p2 = position(indices[t * 3 + 2]);
+					const float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+					const float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+					// Cross product length is twice the triangle area, so summing it weights normals and centroids by area
+					const float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+					const float triangleArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+					for (uint32_t i = 0; i < 3; i++)
+					{
+						cluster.normal[i] += n[i];
+						cluster.centroid[i] += (p0[i] + p1[i] + p2[i]) / 3.0f * triangleArea;
+					}
+					area += triangleArea;
+				}
+				for (uint32_t i = 0; i < 3; i++)
+				{
+					meshCentroid[i] += cluster.centroid[i];
+					cluster.centroid[i] = (area > 0.0f) ? cluster.centroid[i] / area : 0.0f;
+				}
+				meshArea += area;
+			}
+			for (uint32_t i = 0; i < 3; i++)
+			{
+				meshCentroid[i] = (meshArea > 0.0f) ? meshCentroid[i] / meshArea : 0.0f;
+			}
+			for (auto &cluster : sortedClusters)
+			{
+				const float length = std::sqrt(cluster.normal[0] * cluster.normal[0] + cluster.normal[1] * cluster.normal[1] + cluster.normal[2] * cluster.normal[2]);
+				cluster.sortKey = 0.0f;
+				if (length > 0.0f)
+				{
+					for (uint32_t i = 0; i < 3; i++)
+					{
+						cluster.sortKey += (cluster.centroid[i] - meshCentroid[i]) * cluster.normal[i] / length;
+					}
+				}
+			}
+
+			// Clusters facing away from the mesh center are the most likely to occlude others
+			std::stable_sort(sortedClusters.begin(), sortedClusters.end(), [](const Cluster &a, const Cluster &b) {
+				return a.sortKey > b.sortKey;
+			});
+			const std::vector<uint32_t> source(indices, indices + indexCount);
+			size_t outputIndex = 0;
+			for (auto &cluster : sortedClusters)
+			{
+				const size_t count = cluster.triangleCount * 3;
+				memcpy(indices + outputIndex, source.data() + cluster.firstTriangle * 3, count * sizeof(uint32_t));
+				outputIndex += count;
+			}
+		}
+
+		/**
+		* Reorder vertices in the order they are first referenced by the indices, so vertex fetches move linearly through memory
+		*
+		* @param indices Triangle list indices, remapped in place
+		* @param indexCount Number of indices
+		* @param vertices Pointer to the first vertex, reordered in place
+		* @param vertexCount Number of vertices (all indices must be smaller)
+		* @param vertexStride Size of a vertex in bytes
+		*
+		* @note Vertices that are not referenced are moved to the end, the vertex count doesn't change
+		*/
+		inline void optimizeVertexFetch(uint32_t *indices, size_t indexCount, void *vertices, uint32_t vertexCount, size_t vertexStride)
+		{
+			const uint32_t unmapped = ~0u;
+			std::vector<uint32_t> remap(vertexCount, unmapped);
+			uint32_t nextVertex = 0;
+			for (size_t i = 0; i < indexCount; i++)
+			{
+				uint32_t &target = remap[indices[i]];
+				if (target == unmapped)
+				{
+					target = nextVertex++;
+				}
+				indices[i] = target;
+			}
+			for (auto &target : remap)
+			{
+				if (target == unmapped)
+				{
+					target = nextVertex++;
+				}
+			}
+			uint8_t *vertexData = static_cast<uint8_t*>(vertices);
+			const std::vector<uint8_t> source(vertexData, vertexData + vertexCount * vertexStride);
+			for (uint32_t v = 0; v < vertexCount; v++)
+			{
+				memcpy(vertexData + remap[v] * vertexStride, source.data() + v * vertexStride, vertexStride);
+			}
+		}
+
+		/** @brief Cache statistics of a mesh before and after optimizeMesh */
+		struct MeshReport
+		{
+			uint32_t triangleCount = 0;
+			VertexCacheStatistics before;
+			VertexCacheStatistics after;
+		};
+
+		/**
+		* Run all optimizations on a single mesh: vertex cache reordering, overdraw cluster sorting and vertex fetch remapping
+		*
+		* @param indices Triangle list indices, relative to vertices
+		* @param indexCount Number of indices (multiple of 3)
+		* @param vertices Pointer to the first vertex of the mesh, reordered in place
+		* @param vertexCount Number of vertices of the mesh
+		* @param vertexStride Size of a vertex in bytes
+		* @param positionOffset Offset of the position (3 floats) inside a vertex in bytes
+		*/
+		inline MeshReport optimizeMesh(uint32_t *indices, size_t indexCount, void *vertices, uint32_t vertexCount, size_t vertexStride, size_t positionOffset)
+		{
+			MeshReport report;
+			report.triangleCount = static_cast<uint32_t>(indexCount / 3);
+			report.before = analyzeVertexCache(indices, indexCount, vertexCount);
+			std::vector<uint32_t> clusters;
+			optimizeVertexCache(indices, indexCount, vertexCount, defaultCacheSize, &clusters);
+			const float *positions = reinterpret_cast<const float*>(static_cast<const uint8_t*>(vertices) + positionOffset);
+			optimizeOverdraw(indices, indexCount, positions, vertexStride, clusters);
+			optimizeVertexFetch(indices, indexCount, vertices, vertexCount, vertexStride);
+			report.after = analyzeVertexCache(indices, indexCount, vertexCount);
+			return report;
+		}
+
+		/** @brief Largest index value written by packIndices16, 0xFFFF is left out as it restarts primitives if primitive restart is enabled */
+		const uint32_t maxIndex16 = 0xFFFE;
+
+		/**
+		* Convert 32 bit indices to 16 bit indices relative to a base vertex, which has to be passed as the draw's vertexOffset
+		*
+		* @param indices Source indices
+		* @param indexCount Number of indices
+		* @param baseVertex Subtracted from every index
+		* @param destination Receives indexCount 16 bit indices
+		*
+		* @return False if a rebased index doesn't fit into 16 bits (destination is then only partially written)
+		*/
+		inline bool packIndices16(const uint32_t *indices, size_t indexCount, uint32_t baseVertex, uint16_t *destination)
+		{
+			for (size_t i = 0; i < indexCount; i++)
+			{
+				if ((indices[i] < baseVertex) || (indices[i] - baseVertex > maxIndex16))
+				{
+					return false;
+				}
+				destination[i] = static_cast<uint16_t>(indices[i] - baseVertex);
+			}
+			return true;
+		}
+	}
+}
@@ -0,0 +1,372 @@
+/*
+* Mesh simplification
+*
+* Edge collapse simplification of triangle lists driven by quadric error metrics, used to generate index only levels of detail
+* that share the vertex data of the full detail mesh
+*
+* See "Surface Simplification Using Quadric Error Metrics" (Garland, Heckbert, 1997)
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <cfloat>
+
+#include "VulkanMeshOptimizer.hpp"
+
+namespace vks
+{
+	namespace meshopt
+	{
+		/** @brief Symmetric 4x4 matrix summing squared distances to a set of weighted planes */
+		struct Quadric
+		{
+			double a00 = 0.0, a01 = 0.0, a02 = 0.0, a03 = 0.0;
+			double a11 = 0.0, a12 = 0.0, a13 = 0.0;
+			double a22 = 0.0, a23 = 0.0;
+			double a33 = 0.0;
+			double weight = 0.0;
+
+			/** @brief Add the plane ax + by + cz + d = 0 (normalized) with the given weight */
+			void addPlane(double a, double b, double c, double d, double w)
+			{
+				a00 += w * a * a; a01 += w * a * b; a02 += w * a * c; a03 += w * a * d;
+				a11 += w * b * b; a12 += w * b * c; a13 += w * b * d;
+				a22 += w * c * c; a23 += w * c * d;
+				a33 += w * d * d;
+				weight += w;
+			}
+
+			void add(const Quadric &q)
+			{
+				a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+				a11 += q.a11; a12 += q.a12; a13 += q.a13;
+				a22 += q.a22; a23 += q.a23;
+				a33 += q.a33;
+				weight += q.weight;
+			}
+
+			/** @brief Weighted mean squared distance of a point to the planes */
+			double error(const float *p) const
+			{
+				const double x = p[0], y = p[1], z = p[2];
+				const double e = a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x
+					+ a11 * y * y + 2.0 * a12 * y * z + 2.0 * a13 * y
+					+ a22 * z * z + 2.0 * a23 * z
+					+ a33;
+				return (weight > 0.0) ? std::fabs(e) / weight : 0.0;
+			}
+		};
+
+		/**
+		* Simplify a triangle list by collapsing edges in the order of their quadric error
+		* Vertices are only collapsed onto other existing vertices, so the result indexes the same vertex data as the source
+		* Vertices on open borders and attribute seams (edges used by a single triangle) are kept in place to prevent holes
+		*
+		* @param destination Receives the simplified indices, must have room for indexCount indices
+		* @param indices Source triangle list indices
+		* @param indexCount Number of source indices (multiple of 3)
+		* @param positions Pointer to the position (3 floats) of the first vertex
+		* @param vertexCount Number of vertices referenced by the indices (all indices must be smaller)
+		* @param vertexStride Distance between two positions in bytes
+		* @param targetIndexCount Number of indices to stop at
+		* @param maxError Largest allowed distance of the simplified to the original surface, in position units
+		* @param (Optional) resultError Returns the error of the simplified mesh (largest error of all collapses)
+		*
+		* @return Number of indices written to destination, larger than targetIndexCount if the error limit was reached first
+		*/
+		inline size_t simplify(uint32_t *destination, const uint32_t *indices, size_t indexCount, const float *positions, uint32_t vertexCount, size_t vertexStride, size_t targetIndexCount, float maxError, float *resultError = nullptr)
+		{
+			const uint8_t *positionData = reinterpret_cast<const uint8_t*>(positions);
+			auto position = [&](uint32_t v) { return reinterpret_cast<const float*>(positionData + v * vertexStride); };
+
+			std::copy(indices, indices + indexCount, destination);
+			if (resultError)
+			{
+				*resultError = 0.0f;
+			}
+
+			// Vertices on edges without a twin in the opposite direction are locked
+			std::vector<bool> locked(vertexCount, false);
+			{
+				std::vector<std::pair<uint32_t, uint32_t>> edges;
+				edges.reserve(indexCount);
+				for (size_t i = 0; i < indexCount; i += 3)
+				{
+					for (uint32_t e = 0; e < 3; e++)
+					{
+						edges.push_back(std::make_pair(indices[i + e], indices[i + (e + 1) % 3]));
+					}
+				}
+				std::sort(edges.begin(), edges.end());
+				for (auto &edge : edges)
+				{
+					if (!std::binary_search(edges.begin(), edges.end(), std::make_pair(edge.second, edge.first)))
+					{
+						locked[edge.first] = true;
+						locked[edge.second] = true;
+					}
+				}
+			}
+
+			// Area weighted plane quadrics of the triangles around each vertex
+			std::vector<Quadric> quadrics(vertexCount);
+			for (size_t i = 0; i < indexCount; i += 3)
+			{
+				const float *p0 = position(indices[i]);
+				const float *p1 = position(indices[i + 1]);
+				const float *p2 = position(indices[i + 2]);
+				const double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+				const double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+				double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+				const double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				if (length == 0.0)
+				{
+					continue;
+				}
+				n[0] /= length;
+				n[1] /= length;
+				n[2] /= length;
+				const double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+				for (uint32_t v = 0; v < 3; v++)
+				{
+					quadrics[indices[i + v]].addPlane(n[0], n[1], n[2], d, length * 0.5);
+				}
+			}
+
+			// Collapse the cheapest edges in passes, each vertex takes part in at most one collapse per pass
+			const double maxQuadricError = static_cast<double>(maxError) * static_cast<double>(maxError);
+			double largestError = 0.0;
+			std::vector<uint32_t> remap(vertexCount);
+			std::vector<uint32_t> triangleOffsets(vertexCount + 1);
+			std::vector<uint32_t> vertexTriangles;
+			std::vector<uint32_t> collapseTarget(vertexCount);
+			std::vector<double> collapseError(vertexCount);
+			std::vector<uint32_t> candidates;
+			std::vector<bool> touched(vertexCount);
+			while (indexCount > targetIndexCount)
+			{
+				const size_t triangleCount = indexCount / 3;
+
+				// Triangles around each vertex
+				std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+				for (size_t i = 0; i < indexCount; i++)
+				{
+					triangleOffsets[destination[i] + 1]++;
+				}
+				for (uint32_t v = 0; v < vertexCount; v++)
+				{
+					triangleOffsets[v + 1] += triangleOffsets[v];
+				}
+				vertexTriangles.resize(indexCount);
+				std::vector<uint32_t> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+				for (size_t i = 0; i < indexCount; i++)
+				{
+					vertexTriangles[fill[destination[i]]++] = static_cast<uint32_t>(i / 3);
+				}
+
+				// Cheapest collapse of each unlocked vertex onto one of its neighbours
+				std::fill(collapseError.begin(), collapseError.end(), DBL_MAX);
+				for (size_t i = 0; i < indexCount; i += 3)
+				{
+					for (uint32_t e = 0; e < 3; e++)
+					{
+						const uint32_t from = destination[i + e];
+						if (locked[from])
+						{
+							continue;
+						}
+						for (uint32_t o = 1; o < 3; o++)
+						{
+							const uint32_t to = destination[i + (e + o) % 3];
+							Quadric q = quadrics[from];
+							q.add(quadrics[to]);
+							const double error = q.error(position(to));
+							if (error < collapseError[from])
+							{
+								collapseError[from] = error;
+								collapseTarget[from] = to;
+							}
+						}
+					}
+				}
+				candidates.clear();
+				for (uint32_t v = 0; v < vertexCount; v++)
+				{
+					if ((collapseError[v] <= maxQuadricError) && (triangleOffsets[v + 1] > triangleOffsets[v]))
+					{
+						candidates.push_back(v);
+					}
+				}
+				std::sort(candidates.begin(), candidates.end(), [&](uint32_t l, uint32_t r) { return collapseError[l] < collapseError[r]; });
+
+				// A collapse removes about two triangles, stop the pass once enough have been collapsed to reach the target
+				const size_t collapseBudget = std::max<size_t>((triangleCount - targetIndexCount / 3) / 2, 1);
+				size_t collapses = 0;
+				for (uint32_t v = 0; v < vertexCount; v++)
+				{
+					remap[v] = v;
+				}
+				std::fill(touched.begin(), touched.end(), false);
+				for (uint32_t from : candidates)
+				{
+					const uint32_t to = collapseTarget[from];
+					if (touched[from] || touched[to])
+					{
+						continue;
+					}
+					// Reject collapses that flip a remaining triangle
+					bool flipped = false;
+					for (uint32_t t = triangleOffsets[from]; (t < triangleOffsets[from + 1]) && !flipped; t++)
+					{
+						const uint32_t *triangle = &destination[vertexTriangles[t] * 3];
+						if ((triangle[0] == to) || (triangle[1] == to) || (triangle[2] == to))
+						{
+							continue;
+						}
+						float p[3][3], q[3][3];
+						for (uint32_t k = 0; k < 3; k++)
+						{
+							const float *source = position(triangle[k]);
+							const float *target = position((triangle[k] == from) ? to : triangle[k]);
+							for (uint32_t c = 0; c < 3; c++)
+							{
+								p[k][c] = source[c];
+								q[k][c] = target[c];
+							}
+						}
+						double n0[3], n1[3];
+						const double a1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+						const double a2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+						const double b1[3] = { q[1][0] - q[0][0], q[1][1] - q[0][1], q[1][2] - q[0][2] };
+						const double b2[3] = { q[2][0] - q[0][0], q[2][1] - q[0][1], q[2][2] - q[0][2] };
+						n0[0] = a1[1] * a2[2] - a1[2] * a2[1]; n0[1] = a1[2] * a2[0] - a1[0] * a2[2]; n0[2] = a1[0] * a2[1] - a1[1] * a2[0];
+						n1[0] = b1[1] * b2[2] - b1[2] * b2[1]; n1[1] = b1[2] * b2[0] - b1[0] * b2[2]; n1[2] = b1[0] * b2[1] - b1[1] * b2[0];
+						flipped = (n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2]) <= 0.0;
+					}
+					if (flipped)
+					{
+						continue;
+					}
+					remap[from] = to;
+					quadrics[to].add(quadrics[from]);
+					largestError = std::max(largestError, collapseError[from]);
+					// All vertices around the collapsed one keep their triangles for the rest of the pass, so flip tests stay valid
+					for (uint32_t t = triangleOffsets[from]; t < triangleOffsets[from + 1]; t++)
+					{
+						const uint32_t *triangle = &destination[vertexTriangles[t] * 3];
+						touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+					}
+					if (++collapses >= collapseBudget)
+					{
+						break;
+					}
+				}
+				if (collapses == 0)
+				{
+					break;
+				}
+
+				// Apply the collapses and drop the triangles that became degenerate
+				size_t writeIndex = 0;
+				for (size_t i = 0; i < indexCount; i += 3)
+				{
+					const uint32_t i0 = remap[destination[i]];
+					const uint32_t i1 = remap[destination[i + 1]];
+					const uint32_t i2 = remap[destination[i + 2]];
+					if ((i0 != i1) && (i1 != i2) && (i0 != i2))
+					{
+						destination[writeIndex++] = i0;
+						destination[writeIndex++] = i1;
+						destination[writeIndex++] = i2;
+					}
+				}
+				indexCount = writeIndex;
+			}
+
+			if (resultError)
+			{
+				*resultError = static_cast<float>(std::sqrt(largestError));
+			}
+			return indexCount;
+		}
+
+		/** @brief Index range and error of a level of detail generated by generateLods */
+		struct LodLevel
+		{
+			uint32_t firstIndex;
+			uint32_t indexCount;
+			float error;
+		};
+
+		/**
+		* Generate a chain of simplified index lists for a mesh and append them to an index buffer, each level has about half the triangles of the previous one
+		* The levels are optimized for the vertex cache
+		*
+		* @param indexBuffer Index buffer to append the levels to, the source indices are read from it too
+		* @param firstIndex First index of the full detail mesh
+		* @param indexCount Number of indices of the full detail mesh
+		* @param baseVertex Subtracted from the indices to get the position of a vertex (indices are stored with it added)
+		* @param positions Pointer to the position (3 floats) of the vertex at baseVertex
+		* @param vertexCount Number of vertices of the mesh
+		* @param vertexStride Distance between two positions in bytes
+		* @param maxLevels Maximum number of simplified levels to generate
+		* @param maxError Largest allowed error of a level, in position units
+		*
+		* @return Generated levels in decreasing detail (without the full detail mesh), stops early if a level can't be reduced by at least a fifth
+		*/
+		inline std::vector<LodLevel> generateLods(std::vector<uint32_t> &indexBuffer, uint32_t firstIndex, uint32_t indexCount, uint32_t baseVertex, const float *positions, uint32_t vertexCount, size_t vertexStride, uint32_t maxLevels, float maxError)
+		{
+			std::vector<LodLevel> levels;
+			std::vector<uint32_t> source(indexBuffer.begin() + firstIndex, indexBuffer.begin() + firstIndex + indexCount);
+			for (auto &index : source)
+			{
+				index -= baseVertex;
+			}
+			std::vector<uint32_t> simplified(indexCount);
+			for (uint32_t level = 0; level < maxLevels; level++)
+			{
+				const size_t targetIndexCount = source.size() / 6 * 3;
+				float error;
+				const size_t simplifiedCount = simplify(simplified.data(), source.data(), source.size(), positions, vertexCount, vertexStride, targetIndexCount, maxError, &error);
+				if ((simplifiedCount == 0) || (simplifiedCount * 5 > source.size() * 4))
+				{
+					break;
+				}
+				source.assign(simplified.begin(), simplified.begin() + simplifiedCount);
+				// Each level is simplified from the previous one, adding up the errors gives an upper bound of the error against the full detail mesh
+				const float previousError = levels.empty() ? 0.0f : levels.back().error;
+				LodLevel lod;
+				lod.firstIndex = static_cast<uint32_t>(indexBuffer.size());
+				lod.indexCount = static_cast<uint32_t>(simplifiedCount);
+				lod.error = previousError + error;
+				levels.push_back(lod);
+				std::vector<uint32_t> optimized(source);
+				optimizeVertexCache(optimized.data(), optimized.size(), vertexCount);
+				for (auto index : optimized)
+				{
+					indexBuffer.push_back(index + baseVertex);
+				}
+			}
+			return levels;
+		}
+
+		/**
+		* Projected size in pixels of an object space error seen from a given distance
+		*
+		* @param error Error in world units
+		* @param distance Distance of the object from the camera, clamped to avoid division by zero
+		* @param fovY Vertical field of view in radians
+		* @param viewportHeight Height of the viewport in pixels
+		*/
+		inline float projectedError(float error, float distance, float fovY, float viewportHeight)
+		{
+			return error * viewportHeight / (2.0f * std::tan(fovY * 0.5f) * std::max(distance, 1e-4f));
+		}
+	}
+}
@@ -26,6 +26,11 @@
 
 #include "VulkanDevice.hpp"
 #include "VulkanBuffer.hpp"
+#include "VulkanUploadBatch.hpp"
+#include "VulkanModelCache.hpp"
+#include "VulkanMeshOptimizer.hpp"
+#include "VulkanMeshSimplifier.hpp"
+#include "VulkanVertexQuantization.hpp"
 
 #if defined(__ANDROID__)
 #include <android/asset_manager.h>
@@ -42,7 +47,20 @@ namespace vks
 		VERTEX_COMPONENT_TANGENT = 0x4,
 		VERTEX_COMPONENT_BITANGENT = 0x5,
 		VERTEX_COMPONENT_DUMMY_FLOAT = 0x6,
-		VERTEX_COMPONENT_DUMMY_VEC4 = 0x7
+		VERTEX_COMPONENT_DUMMY_VEC4 = 0x7,
+		// Packed components, see Model::dequantization for reconstructing positions and uvs
+		/** @brief Position as 4 x snorm16 relative to the model's bounds (w = 1) */
+		VERTEX_COMPONENT_POSITION_SNORM16 = 0x8,
+		/** @brief Position as 4 x half float (w = 1) */
+		VERTEX_COMPONENT_POSITION_HALF = 0x9,
+		/** @brief Octahedral encoded unit vectors as 2 x snorm16 (see vks::quantization::octEncode) */
+		VERTEX_COMPONENT_NORMAL_OCT16 = 0xA,
+		VERTEX_COMPONENT_TANGENT_OCT16 = 0xB,
+		VERTEX_COMPONENT_BITANGENT_OCT16 = 0xC,
+		/** @brief Texture coordinates as 2 x unorm16 relative to the model's uv bounds */
+		VERTEX_COMPONENT_UV_UNORM16 = 0xD,
+		/** @brief Color as 4 x unorm8 (a = 1) */
+		VERTEX_COMPONENT_COLOR_UNORM8 = 0xE
 	} Component;
 
 	/** @brief Stores vertex layout components for model loading and Vulkan vertex input and atribute bindings  */
@@ -56,28 +74,114 @@ namespace vks
 			this->components = std::move(components);
 		}
 
+		static uint32_t componentSize(Component component)
+		{
+			switch (component)
+			{
+			case VERTEX_COMPONENT_UV:
+				return 2 * sizeof(float);
+			case VERTEX_COMPONENT_DUMMY_FLOAT:
+				return sizeof(float);
+			case VERTEX_COMPONENT_DUMMY_VEC4:
+				return 4 * sizeof(float);
+			case VERTEX_COMPONENT_POSITION_SNORM16:
+			case VERTEX_COMPONENT_POSITION_HALF:
+				return 4 * sizeof(uint16_t);
+			case VERTEX_COMPONENT_NORMAL_OCT16:
+			case VERTEX_COMPONENT_TANGENT_OCT16:
+			case VERTEX_COMPONENT_BITANGENT_OCT16:
+			case VERTEX_COMPONENT_UV_UNORM16:
+				return 2 * sizeof(uint16_t);
+			case VERTEX_COMPONENT_COLOR_UNORM8:
+				return 4 * sizeof(uint8_t);
+			default:
+				// All components except the ones listed above are made up of 3 floats
+				return 3 * sizeof(float);
+			}
+		}
+
+		/** @brief Vulkan format of a component for vertex input attribute descriptions */
+		static VkFormat componentFormat(Component component)
+		{
+			switch (component)
+			{
+			case VERTEX_COMPONENT_UV:
+				return VK_FORMAT_R32G32_SFLOAT;
+			case VERTEX_COMPONENT_DUMMY_FLOAT:
+				return VK_FORMAT_R32_SFLOAT;
+			case VERTEX_COMPONENT_DUMMY_VEC4:
+				return VK_FORMAT_R32G32B32A32_SFLOAT;
+			case VERTEX_COMPONENT_POSITION_SNORM16:
+				return VK_FORMAT_R16G16B16A16_SNORM;
+			case VERTEX_COMPONENT_POSITION_HALF:
+				return VK_FORMAT_R16G16B16A16_SFLOAT;
+			case VERTEX_COMPONENT_NORMAL_OCT16:
+			case VERTEX_COMPONENT_TANGENT_OCT16:
+			case VERTEX_COMPONENT_BITANGENT_OCT16:
+				return VK_FORMAT_R16G16_SNORM;
+			case VERTEX_COMPONENT_UV_UNORM16:
+				return VK_FORMAT_R16G16_UNORM;
+			case VERTEX_COMPONENT_COLOR_UNORM8:
+				return VK_FORMAT_R8G8B8A8_UNORM;
+			default:
+				return VK_FORMAT_R32G32B32_SFLOAT;
+			}
+		}
+
 		uint32_t stride()
 		{
 			uint32_t res = 0;
 			for (auto& component : components)
 			{
-				switch (component)
+				res += componentSize(component);
+			}
+			return res;
+		}
+
+		/** @brief Byte offset of the first occurrence of a component inside a vertex, -1 if the layout doesn't contain it */
+		int32_t offset(Component component)
+		{
+			uint32_t res = 0;
+			for (auto& c : components)
+			{
+				if (c == component)
 				{
-				case VERTEX_COMPONENT_UV:
-					res += 2 * sizeof(float);
-					break;
-				case VERTEX_COMPONENT_DUMMY_FLOAT:
-					res += sizeof(float);
-					break;
-				case VERTEX_COMPONENT_DUMMY_VEC4:
-					res += 4 * sizeof(float);
-					break;
-				default:
-					// All components except the ones listed above are made up of 3 floats
-					res += 3 * sizeof(float);
+					return static_cast<int32_t>(res);
 				}
+				res += componentSize(c);
 			}
-			return res;
+			return -1;
+		}
+
+		/** @brief Vertex input binding for vertices of this layout */
+		VkVertexInputBindingDescription bindingDescription(uint32_t binding)
+		{
+			return vks::initializers::vertexInputBindingDescription(binding, stride(), VK_VERTEX_INPUT_RATE_VERTEX);
+		}
+
+		/**
+		* Vertex input attributes matching this layout, one location per component
+		*
+		* @param binding Binding the vertices are bound to
+		* @param (Optional) firstLocation Shader location of the first component
+		*/
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions(uint32_t binding, uint32_t firstLocation = 0)
+		{
+			std::vector<VkVertexInputAttributeDescription> attributes;
+			uint32_t offset = 0;
+			for (auto& component : components)
+			{
+				attributes.push_back(vks::initializers::vertexInputAttributeDescription(binding, firstLocation + static_cast<uint32_t>(attributes.size()), componentFormat(component), offset));
+				offset += componentSize(component);
+			}
+			return attributes;
+		}
+
+		/** @brief True if the layout contains a component that needs Model::dequantization */
+		bool quantized()
+		{
+			return std::find(components.begin(), components.end(), VERTEX_COMPONENT_POSITION_SNORM16) != components.end() ||
+				std::find(components.begin(), components.end(), VERTEX_COMPONENT_UV_UNORM16) != components.end();
 		}
 	};
 
@@ -86,6 +190,12 @@ namespace vks
 		glm::vec3 center;
 		glm::vec3 scale;
 		glm::vec2 uvscale;
+		/** @brief Reorder indices and vertices for vertex cache efficiency, overdraw and vertex fetch locality (see vks::meshopt) */
+		bool optimizeMeshes = false;
+		/** @brief Maximum number of simplified levels of detail to generate (see Model::lods) */
+		uint32_t lodLevels = 0;
+		/** @brief Largest allowed simplification error relative to the model's bounding radius */
+		float lodMaxError = 0.05f;
 
 		ModelCreateInfo() {};
 
@@ -111,6 +221,8 @@ namespace vks
 		vks::Buffer indices;
 		uint32_t indexCount = 0;
 		uint32_t vertexCount = 0;
+		/** @brief Type to bind the index buffer with, models with less than 64k vertices use 16 bit indices */
+		VkIndexType indexType = VK_INDEX_TYPE_UINT32;
 
 		/** @brief Stores vertex and index base and counts for each part of a model */
 		struct ModelPart {
@@ -121,8 +233,31 @@ namespace vks
 		};
 		std::vector<ModelPart> parts;
 
+		/** @brief Vertex cache statistics of each part before and after mesh optimization (only filled if optimized at load time and not loaded from the cache) */
+		std::vector<vks::meshopt::MeshReport> optimizationReports;
+
+		/** @brief Simplified level of detail, its index range holds the simplified indices of all parts back to back in part order */
+		struct ModelLod {
+			uint32_t firstIndex;
+			uint32_t indexCount;
+			/** @brief Largest simplification error of all parts in model units */
+			float error;
+		};
+		/** @brief Simplified levels of detail in decreasing detail stored behind the full detail indices, level 0 (the full detail model) is not included */
+		std::vector<ModelLod> lods;
+		/** @brief Index ranges of the parts for each level of detail, parts.size() entries per level */
+		std::vector<ModelPart> lodParts;
+
+		/** @brief Triangles submitted by the draws passed to countLodDraw, reset it once per frame to get the triangles per frame */
+		struct DrawStatistics {
+			uint64_t submittedTriangles = 0;
+			/** @brief Triangles the same draws would have submitted at full detail */
+			uint64_t fullDetailTriangles = 0;
+		} drawStatistics;
+
 		static const int defaultFlags = aiProcess_FlipWindingOrder | aiProcess_Triangulate | aiProcess_PreTransformVertices | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals;
 
+		/** @brief Bounds of the vertex positions as stored in the vertex buffer (after scale, center and y flip) */
 		struct Dimension
 		{
 			glm::vec3 min = glm::vec3(FLT_MAX);
@@ -130,16 +265,304 @@ namespace vks
 			glm::vec3 size;
 		} dim;
 
+		/** @brief Reconstructs quantized components in the shader with value = decoded * scale + offset, identity for float components */
+		struct Dequantization
+		{
+			glm::vec3 positionOffset = glm::vec3(0.0f);
+			glm::vec3 positionScale = glm::vec3(1.0f);
+			glm::vec2 uvOffset = glm::vec2(0.0f);
+			glm::vec2 uvScale = glm::vec2(1.0f);
+		} dequantization;
+
+		/** @brief Sections stored in the baked model cache */
+		enum CacheSection {
+			CACHE_SECTION_VERTICES = 0,
+			CACHE_SECTION_INDICES = 1,
+			CACHE_SECTION_PARTS = 2,
+			CACHE_SECTION_DIMENSIONS = 3,
+			CACHE_SECTION_DEQUANTIZATION = 4,
+			CACHE_SECTION_LODS = 5,
+			CACHE_SECTION_LOD_PARTS = 6
+		};
+
+		/** @brief Create the device local vertex and index buffers and record the copies of the model's data */
+		void createBuffers(const void *vertexData, VkDeviceSize vBufferSize, const void *indexData, VkDeviceSize iBufferSize, vks::VulkanDevice *device, VkQueue copyQueue, vks::UploadBatch *batch)
+		{
+			// Create device local target buffers
+			// Vertex buffer
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&vertices,
+				vBufferSize));
+
+			// Index buffer
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&indices,
+				iBufferSize));
+
+			// Move vertex and index data to device local memory through the upload batch's staging memory
+			vks::UploadBatch localBatch(device, copyQueue, 0);
+			vks::UploadBatch *uploads = batch ? batch : &localBatch;
+			uploads->copyToBuffer(vertices.buffer, vertexData, vBufferSize);
+			uploads->copyToBuffer(indices.buffer, indexData, iBufferSize);
+			// Without a batch passed in, the upload is submitted right away
+			localBatch.flush();
+		}
+
+		/**
+		* Load the model from a baked cache file, vertex and index data is copied from the mapped file straight into staging memory
+		*
+		* @return False if there is no valid cache file for the given key
+		*/
+		bool loadFromCache(const std::string &cacheFilename, uint64_t cacheKey, vks::VertexLayout &layout, vks::VulkanDevice *device, VkQueue copyQueue, vks::UploadBatch *batch)
+		{
+			vks::modelcache::Reader reader;
+			if (!reader.open(cacheFilename, cacheKey))
+			{
+				return false;
+			}
+			size_t vertexFloatCount, cachedIndexCount, partCount, dimCount, dequantizationCount, lodCount, lodPartCount;
+			const void *vertexData = reader.getSection(CACHE_SECTION_VERTICES, sizeof(float), &vertexFloatCount);
+			// The element size of the index section tells the index type
+			indexType = VK_INDEX_TYPE_UINT32;
+			const void *indexData = reader.getSection(CACHE_SECTION_INDICES, sizeof(uint32_t), &cachedIndexCount);
+			if (!indexData)
+			{
+				indexType = VK_INDEX_TYPE_UINT16;
+				indexData = reader.getSection(CACHE_SECTION_INDICES, sizeof(uint16_t), &cachedIndexCount);
+			}
+			const ModelPart *partData = static_cast<const ModelPart*>(reader.getSection(CACHE_SECTION_PARTS, sizeof(ModelPart), &partCount));
+			const Dimension *dimData = static_cast<const Dimension*>(reader.getSection(CACHE_SECTION_DIMENSIONS, sizeof(Dimension), &dimCount));
+			const Dequantization *dequantizationData = static_cast<const Dequantization*>(reader.getSection(CACHE_SECTION_DEQUANTIZATION, sizeof(Dequantization), &dequantizationCount));
+			const ModelLod *lodData = static_cast<const ModelLod*>(reader.getSection(CACHE_SECTION_LODS, sizeof(ModelLod), &lodCount));
+			const ModelPart *lodPartData = static_cast<const ModelPart*>(reader.getSection(CACHE_SECTION_LOD_PARTS, sizeof(ModelPart), &lodPartCount));
+			if (!vertexData || !indexData || !partData || (dimCount != 1) || (dequantizationCount != 1) || (lodPartCount != lodCount * partCount))
+			{
+				return false;
+			}
+
+			parts.assign(partData, partData + partCount);
+			dim = *dimData;
+			dequantization = *dequantizationData;
+			lods.assign(lodData, lodData + lodCount);
+			lodParts.assign(lodPartData, lodPartData + lodPartCount);
+			vertexCount = static_cast<uint32_t>(vertexFloatCount * sizeof(float) / layout.stride());
+			// Levels of detail are stored behind the full detail indices
+			indexCount = lods.empty() ? static_cast<uint32_t>(cachedIndexCount) : lods[0].firstIndex;
+
+			createBuffers(vertexData, vertexFloatCount * sizeof(float), indexData, cachedIndexCount * indexSize(), device, copyQueue, batch);
+			return true;
+		}
+
+		/**
+		* Run the mesh optimizations on the generated vertex and index data
+		* Triangles are reordered per part, vertices are remapped for the whole model as parts may reference overlapping vertex ranges
+		*
+		* @note Data with indices outside of the vertex buffer is left untouched
+		*/
+		void optimize(std::vector<float> &vertexBuffer, std::vector<uint32_t> &indexBuffer, vks::VertexLayout &layout)
+		{
+			if (indexBuffer.empty() || (*std::max_element(indexBuffer.begin(), indexBuffer.end()) >= vertexCount))
+			{
+				return;
+			}
+			const uint32_t stride = layout.stride();
+			const int32_t positionOffset = layout.offset(VERTEX_COMPONENT_POSITION);
+			optimizationReports.resize(parts.size());
+			for (size_t i = 0; i < parts.size(); i++)
+			{
+				uint32_t *partIndices = indexBuffer.data() + parts[i].indexBase;
+				const size_t partIndexCount = parts[i].indexCount;
+				if (partIndexCount == 0)
+				{
+					continue;
+				}
+				// Work on indices relative to the lowest vertex of the part to keep the per vertex tables small
+				const uint32_t minIndex = *std::min_element(partIndices, partIndices + partIndexCount);
+				const uint32_t maxIndex = *std::max_element(partIndices, partIndices + partIndexCount);
+				const uint32_t partVertexCount = maxIndex - minIndex + 1;
+				for (size_t j = 0; j < partIndexCount; j++)
+				{
+					partIndices[j] -= minIndex;
+				}
+				vks::meshopt::MeshReport &report = optimizationReports[i];
+				report.triangleCount = static_cast<uint32_t>(partIndexCount / 3);
+				report.before = vks::meshopt::analyzeVertexCache(partIndices, partIndexCount, partVertexCount);
+				std::vector<uint32_t> clusters;
+				vks::meshopt::optimizeVertexCache(partIndices, partIndexCount, partVertexCount, vks::meshopt::defaultCacheSize, &clusters);
+				if (positionOffset >= 0)
+				{
+					const float *positions = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(vertexBuffer.data()) + minIndex * stride + positionOffset);
+					vks::meshopt::optimizeOverdraw(partIndices, partIndexCount, positions, stride, clusters);
+				}
+				report.after = vks::meshopt::analyzeVertexCache(partIndices, partIndexCount, partVertexCount);
+				for (size_t j = 0; j < partIndexCount; j++)
+				{
+					partIndices[j] += minIndex;
+				}
+			}
+
+			vks::meshopt::optimizeVertexFetch(indexBuffer.data(), indexBuffer.size(), vertexBuffer.data(), vertexCount, stride);
+			// Vertex ranges of the parts move with the remapping
+			for (auto &part : parts)
+			{
+				if (part.indexCount > 0)
+				{
+					const uint32_t *partIndices = indexBuffer.data() + part.indexBase;
+					part.vertexBase = *std::min_element(partIndices, partIndices + part.indexCount);
+					part.vertexCount = *std::max_element(partIndices, partIndices + part.indexCount) - part.vertexBase + 1;
+				}
+			}
+		}
+
+		/**
+		* Append simplified levels of detail of all parts to the index buffer (see vks::meshopt::generateLods)
+		* Parts that can't be simplified any further repeat their coarsest level in the remaining levels
+		*
+		* @note Needs float positions, data with indices outside of the vertex buffer is left untouched
+		*/
+		void generateLods(const std::vector<float> &vertexBuffer, std::vector<uint32_t> &indexBuffer, vks::VertexLayout &layout, uint32_t levels, float maxError)
+		{
+			lods.clear();
+			lodParts.clear();
+			const int32_t positionOffset = layout.offset(VERTEX_COMPONENT_POSITION);
+			if ((positionOffset < 0) || indexBuffer.empty() || (*std::max_element(indexBuffer.begin(), indexBuffer.end()) >= vertexCount))
+			{
+				return;
+			}
+			const uint32_t stride = layout.stride();
+
+			// Simplify each part on its own, indices of the levels are kept in a scratch buffer per part
+			std::vector<std::vector<uint32_t>> partIndices(parts.size());
+			std::vector<std::vector<vks::meshopt::LodLevel>> partLevels(parts.size());
+			uint32_t levelCount = 0;
+			for (size_t i = 0; i < parts.size(); i++)
+			{
+				const ModelPart &part = parts[i];
+				if (part.indexCount == 0)
+				{
+					continue;
+				}
+				std::vector<uint32_t> &scratch = partIndices[i];
+				scratch.assign(indexBuffer.begin() + part.indexBase, indexBuffer.begin() + part.indexBase + part.indexCount);
+				const uint32_t minIndex = *std::min_element(scratch.begin(), scratch.end());
+				const uint32_t maxIndex = *std::max_element(scratch.begin(), scratch.end());
+				const float *positions = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(vertexBuffer.data()) + minIndex * stride + positionOffset);
+				partLevels[i] = vks::meshopt::generateLods(scratch, 0, part.indexCount, minIndex, positions, maxIndex - minIndex + 1, stride, levels, maxError);
+				levelCount = std::max(levelCount, static_cast<uint32_t>(partLevels[i].size()));
+			}
+
+			for (uint32_t level = 0; level < levelCount; level++)
+			{
+				ModelLod lod{};
+				lod.firstIndex = static_cast<uint32_t>(indexBuffer.size());
+				for (size_t i = 0; i < parts.size(); i++)
+				{
+					ModelPart lodPart = parts[i];
+					lodPart.indexBase = static_cast<uint32_t>(indexBuffer.size());
+					if (!partLevels[i].empty())
+					{
+						const vks::meshopt::LodLevel &partLevel = partLevels[i][std::min<size_t>(level, partLevels[i].size() - 1)];
+						indexBuffer.insert(indexBuffer.end(), partIndices[i].begin() + partLevel.firstIndex, partIndices[i].begin() + partLevel.firstIndex + partLevel.indexCount);
+						lodPart.indexCount = partLevel.indexCount;
+						lod.error = std::max(lod.error, partLevel.error);
+					}
+					else
+					{
+						// Copied first, inserting a range of the vector into itself is undefined
+						const std::vector<uint32_t> fullDetail(indexBuffer.begin() + parts[i].indexBase, indexBuffer.begin() + parts[i].indexBase + parts[i].indexCount);
+						indexBuffer.insert(indexBuffer.end(), fullDetail.begin(), fullDetail.end());
+					}
+					lodParts.push_back(lodPart);
+				}
+				lod.indexCount = static_cast<uint32_t>(indexBuffer.size()) - lod.firstIndex;
+				lods.push_back(lod);
+			}
+		}
+
+		/**
+		* Select the coarsest level of detail whose simplification error projects to at most maxPixelError pixels
+		*
+		* @param distance Distance of the camera to the model's origin in model units
+		* @param fovY Vertical field of view in radians
+		* @param viewportHeight Height of the viewport in pixels
+		* @param (Optional) maxPixelError Largest allowed error on screen
+		*
+		* @return Level of detail, 0 is the full detail model and level n is lods[n - 1]
+		*/
+		uint32_t selectLod(float distance, float fovY, float viewportHeight, float maxPixelError = 1.0f) const
+		{
+			// Measured to the bounding sphere (offset by its center's distance to the origin), so no part of the model is closer than the assumed distance
+			const float radius = glm::length(dim.size) * 0.5f;
+			const float sphereDistance = distance - glm::length((dim.min + dim.max) * 0.5f) - radius;
+			uint32_t level = 0;
+			while ((level < lods.size()) && (vks::meshopt::projectedError(lods[level].error, sphereDistance, fovY, viewportHeight) <= maxPixelError))
+			{
+				level++;
+			}
+			return level;
+		}
+
+		/** @brief First index of a level of detail (see selectLod) */
+		uint32_t lodFirstIndex(uint32_t level) const
+		{
+			return (level == 0) ? 0 : lods[level - 1].firstIndex;
+		}
+
+		/** @brief Number of indices of a level of detail, divide by three for the number of triangles submitted */
+		uint32_t lodIndexCount(uint32_t level) const
+		{
+			return (level == 0) ? indexCount : lods[level - 1].indexCount;
+		}
+
+		/** @brief Index range of a part in a level of detail */
+		const ModelPart& lodPart(uint32_t level, size_t part) const
+		{
+			return (level == 0) ? parts[part] : lodParts[(level - 1) * parts.size() + part];
+		}
+
+		/** @brief Add a draw of a part at a level of detail (see selectLod) to drawStatistics */
+		void countLodDraw(uint32_t level, size_t part, uint32_t instanceCount = 1)
+		{
+			drawStatistics.submittedTriangles += static_cast<uint64_t>(lodPart(level, part).indexCount / 3) * instanceCount;
+			drawStatistics.fullDetailTriangles += static_cast<uint64_t>(parts[part].indexCount / 3) * instanceCount;
+		}
+
+		/** @brief Print the summed up vertex cache statistics of all optimized parts */
+		void printOptimizationReport()
+		{
+			uint32_t triangles = 0, before = 0, after = 0;
+			for (auto &report : optimizationReports)
+			{
+				triangles += report.triangleCount;
+				before += report.before.transformedVertices;
+				after += report.after.transformedVertices;
+			}
+			if (triangles > 0)
+			{
+				std::cout << ": " << optimizationReports.size() << " parts, ACMR " << static_cast<float>(before) / triangles << " -> " << static_cast<float>(after) / triangles;
+				std::cout << ", vertex shader invocations " << before << " -> " << after;
+			}
+			std::cout << std::endl;
+		}
+
+		/** @brief Size of a single index in bytes */
+		uint32_t indexSize() const
+		{
+			return (indexType == VK_INDEX_TYPE_UINT16) ? sizeof(uint16_t) : sizeof(uint32_t);
+		}
+
 		/** @brief Release all Vulkan resources of this model */
 		void destroy()
 		{		
 			assert(device);
-			vkDestroyBuffer(device, vertices.buffer, nullptr);
-			vkFreeMemory(device, vertices.memory, nullptr);
+			vertices.destroy();
 			if (indices.buffer != VK_NULL_HANDLE)
 			{
-				vkDestroyBuffer(device, indices.buffer, nullptr);
-				vkFreeMemory(device, indices.memory, nullptr);
+				indices.destroy();
 			}
 		}
 
@@ -152,14 +575,41 @@ namespace vks
 		* @param createInfo MeshCreateInfo structure for load time settings like scale, center, etc.
 		* @param copyQueue Queue used for the memory staging copy commands (must support transfer)
 		* @param (Optional) flags ASSIMP model loading flags
+		* @param (Optional) batch Upload batch to record the buffer copies into, the model must not be drawn before the batch has been submitted (defaults to nullptr, uploads right away)
+		*
+		* @note The generated vertex and index data is stored in a baked cache file (see vks::modelcache) and loaded from there on later runs with the same file contents, layout, create info and flags
+		* @note The index buffer has to be bound with indexType
 		*/
-		bool loadFromFile(const std::string& filename, vks::VertexLayout layout, vks::ModelCreateInfo *createInfo, vks::VulkanDevice *device, VkQueue copyQueue, const int flags = defaultFlags)
+		bool loadFromFile(const std::string& filename, vks::VertexLayout layout, vks::ModelCreateInfo *createInfo, vks::VulkanDevice *device, VkQueue copyQueue, const int flags = defaultFlags, vks::UploadBatch *batch = nullptr)
 		{
 			this->device = device->logicalDevice;
 
 			Assimp::Importer Importer;
 			const aiScene* pScene;
 
+			glm::vec3 scale(1.0f);
+			glm::vec2 uvscale(1.0f);
+			glm::vec3 center(0.0f);
+			bool optimizeMeshes = false;
+			uint32_t lodLevels = 0;
+			float lodMaxError = 0.0f;
+			if (createInfo)
+			{
+				scale = createInfo->scale;
+				uvscale = createInfo->uvscale;
+				center = createInfo->center;
+				optimizeMeshes = createInfo->optimizeMeshes;
+				lodLevels = createInfo->lodLevels;
+				lodMaxError = createInfo->lodMaxError;
+			}
+			optimizationReports.clear();
+			lods.clear();
+			lodParts.clear();
+
+			bool useCache = vks::modelcache::enabled();
+			uint64_t cacheKey = vks::modelcache::hashSeed;
+			std::string cacheFilename = vks::modelcache::getCacheFilename(filename);
+
 			// Load file
 #if defined(__ANDROID__)
 			// Meshes are stored inside the apk on Android (compressed)
@@ -179,6 +629,38 @@ namespace vks
 			AAsset_read(asset, meshData, size);
 			AAsset_close(asset);
 
+			if (useCache)
+			{
+				cacheKey = vks::modelcache::hash(meshData, size, cacheKey);
+			}
+#else
+			if (useCache)
+			{
+				useCache = vks::modelcache::hashFile(filename, &cacheKey);
+			}
+#endif
+
+			if (useCache)
+			{
+				// Everything that changes the generated data is part of the key
+				cacheKey = vks::modelcache::hash(layout.components.data(), layout.components.size() * sizeof(Component), cacheKey);
+				cacheKey = vks::modelcache::hash(&scale, sizeof(scale), cacheKey);
+				cacheKey = vks::modelcache::hash(&uvscale, sizeof(uvscale), cacheKey);
+				cacheKey = vks::modelcache::hash(&center, sizeof(center), cacheKey);
+				cacheKey = vks::modelcache::hash(&flags, sizeof(flags), cacheKey);
+				cacheKey = vks::modelcache::hash(&optimizeMeshes, sizeof(optimizeMeshes), cacheKey);
+				cacheKey = vks::modelcache::hash(&lodLevels, sizeof(lodLevels), cacheKey);
+				cacheKey = vks::modelcache::hash(&lodMaxError, sizeof(lodMaxError), cacheKey);
+				if (loadFromCache(cacheFilename, cacheKey, layout, device, copyQueue, batch))
+				{
+#if defined(__ANDROID__)
+					free(meshData);
+#endif
+					return true;
+				}
+			}
+
+#if defined(__ANDROID__)
 			pScene = Importer.ReadFileFromMemory(meshData, size, flags);
 
 			free(meshData);
@@ -195,22 +677,50 @@ namespace vks
 				parts.clear();
 				parts.resize(pScene->mNumMeshes);
 
-				glm::vec3 scale(1.0f);
-				glm::vec2 uvscale(1.0f);
-				glm::vec3 center(0.0f);
-				if (createInfo)
-				{
-					scale = createInfo->scale;
-					uvscale = createInfo->uvscale;
-					center = createInfo->center;
-				}
-
 				std::vector<float> vertexBuffer;
 				std::vector<uint32_t> indexBuffer;
 
 				vertexCount = 0;
 				indexCount = 0;
 
+				// Quantized components are stored relative to the bounds of the whole model
+				dequantization = {};
+				if (layout.quantized())
+				{
+					vks::quantization::Range<3> positionRange;
+					vks::quantization::Range<2> uvRange;
+					for (unsigned int i = 0; i < pScene->mNumMeshes; i++)
+					{
+						const aiMesh* paiMesh = pScene->mMeshes[i];
+						for (unsigned int j = 0; j < paiMesh->mNumVertices; j++)
+						{
+							const aiVector3D &pos = paiMesh->mVertices[j];
+							const float position[3] = { pos.x * scale.x + center.x, -pos.y * scale.y + center.y, pos.z * scale.z + center.z };
+							positionRange.add(position);
+							// Meshes without texture coordinates store (0, 0), so it has to be inside the range as well
+							const bool hasUv = paiMesh->HasTextureCoords(0);
+							const float uv[2] = { hasUv ? paiMesh->mTextureCoords[0][j].x * uvscale.s : 0.0f, hasUv ? paiMesh->mTextureCoords[0][j].y * uvscale.t : 0.0f };
+							uvRange.add(uv);
+						}
+					}
+					positionRange.snormTransform(&dequantization.positionOffset.x, &dequantization.positionScale.x);
+					uvRange.unormTransform(&dequantization.uvOffset.x, &dequantization.uvScale.x);
+				}
+				// Packed components are written as 32 bit words into the float vertex buffer
+				auto pushPacked = [&vertexBuffer](uint32_t word) {
+					vertexBuffer.push_back(0.0f);
+					memcpy(&vertexBuffer.back(), &word, sizeof(word));
+				};
+				auto pack16 = [](uint16_t a, uint16_t b) {
+					return static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 16);
+				};
+				auto pushOct = [&](float x, float y, float z) {
+					const float v[3] = { x, y, z };
+					int16_t encoded[2];
+					vks::quantization::octEncode(v, encoded);
+					pushPacked(pack16(static_cast<uint16_t>(encoded[0]), static_cast<uint16_t>(encoded[1])));
+				};
+
 				// Load meshes
 				for (unsigned int i = 0; i < pScene->mNumMeshes; i++)
 				{
@@ -267,6 +777,34 @@ namespace vks
 								vertexBuffer.push_back(pBiTangent->y);
 								vertexBuffer.push_back(pBiTangent->z);
 								break;
+							case VERTEX_COMPONENT_POSITION_SNORM16:
+							{
+								const glm::vec3 position = (glm::vec3(pPos->x * scale.x + center.x, -pPos->y * scale.y + center.y, pPos->z * scale.z + center.z) - dequantization.positionOffset) / dequantization.positionScale;
+								pushPacked(pack16(static_cast<uint16_t>(vks::quantization::packSnorm16(position.x)), static_cast<uint16_t>(vks::quantization::packSnorm16(position.y))));
+								pushPacked(pack16(static_cast<uint16_t>(vks::quantization::packSnorm16(position.z)), 32767));
+								break;
+							}
+							case VERTEX_COMPONENT_POSITION_HALF:
+								pushPacked(pack16(vks::quantization::floatToHalf(pPos->x * scale.x + center.x), vks::quantization::floatToHalf(-pPos->y * scale.y + center.y)));
+								pushPacked(pack16(vks::quantization::floatToHalf(pPos->z * scale.z + center.z), vks::quantization::floatToHalf(1.0f)));
+								break;
+							case VERTEX_COMPONENT_NORMAL_OCT16:
+								pushOct(pNormal->x, -pNormal->y, pNormal->z);
+								break;
+							case VERTEX_COMPONENT_TANGENT_OCT16:
+								pushOct(pTangent->x, pTangent->y, pTangent->z);
+								break;
+							case VERTEX_COMPONENT_BITANGENT_OCT16:
+								pushOct(pBiTangent->x, pBiTangent->y, pBiTangent->z);
+								break;
+							case VERTEX_COMPONENT_UV_UNORM16:
+								pushPacked(pack16(vks::quantization::packUnorm16((pTexCoord->x * uvscale.s - dequantization.uvOffset.x) / dequantization.uvScale.x),
+									vks::quantization::packUnorm16((pTexCoord->y * uvscale.t - dequantization.uvOffset.y) / dequantization.uvScale.y)));
+								break;
+							case VERTEX_COMPONENT_COLOR_UNORM8:
+								pushPacked(static_cast<uint32_t>(vks::quantization::packUnorm8(pColor.r)) | (static_cast<uint32_t>(vks::quantization::packUnorm8(pColor.g)) << 8) |
+									(static_cast<uint32_t>(vks::quantization::packUnorm8(pColor.b)) << 16) | 0xff000000u);
+								break;
 							// Dummy components for padding
 							case VERTEX_COMPONENT_DUMMY_FLOAT:
 								vertexBuffer.push_back(0.0f);
@@ -280,13 +818,10 @@ namespace vks
 							};
 						}
 
-						dim.max.x = fmax(pPos->x, dim.max.x);
-						dim.max.y = fmax(pPos->y, dim.max.y);
-						dim.max.z = fmax(pPos->z, dim.max.z);
-
-						dim.min.x = fmin(pPos->x, dim.min.x);
-						dim.min.y = fmin(pPos->y, dim.min.y);
-						dim.min.z = fmin(pPos->z, dim.min.z);
+						// Bounds of the positions as stored in the vertex buffer (scaled, centered and flipped)
+						const glm::vec3 pos = glm::vec3(pPos->x * scale.x + center.x, -pPos->y * scale.y + center.y, pPos->z * scale.z + center.z);
+						dim.max = glm::max(pos, dim.max);
+						dim.min = glm::min(pos, dim.min);
 					}
 
 					dim.size = dim.max - dim.min;
@@ -308,62 +843,43 @@ namespace vks
 				}
 
 
+				if (optimizeMeshes)
+				{
+					optimize(vertexBuffer, indexBuffer, layout);
+					std::cout << "Optimized \"" << filename << "\"";
+					printOptimizationReport();
+				}
+
+				if (lodLevels > 0)
+				{
+					generateLods(vertexBuffer, indexBuffer, layout, lodLevels, glm::length(dim.size) * 0.5f * lodMaxError);
+				}
+
+				// All parts are drawn with a vertex offset of zero, so 16 bit indices are only used if the indices of the whole model fit
+				std::vector<uint16_t> shortIndexBuffer(indexBuffer.size());
+				indexType = vks::meshopt::packIndices16(indexBuffer.data(), indexBuffer.size(), 0, shortIndexBuffer.data()) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+				const void *indexData = (indexType == VK_INDEX_TYPE_UINT16) ? static_cast<const void*>(shortIndexBuffer.data()) : static_cast<const void*>(indexBuffer.data());
+
 				uint32_t vBufferSize = static_cast<uint32_t>(vertexBuffer.size()) * sizeof(float);
-				uint32_t iBufferSize = static_cast<uint32_t>(indexBuffer.size()) * sizeof(uint32_t);
-
-				// Use staging buffer to move vertex and index buffer to device local memory
-				// Create staging buffers
-				vks::Buffer vertexStaging, indexStaging;
-
-				// Vertex buffer
-				VK_CHECK_RESULT(device->createBuffer(
-					VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-					&vertexStaging,
-					vBufferSize,
-					vertexBuffer.data()));
-
-				// Index buffer
-				VK_CHECK_RESULT(device->createBuffer(
-					VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-					&indexStaging,
-					iBufferSize,
-					indexBuffer.data()));
-
-				// Create device local target buffers
-				// Vertex buffer
-				VK_CHECK_RESULT(device->createBuffer(
-					VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-					&vertices,
-					vBufferSize));
-
-				// Index buffer
-				VK_CHECK_RESULT(device->createBuffer(
-					VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-					&indices,
-					iBufferSize));
-
-				// Copy from staging buffers
-				VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-				VkBufferCopy copyRegion{};
-
-				copyRegion.size = vertices.size;
-				vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1, &copyRegion);
-
-				copyRegion.size = indices.size;
-				vkCmdCopyBuffer(copyCmd, indexStaging.buffer, indices.buffer, 1, &copyRegion);
-
-				device->flushCommandBuffer(copyCmd, copyQueue);
-
-				// Destroy staging resources
-				vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-				vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
-				vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
-				vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
+				uint32_t iBufferSize = static_cast<uint32_t>(indexBuffer.size()) * indexSize();
+
+				createBuffers(vertexBuffer.data(), vBufferSize, indexData, iBufferSize, device, copyQueue, batch);
+
+				if (useCache)
+				{
+					vks::modelcache::Writer writer;
+					writer.addSection(CACHE_SECTION_VERTICES, vertexBuffer.data(), sizeof(float), vertexBuffer.size());
+					writer.addSection(CACHE_SECTION_INDICES, indexData, indexSize(), indexBuffer.size());
+					writer.addSection(CACHE_SECTION_PARTS, parts.data(), sizeof(ModelPart), parts.size());
+					writer.addSection(CACHE_SECTION_DIMENSIONS, &dim, sizeof(Dimension), 1);
+					writer.addSection(CACHE_SECTION_DEQUANTIZATION, &dequantization, sizeof(Dequantization), 1);
+					writer.addSection(CACHE_SECTION_LODS, lods.data(), sizeof(ModelLod), lods.size());
+					writer.addSection(CACHE_SECTION_LOD_PARTS, lodParts.data(), sizeof(ModelPart), lodParts.size());
+					if (!writer.write(cacheFilename, cacheKey))
+					{
+						std::cout << "Could not write model cache \"" << cacheFilename << "\"" << std::endl;
+					}
+				}
 
 				return true;
 			}
@@ -386,11 +902,12 @@ namespace vks
 		* @param scale Load time scene scale
 		* @param copyQueue Queue used for the memory staging copy commands (must support transfer)
 		* @param (Optional) flags ASSIMP model loading flags
+		* @param (Optional) batch Upload batch to record the buffer copies into, the model must not be drawn before the batch has been submitted (defaults to nullptr, uploads right away)
 		*/
-		bool loadFromFile(const std::string& filename, vks::VertexLayout layout, float scale, vks::VulkanDevice *device, VkQueue copyQueue, const int flags = defaultFlags)
+		bool loadFromFile(const std::string& filename, vks::VertexLayout layout, float scale, vks::VulkanDevice *device, VkQueue copyQueue, const int flags = defaultFlags, vks::UploadBatch *batch = nullptr)
 		{
 			vks::ModelCreateInfo modelCreateInfo(scale, 1.0f, 0.0f);
-			return loadFromFile(filename, layout, &modelCreateInfo, device, copyQueue, flags);
+			return loadFromFile(filename, layout, &modelCreateInfo, device, copyQueue, flags, batch);
 		}
 	};
 };
\ No newline at end of file
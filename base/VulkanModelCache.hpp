@@ -0,0 +1,431 @@
+/*
+* Baked model cache
+*
+* Stores the final vertex and index streams (and loader specific tables) of a model in a versioned binary file
+* that is memory mapped on later loads, so the source asset doesn't have to be parsed and converted again
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+#include "VulkanTools.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vks
+{
+	namespace modelcache
+	{
+		/** @brief "VKBK" */
+		const uint32_t fileMagic = 0x4b424b56;
+		/** @brief Increase whenever the layout of the file or of one of the stored sections changes */
+		const uint32_t fileVersion = 3;
+		/** @brief Offset alignment of sections inside the file, so mapped data can be read in place */
+		const uint64_t sectionAlignment = 16;
+		/** @brief Initial value for hash, keys are built by hashing all inputs in turn starting from this */
+		const uint64_t hashSeed = 14695981039346656037ull;
+
+		struct FileHeader
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint64_t key;
+			uint32_t sectionCount;
+			uint32_t reserved;
+		};
+
+		struct SectionHeader
+		{
+			uint32_t id;
+			uint32_t elementSize;
+			uint64_t offset;
+			uint64_t count;
+		};
+
+		/** @brief Global switch for reading and writing baked model caches (see the --nomodelcache command line argument) */
+		inline bool& enabled()
+		{
+			static bool cacheEnabled = true;
+			return cacheEnabled;
+		}
+
+		/**
+		* 64 bit FNV-1a hash
+		*
+		* @param data Pointer to the data to hash
+		* @param size Size of the data in bytes
+		* @param (Optional) seed Result of a previous call to combine multiple ranges into one key
+		*/
+		inline uint64_t hash(const void *data, size_t size, uint64_t seed = hashSeed)
+		{
+			const uint8_t *bytes = static_cast<const uint8_t*>(data);
+			uint64_t value = seed;
+			for (size_t i = 0; i < size; i++)
+			{
+				value ^= bytes[i];
+				value *= 1099511628211ull;
+			}
+			return value;
+		}
+
+		/** @brief Hash the contents of a file (read from the apk's assets on Android), returns false if the file can't be read */
+		inline bool hashFile(const std::string &filename, uint64_t *value)
+		{
+#if defined(__ANDROID__)
+			AAsset* asset = AAssetManager_open(androidApp->activity->assetManager, filename.c_str(), AASSET_MODE_STREAMING);
+			if (!asset)
+			{
+				return false;
+			}
+			std::vector<char> chunk(1024 * 1024);
+			int bytesRead;
+			while ((bytesRead = AAsset_read(asset, chunk.data(), chunk.size())) > 0)
+			{
+				*value = hash(chunk.data(), static_cast<size_t>(bytesRead), *value);
+			}
+			AAsset_close(asset);
+			return true;
+#else
+			std::ifstream is(filename, std::ios::binary);
+			if (!is.is_open())
+			{
+				return false;
+			}
+			std::vector<char> chunk(1024 * 1024);
+			while (is)
+			{
+				is.read(chunk.data(), chunk.size());
+				*value = hash(chunk.data(), static_cast<size_t>(is.gcount()), *value);
+			}
+			return true;
+#endif
+		}
+
+		/** @brief Name of the cache file for a source asset (next to the asset, or in the app's internal storage on Android) */
+		inline std::string getCacheFilename(const std::string &sourceFilename)
+		{
+#if defined(__ANDROID__)
+			// Assets are stored inside the (read only) apk
+			std::string name = sourceFilename;
+			for (auto &c : name)
+			{
+				if ((c == '/') || (c == '\\'))
+				{
+					c = '_';
+				}
+			}
+			return std::string(androidApp->activity->internalDataPath) + "/" + name + ".vkbake";
+#else
+			return sourceFilename + ".vkbake";
+#endif
+		}
+
+		/** @brief Read only memory mapping of a whole file */
+		class MappedFile
+		{
+		private:
+#if defined(_WIN32)
+			HANDLE file = INVALID_HANDLE_VALUE;
+			HANDLE mapping = NULL;
+#endif
+			void *view = nullptr;
+			size_t viewSize = 0;
+
+		public:
+			MappedFile() {};
+
+			~MappedFile()
+			{
+				close();
+			}
+
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
+
+			/** @brief Map the file, returns false if it does not exist or is empty */
+			bool open(const std::string &filename)
+			{
+				close();
+#if defined(_WIN32)
+				file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+				if (file == INVALID_HANDLE_VALUE)
+				{
+					return false;
+				}
+				LARGE_INTEGER fileSize;
+				if (!GetFileSizeEx(file, &fileSize) || (fileSize.QuadPart == 0))
+				{
+					close();
+					return false;
+				}
+				mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+				if (mapping == NULL)
+				{
+					close();
+					return false;
+				}
+				view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				viewSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+				int fd = ::open(filename.c_str(), O_RDONLY);
+				if (fd < 0)
+				{
+					return false;
+				}
+				struct stat fileStat;
+				if ((fstat(fd, &fileStat) != 0) || (fileStat.st_size == 0))
+				{
+					::close(fd);
+					return false;
+				}
+				void *mapped = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+				// The mapping stays valid after the descriptor has been closed
+				::close(fd);
+				if (mapped == MAP_FAILED)
+				{
+					return false;
+				}
+				view = mapped;
+				viewSize = static_cast<size_t>(fileStat.st_size);
+#endif
+				return view != nullptr;
+			}
+
+			void close()
+			{
+#if defined(_WIN32)
+				if (view)
+				{
+					UnmapViewOfFile(view);
+				}
+				if (mapping != NULL)
+				{
+					CloseHandle(mapping);
+					mapping = NULL;
+				}
+				if (file != INVALID_HANDLE_VALUE)
+				{
+					CloseHandle(file);
+					file = INVALID_HANDLE_VALUE;
+				}
+#else
+				if (view)
+				{
+					munmap(view, viewSize);
+				}
+#endif
+				view = nullptr;
+				viewSize = 0;
+			}
+
+			const uint8_t* data() const
+			{
+				return static_cast<const uint8_t*>(view);
+			}
+
+			size_t size() const
+			{
+				return viewSize;
+			}
+		};
+
+		/** @brief Validates a mapped cache file and gives access to its sections */
+		class Reader
+		{
+		private:
+			MappedFile file;
+			const SectionHeader *sections = nullptr;
+			uint32_t sectionCount = 0;
+
+		public:
+			/**
+			* Map a cache file
+			*
+			* @param filename Cache file to map
+			* @param key Key the file must have been written with (see Writer::write)
+			*
+			* @return False if the file does not exist, is damaged or was written by another version or for another key
+			*/
+			bool open(const std::string &filename, uint64_t key)
+			{
+				sections = nullptr;
+				sectionCount = 0;
+				if (!file.open(filename))
+				{
+					return false;
+				}
+				FileHeader header;
+				if (file.size() < sizeof(FileHeader))
+				{
+					file.close();
+					return false;
+				}
+				memcpy(&header, file.data(), sizeof(FileHeader));
+				if ((header.magic != fileMagic) || (header.version != fileVersion) || (header.key != key) || (header.sectionCount > (file.size() - sizeof(FileHeader)) / sizeof(SectionHeader)))
+				{
+					file.close();
+					return false;
+				}
+				sections = reinterpret_cast<const SectionHeader*>(file.data() + sizeof(FileHeader));
+				sectionCount = header.sectionCount;
+				for (uint32_t i = 0; i < sectionCount; i++)
+				{
+					// Written as divisions, so damaged headers can't overflow the range check
+					const SectionHeader &section = sections[i];
+					if ((section.offset > file.size()) || ((section.elementSize > 0) && (section.count > (file.size() - section.offset) / section.elementSize)))
+					{
+						file.close();
+						sections = nullptr;
+						sectionCount = 0;
+						return false;
+					}
+				}
+				return true;
+			}
+
+			/**
+			* Get a pointer to the (mapped) data of a section
+			*
+			* @param id Id of the section
+			* @param elementSize Expected size of a single element, a mismatch is treated like a missing section
+			* @param count Returns the number of elements stored in the section
+			*
+			* @return Pointer to the first element or nullptr if there is no matching section
+			*/
+			const void* getSection(uint32_t id, uint32_t elementSize, size_t *count) const
+			{
+				for (uint32_t i = 0; i < sectionCount; i++)
+				{
+					if ((sections[i].id == id) && (sections[i].elementSize == elementSize))
+					{
+						*count = static_cast<size_t>(sections[i].count);
+						return file.data() + sections[i].offset;
+					}
+				}
+				*count = 0;
+				return nullptr;
+			}
+		};
+
+		/** @brief Collects sections and writes them to a cache file */
+		class Writer
+		{
+		private:
+			struct Chunk
+			{
+				const void *data;
+				size_t count;
+			};
+			struct Section
+			{
+				SectionHeader header;
+				std::vector<Chunk> chunks;
+			};
+			std::vector<Section> sections;
+
+		public:
+			/**
+			* Add a section to the file
+			*
+			* @param id Id used to look up the section (see Reader::getSection)
+			* @param data Pointer to the elements, must stay valid until the file has been written
+			* @param elementSize Size of a single element in bytes
+			* @param count Number of elements
+			*/
+			void addSection(uint32_t id, const void *data, uint32_t elementSize, size_t count)
+			{
+				Section section{};
+				section.header.id = id;
+				section.header.elementSize = elementSize;
+				section.header.count = count;
+				section.chunks.push_back({ data, count });
+				sections.push_back(section);
+			}
+
+			/**
+			* Append elements to the section that was added last, for sections whose data is spread over multiple arrays
+			*
+			* @param data Pointer to the elements, must stay valid until the file has been written
+			* @param count Number of elements
+			*/
+			void appendToSection(const void *data, size_t count)
+			{
+				assert(!sections.empty());
+				Section &section = sections.back();
+				section.header.count += count;
+				section.chunks.push_back({ data, count });
+			}
+
+			/**
+			* Write all sections to a cache file
+			*
+			* @param filename Cache file to write, an existing file is replaced
+			* @param key Key identifying the source data and load settings the sections were generated from
+			*
+			* @return False if the file could not be written (e.g. read only asset directory)
+			*/
+			bool write(const std::string &filename, uint64_t key)
+			{
+				FileHeader header{};
+				header.magic = fileMagic;
+				header.version = fileVersion;
+				header.key = key;
+				header.sectionCount = static_cast<uint32_t>(sections.size());
+
+				uint64_t offset = sizeof(FileHeader) + sections.size() * sizeof(SectionHeader);
+				for (auto &section : sections)
+				{
+					offset = (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+					section.header.offset = offset;
+					offset += section.header.count * section.header.elementSize;
+				}
+
+				// Written to a temporary file first, so a concurrently running instance never maps a partial file
+				std::string tempFilename = filename + ".tmp";
+				std::ofstream os(tempFilename, std::ios::binary | std::ios::trunc);
+				if (!os.is_open())
+				{
+					return false;
+				}
+				os.write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
+				for (auto &section : sections)
+				{
+					os.write(reinterpret_cast<const char*>(&section.header), sizeof(SectionHeader));
+				}
+				const char padding[sectionAlignment] = {};
+				for (auto &section : sections)
+				{
+					os.write(padding, section.header.offset - static_cast<uint64_t>(os.tellp()));
+					for (auto &chunk : section.chunks)
+					{
+						os.write(static_cast<const char*>(chunk.data), chunk.count * section.header.elementSize);
+					}
+				}
+				bool success = os.good();
+				os.close();
+				if (success)
+				{
+					std::remove(filename.c_str());
+					success = (std::rename(tempFilename.c_str(), filename.c_str()) == 0);
+				}
+				if (!success)
+				{
+					std::remove(tempFilename.c_str());
+				}
+				return success;
+			}
+		};
+	}
+}
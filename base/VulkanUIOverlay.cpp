@@ -272,7 +272,18 @@ namespace vks
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device->logicalDevice, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline));
 	}
 
-	/** Update vertex and index buffer containing the imGui elements when required */
+	/** Returns true if the next update has to recreate the vertex or index buffer */
+	bool UIOverlay::bufferResizeRequired() const
+	{
+		ImDrawData* imDrawData = ImGui::GetDrawData();
+		if ((!imDrawData) || (imDrawData->TotalVtxCount == 0) || (imDrawData->TotalIdxCount == 0)) {
+			return false;
+		}
+		return (vertexBuffer.buffer == VK_NULL_HANDLE) || (vertexCount != imDrawData->TotalVtxCount) ||
+			(indexBuffer.buffer == VK_NULL_HANDLE) || (indexCount < imDrawData->TotalIdxCount) || (bufferRegionCount != regionCount);
+	}
+
+	/** Recreate the vertex and index buffer when required, returns true if the command buffers have to be rebuilt */
 	bool UIOverlay::update()
 	{
 		ImDrawData* imDrawData = ImGui::GetDrawData();
@@ -281,8 +292,8 @@ namespace vks
 		if (!imDrawData) { return false; };
 
 		// Note: Alignment is done inside buffer creation
-		VkDeviceSize vertexBufferSize = imDrawData->TotalVtxCount * sizeof(ImDrawVert);
-		VkDeviceSize indexBufferSize = imDrawData->TotalIdxCount * sizeof(ImDrawIdx);
+		VkDeviceSize vertexBufferSize = imDrawData->TotalVtxCount * sizeof(ImDrawVert) * regionCount;
+		VkDeviceSize indexBufferSize = imDrawData->TotalIdxCount * sizeof(ImDrawIdx) * regionCount;
 
 		// Update buffers only if vertex or index count has been changed compared to current buffer size
 		if ((vertexBufferSize == 0) || (indexBufferSize == 0)) {
@@ -290,7 +301,7 @@ namespace vks
 		}
 
 		// Vertex buffer
-		if ((vertexBuffer.buffer == VK_NULL_HANDLE) || (vertexCount != imDrawData->TotalVtxCount)) {
+		if ((vertexBuffer.buffer == VK_NULL_HANDLE) || (vertexCount != imDrawData->TotalVtxCount) || (bufferRegionCount != regionCount)) {
 			vertexBuffer.unmap();
 			vertexBuffer.destroy();
 			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &vertexBuffer, vertexBufferSize));
@@ -301,8 +312,7 @@ namespace vks
 		}
 
 		// Index buffer
-		VkDeviceSize indexSize = imDrawData->TotalIdxCount * sizeof(ImDrawIdx);
-		if ((indexBuffer.buffer == VK_NULL_HANDLE) || (indexCount < imDrawData->TotalIdxCount)) {
+		if ((indexBuffer.buffer == VK_NULL_HANDLE) || (indexCount < imDrawData->TotalIdxCount) || (bufferRegionCount != regionCount)) {
 			indexBuffer.unmap();
 			indexBuffer.destroy();
 			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &indexBuffer, indexBufferSize));
@@ -311,9 +321,22 @@ namespace vks
 			updateCmdBuffers = true;
 		}
 
-		// Upload data
-		ImDrawVert* vtxDst = (ImDrawVert*)vertexBuffer.mapped;
-		ImDrawIdx* idxDst = (ImDrawIdx*)indexBuffer.mapped;
+		bufferRegionCount = regionCount;
+
+		return updateCmdBuffers;
+	}
+
+	/** Copy the imGui elements into a region of the vertex and index buffer, no frame in flight may be reading that region */
+	void UIOverlay::upload(uint32_t region)
+	{
+		ImDrawData* imDrawData = ImGui::GetDrawData();
+
+		if ((!imDrawData) || (region >= bufferRegionCount) || (imDrawData->TotalVtxCount > vertexCount) || (imDrawData->TotalIdxCount > indexCount)) {
+			return;
+		}
+
+		ImDrawVert* vtxDst = (ImDrawVert*)vertexBuffer.mapped + region * vertexCount;
+		ImDrawIdx* idxDst = (ImDrawIdx*)indexBuffer.mapped + region * indexCount;
 
 		for (int n = 0; n < imDrawData->CmdListsCount; n++) {
 			const ImDrawList* cmd_list = imDrawData->CmdLists[n];
@@ -326,17 +349,16 @@ namespace vks
 		// Flush to make writes visible to GPU
 		vertexBuffer.flush();
 		indexBuffer.flush();
-
-		return updateCmdBuffers;
 	}
 
-	void UIOverlay::draw(const VkCommandBuffer commandBuffer)
+	/** Draw the imGui elements from a region of the vertex and index buffer (e.g. the swap chain image the command buffer renders to) */
+	void UIOverlay::draw(const VkCommandBuffer commandBuffer, uint32_t region)
 	{
 		ImDrawData* imDrawData = ImGui::GetDrawData();
 		int32_t vertexOffset = 0;
 		int32_t indexOffset = 0;
 
-		if ((!imDrawData) || (imDrawData->CmdListsCount == 0)) {
+		if ((!imDrawData) || (imDrawData->CmdListsCount == 0) || (region >= bufferRegionCount)) {
 			return;
 		}
 
@@ -349,9 +371,9 @@ namespace vks
 		pushConstBlock.translate = glm::vec2(-1.0f);
 		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
 
-		VkDeviceSize offsets[1] = { 0 };
+		VkDeviceSize offsets[1] = { (VkDeviceSize)region * vertexCount * sizeof(ImDrawVert) };
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer.buffer, offsets);
-		vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, (VkDeviceSize)region * indexCount * sizeof(ImDrawIdx), VK_INDEX_TYPE_UINT16);
 
 		for (int32_t i = 0; i < imDrawData->CmdListsCount; i++)
 		{
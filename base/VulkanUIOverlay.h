@@ -39,10 +39,16 @@ namespace vks
 		VkSampleCountFlagBits rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 		uint32_t subpass = 0;
 
+		// The vertex and index buffer hold one region per swap chain image, so the geometry drawn by one image
+		// can be rewritten while the frames of the other images are still in flight
 		vks::Buffer vertexBuffer;
 		vks::Buffer indexBuffer;
+		// Vertices and indices per region
 		int32_t vertexCount = 0;
 		int32_t indexCount = 0;
+		// Number of regions the buffers are created with (usually the swap chain image count)
+		uint32_t regionCount = 1;
+		uint32_t bufferRegionCount = 0;
 
 		std::vector<VkPipelineShaderStageCreateInfo> shaders;
 
@@ -72,8 +78,10 @@ namespace vks
 		void preparePipeline(const VkPipelineCache pipelineCache, const VkRenderPass renderPass);
 		void prepareResources();
 
+		bool bufferResizeRequired() const;
 		bool update();
-		void draw(const VkCommandBuffer commandBuffer);
+		void upload(uint32_t region);
+		void draw(const VkCommandBuffer commandBuffer, uint32_t region);
 		void resize(uint32_t width, uint32_t height);
 
 		void freeResources();
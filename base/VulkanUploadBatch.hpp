@@ -0,0 +1,320 @@
+/*
+* Vulkan upload batching
+*
+* Collects staging copies from several loaders into a single command buffer that is
+* submitted once, with staging memory taken from a ring of persistently mapped chunks
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <assert.h>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.hpp"
+#include "VulkanBuffer.hpp"
+
+namespace vks
+{
+	/** @brief Identifies a submitted upload batch, see UploadBatch::isComplete and UploadBatch::wait */
+	struct UploadToken
+	{
+		uint64_t serial = 0;
+
+		UploadToken() {};
+		explicit UploadToken(uint64_t serial) : serial(serial) {};
+	};
+
+	/**
+	* @brief Records buffer and image uploads from multiple loaders into one command buffer
+	*
+	* @note Destination resources must not be used by the GPU before the batch has been submitted
+	* @note Command buffers are allocated from the device's default command pool, so the queue passed in must belong to the same family
+	*/
+	class UploadBatch
+	{
+	private:
+		/** @brief Persistently mapped staging buffer, reused once all submissions reading from it have completed */
+		struct StagingChunk
+		{
+			vks::Buffer buffer;
+			VkDeviceSize head = 0;
+			uint64_t lastSerial = 0;
+		};
+
+		struct Submission
+		{
+			uint64_t serial;
+			VkFence fence;
+			VkCommandBuffer commandBuffer;
+		};
+
+		vks::VulkanDevice *device = nullptr;
+		VkQueue queue = VK_NULL_HANDLE;
+		VkDeviceSize chunkSize = 0;
+
+		std::vector<StagingChunk*> chunks;
+		StagingChunk *currentChunk = nullptr;
+		std::vector<Submission> pending;
+		std::vector<VkFence> freeFences;
+
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		uint64_t submittedSerial = 0;
+		uint64_t completedSerial = 0;
+
+		static VkDeviceSize alignOffset(VkDeviceSize offset, VkDeviceSize alignment)
+		{
+			return (offset + alignment - 1) / alignment * alignment;
+		}
+
+		/** @brief Least common multiple, used to combine alignments that aren't powers of two */
+		static VkDeviceSize leastCommonMultiple(VkDeviceSize a, VkDeviceSize b)
+		{
+			VkDeviceSize x = a, y = b;
+			while (y != 0)
+			{
+				const VkDeviceSize r = x % y;
+				x = y;
+				y = r;
+			}
+			return a / x * b;
+		}
+
+		/** @brief Release command buffers and fences of all submissions the GPU has finished with */
+		void retire()
+		{
+			for (auto it = pending.begin(); it != pending.end();)
+			{
+				if (vkGetFenceStatus(device->logicalDevice, it->fence) != VK_SUCCESS)
+				{
+					++it;
+					continue;
+				}
+				completedSerial = std::max(completedSerial, it->serial);
+				vkFreeCommandBuffers(device->logicalDevice, device->commandPool, 1, &it->commandBuffer);
+				VK_CHECK_RESULT(vkResetFences(device->logicalDevice, 1, &it->fence));
+				freeFences.push_back(it->fence);
+				it = pending.erase(it);
+			}
+		}
+
+		/** @brief Find a chunk with room for the given range, recycling chunks whose uploads have completed */
+		StagingChunk* acquireChunk(VkDeviceSize size, VkDeviceSize alignment)
+		{
+			if (currentChunk && alignOffset(currentChunk->head, alignment) + size <= currentChunk->buffer.size)
+			{
+				return currentChunk;
+			}
+			retire();
+			for (auto chunk : chunks)
+			{
+				if ((chunk != currentChunk) && (chunk->lastSerial <= completedSerial) && (size <= chunk->buffer.size))
+				{
+					chunk->head = 0;
+					currentChunk = chunk;
+					return chunk;
+				}
+			}
+			StagingChunk *chunk = new StagingChunk();
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&chunk->buffer,
+				std::max(size, chunkSize)));
+			VK_CHECK_RESULT(chunk->buffer.map());
+			chunks.push_back(chunk);
+			currentChunk = chunk;
+			return chunk;
+		}
+
+	public:
+		/** @brief Number of copy commands recorded since the last submit */
+		uint32_t copyCount = 0;
+
+		/**
+		* Create an upload batch
+		*
+		* @param device Device that owns the destination resources
+		* @param queue Queue the batch is submitted to (must support transfer)
+		* @param chunkSize (Optional) Size of a single staging chunk, larger uploads get a chunk of their own (defaults to 16 MiB)
+		*/
+		UploadBatch(vks::VulkanDevice *device, VkQueue queue, VkDeviceSize chunkSize = 16 * 1024 * 1024)
+		{
+			this->device = device;
+			this->queue = queue;
+			this->chunkSize = chunkSize;
+		}
+
+		~UploadBatch()
+		{
+			// Also submits anything that is still being recorded
+			flush();
+			for (auto chunk : chunks)
+			{
+				chunk->buffer.destroy();
+				delete chunk;
+			}
+			for (auto fence : freeFences)
+			{
+				vkDestroyFence(device->logicalDevice, fence, nullptr);
+			}
+		}
+
+		UploadBatch(const UploadBatch&) = delete;
+		UploadBatch& operator=(const UploadBatch&) = delete;
+
+		/** @brief Command buffer the current batch is recorded to, can be used for additional commands like mip map blits */
+		VkCommandBuffer getCommandBuffer()
+		{
+			if (commandBuffer == VK_NULL_HANDLE)
+			{
+				commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			}
+			return commandBuffer;
+		}
+
+		/**
+		* Reserve staging memory that stays valid until the batch has been executed
+		*
+		* @param size Size of the range in bytes
+		* @param alignment Required alignment of the range's offset inside the staging buffer
+		* @param buffer Returns the staging buffer to copy from
+		* @param offset Returns the offset of the range inside the staging buffer
+		*
+		* @return Host pointer to the reserved range
+		*/
+		void* stage(VkDeviceSize size, VkDeviceSize alignment, VkBuffer *buffer, VkDeviceSize *offset)
+		{
+			StagingChunk *chunk = acquireChunk(size, alignment);
+			*offset = alignOffset(chunk->head, alignment);
+			*buffer = chunk->buffer.buffer;
+			chunk->head = *offset + size;
+			chunk->lastSerial = submittedSerial + 1;
+			return static_cast<uint8_t*>(chunk->buffer.mapped) + *offset;
+		}
+
+		/**
+		* Copy host data into a buffer
+		*
+		* @param dst Destination buffer (must have been created with VK_BUFFER_USAGE_TRANSFER_DST_BIT)
+		* @param data Pointer to the data to copy, can be released once this call returns
+		* @param size Size of the data in bytes
+		* @param dstOffset (Optional) Byte offset into the destination buffer
+		*/
+		void copyToBuffer(VkBuffer dst, const void *data, VkDeviceSize size, VkDeviceSize dstOffset = 0)
+		{
+			VkBuffer stagingBuffer;
+			VkBufferCopy copyRegion{};
+			void *staged = stage(size, 4, &stagingBuffer, &copyRegion.srcOffset);
+			memcpy(staged, data, size);
+			copyRegion.dstOffset = dstOffset;
+			copyRegion.size = size;
+			vkCmdCopyBuffer(getCommandBuffer(), stagingBuffer, dst, 1, &copyRegion);
+			copyCount++;
+		}
+
+		/**
+		* Copy host data into an image and transition it to its final layout
+		*
+		* @param image Destination image (must have been created with VK_IMAGE_USAGE_TRANSFER_DST_BIT and be in undefined layout)
+		* @param data Pointer to the data to copy, can be released once this call returns
+		* @param size Size of the data in bytes
+		* @param regions Copy regions with buffer offsets relative to data
+		* @param subresourceRange Subresources covered by the copy
+		* @param finalLayout Layout the image is transitioned to after the copy
+		* @param blockSize Size of a texel (or compressed block) of the image's format in bytes
+		*/
+		void copyToImage(VkImage image, const void *data, VkDeviceSize size, std::vector<VkBufferImageCopy> regions, VkImageSubresourceRange subresourceRange, VkImageLayout finalLayout, VkDeviceSize blockSize)
+		{
+			// Buffer offsets of image copies must be a multiple of the texel block size and of 4
+			assert(blockSize > 0);
+			const VkDeviceSize alignment = leastCommonMultiple(leastCommonMultiple(blockSize, 4), std::max<VkDeviceSize>(device->properties.limits.optimalBufferCopyOffsetAlignment, 1));
+			VkBuffer stagingBuffer;
+			VkDeviceSize stagingOffset;
+			void *staged = stage(size, alignment, &stagingBuffer, &stagingOffset);
+			memcpy(staged, data, size);
+			for (auto &region : regions)
+			{
+				region.bufferOffset += stagingOffset;
+			}
+
+			VkCommandBuffer cmd = getCommandBuffer();
+			vks::tools::setImageLayout(cmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+			vkCmdCopyBufferToImage(cmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+			if (finalLayout != VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+			{
+				vks::tools::setImageLayout(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, finalLayout, subresourceRange);
+			}
+			copyCount++;
+		}
+
+		/**
+		* Submit all recorded uploads without waiting for them
+		*
+		* @return Token that can be used to check for or wait on completion of this submission
+		*/
+		UploadToken submit()
+		{
+			if (commandBuffer == VK_NULL_HANDLE)
+			{
+				return UploadToken{ submittedSerial };
+			}
+			VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+
+			retire();
+			VkFence fence;
+			if (freeFences.empty())
+			{
+				VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
+				VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceInfo, nullptr, &fence));
+			}
+			else
+			{
+				fence = freeFences.back();
+				freeFences.pop_back();
+			}
+
+			VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &commandBuffer;
+			VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+
+			submittedSerial++;
+			pending.push_back({ submittedSerial, fence, commandBuffer });
+			commandBuffer = VK_NULL_HANDLE;
+			copyCount = 0;
+			return UploadToken{ submittedSerial };
+		}
+
+		/** @brief Returns true if the GPU has finished the submission identified by token */
+		bool isComplete(UploadToken token)
+		{
+			retire();
+			return token.serial <= completedSerial;
+		}
+
+		/** @brief Block until the submission identified by token has been executed */
+		void wait(UploadToken token)
+		{
+			for (auto &submission : pending)
+			{
+				if (submission.serial <= token.serial)
+				{
+					VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &submission.fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT));
+				}
+			}
+			retire();
+		}
+
+		/** @brief Submit all recorded uploads and wait for them to finish */
+		void flush()
+		{
+			wait(submit());
+		}
+	};
+}
@@ -0,0 +1,195 @@
+/*
+* Vertex attribute quantization
+*
+* Conversion of float vertex attributes to compact GPU vertex formats: half floats, normalized 16 and 8 bit integers
+* and octahedral encoded unit vectors
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <cfloat>
+
+namespace vks
+{
+	namespace quantization
+	{
+		/** @brief Convert a float to an IEEE 754 half float (round to nearest even, out of range values become infinity) */
+		inline uint16_t floatToHalf(float value)
+		{
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			const uint32_t sign = (bits >> 16) & 0x8000;
+			const uint32_t absolute = bits & 0x7fffffff;
+			// NaN and infinity
+			if (absolute >= 0x7f800000)
+			{
+				return static_cast<uint16_t>(sign | 0x7c00 | ((absolute > 0x7f800000) ? 0x200 : 0));
+			}
+			// Too large, becomes infinity
+			if (absolute >= 0x477ff000)
+			{
+				return static_cast<uint16_t>(sign | 0x7c00);
+			}
+			// Normalized half float
+			if (absolute >= 0x38800000)
+			{
+				const uint32_t rounded = absolute + 0xfff + ((absolute >> 13) & 1);
+				return static_cast<uint16_t>(sign | ((rounded - 0x38000000) >> 13));
+			}
+			// Denormalized half float or zero
+			float magnitude;
+			memcpy(&magnitude, &absolute, sizeof(magnitude));
+			return static_cast<uint16_t>(sign | static_cast<uint32_t>(std::nearbyint(magnitude * 16777216.0f)));
+		}
+
+		/** @brief Convert a value in [-1, 1] to a signed normalized 16 bit integer */
+		inline int16_t packSnorm16(float value)
+		{
+			return static_cast<int16_t>(std::lround(std::max(-1.0f, std::min(value, 1.0f)) * 32767.0f));
+		}
+
+		/** @brief Convert a value in [0, 1] to an unsigned normalized 16 bit integer */
+		inline uint16_t packUnorm16(float value)
+		{
+			return static_cast<uint16_t>(std::lround(std::max(0.0f, std::min(value, 1.0f)) * 65535.0f));
+		}
+
+		/** @brief Convert a value in [0, 1] to an unsigned normalized 8 bit integer */
+		inline uint8_t packUnorm8(float value)
+		{
+			return static_cast<uint8_t>(std::lround(std::max(0.0f, std::min(value, 1.0f)) * 255.0f));
+		}
+
+		/**
+		* Encode a unit vector with an octahedral mapping to two signed normalized 16 bit integers
+		*
+		* @param v Unit vector to encode, a zero vector is encoded as (0, 0, 1)
+		* @param encoded Returns the two components, decode in the shader with n = vec3(e.xy, 1 - |e.x| - |e.y|), n.xy = (n.z < 0) ? (1 - |n.yx|) * sign(n.xy) : n.xy, normalize(n)
+		*/
+		inline void octEncode(const float v[3], int16_t encoded[2])
+		{
+			const float length = std::fabs(v[0]) + std::fabs(v[1]) + std::fabs(v[2]);
+			if (length == 0.0f)
+			{
+				encoded[0] = encoded[1] = 0;
+				return;
+			}
+			float x = v[0] / length;
+			float y = v[1] / length;
+			if (v[2] < 0.0f)
+			{
+				// Fold the lower hemisphere over the diagonals
+				const float fx = (1.0f - std::fabs(y)) * ((x >= 0.0f) ? 1.0f : -1.0f);
+				const float fy = (1.0f - std::fabs(x)) * ((y >= 0.0f) ? 1.0f : -1.0f);
+				x = fx;
+				y = fy;
+			}
+			encoded[0] = packSnorm16(x);
+			encoded[1] = packSnorm16(y);
+		}
+
+		/** @brief Inverse of octEncode, used to check precision */
+		inline void octDecode(const int16_t encoded[2], float v[3])
+		{
+			float x = std::max(encoded[0] / 32767.0f, -1.0f);
+			float y = std::max(encoded[1] / 32767.0f, -1.0f);
+			const float z = 1.0f - std::fabs(x) - std::fabs(y);
+			if (z < 0.0f)
+			{
+				const float fx = (1.0f - std::fabs(y)) * ((x >= 0.0f) ? 1.0f : -1.0f);
+				const float fy = (1.0f - std::fabs(x)) * ((y >= 0.0f) ? 1.0f : -1.0f);
+				x = fx;
+				y = fy;
+			}
+			const float length = std::sqrt(x * x + y * y + z * z);
+			v[0] = x / length;
+			v[1] = y / length;
+			v[2] = z / length;
+		}
+
+		/**
+		* Convert four weights to unsigned normalized 8 bit integers that still add up to exactly one
+		* The rounding error is assigned to the largest weight
+		*/
+		inline void packWeights(const float weights[4], uint8_t packed[4])
+		{
+			const float sum = weights[0] + weights[1] + weights[2] + weights[3];
+			const float scale = (sum > 0.0f) ? 1.0f / sum : 0.0f;
+			int total = 0;
+			int largest = 0;
+			for (int i = 0; i < 4; i++)
+			{
+				packed[i] = packUnorm8(weights[i] * scale);
+				total += packed[i];
+				if (weights[i] > weights[largest])
+				{
+					largest = i;
+				}
+			}
+			if (sum > 0.0f)
+			{
+				packed[largest] = static_cast<uint8_t>(packed[largest] + 255 - total);
+			}
+		}
+
+		/**
+		* Maps values inside an axis aligned range to [-1, 1] (snorm) or [0, 1] (unorm) and back
+		* Shaders reconstruct the original value with decoded * scale + offset
+		*/
+		template<int N>
+		struct Range
+		{
+			float min[N];
+			float max[N];
+
+			Range()
+			{
+				for (int i = 0; i < N; i++)
+				{
+					min[i] = FLT_MAX;
+					max[i] = -FLT_MAX;
+				}
+			}
+
+			void add(const float *v)
+			{
+				for (int i = 0; i < N; i++)
+				{
+					min[i] = std::min(min[i], v[i]);
+					max[i] = std::max(max[i], v[i]);
+				}
+			}
+
+			bool empty() const
+			{
+				return min[0] > max[0];
+			}
+
+			/** @brief Offset and per component scale for snorm encoded values */
+			void snormTransform(float offset[N], float scale[N]) const
+			{
+				for (int i = 0; i < N; i++)
+				{
+					offset[i] = empty() ? 0.0f : (min[i] + max[i]) * 0.5f;
+					scale[i] = (empty() || (max[i] <= min[i])) ? 1.0f : (max[i] - min[i]) * 0.5f;
+				}
+			}
+
+			/** @brief Offset and per component scale for unorm encoded values */
+			void unormTransform(float offset[N], float scale[N]) const
+			{
+				for (int i = 0; i < N; i++)
+				{
+					offset[i] = empty() ? 0.0f : min[i];
+					scale[i] = (empty() || (max[i] <= min[i])) ? 1.0f : max[i] - min[i];
+				}
+			}
+		};
+	}
+}
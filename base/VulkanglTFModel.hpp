@@ -12,9 +12,19 @@
 #include <string>
 #include <fstream>
 #include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <numeric>
 
 #include "vulkan/vulkan.h"
 #include "VulkanDevice.hpp"
+#include "VulkanUploadBatch.hpp"
+#include "VulkanModelCache.hpp"
+#include "VulkanMeshOptimizer.hpp"
+#include "VulkanMeshSimplifier.hpp"
+#include "VulkanVertexQuantization.hpp"
+#include "jobsystem.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -23,6 +33,8 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <gli/gli.hpp>
 
+#include "frustum.hpp"
+
 #define TINYGLTF_IMPLEMENTATION
 #define STB_IMAGE_IMPLEMENTATION
 #include "tiny_gltf.h"
@@ -33,6 +45,31 @@
 
 namespace vkglTF
 {
+	/*
+		Optional processing steps for loadFromFile
+	*/
+	enum FileLoadingFlags {
+		None = 0x00000000,
+		// Reorder the indices and vertices of each primitive for vertex cache efficiency, overdraw and vertex fetch locality (see vks::meshopt)
+		OptimizeMeshes = 0x00000001,
+		// Store vertices as Model::PackedVertex instead of Model::Vertex (see Model::getVertexInputAttributes)
+		PackVertices = 0x00000002,
+		// Generate simplified levels of detail for each primitive (see Model::generateLods and Model::selectLods)
+		GenerateLods = 0x00000004
+	};
+
+	/*
+		Options for the draw functions of Model
+		Without any of the Render*Nodes flags, primitives of all alpha modes are drawn
+	*/
+	enum RenderFlags {
+		// Bind the material descriptor sets to set bindImageSet of the passed pipeline layout
+		BindImages = 0x00000001,
+		RenderOpaqueNodes = 0x00000002,
+		RenderAlphaMaskedNodes = 0x00000004,
+		RenderAlphaBlendedNodes = 0x00000008
+	};
+
 	struct Node;
 
 	/*
@@ -42,7 +79,7 @@ namespace vkglTF
 		vks::VulkanDevice *device;
 		VkImage image;
 		VkImageLayout imageLayout;
-		VkDeviceMemory deviceMemory;
+		vks::Allocation allocation;
 		VkImageView view;
 		uint32_t width, height;
 		uint32_t mipLevels;
@@ -61,18 +98,16 @@ namespace vkglTF
 		{
 			vkDestroyImageView(device->logicalDevice, view, nullptr);
 			vkDestroyImage(device->logicalDevice, image, nullptr);
-			vkFreeMemory(device->logicalDevice, deviceMemory, nullptr);
+			allocation.free();
 			vkDestroySampler(device->logicalDevice, sampler, nullptr);
 		}
 
 		/*
 			Load a texture from a glTF image (stored as vector of chars loaded via stb_image)
-			Also generates the mip chain as glTF images are stored as jpg or png without any mips
+			If an upload batch is passed, the texture must not be used before that batch has been submitted
 		*/
-		void fromglTfImage(tinygltf::Image &gltfimage, vks::VulkanDevice *device, VkQueue copyQueue)
+		void fromglTfImage(tinygltf::Image &gltfimage, vks::VulkanDevice *device, VkQueue copyQueue, vks::UploadBatch *batch = nullptr)
 		{
-			this->device = device;
-
 			unsigned char* buffer = nullptr;
 			VkDeviceSize bufferSize = 0;
 			bool deleteBuffer = false;
@@ -97,42 +132,35 @@ namespace vkglTF
 				bufferSize = gltfimage.image.size();
 			}
 
+			fromRGBA(buffer, bufferSize, gltfimage.width, gltfimage.height, device, copyQueue, batch);
+
+			// Image data has been copied into staging memory
+			if (deleteBuffer) {
+				delete[] buffer;
+			}
+		}
+
+		/*
+			Load a texture from decoded RGBA8 pixels (e.g. a glTF image or the baked model cache)
+			Also generates the mip chain as glTF images are stored as jpg or png without any mips
+			If an upload batch is passed, the texture must not be used before that batch has been submitted
+		*/
+		void fromRGBA(const unsigned char *buffer, VkDeviceSize bufferSize, uint32_t width, uint32_t height, vks::VulkanDevice *device, VkQueue copyQueue, vks::UploadBatch *batch = nullptr)
+		{
+			this->device = device;
+
 			VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
 
 			VkFormatProperties formatProperties;
 
-			width = gltfimage.width;
-			height = gltfimage.height;
+			this->width = width;
+			this->height = height;
 			mipLevels = static_cast<uint32_t>(floor(log2(std::max(width, height))) + 1.0);
 
 			vkGetPhysicalDeviceFormatProperties(device->physicalDevice, format, &formatProperties);
 			assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT);
 			assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
 
-			VkMemoryAllocateInfo memAllocInfo{};
-			memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-			VkMemoryRequirements memReqs{};
-
-			VkBuffer stagingBuffer;
-			VkDeviceMemory stagingMemory;
-
-			VkBufferCreateInfo bufferCreateInfo{};
-			bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-			bufferCreateInfo.size = bufferSize;
-			bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-			bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-			VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-			vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-			memAllocInfo.allocationSize = memReqs.size;
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-			VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-			uint8_t *data;
-			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
-			memcpy(data, buffer, bufferSize);
-			vkUnmapMemory(device->logicalDevice, stagingMemory);
-
 			VkImageCreateInfo imageCreateInfo{};
 			imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 			imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -147,31 +175,17 @@ namespace vkglTF
 			imageCreateInfo.extent = { width, height, 1 };
 			imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
-			vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-			memAllocInfo.allocationSize = memReqs.size;
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+			VK_CHECK_RESULT(device->allocateImageMemory(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &allocation));
 
-			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			// Copy and mip chain generation are recorded into the caller's upload batch, or into one that is owned (and submitted) by this call
+			vks::UploadBatch localBatch(device, copyQueue, 0);
+			vks::UploadBatch *uploads = batch ? batch : &localBatch;
 
 			VkImageSubresourceRange subresourceRange = {};
 			subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 			subresourceRange.levelCount = 1;
 			subresourceRange.layerCount = 1;
 
-			{
-				VkImageMemoryBarrier imageMemoryBarrier{};
-				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				imageMemoryBarrier.srcAccessMask = 0;
-				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				imageMemoryBarrier.image = image;
-				imageMemoryBarrier.subresourceRange = subresourceRange;
-				vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-			}
-
 			VkBufferImageCopy bufferCopyRegion = {};
 			bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 			bufferCopyRegion.imageSubresource.mipLevel = 0;
@@ -181,27 +195,11 @@ namespace vkglTF
 			bufferCopyRegion.imageExtent.height = height;
 			bufferCopyRegion.imageExtent.depth = 1;
 
-			vkCmdCopyBufferToImage(copyCmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
-
-			{
-				VkImageMemoryBarrier imageMemoryBarrier{};
-				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-				imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-				imageMemoryBarrier.image = image;
-				imageMemoryBarrier.subresourceRange = subresourceRange;
-				vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-			}
-
-			device->flushCommandBuffer(copyCmd, copyQueue, true);
-
-			vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-			vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+			// The first mip level is the source for the blits below
+			uploads->copyToImage(image, buffer, bufferSize, { bufferCopyRegion }, subresourceRange, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, 4 /* R8G8B8A8 */);
 
 			// Generate the mip chain (glTF uses jpg and png, so we need to create this manually)
-			VkCommandBuffer blitCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			VkCommandBuffer blitCmd = uploads->getCommandBuffer();
 			for (uint32_t i = 1; i < mipLevels; i++) {
 				VkImageBlit imageBlit{};
 
@@ -267,7 +265,8 @@ namespace vkglTF
 				vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
 			}
 
-			device->flushCommandBuffer(blitCmd, copyQueue, true);
+			// Without a batch passed in, the upload is submitted right away
+			localBatch.flush();
 
 			VkSamplerCreateInfo samplerInfo{};
 			samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -332,7 +331,15 @@ namespace vkglTF
 	struct Primitive {
 		uint32_t firstIndex;
 		uint32_t indexCount;
+		uint32_t firstVertex = 0;
+		uint32_t vertexCount = 0;
+		// Added to the indices when drawing, 16 bit indices are stored relative to the primitive's first vertex
+		int32_t vertexOffset = 0;
 		Material &material;
+		// Simplified index ranges in decreasing detail, level 0 is the full detail range above
+		std::vector<vks::meshopt::LodLevel> lods;
+		// Level of detail to draw, set by Model::selectLods
+		uint32_t lod = 0;
 
 		struct Dimensions {
 			glm::vec3 min = glm::vec3(FLT_MAX);
@@ -351,50 +358,41 @@ namespace vkglTF
 		}
 
 		Primitive(uint32_t firstIndex, uint32_t indexCount, Material &material) : firstIndex(firstIndex), indexCount(indexCount), material(material) {};
+
+		uint32_t lodFirstIndex() const {
+			return (lod == 0) ? firstIndex : lods[lod - 1].firstIndex;
+		}
+
+		uint32_t lodIndexCount() const {
+			return (lod == 0) ? indexCount : lods[lod - 1].indexCount;
+		}
+	};
+
+	/*
+		Transform to reconstruct packed vertex attributes in the shader, position = decoded.xyz * positionScale.xyz + positionOffset.xyz and uv = decoded * uvTransform.zw + uvTransform.xy
+		Identity for models with float vertices
+	*/
+	struct VertexQuantization {
+		glm::vec4 positionOffset = glm::vec4(0.0f);
+		glm::vec4 positionScale = glm::vec4(1.0f);
+		glm::vec4 uvTransform = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
 	};
 
 	/*
 		glTF mesh
 	*/
 	struct Mesh {
-		vks::VulkanDevice *device;
-
 		std::vector<Primitive*> primitives;
 		std::string name;
 
-		struct UniformBuffer {
-			VkBuffer buffer;
-			VkDeviceMemory memory;
-			VkDescriptorBufferInfo descriptor;
-			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
-			void *mapped;
-		} uniformBuffer;
-
-		struct UniformBlock {
-			glm::mat4 matrix;
-			glm::mat4 jointMatrix[64]{};
-			float jointcount{ 0 };
-		} uniformBlock;
-
-		Mesh(vks::VulkanDevice *device, glm::mat4 matrix) {
-			this->device = device;
-			this->uniformBlock.matrix = matrix;
-			VK_CHECK_RESULT(device->createBuffer(
-				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				sizeof(uniformBlock),
-				&uniformBuffer.buffer,
-				&uniformBuffer.memory,
-				&uniformBlock));
-			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, uniformBuffer.memory, 0, sizeof(uniformBlock), 0, &uniformBuffer.mapped));
-			uniformBuffer.descriptor = { uniformBuffer.buffer, 0, sizeof(uniformBlock) };
-		};
-
-		~Mesh() {
-			vkDestroyBuffer(device->logicalDevice, uniformBuffer.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, uniformBuffer.memory, nullptr);
-		}
-
+		// Slot of the mesh in the model's mesh storage, passed as firstInstance to all draws of the mesh's primitives
+		uint32_t index = 0;
+		// Number of joint matrices stored after the mesh matrix (0 for meshes without skin)
+		uint32_t jointCount = 0;
+		// Mapped mesh storage of this mesh, the world matrix followed by jointCount joint matrices (see Model::prepareMeshStorage)
+		glm::mat4 *matrices = nullptr;
+		// Packed vertices of all primitives of the mesh are quantized relative to the mesh's bounds
+		VertexQuantization quantization;
 	};
 
 	/*
@@ -405,6 +403,107 @@ namespace vkglTF
 		Node *skeletonRoot = nullptr;
 		std::vector<glm::mat4> inverseBindMatrices;
 		std::vector<Node*> joints;
+		// First matrix of this skin's joints in an instance's joint palette (see Model::evaluateInstances)
+		uint32_t paletteOffset = 0;
+		// Bounding box of the joint positions in the bind pose, in the space of the skinned meshes (see Model::pushCullBounds)
+		glm::vec3 bindJointMin = glm::vec3(0.0f);
+		glm::vec3 bindJointMax = glm::vec3(0.0f);
+	};
+
+	/*
+		Flattened transform hierarchy of all nodes of a model
+		Nodes are stored in topological order (parents before their children) as separate arrays per attribute,
+		so world matrices can be updated with a single forward pass that only touches nodes whose local transform or parent changed
+	*/
+	struct NodeHierarchy {
+		// Index of the parent node, -1 for root nodes
+		std::vector<int32_t> parents;
+		std::vector<glm::vec3> translations;
+		std::vector<glm::quat> rotations;
+		std::vector<glm::vec3> scales;
+		std::vector<glm::mat4> matrices;
+		std::vector<glm::mat4> worldMatrices;
+		// Local transform has changed since the last update
+		std::vector<uint8_t> dirty;
+		// World matrix has been recalculated by the last update, used to propagate changes to the children
+		std::vector<uint8_t> updated;
+		// World matrix has changed since the last clearChanged call, so consumers of world matrices (e.g. the mesh storage) don't miss updates triggered by someone else
+		std::vector<uint8_t> changed;
+		bool anyDirty = false;
+		bool anyChanged = false;
+
+		uint32_t add(int32_t parent, const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale, const glm::mat4 &matrix) {
+			assert(parent < static_cast<int32_t>(parents.size()));
+			parents.push_back(parent);
+			translations.push_back(translation);
+			rotations.push_back(rotation);
+			scales.push_back(scale);
+			matrices.push_back(matrix);
+			worldMatrices.push_back(glm::mat4(1.0f));
+			dirty.push_back(1);
+			updated.push_back(0);
+			changed.push_back(0);
+			anyDirty = true;
+			return static_cast<uint32_t>(parents.size() - 1);
+		}
+
+		void clear() {
+			parents.clear();
+			translations.clear();
+			rotations.clear();
+			scales.clear();
+			matrices.clear();
+			worldMatrices.clear();
+			dirty.clear();
+			updated.clear();
+			changed.clear();
+			anyDirty = false;
+			anyChanged = false;
+		}
+
+		void markDirty(uint32_t index) {
+			dirty[index] = 1;
+			anyDirty = true;
+		}
+
+		glm::mat4 localMatrix(uint32_t index) const {
+			return glm::translate(glm::mat4(1.0f), translations[index]) * glm::mat4(rotations[index]) * glm::scale(glm::mat4(1.0f), scales[index]) * matrices[index];
+		}
+
+		/*
+			Recalculate the world matrices of all dirty nodes and their descendants
+			Returns true if any world matrix has changed, the affected nodes are flagged in changed until clearChanged is called
+		*/
+		bool update() {
+			if (!anyDirty) {
+				return false;
+			}
+			for (size_t i = 0; i < parents.size(); i++) {
+				const int32_t parent = parents[i];
+				// Parents come first, so their updated flag is already set for this pass
+				if (dirty[i] || ((parent > -1) && updated[parent])) {
+					worldMatrices[i] = (parent > -1) ? worldMatrices[parent] * localMatrix(i) : localMatrix(i);
+					updated[i] = 1;
+					changed[i] = 1;
+				} else {
+					updated[i] = 0;
+				}
+				dirty[i] = 0;
+			}
+			anyDirty = false;
+			anyChanged = true;
+			return true;
+		}
+
+		/*
+			Reset the changed flags once all world matrix changes have been consumed
+		*/
+		void clearChanged() {
+			if (anyChanged) {
+				std::fill(changed.begin(), changed.end(), 0);
+				anyChanged = false;
+			}
+		}
 	};
 
 	/*
@@ -414,47 +513,97 @@ namespace vkglTF
 		Node *parent;
 		uint32_t index;
 		std::vector<Node*> children;
-		glm::mat4 matrix;
 		std::string name;
 		Mesh *mesh;
 		Skin *skin;
 		int32_t skinIndex = -1;
-		glm::vec3 translation{};
-		glm::vec3 scale{ 1.0f };
-		glm::quat rotation{};
+		// Local and world transforms are stored in the model's flattened hierarchy
+		NodeHierarchy *hierarchy = nullptr;
+		uint32_t hierarchyIndex = 0;
+
+		glm::vec3 getTranslation() const {
+			return hierarchy->translations[hierarchyIndex];
+		}
+
+		glm::quat getRotation() const {
+			return hierarchy->rotations[hierarchyIndex];
+		}
+
+		glm::vec3 getScale() const {
+			return hierarchy->scales[hierarchyIndex];
+		}
+
+		void setTranslation(const glm::vec3 &translation) {
+			if (hierarchy->translations[hierarchyIndex] != translation) {
+				hierarchy->translations[hierarchyIndex] = translation;
+				hierarchy->markDirty(hierarchyIndex);
+			}
+		}
+
+		void setRotation(const glm::quat &rotation) {
+			if (hierarchy->rotations[hierarchyIndex] != rotation) {
+				hierarchy->rotations[hierarchyIndex] = rotation;
+				hierarchy->markDirty(hierarchyIndex);
+			}
+		}
+
+		void setScale(const glm::vec3 &scale) {
+			if (hierarchy->scales[hierarchyIndex] != scale) {
+				hierarchy->scales[hierarchyIndex] = scale;
+				hierarchy->markDirty(hierarchyIndex);
+			}
+		}
 
 		glm::mat4 localMatrix() {
-			return glm::translate(glm::mat4(1.0f), translation) * glm::mat4(rotation) * glm::scale(glm::mat4(1.0f), scale) * matrix;
+			return hierarchy->localMatrix(hierarchyIndex);
 		}
 
+		/*
+			World matrix of the node, recalculates the hierarchy first if any local transform has changed
+			The changed flags are kept, so updateAnimation still writes the affected meshes
+		*/
 		glm::mat4 getMatrix() {
-			glm::mat4 m = localMatrix();
-			vkglTF::Node *p = parent;
-			while (p) {
-				m = p->localMatrix() * m;
-				p = p->parent;
+			hierarchy->update();
+			return hierarchy->worldMatrices[hierarchyIndex];
+		}
+
+		/*
+			Returns true if the world matrix of the node or of one of its skin's joints changed since the hierarchy's changed flags were last cleared
+		*/
+		bool transformChanged() const {
+			if (hierarchy->changed[hierarchyIndex]) {
+				return true;
+			}
+			if (skin) {
+				for (auto joint : skin->joints) {
+					if (hierarchy->changed[joint->hierarchyIndex]) {
+						return true;
+					}
+				}
+			}
+			return false;
+		}
+
+		/*
+			Write the node's world matrix (and joint matrices) to the model's mesh storage
+		*/
+		void updateMesh() {
+			glm::mat4 m = getMatrix();
+			mesh->matrices[0] = m;
+			if (skin) {
+				// Update join matrices
+				glm::mat4 inverseTransform = glm::inverse(m);
+				for (size_t i = 0; i < skin->joints.size(); i++) {
+					vkglTF::Node *jointNode = skin->joints[i];
+					glm::mat4 jointMat = hierarchy->worldMatrices[jointNode->hierarchyIndex] * skin->inverseBindMatrices[i];
+					mesh->matrices[1 + i] = inverseTransform * jointMat;
+				}
 			}
-			return m;
 		}
 
 		void update() {
 			if (mesh) {
-				glm::mat4 m = getMatrix();
-				if (skin) {
-					mesh->uniformBlock.matrix = m;
-					// Update join matrices
-					glm::mat4 inverseTransform = glm::inverse(m);
-					for (size_t i = 0; i < skin->joints.size(); i++) {
-						vkglTF::Node *jointNode = skin->joints[i];
-						glm::mat4 jointMat = jointNode->getMatrix() * skin->inverseBindMatrices[i];
-						jointMat = inverseTransform * jointMat;
-						mesh->uniformBlock.jointMatrix[i] = jointMat;
-					}
-					mesh->uniformBlock.jointcount = (float)skin->joints.size();
-					memcpy(mesh->uniformBuffer.mapped, &mesh->uniformBlock, sizeof(mesh->uniformBlock));
-				} else {
-					memcpy(mesh->uniformBuffer.mapped, &m, sizeof(glm::mat4));
-				}
+				updateMesh();
 			}
 
 			for (auto& child : children) {
@@ -480,6 +629,8 @@ namespace vkglTF
 		PathType path;
 		Node *node;
 		uint32_t samplerIndex;
+		// Keyframe interval found by the last update, playback usually stays in it or advances by one
+		uint32_t keyCursor = 0;
 	};
 
 	/*
@@ -488,8 +639,12 @@ namespace vkglTF
 	struct AnimationSampler {
 		enum InterpolationType { LINEAR, STEP, CUBICSPLINE };
 		InterpolationType interpolation;
-		std::vector<float> inputs;
-		std::vector<glm::vec4> outputsVec4;
+		// Keyframe times of this sampler in Animation::inputs
+		uint32_t inputOffset;
+		uint32_t keyCount;
+		// T/R/S values of this sampler in Animation::outputs, cubic spline samplers store in-tangent, value and out-tangent per keyframe
+		uint32_t outputOffset;
+		uint32_t outputCount;
 	};
 
 	/*
@@ -499,18 +654,42 @@ namespace vkglTF
 		std::string name;
 		std::vector<AnimationSampler> samplers;
 		std::vector<AnimationChannel> channels;
+		// Keyframe times and values of all samplers, stored back to back
+		std::vector<float> inputs;
+		std::vector<glm::vec4> outputs;
 		float start = std::numeric_limits<float>::max();
 		float end = std::numeric_limits<float>::min();
 	};
 
+	/*
+		Playback state of one animation clip on a model instance
+	*/
+	struct AnimationState {
+		uint32_t animation = 0;
+		float time = 0.0f;
+		// Relative weight when blending multiple states of an instance, states with a weight of zero are skipped
+		float weight = 1.0f;
+		// Keyframe interval per channel of the clip, maintained by Model::evaluateInstances
+		std::vector<uint32_t> keyCursors;
+	};
+
+	/*
+		Pose source of one instance of a model, all instances share the model's skeleton and animations
+	*/
+	struct AnimationInstance {
+		std::vector<AnimationState> states;
+	};
+
 	/*
 		glTF model loading and rendering class
 	*/
 	struct Model {
 
-		vks::VulkanDevice *device;
+		vks::VulkanDevice *device = nullptr;
 		VkDescriptorPool descriptorPool;
+		// Binding 0: MeshInfo array, binding 1: matrix array of the mesh storage (both storage buffers, vertex stage)
 		VkDescriptorSetLayout descriptorSetLayout;
+		VkDescriptorSet descriptorSet;
 
 		struct Vertex {
 			glm::vec3 pos;
@@ -520,18 +699,130 @@ namespace vkglTF
 			glm::vec4 weight0;
 		};
 
+		/*
+			Compact vertex (24 instead of 64 bytes) used with FileLoadingFlags::PackVertices
+			Positions are snorm16 and uvs unorm16 relative to the mesh's bounds (see Mesh::quantization), normals are octahedral encoded (see vks::quantization::octEncode)
+		*/
+		struct PackedVertex {
+			int16_t pos[4];
+			int16_t normal[2];
+			uint16_t uv[2];
+			uint8_t joint0[4];
+			uint8_t weight0[4];
+		};
+		// Set if the vertex buffer stores PackedVertex
+		bool packedVertices = false;
+
 		struct Vertices {
 			VkBuffer buffer;
-			VkDeviceMemory memory;
+			vks::Allocation allocation;
 		} vertices;
 		struct Indices {
 			int count;
 			VkBuffer buffer;
-			VkDeviceMemory memory;
+			vks::Allocation allocation;
+			// Type to bind the index buffer with, VK_INDEX_TYPE_UINT16 if the vertices of every primitive fit into 16 bit indices
+			VkIndexType type = VK_INDEX_TYPE_UINT32;
 		} indices;
 
 		std::vector<Node*> nodes;
 		std::vector<Node*> linearNodes;
+		NodeHierarchy hierarchy;
+
+		/*
+			Per mesh entry of the mesh storage, shaders look it up with the draw's instance index (gl_InstanceIndex)
+			The mesh matrix is stored at matrixOffset, followed by jointCount joint matrices
+		*/
+		struct MeshInfo {
+			uint32_t matrixOffset;
+			uint32_t jointCount;
+			uint32_t padding[2];
+			VertexQuantization quantization;
+		};
+
+		/*
+			Single host visible storage buffer with the MeshInfo array at the start and the matrices of all meshes after it
+		*/
+		struct MeshStorage {
+			VkBuffer buffer = VK_NULL_HANDLE;
+			vks::Allocation allocation;
+			VkDescriptorBufferInfo infoDescriptor;
+			VkDescriptorBufferInfo matrixDescriptor;
+			uint32_t meshCount = 0;
+			uint32_t matrixCount = 0;
+		} meshStorage;
+
+		/*
+			Primitive counts of the last culled draw (see draw with frustum and cullDrawList)
+			Draw calls and material binds are counted by all draw functions
+		*/
+		struct DrawStatistics {
+			uint32_t drawnPrimitives = 0;
+			uint32_t culledPrimitives = 0;
+			uint64_t drawnTriangles = 0;
+			uint64_t culledTriangles = 0;
+			uint32_t drawCalls = 0;
+			uint32_t materialBinds = 0;
+			// Drawn primitives using a simplified level of detail and the triangles the drawn primitives have at full detail
+			uint32_t reducedPrimitives = 0;
+			uint64_t fullDetailTriangles = 0;
+		} drawStatistics;
+
+		/*
+			Primitives of a draw list batch share their material, which is bound once for the whole batch
+		*/
+		struct DrawBatch {
+			Material *material;
+			uint32_t firstCommand;
+			uint32_t commandCount;
+			// Number of commands of the batch with a non zero instance count, batches without any are skipped
+			uint32_t visibleCount;
+		};
+
+		/*
+			Draw list compiled after loading (see buildDrawList and drawIndirect)
+			Holds one indirect command per primitive, sorted by alpha mode and material, in a persistently mapped buffer
+		*/
+		struct DrawList {
+			std::vector<Node*> nodes;
+			std::vector<Primitive*> primitives;
+			std::vector<VkDrawIndexedIndirectCommand> commands;
+			std::vector<DrawBatch> batches;
+			// Batch index of each command
+			std::vector<uint32_t> commandBatches;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			vks::Allocation allocation;
+			VkDrawIndexedIndirectCommand *mapped = nullptr;
+			// Indirect draws need drawIndirectFirstInstance for the mesh slots, without it commands are issued as direct draws
+			bool indirect = false;
+			// Maximum number of commands per vkCmdDrawIndexedIndirect (1 without multiDrawIndirect)
+			uint32_t maxDrawCount = 1;
+			// Number of commands rewritten by the last cullDrawList call
+			uint32_t updatedCommands = 0;
+		} drawList;
+
+		// Scratch data for culled draws, world space bounds of all primitives in cullPrimitives order
+		vks::BoxBounds cullBounds;
+		std::vector<Primitive*> cullPrimitives;
+		std::vector<uint32_t> cullMeshIndices;
+		std::vector<uint32_t> cullVisibility;
+		// Material bound by the last draw call of draw, nullptr if none has been bound yet
+		const Material *boundMaterial = nullptr;
+
+		// Number of joint matrices per instance written by evaluateInstances (joints of all skins)
+		uint32_t jointPaletteSize = 0;
+
+		/*
+			Per thread scratch data for evaluating instance poses
+		*/
+		struct InstancePose {
+			std::vector<glm::vec3> translations;
+			std::vector<glm::vec4> rotations;
+			std::vector<glm::vec3> scales;
+			std::vector<glm::vec3> weights;
+			std::vector<glm::mat4> worldMatrices;
+		};
+		std::vector<InstancePose> instancePoses;
 
 		std::vector<Skin*> skins;
 
@@ -549,20 +840,206 @@ namespace vkglTF
 
 		bool metallicRoughnessWorkflow = true;
 
+		/*
+			Time spent loading the images of the last loadFromFile call (in ms)
+			Decode and convert are summed up over all worker threads, upload covers recording and (if not batched by the caller) executing the copies
+		*/
+		struct LoadTimings {
+			double decode = 0.0;
+			double convert = 0.0;
+			double upload = 0.0;
+			uint32_t threadCount = 0;
+		} loadTimings;
+
+		/*
+			Sections stored in the baked model cache
+			Besides the geometry the cache holds everything else loadFromFile takes from the glTF file (decoded images, materials, nodes, skins and animations), so a cache hit needs no parsing and no image decoding
+		*/
+		enum CacheSection {
+			CACHE_SECTION_VERTICES = 0,
+			CACHE_SECTION_INDICES = 1,
+			CACHE_SECTION_PRIMITIVES = 2,
+			CACHE_SECTION_QUANTIZATION = 3,
+			CACHE_SECTION_LODS = 4,
+			CACHE_SECTION_MODEL = 5,
+			CACHE_SECTION_DEPENDENCIES = 6,
+			CACHE_SECTION_STRINGS = 7,
+			CACHE_SECTION_IMAGES = 8,
+			CACHE_SECTION_IMAGE_DATA = 9,
+			CACHE_SECTION_MATERIALS = 10,
+			CACHE_SECTION_NODES = 11,
+			CACHE_SECTION_PRIMITIVE_INFOS = 12,
+			CACHE_SECTION_SKINS = 13,
+			CACHE_SECTION_SKIN_JOINTS = 14,
+			CACHE_SECTION_INVERSE_BIND_MATRICES = 15,
+			CACHE_SECTION_ANIMATIONS = 16,
+			CACHE_SECTION_ANIMATION_SAMPLERS = 17,
+			CACHE_SECTION_ANIMATION_CHANNELS = 18,
+			CACHE_SECTION_ANIMATION_INPUTS = 19,
+			CACHE_SECTION_ANIMATION_OUTPUTS = 20
+		};
+
+		/*
+			Name stored in the string section of the baked model cache
+		*/
+		struct BakedString {
+			uint32_t offset;
+			uint32_t length;
+		};
+
+		struct BakedModel {
+			uint32_t metallicRoughnessWorkflow;
+		};
+
+		/*
+			External buffer or image file of the glTF file (relative to its directory) with the hash of its contents
+			The cache key only covers the glTF file itself, so these are checked before a cache file is used
+		*/
+		struct BakedDependency {
+			BakedString uri;
+			uint64_t hash;
+		};
+
+		/*
+			Decoded RGBA8 image, dataOffset is the offset of the first byte in the image data section
+		*/
+		struct BakedImage {
+			uint32_t width;
+			uint32_t height;
+			uint64_t dataOffset;
+		};
+
+		/*
+			Texture indices are -1 for unused slots, the slots are stored in the order of materialTextureSlots
+		*/
+		struct BakedMaterial {
+			static const uint32_t textureSlotCount = 7;
+			uint32_t alphaMode;
+			float alphaCutoff;
+			float metallicFactor;
+			float roughnessFactor;
+			glm::vec4 baseColorFactor;
+			int32_t textures[textureSlotCount];
+		};
+
+		/*
+			Nodes are stored in hierarchy order (parents before their children), parent is an index into the stored nodes and -1 for root nodes
+			Nodes with a mesh have a primitiveCount of zero or more, their primitives are stored in linearNodes order
+		*/
+		struct BakedNode {
+			int32_t parent;
+			uint32_t index;
+			int32_t skinIndex;
+			int32_t primitiveCount;
+			BakedString name;
+			BakedString meshName;
+			glm::vec3 translation;
+			glm::quat rotation;
+			glm::vec3 scale;
+			glm::mat4 matrix;
+		};
+
+		/*
+			Material and bounds of a primitive, in the same order as the primitive ranges
+		*/
+		struct BakedPrimitive {
+			uint32_t material;
+			glm::vec3 min;
+			glm::vec3 max;
+		};
+
+		/*
+			Joints and skeleton root are referenced by their glTF node index
+		*/
+		struct BakedSkin {
+			BakedString name;
+			int32_t skeletonRoot;
+			uint32_t firstJoint;
+			uint32_t jointCount;
+			uint32_t firstInverseBindMatrix;
+			uint32_t inverseBindMatrixCount;
+		};
+
+		struct BakedAnimation {
+			BakedString name;
+			float start;
+			float end;
+			uint32_t firstSampler;
+			uint32_t samplerCount;
+			uint32_t firstChannel;
+			uint32_t channelCount;
+			uint32_t firstInput;
+			uint32_t inputCount;
+			uint32_t firstOutput;
+			uint32_t outputCount;
+		};
+
+		struct BakedAnimationSampler {
+			uint32_t interpolation;
+			uint32_t inputOffset;
+			uint32_t keyCount;
+			uint32_t outputOffset;
+			uint32_t outputCount;
+		};
+
+		struct BakedAnimationChannel {
+			uint32_t path;
+			uint32_t node;
+			uint32_t samplerIndex;
+		};
+
+		/*
+			Level of detail stored in the baked model cache, primitives are numbered in linearNodes order
+		*/
+		struct PrimitiveLod {
+			uint32_t primitive;
+			vks::meshopt::LodLevel level;
+		};
+
+		// Maximum number of simplified levels per primitive and the largest allowed simplification error relative to the primitive's bounding radius
+		uint32_t maxLodLevels = 4;
+		float maxLodError = 0.05f;
+
+		/*
+			Index and vertex range of a primitive, stored in the baked model cache in the order loadNode creates the primitives
+		*/
+		struct PrimitiveRange {
+			uint32_t firstIndex;
+			uint32_t indexCount;
+			uint32_t firstVertex;
+			uint32_t vertexCount;
+		};
+		std::vector<PrimitiveRange> primitiveRanges;
+		// Set if the last loadFromFile call restored the model from the baked model cache instead of parsing the glTF file
+		bool loadedFromCache = false;
+		// Cleared if loading had to skip parts of the glTF file (e.g. unsupported index types), the model is not written to the baked model cache then
+		bool cacheable = true;
+
+		// Vertex cache statistics of each primitive (in primitiveRanges order) before and after mesh optimization, only filled if optimized at load time and not taken from the baked model cache
+		std::vector<vks::meshopt::MeshReport> optimizationReports;
+
 		Model() {};
 
 		~Model() 
 		{
+			for (auto node : nodes) {
+				delete node;
+			}
+			// Models that have not been loaded (e.g. assembled on the CPU only) own no Vulkan objects
+			if (!device) {
+				return;
+			}
 			vkDestroyBuffer(device->logicalDevice, vertices.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, vertices.memory, nullptr);
+			vertices.allocation.free();
 			vkDestroyBuffer(device->logicalDevice, indices.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, indices.memory, nullptr);
+			indices.allocation.free();
 			for (auto texture : textures) {
 				texture.destroy();
 			}
-			for (auto node : nodes) {
-				delete node;
-			}
+			vkDestroyBuffer(device->logicalDevice, meshStorage.buffer, nullptr);
+			meshStorage.allocation.free();
+			vkDestroyBuffer(device->logicalDevice, drawList.buffer, nullptr);
+			drawList.allocation.free();
 			vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayout, nullptr);
 			vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
 		}
@@ -574,31 +1051,32 @@ namespace vkglTF
 			newNode->parent = parent;
 			newNode->name = node.name;
 			newNode->skinIndex = node.skin;
-			newNode->matrix = glm::mat4(1.0f);
 
 			// Generate local node matrix
 			glm::vec3 translation = glm::vec3(0.0f);
 			if (node.translation.size() == 3) {
 				translation = glm::make_vec3(node.translation.data());
-				newNode->translation = translation;
 			}
-			glm::mat4 rotation = glm::mat4(1.0f);
+			glm::quat rotation{};
 			if (node.rotation.size() == 4) {
-				glm::quat q = glm::make_quat(node.rotation.data());
-				newNode->rotation = glm::mat4(q);
+				rotation = glm::make_quat(node.rotation.data());
 			}
 			glm::vec3 scale = glm::vec3(1.0f);
 			if (node.scale.size() == 3) {
 				scale = glm::make_vec3(node.scale.data());
-				newNode->scale = scale;
 			}
+			glm::mat4 matrix = glm::mat4(1.0f);
 			if (node.matrix.size() == 16) {
-				newNode->matrix = glm::make_mat4x4(node.matrix.data());
+				matrix = glm::make_mat4x4(node.matrix.data());
 				if (globalscale != 1.0f) {
-					//newNode->matrix = glm::scale(newNode->matrix, glm::vec3(globalscale));
+					//matrix = glm::scale(matrix, glm::vec3(globalscale));
 				}
 			};
 
+			// Added before the children are loaded, so parents always precede their children in the flattened hierarchy
+			newNode->hierarchy = &hierarchy;
+			newNode->hierarchyIndex = hierarchy.add(parent ? static_cast<int32_t>(parent->hierarchyIndex) : -1, translation, rotation, scale, matrix);
+
 			// Node with children
 			if (node.children.size() > 0) {
 				for (auto i = 0; i < node.children.size(); i++) {
@@ -609,7 +1087,7 @@ namespace vkglTF
 			// Node contains mesh data
 			if (node.mesh > -1) {
 				const tinygltf::Mesh mesh = model.meshes[node.mesh];
-				Mesh *newMesh = new Mesh(device, newNode->matrix);
+				Mesh *newMesh = new Mesh();
 				newMesh->name = mesh.name;
 				for (size_t j = 0; j < mesh.primitives.size(); j++) {
 					const tinygltf::Primitive &primitive = mesh.primitives[j];
@@ -619,9 +1097,11 @@ namespace vkglTF
 					uint32_t indexStart = static_cast<uint32_t>(indexBuffer.size());
 					uint32_t vertexStart = static_cast<uint32_t>(vertexBuffer.size());
 					uint32_t indexCount = 0;
+					uint32_t vertexCount = 0;
 					glm::vec3 posMin{};
 					glm::vec3 posMax{};
 					bool hasSkin = false;
+					bool indexTypeSupported = true;
 					// Vertices
 					{
 						const float *bufferPos = nullptr;
@@ -672,7 +1152,7 @@ namespace vkglTF
 							vert.pos = glm::vec4(glm::make_vec3(&bufferPos[v * 3]), 1.0f);
 							vert.normal = glm::normalize(glm::vec3(bufferNormals ? glm::make_vec3(&bufferNormals[v * 3]) : glm::vec3(0.0f)));
 							vert.uv = bufferTexCoords ? glm::make_vec2(&bufferTexCoords[v * 2]) : glm::vec3(0.0f);
-							
+						
 							vert.joint0 = hasSkin ? glm::vec4(glm::make_vec4(&bufferJoints[v * 4])) : glm::vec4(0.0f);
 							vert.weight0 = hasSkin ? glm::make_vec4(&bufferWeights[v * 4]) : glm::vec4(0.0f);
 							vertexBuffer.push_back(vert);
@@ -713,10 +1193,21 @@ namespace vkglTF
 						}
 						default:
 							std::cerr << "Index component type " << accessor.componentType << " not supported!" << std::endl;
-							return;
+							indexTypeSupported = false;
+							break;
 						}
 					}
+					if (!indexTypeSupported) {
+						// Skip the primitive, the model is not written to the baked model cache as it no longer matches the glTF file
+						vertexBuffer.resize(vertexStart);
+						cacheable = false;
+						continue;
+					}
+					vertexCount = static_cast<uint32_t>(vertexBuffer.size()) - vertexStart;
+					primitiveRanges.push_back({ indexStart, indexCount, vertexStart, vertexCount });
 					Primitive *newPrimitive = new Primitive(indexStart, indexCount, materials[primitive.material]);
+					newPrimitive->firstVertex = vertexStart;
+					newPrimitive->vertexCount = vertexCount;
 					newPrimitive->setDimensions(posMin, posMax);
 					newMesh->primitives.push_back(newPrimitive);
 				}
@@ -758,17 +1249,140 @@ namespace vkglTF
 					memcpy(newSkin->inverseBindMatrices.data(), &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::mat4));
 				}
 
+				newSkin->paletteOffset = jointPaletteSize;
+				jointPaletteSize += static_cast<uint32_t>(newSkin->joints.size());
+
 				skins.push_back(newSkin);
 			}
 		}
 
-		void loadImages(tinygltf::Model &gltfModel, vks::VulkanDevice *device, VkQueue transferQueue)
+		/*
+			Image loader passed to tinyglTF that only keeps the encoded data (component count stays 0)
+			Decoding is done in parallel by loadImages
+		*/
+		static bool loadImageDataDeferred(tinygltf::Image *image, std::string *err, int req_width, int req_height, const unsigned char *bytes, int size, void *userData)
+		{
+			image->width = 0;
+			image->height = 0;
+			image->component = 0;
+			image->image.assign(bytes, bytes + size);
+			return true;
+		}
+
+		/*
+			Decode an image stored by loadImageDataDeferred and expand it to RGBA
+			Returns false if stb can't decode the data, the image is left empty in that case
+		*/
+		static bool decodeImage(tinygltf::Image &image, double &decodeTime, double &convertTime)
+		{
+			auto tStart = std::chrono::high_resolution_clock::now();
+			int width, height, component;
+			unsigned char *data = stbi_load_from_memory(image.image.data(), static_cast<int>(image.image.size()), &width, &height, &component, 0);
+			auto tDecoded = std::chrono::high_resolution_clock::now();
+			decodeTime = std::chrono::duration<double, std::milli>(tDecoded - tStart).count();
+			if (!data) {
+				std::cerr << "Could not decode glTF image \"" << image.uri << "\": " << stbi_failure_reason() << std::endl;
+				image.image.clear();
+				return false;
+			}
+
+			// Most devices don't support RGB only on Vulkan so always convert
+			const size_t pixelCount = static_cast<size_t>(width) * height;
+			image.image.resize(pixelCount * 4);
+			unsigned char *rgba = image.image.data();
+			const unsigned char *src = data;
+			switch (component) {
+			case 4:
+				memcpy(rgba, src, pixelCount * 4);
+				break;
+			case 3:
+				for (size_t i = 0; i < pixelCount; ++i) {
+					rgba[0] = src[0];
+					rgba[1] = src[1];
+					rgba[2] = src[2];
+					rgba[3] = 255;
+					rgba += 4;
+					src += 3;
+				}
+				break;
+			default:
+				// Grey (+ alpha)
+				for (size_t i = 0; i < pixelCount; ++i) {
+					rgba[0] = rgba[1] = rgba[2] = src[0];
+					rgba[3] = (component == 2) ? src[1] : 255;
+					rgba += 4;
+					src += component;
+				}
+				break;
+			}
+			stbi_image_free(data);
+			image.width = width;
+			image.height = height;
+			image.component = 4;
+			convertTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tDecoded).count();
+			return true;
+		}
+
+		/*
+			Decode all images in parallel and create their textures
+			The decoded RGBA data is released once staged, unless keepDecodedData is set (e.g. to write it to the baked model cache)
+		*/
+		void loadImages(tinygltf::Model &gltfModel, vks::VulkanDevice *device, VkQueue transferQueue, vks::UploadBatch *batch, bool keepDecodedData = false)
 		{
-			for (tinygltf::Image &image : gltfModel.images) {
+			std::vector<tinygltf::Image> &images = gltfModel.images;
+			std::vector<double> decodeTimes(images.size(), 0.0);
+			std::vector<double> convertTimes(images.size(), 0.0);
+			// Written per image by the decoding jobs, so not a std::vector<bool>
+			std::vector<char> decodeFailed(images.size(), 0);
+
+			std::vector<size_t> pendingImages;
+			for (size_t i = 0; i < images.size(); i++) {
+				if ((images[i].component == 0) && !images[i].image.empty()) {
+					pendingImages.push_back(i);
+				}
+			}
+
+			uint32_t threadCount = std::min(std::max(std::thread::hardware_concurrency(), 1u), static_cast<uint32_t>(pendingImages.size()));
+			loadTimings.threadCount = threadCount;
+			if (threadCount > 1) {
+				// Largest images first, so the expensive decodes are started early and small ones fill up idle workers at the end
+				std::sort(pendingImages.begin(), pendingImages.end(), [&images](size_t a, size_t b) { return images[a].image.size() > images[b].image.size(); });
+				vks::JobSystem jobSystem(threadCount - 1);
+				jobSystem.parallelFor(static_cast<uint32_t>(pendingImages.size()), [&images, &pendingImages, &decodeTimes, &convertTimes, &decodeFailed](uint32_t first, uint32_t last) {
+					for (uint32_t i = first; i < last; i++) {
+						const size_t index = pendingImages[i];
+						decodeFailed[index] = !decodeImage(images[index], decodeTimes[index], convertTimes[index]);
+					}
+				}, 1);
+			}
+			else {
+				for (size_t index : pendingImages) {
+					decodeFailed[index] = !decodeImage(images[index], decodeTimes[index], convertTimes[index]);
+				}
+			}
+			loadTimings.decode = std::accumulate(decodeTimes.begin(), decodeTimes.end(), 0.0);
+			loadTimings.convert = std::accumulate(convertTimes.begin(), convertTimes.end(), 0.0);
+
+			auto tStart = std::chrono::high_resolution_clock::now();
+			for (size_t i = 0; i < images.size(); i++) {
+				tinygltf::Image &image = images[i];
+				if (decodeFailed[i] || image.image.empty()) {
+					// Keep the texture indices of the materials valid by substituting a single white texel
+					std::cerr << "Using a placeholder for glTF image \"" << (image.uri.empty() ? image.name : image.uri) << "\"" << std::endl;
+					image.width = 1;
+					image.height = 1;
+					image.component = 4;
+					image.image.assign(4, 255);
+				}
 				vkglTF::Texture texture;
-				texture.fromglTfImage(image, device, transferQueue);
+				texture.fromglTfImage(image, device, transferQueue, batch);
 				textures.push_back(texture);
+				if (!keepDecodedData) {
+					// Staged, the decoded data is no longer needed
+					std::vector<unsigned char>().swap(image.image);
+				}
 			}
+			loadTimings.upload = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
 		}
 
 		void loadMaterials(tinygltf::Model &gltfModel)
@@ -865,18 +1479,17 @@ namespace vkglTF
 
 						assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
 
-						float *buf = new float[accessor.count];
-						memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(float));
-						for (size_t index = 0; index < accessor.count; index++) {
-							sampler.inputs.push_back(buf[index]);
-						}
+						const float *buf = reinterpret_cast<const float*>(&buffer.data[accessor.byteOffset + bufferView.byteOffset]);
+						sampler.inputOffset = static_cast<uint32_t>(animation.inputs.size());
+						sampler.keyCount = static_cast<uint32_t>(accessor.count);
+						animation.inputs.insert(animation.inputs.end(), buf, buf + accessor.count);
 
-						for (auto input : sampler.inputs) {
-							if (input < animation.start) {
-								animation.start = input;
+						for (size_t index = 0; index < accessor.count; index++) {
+							if (buf[index] < animation.start) {
+								animation.start = buf[index];
 							};
-							if (input > animation.end) {
-								animation.end = input;
+							if (buf[index] > animation.end) {
+								animation.end = buf[index];
 							}
 						}
 					}
@@ -889,21 +1502,18 @@ namespace vkglTF
 
 						assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
 
+						sampler.outputOffset = static_cast<uint32_t>(animation.outputs.size());
 						switch (accessor.type) {
 						case TINYGLTF_TYPE_VEC3: {
-							glm::vec3 *buf = new glm::vec3[accessor.count];
-							memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::vec3));
+							const glm::vec3 *buf = reinterpret_cast<const glm::vec3*>(&buffer.data[accessor.byteOffset + bufferView.byteOffset]);
 							for (size_t index = 0; index < accessor.count; index++) {
-								sampler.outputsVec4.push_back(glm::vec4(buf[index], 0.0f));
+								animation.outputs.push_back(glm::vec4(buf[index], 0.0f));
 							}
 							break;
 						}
 						case TINYGLTF_TYPE_VEC4: {
-							glm::vec4 *buf = new glm::vec4[accessor.count];
-							memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::vec4));
-							for (size_t index = 0; index < accessor.count; index++) {
-								sampler.outputsVec4.push_back(buf[index]);
-							}
+							const glm::vec4 *buf = reinterpret_cast<const glm::vec4*>(&buffer.data[accessor.byteOffset + bufferView.byteOffset]);
+							animation.outputs.insert(animation.outputs.end(), buf, buf + accessor.count);
 							break;
 						}
 						default: {
@@ -911,6 +1521,7 @@ namespace vkglTF
 							break;
 						}
 						}
+						sampler.outputCount = static_cast<uint32_t>(animation.outputs.size()) - sampler.outputOffset;
 					}
 
 					animation.samplers.push_back(sampler);
@@ -946,97 +1557,821 @@ namespace vkglTF
 			}
 		}
 
-		void loadFromFile(std::string filename, vks::VulkanDevice *device, VkQueue transferQueue, float scale = 1.0f)
+		/*
+			Run the mesh optimizations (see vks::meshopt) on each primitive's index and vertex range
+			Called by loadFromFile for FileLoadingFlags::OptimizeMeshes before the buffers are uploaded
+		*/
+		void optimizeMeshes(std::vector<uint32_t> &indexBuffer, std::vector<Vertex> &vertexBuffer)
 		{
-			tinygltf::Model gltfModel;
-			tinygltf::TinyGLTF gltfContext;
-			std::string error;
+			optimizationReports.clear();
+			uint32_t triangles = 0, before = 0, after = 0;
+			for (auto &range : primitiveRanges) {
+				uint32_t *primitiveIndices = indexBuffer.data() + range.firstIndex;
+				for (uint32_t i = 0; i < range.indexCount; i++) {
+					primitiveIndices[i] -= range.firstVertex;
+				}
+				vks::meshopt::MeshReport report = vks::meshopt::optimizeMesh(primitiveIndices, range.indexCount, vertexBuffer.data() + range.firstVertex, range.vertexCount, sizeof(Vertex), offsetof(Vertex, pos));
+				for (uint32_t i = 0; i < range.indexCount; i++) {
+					primitiveIndices[i] += range.firstVertex;
+				}
+				triangles += report.triangleCount;
+				before += report.before.transformedVertices;
+				after += report.after.transformedVertices;
+				optimizationReports.push_back(report);
+			}
+			if (triangles > 0) {
+				std::cout << "Optimized " << optimizationReports.size() << " primitives: ACMR " << static_cast<float>(before) / triangles << " -> " << static_cast<float>(after) / triangles << ", vertex shader invocations " << before << " -> " << after << std::endl;
+			}
+		}
+
+		/*
+			Convert the float vertices of all meshes to packed vertices, quantized relative to each mesh's bounds
+			Returns false (and leaves the vertices as they are) if a joint index doesn't fit into 8 bits
+		*/
+		bool packVertices(const std::vector<Vertex> &vertexBuffer, std::vector<PackedVertex> &packedVertexBuffer)
+		{
+			for (auto &vertex : vertexBuffer) {
+				if (std::max(std::max(vertex.joint0.x, vertex.joint0.y), std::max(vertex.joint0.z, vertex.joint0.w)) > 255.0f) {
+					std::cerr << "Joint indices exceed 8 bits, vertices are not packed" << std::endl;
+					return false;
+				}
+			}
+			packedVertexBuffer.resize(vertexBuffer.size());
+			for (auto node : linearNodes) {
+				if (!node->mesh) {
+					continue;
+				}
+				Mesh *mesh = node->mesh;
+				vks::quantization::Range<3> positionRange;
+				vks::quantization::Range<2> uvRange;
+				for (Primitive *primitive : mesh->primitives) {
+					for (uint32_t v = primitive->firstVertex; v < primitive->firstVertex + primitive->vertexCount; v++) {
+						positionRange.add(&vertexBuffer[v].pos.x);
+						uvRange.add(&vertexBuffer[v].uv.x);
+					}
+				}
+				VertexQuantization &quantization = mesh->quantization;
+				positionRange.snormTransform(&quantization.positionOffset.x, &quantization.positionScale.x);
+				uvRange.unormTransform(&quantization.uvTransform.x, &quantization.uvTransform.z);
+				for (Primitive *primitive : mesh->primitives) {
+					for (uint32_t v = primitive->firstVertex; v < primitive->firstVertex + primitive->vertexCount; v++) {
+						const Vertex &vertex = vertexBuffer[v];
+						PackedVertex &packed = packedVertexBuffer[v];
+						for (uint32_t i = 0; i < 3; i++) {
+							packed.pos[i] = vks::quantization::packSnorm16((vertex.pos[i] - quantization.positionOffset[i]) / quantization.positionScale[i]);
+						}
+						packed.pos[3] = 32767;
+						vks::quantization::octEncode(&vertex.normal.x, packed.normal);
+						for (uint32_t i = 0; i < 2; i++) {
+							packed.uv[i] = vks::quantization::packUnorm16((vertex.uv[i] - quantization.uvTransform[i]) / quantization.uvTransform[2 + i]);
+						}
+						for (uint32_t i = 0; i < 4; i++) {
+							packed.joint0[i] = static_cast<uint8_t>(vertex.joint0[i]);
+						}
+						vks::quantization::packWeights(&vertex.weight0.x, packed.weight0);
+					}
+				}
+			}
+			return true;
+		}
+
+		/*
+			Convert the indices of all primitives to 16 bit indices relative to each primitive's first vertex
+			Returns false if a primitive references more vertices than 16 bit indices can address, the model then keeps 32 bit indices
+		*/
+		bool packIndices16(const std::vector<uint32_t> &indexBuffer, std::vector<uint16_t> &shortIndexBuffer)
+		{
+			shortIndexBuffer.resize(indexBuffer.size());
+			for (auto &range : primitiveRanges) {
+				if (!vks::meshopt::packIndices16(indexBuffer.data() + range.firstIndex, range.indexCount, range.firstVertex, shortIndexBuffer.data() + range.firstIndex)) {
+					shortIndexBuffer.clear();
+					return false;
+				}
+			}
+			// Levels of detail only reference vertices of their primitive, so they fit if the full detail range does
+			for (auto node : linearNodes) {
+				if (node->mesh) {
+					for (Primitive *primitive : node->mesh->primitives) {
+						for (auto &lod : primitive->lods) {
+							vks::meshopt::packIndices16(indexBuffer.data() + lod.firstIndex, lod.indexCount, primitive->firstVertex, shortIndexBuffer.data() + lod.firstIndex);
+						}
+					}
+				}
+			}
+			return true;
+		}
+
+		/*
+			Append simplified levels of detail of every primitive to the index buffer (see vks::meshopt::generateLods)
+		*/
+		void generateLods(std::vector<uint32_t> &indexBuffer, const std::vector<Vertex> &vertexBuffer)
+		{
+			for (auto node : linearNodes) {
+				if (!node->mesh) {
+					continue;
+				}
+				for (Primitive *primitive : node->mesh->primitives) {
+					if ((primitive->indexCount == 0) || (primitive->vertexCount == 0)) {
+						continue;
+					}
+					primitive->lods = vks::meshopt::generateLods(indexBuffer, primitive->firstIndex, primitive->indexCount, primitive->firstVertex,
+						&vertexBuffer[primitive->firstVertex].pos.x, primitive->vertexCount, sizeof(Vertex), maxLodLevels, primitive->dimensions.radius * maxLodError);
+				}
+			}
+		}
+
+		/*
+			Select the level of detail of each primitive, the coarsest one whose simplification error projects to at most maxPixelError pixels is used
+			The distance is measured to the primitive's world space bounding sphere, skinned primitives are always drawn at full detail as their bounds only cover the bind pose
+			Draw list commands are updated in place, the previous frame drawing the list must have completed
+		*/
+		void selectLods(const glm::vec3 &cameraPosition, float fovY, float viewportHeight, float maxPixelError = 1.0f)
+		{
+			hierarchy.update();
+			for (auto node : linearNodes) {
+				if (!node->mesh) {
+					continue;
+				}
+				const glm::mat4 &m = hierarchy.worldMatrices[node->hierarchyIndex];
+				const float scale = std::max(glm::length(glm::vec3(m[0])), std::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+				for (Primitive *primitive : node->mesh->primitives) {
+					primitive->lod = 0;
+					if (node->skin || primitive->lods.empty()) {
+						continue;
+					}
+					const glm::vec3 center = glm::vec3(m * glm::vec4(primitive->dimensions.center, 1.0f));
+					const float distance = glm::length(center - cameraPosition) - primitive->dimensions.radius * scale;
+					for (uint32_t i = 0; i < primitive->lods.size(); i++) {
+						if (vks::meshopt::projectedError(primitive->lods[i].error * scale, distance, fovY, viewportHeight) > maxPixelError) {
+							break;
+						}
+						primitive->lod = i + 1;
+					}
+				}
+			}
+			for (size_t i = 0; i < drawList.commands.size(); i++) {
+				VkDrawIndexedIndirectCommand &command = drawList.commands[i];
+				const Primitive *primitive = drawList.primitives[i];
+				if (command.firstIndex == primitive->lodFirstIndex()) {
+					continue;
+				}
+				command.firstIndex = primitive->lodFirstIndex();
+				command.indexCount = primitive->lodIndexCount();
+				if (drawList.mapped) {
+					drawList.mapped[i].firstIndex = command.firstIndex;
+					drawList.mapped[i].indexCount = command.indexCount;
+				}
+			}
+		}
+
+		/*
+			Vertex input binding for the model's vertex buffer
+		*/
+		VkVertexInputBindingDescription getVertexInputBinding(uint32_t binding)
+		{
+			return vks::initializers::vertexInputBindingDescription(binding, packedVertices ? sizeof(PackedVertex) : sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX);
+		}
+
+		/*
+			Vertex input attributes for the model's vertex format: location 0 position, 1 normal, 2 uv, 3 joint indices, 4 joint weights
+			Packed vertices have to be decoded in the shader: octahedral normals, joint indices as uvec4 and positions/uvs with the mesh's quantization (see MeshInfo)
+		*/
+		std::vector<VkVertexInputAttributeDescription> getVertexInputAttributes(uint32_t binding)
+		{
+			if (packedVertices) {
+				return {
+					vks::initializers::vertexInputAttributeDescription(binding, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(PackedVertex, pos)),
+					vks::initializers::vertexInputAttributeDescription(binding, 1, VK_FORMAT_R16G16_SNORM, offsetof(PackedVertex, normal)),
+					vks::initializers::vertexInputAttributeDescription(binding, 2, VK_FORMAT_R16G16_UNORM, offsetof(PackedVertex, uv)),
+					vks::initializers::vertexInputAttributeDescription(binding, 3, VK_FORMAT_R8G8B8A8_UINT, offsetof(PackedVertex, joint0)),
+					vks::initializers::vertexInputAttributeDescription(binding, 4, VK_FORMAT_R8G8B8A8_UNORM, offsetof(PackedVertex, weight0)),
+				};
+			}
+			return {
+				vks::initializers::vertexInputAttributeDescription(binding, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos)),
+				vks::initializers::vertexInputAttributeDescription(binding, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal)),
+				vks::initializers::vertexInputAttributeDescription(binding, 2, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv)),
+				vks::initializers::vertexInputAttributeDescription(binding, 3, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Vertex, joint0)),
+				vks::initializers::vertexInputAttributeDescription(binding, 4, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Vertex, weight0)),
+			};
+		}
+
+		/*
+			Texture slots of a material in the order they are stored in the baked model cache (see BakedMaterial)
+		*/
+		static void materialTextureSlots(Material &material, vkglTF::Texture **slots[BakedMaterial::textureSlotCount])
+		{
+			slots[0] = &material.baseColorTexture;
+			slots[1] = &material.metallicRoughnessTexture;
+			slots[2] = &material.normalTexture;
+			slots[3] = &material.occlusionTexture;
+			slots[4] = &material.emissiveTexture;
+			slots[5] = &material.specularGlossinessTexture;
+			slots[6] = &material.diffuseTexture;
+		}
+
+		/*
+			Append a node and its descendants to linearNodes in the order loadNode creates them (children first)
+		*/
+		void appendLinearNodes(Node *node)
+		{
+			for (auto child : node->children) {
+				appendLinearNodes(child);
+			}
+			linearNodes.push_back(node);
+		}
+
+		/*
+			Restore the model from a mapped baked model cache file instead of parsing the glTF file and decoding its images
+			Vertex and index data are not copied, the returned pointers point into the mapping
+			Returns false without creating anything if the cache is incomplete or an external buffer or image has changed since it was written
+		*/
+		bool loadCache(const vks::modelcache::Reader &reader, const std::string &baseDir, VkQueue transferQueue, vks::UploadBatch *uploads, const void **vertexData, size_t *vertexCount, const void **indexData, size_t *indexCount)
+		{
+			size_t modelCount, dependencyCount, stringSize, imageCount, imageDataSize, materialCount, nodeCount, rangeCount, primitiveCount, quantizationCount, lodCount;
+			size_t skinCount, jointCount, inverseBindMatrixCount, animationCount, samplerCount, channelCount, inputCount, outputCount;
+			const BakedModel *bakedModel = static_cast<const BakedModel*>(reader.getSection(CACHE_SECTION_MODEL, sizeof(BakedModel), &modelCount));
+			const BakedDependency *dependencies = static_cast<const BakedDependency*>(reader.getSection(CACHE_SECTION_DEPENDENCIES, sizeof(BakedDependency), &dependencyCount));
+			const char *strings = static_cast<const char*>(reader.getSection(CACHE_SECTION_STRINGS, sizeof(char), &stringSize));
+			const BakedImage *images = static_cast<const BakedImage*>(reader.getSection(CACHE_SECTION_IMAGES, sizeof(BakedImage), &imageCount));
+			const uint8_t *imageData = static_cast<const uint8_t*>(reader.getSection(CACHE_SECTION_IMAGE_DATA, sizeof(uint8_t), &imageDataSize));
+			const BakedMaterial *bakedMaterials = static_cast<const BakedMaterial*>(reader.getSection(CACHE_SECTION_MATERIALS, sizeof(BakedMaterial), &materialCount));
+			const BakedNode *bakedNodes = static_cast<const BakedNode*>(reader.getSection(CACHE_SECTION_NODES, sizeof(BakedNode), &nodeCount));
+			const PrimitiveRange *ranges = static_cast<const PrimitiveRange*>(reader.getSection(CACHE_SECTION_PRIMITIVES, sizeof(PrimitiveRange), &rangeCount));
+			const BakedPrimitive *bakedPrimitives = static_cast<const BakedPrimitive*>(reader.getSection(CACHE_SECTION_PRIMITIVE_INFOS, sizeof(BakedPrimitive), &primitiveCount));
+			const PrimitiveLod *lods = static_cast<const PrimitiveLod*>(reader.getSection(CACHE_SECTION_LODS, sizeof(PrimitiveLod), &lodCount));
+			const BakedSkin *bakedSkins = static_cast<const BakedSkin*>(reader.getSection(CACHE_SECTION_SKINS, sizeof(BakedSkin), &skinCount));
+			const uint32_t *joints = static_cast<const uint32_t*>(reader.getSection(CACHE_SECTION_SKIN_JOINTS, sizeof(uint32_t), &jointCount));
+			const glm::mat4 *inverseBindMatrices = static_cast<const glm::mat4*>(reader.getSection(CACHE_SECTION_INVERSE_BIND_MATRICES, sizeof(glm::mat4), &inverseBindMatrixCount));
+			const BakedAnimation *bakedAnimations = static_cast<const BakedAnimation*>(reader.getSection(CACHE_SECTION_ANIMATIONS, sizeof(BakedAnimation), &animationCount));
+			const BakedAnimationSampler *samplers = static_cast<const BakedAnimationSampler*>(reader.getSection(CACHE_SECTION_ANIMATION_SAMPLERS, sizeof(BakedAnimationSampler), &samplerCount));
+			const BakedAnimationChannel *channels = static_cast<const BakedAnimationChannel*>(reader.getSection(CACHE_SECTION_ANIMATION_CHANNELS, sizeof(BakedAnimationChannel), &channelCount));
+			const float *inputs = static_cast<const float*>(reader.getSection(CACHE_SECTION_ANIMATION_INPUTS, sizeof(float), &inputCount));
+			const glm::vec4 *outputs = static_cast<const glm::vec4*>(reader.getSection(CACHE_SECTION_ANIMATION_OUTPUTS, sizeof(glm::vec4), &outputCount));
+			// Packed models are cached as float vertices if packing wasn't possible, in that case the quantization section is missing
+			const VertexQuantization *quantizations = static_cast<const VertexQuantization*>(reader.getSection(CACHE_SECTION_QUANTIZATION, sizeof(VertexQuantization), &quantizationCount));
+			const bool packed = (quantizations != nullptr);
+			const void *vertexSection = reader.getSection(CACHE_SECTION_VERTICES, packed ? sizeof(PackedVertex) : sizeof(Vertex), vertexCount);
+			// The element size of the index section tells the index type
+			VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+			const void *indexSection = reader.getSection(CACHE_SECTION_INDICES, sizeof(uint32_t), indexCount);
+			if (!indexSection) {
+				indexType = VK_INDEX_TYPE_UINT16;
+				indexSection = reader.getSection(CACHE_SECTION_INDICES, sizeof(uint16_t), indexCount);
+			}
+			if (!bakedModel || (modelCount != 1) || !dependencies || !strings || !images || !imageData || !bakedMaterials || !bakedNodes || !ranges || !bakedPrimitives || !lods || !bakedSkins || !joints || !inverseBindMatrices
+				|| !bakedAnimations || !samplers || !channels || !inputs || !outputs || !vertexSection || !indexSection || (primitiveCount != rangeCount)) {
+				return false;
+			}
+
+			// All references are checked up front, so nothing has to be rolled back below
+			auto inRange = [](uint64_t first, uint64_t count, uint64_t size) { return (first <= size) && (count <= size - first); };
+			auto validString = [&](const BakedString &string) { return inRange(string.offset, string.length, stringSize); };
+			for (size_t i = 0; i < dependencyCount; i++) {
+				if (!validString(dependencies[i].uri)) {
+					return false;
+				}
+				uint64_t hash = vks::modelcache::hashSeed;
+				if (!vks::modelcache::hashFile(baseDir + std::string(strings + dependencies[i].uri.offset, dependencies[i].uri.length), &hash) || (hash != dependencies[i].hash)) {
+					return false;
+				}
+			}
+			for (size_t i = 0; i < imageCount; i++) {
+				if (!inRange(images[i].dataOffset, static_cast<uint64_t>(images[i].width) * images[i].height * 4, imageDataSize)) {
+					return false;
+				}
+			}
+			for (size_t i = 0; i < materialCount; i++) {
+				for (uint32_t slot = 0; slot < BakedMaterial::textureSlotCount; slot++) {
+					if (bakedMaterials[i].textures[slot] >= static_cast<int32_t>(imageCount)) {
+						return false;
+					}
+				}
+			}
+			size_t meshCount = 0;
+			size_t nodePrimitiveCount = 0;
+			for (size_t i = 0; i < nodeCount; i++) {
+				if ((bakedNodes[i].parent >= static_cast<int32_t>(i)) || (bakedNodes[i].skinIndex >= static_cast<int32_t>(skinCount)) || !validString(bakedNodes[i].name) || !validString(bakedNodes[i].meshName)) {
+					return false;
+				}
+				if (bakedNodes[i].primitiveCount > -1) {
+					meshCount++;
+					nodePrimitiveCount += bakedNodes[i].primitiveCount;
+				}
+			}
+			if ((nodePrimitiveCount != rangeCount) || (packed && (quantizationCount != meshCount))) {
+				return false;
+			}
+			for (size_t i = 0; i < rangeCount; i++) {
+				if (!inRange(ranges[i].firstIndex, ranges[i].indexCount, *indexCount) || !inRange(ranges[i].firstVertex, ranges[i].vertexCount, *vertexCount) || (bakedPrimitives[i].material >= materialCount)) {
+					return false;
+				}
+			}
+			for (size_t i = 0; i < lodCount; i++) {
+				if ((lods[i].primitive >= rangeCount) || !inRange(lods[i].level.firstIndex, lods[i].level.indexCount, *indexCount)) {
+					return false;
+				}
+			}
+			for (size_t i = 0; i < skinCount; i++) {
+				if (!validString(bakedSkins[i].name) || !inRange(bakedSkins[i].firstJoint, bakedSkins[i].jointCount, jointCount) || !inRange(bakedSkins[i].firstInverseBindMatrix, bakedSkins[i].inverseBindMatrixCount, inverseBindMatrixCount)) {
+					return false;
+				}
+			}
+			for (size_t i = 0; i < animationCount; i++) {
+				const BakedAnimation &animation = bakedAnimations[i];
+				if (!validString(animation.name) || !inRange(animation.firstSampler, animation.samplerCount, samplerCount) || !inRange(animation.firstChannel, animation.channelCount, channelCount)
+					|| !inRange(animation.firstInput, animation.inputCount, inputCount) || !inRange(animation.firstOutput, animation.outputCount, outputCount)) {
+					return false;
+				}
+				for (uint32_t j = 0; j < animation.samplerCount; j++) {
+					const BakedAnimationSampler &sampler = samplers[animation.firstSampler + j];
+					if (!inRange(sampler.inputOffset, sampler.keyCount, animation.inputCount) || !inRange(sampler.outputOffset, sampler.outputCount, animation.outputCount)) {
+						return false;
+					}
+				}
+				for (uint32_t j = 0; j < animation.channelCount; j++) {
+					if (channels[animation.firstChannel + j].samplerIndex >= animation.samplerCount) {
+						return false;
+					}
+				}
+			}
+
+			metallicRoughnessWorkflow = (bakedModel->metallicRoughnessWorkflow != 0);
+
+			// Images are stored decoded, so they go straight into staging memory
+			auto tStart = std::chrono::high_resolution_clock::now();
+			textures.reserve(imageCount);
+			for (size_t i = 0; i < imageCount; i++) {
+				vkglTF::Texture texture;
+				texture.fromRGBA(imageData + images[i].dataOffset, static_cast<VkDeviceSize>(images[i].width) * images[i].height * 4, images[i].width, images[i].height, device, transferQueue, uploads);
+				textures.push_back(texture);
+			}
+			loadTimings.upload = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+
+			// Primitives reference their material, so the table must not be resized afterwards
+			materials.reserve(materialCount);
+			for (size_t i = 0; i < materialCount; i++) {
+				const BakedMaterial &source = bakedMaterials[i];
+				vkglTF::Material material{};
+				material.alphaMode = static_cast<Material::AlphaMode>(source.alphaMode);
+				material.alphaCutoff = source.alphaCutoff;
+				material.metallicFactor = source.metallicFactor;
+				material.roughnessFactor = source.roughnessFactor;
+				material.baseColorFactor = source.baseColorFactor;
+				vkglTF::Texture **slots[BakedMaterial::textureSlotCount];
+				materialTextureSlots(material, slots);
+				for (uint32_t slot = 0; slot < BakedMaterial::textureSlotCount; slot++) {
+					*slots[slot] = (source.textures[slot] > -1) ? &textures[source.textures[slot]] : nullptr;
+				}
+				materials.push_back(material);
+			}
+
+			// Nodes are added in hierarchy order, so every node's index in the flattened hierarchy equals its index in the cache
+			std::vector<Node*> hierarchyNodes(nodeCount);
+			for (size_t i = 0; i < nodeCount; i++) {
+				const BakedNode &source = bakedNodes[i];
+				Node *newNode = new Node{};
+				newNode->index = source.index;
+				newNode->parent = (source.parent > -1) ? hierarchyNodes[source.parent] : nullptr;
+				newNode->name.assign(strings + source.name.offset, source.name.length);
+				newNode->skinIndex = source.skinIndex;
+				newNode->hierarchy = &hierarchy;
+				newNode->hierarchyIndex = hierarchy.add(newNode->parent ? static_cast<int32_t>(newNode->parent->hierarchyIndex) : -1, source.translation, source.rotation, source.scale, source.matrix);
+				if (source.primitiveCount > -1) {
+					newNode->mesh = new Mesh();
+					newNode->mesh->name.assign(strings + source.meshName.offset, source.meshName.length);
+				}
+				if (newNode->parent) {
+					newNode->parent->children.push_back(newNode);
+				} else {
+					nodes.push_back(newNode);
+				}
+				hierarchyNodes[i] = newNode;
+			}
+			for (auto node : nodes) {
+				appendLinearNodes(node);
+			}
+
+			// Primitives, quantizations and levels of detail are stored in linearNodes order
+			primitiveRanges.assign(ranges, ranges + rangeCount);
+			std::vector<Primitive*> primitives;
+			size_t meshIndex = 0;
+			for (auto node : linearNodes) {
+				if (!node->mesh) {
+					continue;
+				}
+				for (int32_t i = 0; i < bakedNodes[node->hierarchyIndex].primitiveCount; i++) {
+					const PrimitiveRange &range = primitiveRanges[primitives.size()];
+					const BakedPrimitive &source = bakedPrimitives[primitives.size()];
+					Primitive *newPrimitive = new Primitive(range.firstIndex, range.indexCount, materials[source.material]);
+					newPrimitive->firstVertex = range.firstVertex;
+					newPrimitive->vertexCount = range.vertexCount;
+					newPrimitive->setDimensions(source.min, source.max);
+					node->mesh->primitives.push_back(newPrimitive);
+					primitives.push_back(newPrimitive);
+				}
+				if (packed) {
+					node->mesh->quantization = quantizations[meshIndex];
+				}
+				meshIndex++;
+			}
+			for (size_t i = 0; i < lodCount; i++) {
+				primitives[lods[i].primitive]->lods.push_back(lods[i].level);
+			}
+
+			for (size_t i = 0; i < skinCount; i++) {
+				const BakedSkin &source = bakedSkins[i];
+				Skin *newSkin = new Skin{};
+				newSkin->name.assign(strings + source.name.offset, source.name.length);
+				if (source.skeletonRoot > -1) {
+					newSkin->skeletonRoot = nodeFromIndex(source.skeletonRoot);
+				}
+				for (uint32_t j = 0; j < source.jointCount; j++) {
+					Node *node = nodeFromIndex(joints[source.firstJoint + j]);
+					if (node) {
+						newSkin->joints.push_back(node);
+					}
+				}
+				newSkin->inverseBindMatrices.assign(inverseBindMatrices + source.firstInverseBindMatrix, inverseBindMatrices + source.firstInverseBindMatrix + source.inverseBindMatrixCount);
+				newSkin->paletteOffset = jointPaletteSize;
+				jointPaletteSize += static_cast<uint32_t>(newSkin->joints.size());
+				skins.push_back(newSkin);
+			}
+
+			for (size_t i = 0; i < animationCount; i++) {
+				const BakedAnimation &source = bakedAnimations[i];
+				vkglTF::Animation animation{};
+				animation.name.assign(strings + source.name.offset, source.name.length);
+				animation.start = source.start;
+				animation.end = source.end;
+				for (uint32_t j = 0; j < source.samplerCount; j++) {
+					const BakedAnimationSampler &bakedSampler = samplers[source.firstSampler + j];
+					vkglTF::AnimationSampler sampler{};
+					sampler.interpolation = static_cast<AnimationSampler::InterpolationType>(bakedSampler.interpolation);
+					sampler.inputOffset = bakedSampler.inputOffset;
+					sampler.keyCount = bakedSampler.keyCount;
+					sampler.outputOffset = bakedSampler.outputOffset;
+					sampler.outputCount = bakedSampler.outputCount;
+					animation.samplers.push_back(sampler);
+				}
+				for (uint32_t j = 0; j < source.channelCount; j++) {
+					const BakedAnimationChannel &bakedChannel = channels[source.firstChannel + j];
+					vkglTF::AnimationChannel channel{};
+					channel.path = static_cast<AnimationChannel::PathType>(bakedChannel.path);
+					channel.samplerIndex = bakedChannel.samplerIndex;
+					channel.node = nodeFromIndex(bakedChannel.node);
+					if (channel.node) {
+						animation.channels.push_back(channel);
+					}
+				}
+				animation.inputs.assign(inputs + source.firstInput, inputs + source.firstInput + source.inputCount);
+				animation.outputs.assign(outputs + source.firstOutput, outputs + source.firstOutput + source.outputCount);
+				animations.push_back(animation);
+			}
+
+			packedVertices = packed;
+			indices.type = indexType;
+			*vertexData = vertexSection;
+			*indexData = indexSection;
+			return true;
+		}
+
+		/*
+			Write the loaded model to a baked model cache file, see loadCache
+			gltfModel must still hold the decoded images (see loadImages) and provides the external files the cache depends on
+		*/
+		bool writeCache(const std::string &cacheFilename, uint64_t cacheKey, const tinygltf::Model &gltfModel, const std::string &baseDir, const void *vertexData, size_t vertexCount, const void *indexData, size_t indexCount)
+		{
+			std::vector<char> strings;
+			auto addString = [&strings](const std::string &string) {
+				BakedString baked{ static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(string.size()) };
+				strings.insert(strings.end(), string.begin(), string.end());
+				return baked;
+			};
 
+			BakedModel bakedModel{};
+			bakedModel.metallicRoughnessWorkflow = metallicRoughnessWorkflow ? 1 : 0;
+
+			// Embedded (data uri) buffers and images are covered by the hash of the glTF file
+			std::vector<BakedDependency> dependencies;
+			std::vector<std::string> uris;
+			for (auto &buffer : gltfModel.buffers) {
+				uris.push_back(buffer.uri);
+			}
+			for (auto &image : gltfModel.images) {
+				uris.push_back(image.uri);
+			}
+			for (auto &uri : uris) {
+				if (uri.empty() || (uri.compare(0, 5, "data:") == 0)) {
+					continue;
+				}
+				BakedDependency dependency{};
+				dependency.uri = addString(uri);
+				dependency.hash = vks::modelcache::hashSeed;
+				if (!vks::modelcache::hashFile(baseDir + uri, &dependency.hash)) {
+					return false;
+				}
+				dependencies.push_back(dependency);
+			}
+
+			// One texture has been created per glTF image (see loadImages)
+			assert(gltfModel.images.size() == textures.size());
+			std::vector<BakedImage> images;
+			uint64_t dataOffset = 0;
+			for (size_t i = 0; i < textures.size(); i++) {
+				BakedImage image{};
+				image.width = textures[i].width;
+				image.height = textures[i].height;
+				image.dataOffset = dataOffset;
+				if (gltfModel.images[i].image.size() != static_cast<size_t>(image.width) * image.height * 4) {
+					return false;
+				}
+				dataOffset += gltfModel.images[i].image.size();
+				images.push_back(image);
+			}
+
+			std::vector<BakedMaterial> bakedMaterials;
+			for (auto &material : materials) {
+				BakedMaterial bakedMaterial{};
+				bakedMaterial.alphaMode = material.alphaMode;
+				bakedMaterial.alphaCutoff = material.alphaCutoff;
+				bakedMaterial.metallicFactor = material.metallicFactor;
+				bakedMaterial.roughnessFactor = material.roughnessFactor;
+				bakedMaterial.baseColorFactor = material.baseColorFactor;
+				vkglTF::Texture **slots[BakedMaterial::textureSlotCount];
+				materialTextureSlots(material, slots);
+				for (uint32_t slot = 0; slot < BakedMaterial::textureSlotCount; slot++) {
+					bakedMaterial.textures[slot] = *slots[slot] ? static_cast<int32_t>(*slots[slot] - textures.data()) : -1;
+				}
+				bakedMaterials.push_back(bakedMaterial);
+			}
+
+			std::vector<BakedNode> bakedNodes(linearNodes.size());
+			std::vector<BakedPrimitive> bakedPrimitives;
+			std::vector<VertexQuantization> quantizations;
+			std::vector<PrimitiveLod> lods;
+			for (auto node : linearNodes) {
+				BakedNode &bakedNode = bakedNodes[node->hierarchyIndex];
+				bakedNode.parent = node->parent ? static_cast<int32_t>(node->parent->hierarchyIndex) : -1;
+				bakedNode.index = node->index;
+				bakedNode.skinIndex = node->skinIndex;
+				bakedNode.primitiveCount = -1;
+				bakedNode.name = addString(node->name);
+				bakedNode.translation = hierarchy.translations[node->hierarchyIndex];
+				bakedNode.rotation = hierarchy.rotations[node->hierarchyIndex];
+				bakedNode.scale = hierarchy.scales[node->hierarchyIndex];
+				bakedNode.matrix = hierarchy.matrices[node->hierarchyIndex];
+				if (node->mesh) {
+					bakedNode.primitiveCount = static_cast<int32_t>(node->mesh->primitives.size());
+					bakedNode.meshName = addString(node->mesh->name);
+					for (Primitive *primitive : node->mesh->primitives) {
+						for (auto &level : primitive->lods) {
+							lods.push_back({ static_cast<uint32_t>(bakedPrimitives.size()), level });
+						}
+						BakedPrimitive bakedPrimitive{};
+						bakedPrimitive.material = static_cast<uint32_t>(&primitive->material - materials.data());
+						bakedPrimitive.min = primitive->dimensions.min;
+						bakedPrimitive.max = primitive->dimensions.max;
+						bakedPrimitives.push_back(bakedPrimitive);
+					}
+					quantizations.push_back(node->mesh->quantization);
+				}
+			}
+
+			std::vector<BakedSkin> bakedSkins;
+			std::vector<uint32_t> joints;
+			std::vector<glm::mat4> inverseBindMatrices;
+			for (auto skin : skins) {
+				BakedSkin bakedSkin{};
+				bakedSkin.name = addString(skin->name);
+				bakedSkin.skeletonRoot = skin->skeletonRoot ? static_cast<int32_t>(skin->skeletonRoot->index) : -1;
+				bakedSkin.firstJoint = static_cast<uint32_t>(joints.size());
+				bakedSkin.jointCount = static_cast<uint32_t>(skin->joints.size());
+				for (auto joint : skin->joints) {
+					joints.push_back(joint->index);
+				}
+				bakedSkin.firstInverseBindMatrix = static_cast<uint32_t>(inverseBindMatrices.size());
+				bakedSkin.inverseBindMatrixCount = static_cast<uint32_t>(skin->inverseBindMatrices.size());
+				inverseBindMatrices.insert(inverseBindMatrices.end(), skin->inverseBindMatrices.begin(), skin->inverseBindMatrices.end());
+				bakedSkins.push_back(bakedSkin);
+			}
+
+			std::vector<BakedAnimation> bakedAnimations;
+			std::vector<BakedAnimationSampler> samplers;
+			std::vector<BakedAnimationChannel> channels;
+			std::vector<float> inputs;
+			std::vector<glm::vec4> outputs;
+			for (auto &animation : animations) {
+				BakedAnimation bakedAnimation{};
+				bakedAnimation.name = addString(animation.name);
+				bakedAnimation.start = animation.start;
+				bakedAnimation.end = animation.end;
+				bakedAnimation.firstSampler = static_cast<uint32_t>(samplers.size());
+				bakedAnimation.samplerCount = static_cast<uint32_t>(animation.samplers.size());
+				for (auto &sampler : animation.samplers) {
+					samplers.push_back({ static_cast<uint32_t>(sampler.interpolation), sampler.inputOffset, sampler.keyCount, sampler.outputOffset, sampler.outputCount });
+				}
+				bakedAnimation.firstChannel = static_cast<uint32_t>(channels.size());
+				bakedAnimation.channelCount = static_cast<uint32_t>(animation.channels.size());
+				for (auto &channel : animation.channels) {
+					channels.push_back({ static_cast<uint32_t>(channel.path), channel.node->index, channel.samplerIndex });
+				}
+				bakedAnimation.firstInput = static_cast<uint32_t>(inputs.size());
+				bakedAnimation.inputCount = static_cast<uint32_t>(animation.inputs.size());
+				inputs.insert(inputs.end(), animation.inputs.begin(), animation.inputs.end());
+				bakedAnimation.firstOutput = static_cast<uint32_t>(outputs.size());
+				bakedAnimation.outputCount = static_cast<uint32_t>(animation.outputs.size());
+				outputs.insert(outputs.end(), animation.outputs.begin(), animation.outputs.end());
+				bakedAnimations.push_back(bakedAnimation);
+			}
+
+			vks::modelcache::Writer writer;
+			writer.addSection(CACHE_SECTION_MODEL, &bakedModel, sizeof(BakedModel), 1);
+			writer.addSection(CACHE_SECTION_VERTICES, vertexData, packedVertices ? sizeof(PackedVertex) : sizeof(Vertex), vertexCount);
+			if (packedVertices) {
+				writer.addSection(CACHE_SECTION_QUANTIZATION, quantizations.data(), sizeof(VertexQuantization), quantizations.size());
+			}
+			writer.addSection(CACHE_SECTION_INDICES, indexData, (indices.type == VK_INDEX_TYPE_UINT16) ? sizeof(uint16_t) : sizeof(uint32_t), indexCount);
+			writer.addSection(CACHE_SECTION_PRIMITIVES, primitiveRanges.data(), sizeof(PrimitiveRange), primitiveRanges.size());
+			writer.addSection(CACHE_SECTION_PRIMITIVE_INFOS, bakedPrimitives.data(), sizeof(BakedPrimitive), bakedPrimitives.size());
+			writer.addSection(CACHE_SECTION_LODS, lods.data(), sizeof(PrimitiveLod), lods.size());
+			writer.addSection(CACHE_SECTION_DEPENDENCIES, dependencies.data(), sizeof(BakedDependency), dependencies.size());
+			writer.addSection(CACHE_SECTION_IMAGES, images.data(), sizeof(BakedImage), images.size());
+			writer.addSection(CACHE_SECTION_IMAGE_DATA, nullptr, sizeof(uint8_t), 0);
+			for (auto &image : gltfModel.images) {
+				writer.appendToSection(image.image.data(), image.image.size());
+			}
+			writer.addSection(CACHE_SECTION_MATERIALS, bakedMaterials.data(), sizeof(BakedMaterial), bakedMaterials.size());
+			writer.addSection(CACHE_SECTION_NODES, bakedNodes.data(), sizeof(BakedNode), bakedNodes.size());
+			writer.addSection(CACHE_SECTION_SKINS, bakedSkins.data(), sizeof(BakedSkin), bakedSkins.size());
+			writer.addSection(CACHE_SECTION_SKIN_JOINTS, joints.data(), sizeof(uint32_t), joints.size());
+			writer.addSection(CACHE_SECTION_INVERSE_BIND_MATRICES, inverseBindMatrices.data(), sizeof(glm::mat4), inverseBindMatrices.size());
+			writer.addSection(CACHE_SECTION_ANIMATIONS, bakedAnimations.data(), sizeof(BakedAnimation), bakedAnimations.size());
+			writer.addSection(CACHE_SECTION_ANIMATION_SAMPLERS, samplers.data(), sizeof(BakedAnimationSampler), samplers.size());
+			writer.addSection(CACHE_SECTION_ANIMATION_CHANNELS, channels.data(), sizeof(BakedAnimationChannel), channels.size());
+			writer.addSection(CACHE_SECTION_ANIMATION_INPUTS, inputs.data(), sizeof(float), inputs.size());
+			writer.addSection(CACHE_SECTION_ANIMATION_OUTPUTS, outputs.data(), sizeof(glm::vec4), outputs.size());
+			// Added last, names are collected by all of the above
+			writer.addSection(CACHE_SECTION_STRINGS, strings.data(), sizeof(char), strings.size());
+			return writer.write(cacheFilename, cacheKey);
+		}
+
+		/*
+			Load a glTF scene, all image and buffer uploads are recorded into a single command buffer
+			If an upload batch is passed, the model must not be drawn before that batch has been submitted
+			fileLoadingFlags is a combination of vkglTF::FileLoadingFlags
+		*/
+		void loadFromFile(std::string filename, vks::VulkanDevice *device, VkQueue transferQueue, float scale = 1.0f, vks::UploadBatch *batch = nullptr, uint32_t fileLoadingFlags = vkglTF::FileLoadingFlags::None)
+		{
 			this->device = device;
+			loadTimings = {};
+
+			auto tStart = std::chrono::high_resolution_clock::now();
+
+			// The key covers the glTF file and all settings that change the loaded data, external buffers and images are checked by loadCache
+			bool useCache = vks::modelcache::enabled();
+			uint64_t cacheKey = vks::modelcache::hashSeed;
+			if (useCache) {
+				useCache = vks::modelcache::hashFile(filename, &cacheKey);
+			}
+			if (useCache) {
+				cacheKey = vks::modelcache::hash(&scale, sizeof(scale), cacheKey);
+				uint32_t vertexSize = sizeof(Vertex);
+				cacheKey = vks::modelcache::hash(&vertexSize, sizeof(vertexSize), cacheKey);
+				cacheKey = vks::modelcache::hash(&fileLoadingFlags, sizeof(fileLoadingFlags), cacheKey);
+				if (fileLoadingFlags & vkglTF::FileLoadingFlags::GenerateLods) {
+					cacheKey = vks::modelcache::hash(&maxLodLevels, sizeof(maxLodLevels), cacheKey);
+					cacheKey = vks::modelcache::hash(&maxLodError, sizeof(maxLodError), cacheKey);
+				}
+			}
+			// External files are relative to the glTF file
+			const std::string baseDir = filename.substr(0, filename.find_last_of("/\\") + 1);
+			const std::string cacheFilename = vks::modelcache::getCacheFilename(filename);
+
+			vks::UploadBatch localBatch(device, transferQueue);
+			vks::UploadBatch *uploads = batch ? batch : &localBatch;
+
+			std::vector<uint32_t> indexBuffer;
+			std::vector<uint16_t> shortIndexBuffer;
+			std::vector<Vertex> vertexBuffer;
+			std::vector<PackedVertex> packedVertexBuffer;
+			packedVertices = false;
+			indices.type = VK_INDEX_TYPE_UINT32;
+			primitiveRanges.clear();
+			cacheable = true;
+
+			// On a cache hit vertex and index data are copied to staging memory straight from the mapped cache file
+			vks::modelcache::Reader cacheReader;
+			const void *vertexData = nullptr;
+			const void *indexData = nullptr;
+			size_t vertexCount = 0;
+			size_t indexCount = 0;
+			loadedFromCache = useCache && cacheReader.open(cacheFilename, cacheKey) && loadCache(cacheReader, baseDir, transferQueue, uploads, &vertexData, &vertexCount, &indexData, &indexCount);
+
+			// Only parsed on a cache miss, also provides the decoded images and external files for writing the cache
+			tinygltf::Model gltfModel;
+			if (!loadedFromCache) {
+				tinygltf::TinyGLTF gltfContext;
+				std::string error;
+
+				// Images are decoded later on by loadImages, spread across multiple threads
+				gltfContext.SetImageLoader(loadImageDataDeferred, nullptr);
 
 #if defined(__ANDROID__)
-			AAsset* asset = AAssetManager_open(androidApp->activity->assetManager, filename.c_str(), AASSET_MODE_STREAMING);
-			assert(asset);
-			size_t size = AAsset_getLength(asset);
-			assert(size > 0);
-			char* fileData = new char[size];
-			AAsset_read(asset, fileData, size);
-			AAsset_close(asset);
-			std::string baseDir;
-			bool fileLoaded = gltfContext.LoadASCIIFromString(&gltfModel, &error, fileData, size, baseDir);
-			free(fileData);
+				AAsset* asset = AAssetManager_open(androidApp->activity->assetManager, filename.c_str(), AASSET_MODE_STREAMING);
+				assert(asset);
+				size_t size = AAsset_getLength(asset);
+				assert(size > 0);
+				char* fileData = new char[size];
+				AAsset_read(asset, fileData, size);
+				AAsset_close(asset);
+				std::string assetDir;
+				bool fileLoaded = gltfContext.LoadASCIIFromString(&gltfModel, &error, fileData, size, assetDir);
+				free(fileData);
 #else
-			bool fileLoaded = gltfContext.LoadASCIIFromFile(&gltfModel, &error, filename.c_str());
+				bool fileLoaded = gltfContext.LoadASCIIFromFile(&gltfModel, &error, filename.c_str());
 #endif
-			std::vector<uint32_t> indexBuffer;
-			std::vector<Vertex> vertexBuffer;
+				if (!fileLoaded) {
+					// TODO: throw
+					std::cerr << "Could not load gltf file: " << error << std::endl;
+					return;
+				}
+
+				for (auto extension : gltfModel.extensionsUsed) {
+					if (extension == "KHR_materials_pbrSpecularGlossiness") {
+						std::cout << "Required extension: " << extension;
+						metallicRoughnessWorkflow = false;
+					}
+				}
 
-			if (fileLoaded) {
-				loadImages(gltfModel, device, transferQueue);
+				loadImages(gltfModel, device, transferQueue, uploads, useCache);
 				loadMaterials(gltfModel);
 				const tinygltf::Scene &scene = gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
 				for (size_t i = 0; i < scene.nodes.size(); i++) {
 					const tinygltf::Node node = gltfModel.nodes[scene.nodes[i]];
 					loadNode(nullptr, node, scene.nodes[i], gltfModel, indexBuffer, vertexBuffer, scale);
 				}
+				if (fileLoadingFlags & vkglTF::FileLoadingFlags::OptimizeMeshes) {
+					optimizeMeshes(indexBuffer, vertexBuffer);
+				}
+				if (fileLoadingFlags & vkglTF::FileLoadingFlags::GenerateLods) {
+					generateLods(indexBuffer, vertexBuffer);
+				}
+				if (fileLoadingFlags & vkglTF::FileLoadingFlags::PackVertices) {
+					packedVertices = packVertices(vertexBuffer, packedVertexBuffer);
+				}
+				indices.type = packIndices16(indexBuffer, shortIndexBuffer) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
 				if (gltfModel.animations.size() > 0) {
 					loadAnimations(gltfModel);
 				}
 				loadSkins(gltfModel);
 
+				vertexData = packedVertices ? static_cast<const void*>(packedVertexBuffer.data()) : static_cast<const void*>(vertexBuffer.data());
+				vertexCount = vertexBuffer.size();
+				indexData = (indices.type == VK_INDEX_TYPE_UINT16) ? static_cast<const void*>(shortIndexBuffer.data()) : static_cast<const void*>(indexBuffer.data());
+				indexCount = indexBuffer.size();
+			}
+
+			// Assign skins
+			for (auto node : linearNodes) {
+				if (node->skinIndex > -1) {
+					node->skin = skins[node->skinIndex];
+				}
+			}
+			for (auto skin : skins) {
+				const size_t jointCount = std::min(skin->joints.size(), skin->inverseBindMatrices.size());
+				for (size_t i = 0; i < jointCount; i++) {
+					const glm::vec3 pos = glm::vec3(glm::inverse(skin->inverseBindMatrices[i])[3]);
+					skin->bindJointMin = (i == 0) ? pos : glm::min(skin->bindJointMin, pos);
+					skin->bindJointMax = (i == 0) ? pos : glm::max(skin->bindJointMax, pos);
+				}
+			}
+			if (indices.type == VK_INDEX_TYPE_UINT16) {
 				for (auto node : linearNodes) {
-					// Assign skins
-					if (node->skinIndex > -1) {
-						node->skin = skins[node->skinIndex];
-					}
-					// Initial pose
 					if (node->mesh) {
-						node->update();
+						for (Primitive *primitive : node->mesh->primitives) {
+							primitive->vertexOffset = static_cast<int32_t>(primitive->firstVertex);
+						}
 					}
 				}
 			}
-			else {
-				// TODO: throw
-				std::cerr << "Could not load gltf file: " << error << std::endl;
-				return;
-			}
-
-			for (auto extension : gltfModel.extensionsUsed) {
-				if (extension == "KHR_materials_pbrSpecularGlossiness") {
-					std::cout << "Required extension: " << extension;
-					metallicRoughnessWorkflow = false;
+			prepareMeshStorage();
+			// Initial pose
+			for (auto node : linearNodes) {
+				if (node->mesh) {
+					node->updateMesh();
 				}
 			}
+			hierarchy.clearChanged();
 
-			size_t vertexBufferSize = vertexBuffer.size() * sizeof(Vertex);
-			size_t indexBufferSize = indexBuffer.size() * sizeof(uint32_t);
-			indices.count = static_cast<uint32_t>(indexBuffer.size());
+			const size_t vertexStride = packedVertices ? sizeof(PackedVertex) : sizeof(Vertex);
+			const size_t indexSize = (indices.type == VK_INDEX_TYPE_UINT16) ? sizeof(uint16_t) : sizeof(uint32_t);
+			size_t vertexBufferSize = vertexCount * vertexStride;
+			size_t indexBufferSize = indexCount * indexSize;
+			indices.count = static_cast<uint32_t>(indexCount);
 
 			assert((vertexBufferSize > 0) && (indexBufferSize > 0));
 
-			struct StagingBuffer {
-				VkBuffer buffer;
-				VkDeviceMemory memory;
-			} vertexStaging, indexStaging;
-
-			// Create staging buffers
-			// Vertex data
-			VK_CHECK_RESULT(device->createBuffer(
-				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				vertexBufferSize,
-				&vertexStaging.buffer,
-				&vertexStaging.memory,
-				vertexBuffer.data()));
-			// Index data
-			VK_CHECK_RESULT(device->createBuffer(
-				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				indexBufferSize,
-				&indexStaging.buffer,
-				&indexStaging.memory,
-				indexBuffer.data()));
-
 			// Create device local buffers
 			// Vertex buffer
 			VK_CHECK_RESULT(device->createBuffer(
@@ -1044,80 +2379,451 @@ namespace vkglTF
 				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 				vertexBufferSize,
 				&vertices.buffer,
-				&vertices.memory));
+				&vertices.allocation));
 			// Index buffer
 			VK_CHECK_RESULT(device->createBuffer(
 				VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 				indexBufferSize,
 				&indices.buffer,
-				&indices.memory));
+				&indices.allocation));
 
-			// Copy from staging buffers
-			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			// Copy through the same batch as the images, so the whole model is uploaded with a single submission
+			uploads->copyToBuffer(vertices.buffer, vertexData, vertexBufferSize);
+			uploads->copyToBuffer(indices.buffer, indexData, indexBufferSize);
+			auto tFlush = std::chrono::high_resolution_clock::now();
+			localBatch.flush();
+			loadTimings.upload += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tFlush).count();
 
-			VkBufferCopy copyRegion = {};
+			std::cout << "Loaded \"" << filename << "\" in " << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count() << " ms: "
+				<< textures.size() << " images, decode " << loadTimings.decode << " ms, convert " << loadTimings.convert << " ms (summed over " << loadTimings.threadCount << " threads), upload " << loadTimings.upload << " ms" << (loadedFromCache ? ", from baked cache" : "") << std::endl;
 
-			copyRegion.size = vertexBufferSize;
-			vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1, &copyRegion);
-
-			copyRegion.size = indexBufferSize;
-			vkCmdCopyBuffer(copyCmd, indexStaging.buffer, indices.buffer, 1, &copyRegion);
-
-			device->flushCommandBuffer(copyCmd, transferQueue, true);
-
-			vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
-			vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
+			if (useCache && !loadedFromCache) {
+				if (!cacheable) {
+					std::cout << "Not writing model cache \"" << cacheFilename << "\", parts of the glTF file were skipped" << std::endl;
+				}
+				else if (!writeCache(cacheFilename, cacheKey, gltfModel, baseDir, vertexData, vertexCount, indexData, indexCount)) {
+					std::cout << "Could not write model cache \"" << cacheFilename << "\"" << std::endl;
+				}
+			}
 
 			getSceneDimensions();
 
-			// Setup descriptors
-			uint32_t uboCount{ 0 };
-			for (auto node : linearNodes) {
-				if (node->mesh) {
-					uboCount++;
-				}
-			}
+			// Setup descriptors, a single set for the mesh storage of all meshes
 			std::vector<VkDescriptorPoolSize> poolSizes = {
-				vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uboCount),
+				vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2),
 			};
-			VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes.size(), poolSizes.data(), uboCount);
+			VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes.size(), poolSizes.data(), 1);
 			VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &descriptorPool));
 
 			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 1),
 			};
 			VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
 			descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 			descriptorLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
 			descriptorLayoutCI.pBindings = setLayoutBindings.data();
 			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, nullptr, &descriptorSetLayout));
-			for (auto node : nodes) {
-				prepareNodeDescriptor(node, descriptorSetLayout);
+
+			VkDescriptorSetAllocateInfo descriptorSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &descriptorSetAllocInfo, &descriptorSet));
+			std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+				vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &meshStorage.infoDescriptor),
+				vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &meshStorage.matrixDescriptor),
+			};
+			vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+			buildDrawList();
+		}
+
+		/*
+			Create the storage buffer holding the matrices of all meshes and assign each mesh its slot
+			Only skinned meshes reserve space for joint matrices, and only as many as their skin has joints
+		*/
+		void prepareMeshStorage()
+		{
+			std::vector<MeshInfo> meshInfos;
+			uint32_t matrixCount = 0;
+			for (auto node : linearNodes) {
+				if (!node->mesh) {
+					continue;
+				}
+				Mesh *mesh = node->mesh;
+				mesh->index = static_cast<uint32_t>(meshInfos.size());
+				mesh->jointCount = node->skin ? static_cast<uint32_t>(node->skin->joints.size()) : 0;
+				MeshInfo info{};
+				info.matrixOffset = matrixCount;
+				info.jointCount = mesh->jointCount;
+				info.quantization = mesh->quantization;
+				meshInfos.push_back(info);
+				matrixCount += 1 + mesh->jointCount;
+			}
+			meshStorage.meshCount = static_cast<uint32_t>(meshInfos.size());
+			meshStorage.matrixCount = matrixCount;
+
+			// Descriptor ranges must not be empty, so models without meshes still get one (unused) entry of each
+			const VkDeviceSize infoSize = std::max<size_t>(meshInfos.size(), 1) * sizeof(MeshInfo);
+			const VkDeviceSize matrixSize = std::max<uint32_t>(matrixCount, 1) * sizeof(glm::mat4);
+			const VkDeviceSize alignment = std::max<VkDeviceSize>(device->properties.limits.minStorageBufferOffsetAlignment, 1);
+			const VkDeviceSize matrixOffset = (infoSize + alignment - 1) / alignment * alignment;
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				matrixOffset + matrixSize,
+				&meshStorage.buffer,
+				&meshStorage.allocation));
+			meshStorage.infoDescriptor = { meshStorage.buffer, 0, infoSize };
+			meshStorage.matrixDescriptor = { meshStorage.buffer, matrixOffset, matrixSize };
+
+			uint8_t *mapped = static_cast<uint8_t*>(meshStorage.allocation.mapped);
+			if (!meshInfos.empty()) {
+				memcpy(mapped, meshInfos.data(), meshInfos.size() * sizeof(MeshInfo));
+			}
+			glm::mat4 *matrices = reinterpret_cast<glm::mat4*>(mapped + matrixOffset);
+			for (auto node : linearNodes) {
+				if (node->mesh) {
+					node->mesh->matrices = matrices + meshInfos[node->mesh->index].matrixOffset;
+				}
+			}
+		}
+
+		/*
+			Check a material's alpha mode against the Render*Nodes bits of renderFlags
+		*/
+		static bool renderAlphaMode(const Material &material, uint32_t renderFlags)
+		{
+			const uint32_t alphaModeFlags = RenderOpaqueNodes | RenderAlphaMaskedNodes | RenderAlphaBlendedNodes;
+			if ((renderFlags & alphaModeFlags) == 0) {
+				return true;
+			}
+			switch (material.alphaMode) {
+			case Material::ALPHAMODE_MASK:
+				return (renderFlags & RenderAlphaMaskedNodes) != 0;
+			case Material::ALPHAMODE_BLEND:
+				return (renderFlags & RenderAlphaBlendedNodes) != 0;
+			default:
+				return (renderFlags & RenderOpaqueNodes) != 0;
+			}
+		}
+
+		/*
+			Bind the descriptor set of a primitive's material if BindImages is set and it differs from the one bound last
+			Without a command buffer only the bind is counted, as if every material had a descriptor set
+		*/
+		void bindMaterial(VkCommandBuffer commandBuffer, const Material &material, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet)
+		{
+			if (!(renderFlags & BindImages) || (boundMaterial == &material)) {
+				return;
+			}
+			if (commandBuffer != VK_NULL_HANDLE) {
+				if ((pipelineLayout == VK_NULL_HANDLE) || (material.descriptorSet == VK_NULL_HANDLE)) {
+					return;
+				}
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindImageSet, 1, &material.descriptorSet, 0, nullptr);
 			}
+			boundMaterial = &material;
+			drawStatistics.materialBinds++;
 		}
 
-		void drawNode(Node *node, VkCommandBuffer commandBuffer)
+		/*
+			Draws pass the mesh's storage slot as firstInstance, bind descriptorSet to give shaders access to the mesh matrices
+			With BindImages set, material descriptor sets are bound to set bindImageSet of pipelineLayout whenever the material changes
+		*/
+		void drawNode(Node *node, VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1)
 		{
 			if (node->mesh) {
 				for (Primitive *primitive : node->mesh->primitives) {
-					vkCmdDrawIndexed(commandBuffer, primitive->indexCount, 1, primitive->firstIndex, 0, 0);
+					if (!renderAlphaMode(primitive->material, renderFlags)) {
+						continue;
+					}
+					bindMaterial(commandBuffer, primitive->material, renderFlags, pipelineLayout, bindImageSet);
+					if (commandBuffer != VK_NULL_HANDLE) {
+						vkCmdDrawIndexed(commandBuffer, primitive->lodIndexCount(), 1, primitive->lodFirstIndex(), primitive->vertexOffset, node->mesh->index);
+					}
+					drawStatistics.drawCalls++;
 				}
 			}
 			for (auto& child : node->children) {
-				drawNode(child, commandBuffer);
+				drawNode(child, commandBuffer, renderFlags, pipelineLayout, bindImageSet);
 			}
 		}
 
-		void draw(VkCommandBuffer commandBuffer)
+		/*
+			Bind the model's vertex and index buffer
+		*/
+		void bindBuffers(VkCommandBuffer commandBuffer)
 		{
+			if (commandBuffer == VK_NULL_HANDLE) {
+				return;
+			}
 			const VkDeviceSize offsets[1] = { 0 };
 			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
-			vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+			vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, indices.type);
+		}
+
+		/*
+			Draw all primitives in node order
+			All draw functions accept VK_NULL_HANDLE as command buffer, they only update drawStatistics then (e.g. to compare the draw paths without a device)
+		*/
+		void draw(VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1)
+		{
+			bindBuffers(commandBuffer);
+			drawStatistics.drawCalls = 0;
+			drawStatistics.materialBinds = 0;
+			boundMaterial = nullptr;
 			for (auto& node : nodes) {
-				drawNode(node, commandBuffer);
+				drawNode(node, commandBuffer, renderFlags, pipelineLayout, bindImageSet);
+			}
+		}
+
+		/*
+			Add the world space bounding box of a primitive to cullBounds
+			Skinned primitives are bounded by the current joint positions, grown by the distance the primitive's bind pose box extends past the bind pose joints
+			This assumes the joints are not scaled up relative to the bind pose, skins without joints are never culled
+		*/
+		void pushCullBounds(const Node *node, const Primitive *primitive)
+		{
+			if (node->skin) {
+				const Skin *skin = node->skin;
+				const size_t jointCount = std::min(skin->joints.size(), skin->inverseBindMatrices.size());
+				if (jointCount == 0) {
+					cullBounds.push_back(glm::vec3(-FLT_MAX), glm::vec3(FLT_MAX));
+					return;
+				}
+				const glm::vec3 overhang = glm::max(glm::max(skin->bindJointMin - primitive->dimensions.min, primitive->dimensions.max - skin->bindJointMax), glm::vec3(0.0f));
+				// Joints may rotate, so the largest overhang applies to every axis
+				const glm::vec3 margin = glm::vec3(std::max(overhang.x, std::max(overhang.y, overhang.z)));
+				glm::vec3 min = glm::vec3(hierarchy.worldMatrices[skin->joints[0]->hierarchyIndex][3]);
+				glm::vec3 max = min;
+				for (size_t i = 1; i < jointCount; i++) {
+					const glm::vec3 pos = glm::vec3(hierarchy.worldMatrices[skin->joints[i]->hierarchyIndex][3]);
+					min = glm::min(min, pos);
+					max = glm::max(max, pos);
+				}
+				cullBounds.push_back(min - margin, max + margin);
+				return;
+			}
+			// Transform center and half extent of the local box, the absolute rotation part gives the extent of the world space box
+			const glm::mat4 &m = hierarchy.worldMatrices[node->hierarchyIndex];
+			const glm::vec3 center = glm::vec3(m * glm::vec4(primitive->dimensions.center, 1.0f));
+			const glm::vec3 extent = primitive->dimensions.size * 0.5f;
+			const glm::vec3 worldExtent = glm::abs(glm::vec3(m[0])) * extent.x + glm::abs(glm::vec3(m[1])) * extent.y + glm::abs(glm::vec3(m[2])) * extent.z;
+			cullBounds.push_back(center - worldExtent, center + worldExtent);
+		}
+
+		/*
+			Draw only the primitives whose world space bounding box intersects the frustum, see drawStatistics for the results
+			Primitives are drawn in node order, renderFlags, pipelineLayout and bindImageSet work as for draw
+		*/
+		void draw(VkCommandBuffer commandBuffer, const vks::Frustum &frustum, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1)
+		{
+			hierarchy.update();
+
+			cullBounds.clear();
+			cullPrimitives.clear();
+			cullMeshIndices.clear();
+			for (auto node : linearNodes) {
+				if (!node->mesh) {
+					continue;
+				}
+				for (Primitive *primitive : node->mesh->primitives) {
+					if (!renderAlphaMode(primitive->material, renderFlags)) {
+						continue;
+					}
+					pushCullBounds(node, primitive);
+					cullPrimitives.push_back(primitive);
+					cullMeshIndices.push_back(node->mesh->index);
+				}
+			}
+			frustum.checkBoxes(cullBounds, cullVisibility);
+
+			bindBuffers(commandBuffer);
+			drawStatistics = {};
+			boundMaterial = nullptr;
+			for (size_t i = 0; i < cullPrimitives.size(); i++) {
+				const Primitive *primitive = cullPrimitives[i];
+				if (cullVisibility[i / 32] & (1u << (i % 32))) {
+					bindMaterial(commandBuffer, primitive->material, renderFlags, pipelineLayout, bindImageSet);
+					if (commandBuffer != VK_NULL_HANDLE) {
+						vkCmdDrawIndexed(commandBuffer, primitive->lodIndexCount(), 1, primitive->lodFirstIndex(), primitive->vertexOffset, cullMeshIndices[i]);
+					}
+					drawStatistics.drawCalls++;
+					drawStatistics.drawnPrimitives++;
+					drawStatistics.drawnTriangles += primitive->lodIndexCount() / 3;
+					drawStatistics.fullDetailTriangles += primitive->indexCount / 3;
+					if (primitive->lod > 0) {
+						drawStatistics.reducedPrimitives++;
+					}
+				}
+				else {
+					drawStatistics.culledPrimitives++;
+					drawStatistics.culledTriangles += primitive->lodIndexCount() / 3;
+				}
+			}
+		}
+
+		/*
+			Compile the primitives of all nodes into the indirect draw list
+			Opaque primitives come first, then masked and blended ones, each group sorted by material so every material is bound once
+			Blended primitives are not sorted by depth, as the draw list is view independent
+		*/
+		void buildDrawList()
+		{
+			struct DrawItem {
+				Node *node;
+				Primitive *primitive;
+			};
+			std::vector<DrawItem> items;
+			for (auto node : linearNodes) {
+				if (node->mesh) {
+					for (Primitive *primitive : node->mesh->primitives) {
+						items.push_back({ node, primitive });
+					}
+				}
+			}
+			std::stable_sort(items.begin(), items.end(), [](const DrawItem &a, const DrawItem &b) {
+				if (a.primitive->material.alphaMode != b.primitive->material.alphaMode) {
+					return a.primitive->material.alphaMode < b.primitive->material.alphaMode;
+				}
+				// All materials are stored in the materials vector, so their addresses follow the material order
+				return &a.primitive->material < &b.primitive->material;
+			});
+
+			drawList.nodes.clear();
+			drawList.primitives.clear();
+			drawList.commands.clear();
+			drawList.batches.clear();
+			drawList.commandBatches.clear();
+			for (auto &item : items) {
+				Material *material = &item.primitive->material;
+				if (drawList.batches.empty() || (drawList.batches.back().material != material)) {
+					DrawBatch batch{};
+					batch.material = material;
+					batch.firstCommand = static_cast<uint32_t>(drawList.commands.size());
+					drawList.batches.push_back(batch);
+				}
+				DrawBatch &batch = drawList.batches.back();
+				batch.commandCount++;
+				batch.visibleCount++;
+				VkDrawIndexedIndirectCommand command{};
+				command.indexCount = item.primitive->lodIndexCount();
+				command.instanceCount = 1;
+				command.firstIndex = item.primitive->lodFirstIndex();
+				command.vertexOffset = item.primitive->vertexOffset;
+				command.firstInstance = item.node->mesh->index;
+				drawList.nodes.push_back(item.node);
+				drawList.primitives.push_back(item.primitive);
+				drawList.commands.push_back(command);
+				drawList.commandBatches.push_back(static_cast<uint32_t>(drawList.batches.size() - 1));
+			}
+
+			// Without a device (models assembled on the CPU only) the list is kept on the host and drawn directly
+			drawList.indirect = device && (device->enabledFeatures.drawIndirectFirstInstance == VK_TRUE);
+			drawList.maxDrawCount = (device && (device->enabledFeatures.multiDrawIndirect == VK_TRUE)) ? std::max(device->properties.limits.maxDrawIndirectCount, 1u) : 1;
+			if (drawList.indirect && !drawList.commands.empty()) {
+				const VkDeviceSize size = drawList.commands.size() * sizeof(VkDrawIndexedIndirectCommand);
+				VK_CHECK_RESULT(device->createBuffer(
+					VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					size,
+					&drawList.buffer,
+					&drawList.allocation,
+					drawList.commands.data()));
+				drawList.mapped = static_cast<VkDrawIndexedIndirectCommand*>(drawList.allocation.mapped);
+			}
+		}
+
+		/*
+			Update the instance counts of the draw list for the primitives visible in the frustum, see drawStatistics for the results
+			Only commands whose visibility changed since the last call are rewritten, the previous frame drawing the list must have completed
+		*/
+		void cullDrawList(const vks::Frustum &frustum)
+		{
+			hierarchy.update();
+
+			cullBounds.clear();
+			for (size_t i = 0; i < drawList.commands.size(); i++) {
+				pushCullBounds(drawList.nodes[i], drawList.primitives[i]);
+			}
+			frustum.checkBoxes(cullBounds, cullVisibility);
+
+			const uint32_t drawCalls = drawStatistics.drawCalls;
+			const uint32_t materialBinds = drawStatistics.materialBinds;
+			drawStatistics = {};
+			drawStatistics.drawCalls = drawCalls;
+			drawStatistics.materialBinds = materialBinds;
+			drawList.updatedCommands = 0;
+			for (size_t i = 0; i < drawList.commands.size(); i++) {
+				VkDrawIndexedIndirectCommand &command = drawList.commands[i];
+				const uint32_t instanceCount = (cullVisibility[i / 32] & (1u << (i % 32))) ? 1 : 0;
+				if (instanceCount) {
+					drawStatistics.drawnPrimitives++;
+					drawStatistics.drawnTriangles += command.indexCount / 3;
+					drawStatistics.fullDetailTriangles += drawList.primitives[i]->indexCount / 3;
+					if (drawList.primitives[i]->lod > 0) {
+						drawStatistics.reducedPrimitives++;
+					}
+				}
+				else {
+					drawStatistics.culledPrimitives++;
+					drawStatistics.culledTriangles += command.indexCount / 3;
+				}
+				if (command.instanceCount == instanceCount) {
+					continue;
+				}
+				DrawBatch &batch = drawList.batches[drawList.commandBatches[i]];
+				batch.visibleCount = instanceCount ? batch.visibleCount + 1 : batch.visibleCount - 1;
+				command.instanceCount = instanceCount;
+				if (drawList.mapped) {
+					drawList.mapped[i].instanceCount = instanceCount;
+				}
+				drawList.updatedCommands++;
+			}
+		}
+
+		/*
+			Draw the compiled draw list with one indirect draw per material batch (split at maxDrawIndirectCount), see buildDrawList
+			Without multiDrawIndirect every command is a separate indirect draw, without drawIndirectFirstInstance a direct draw
+			With BindImages set, each batch's material descriptor set is bound to set bindImageSet of pipelineLayout
+		*/
+		void drawIndirect(VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1)
+		{
+			bindBuffers(commandBuffer);
+			drawStatistics.drawCalls = 0;
+			drawStatistics.materialBinds = 0;
+			boundMaterial = nullptr;
+			for (auto &batch : drawList.batches) {
+				if (batch.visibleCount == 0) {
+					continue;
+				}
+				if (!renderAlphaMode(*batch.material, renderFlags)) {
+					continue;
+				}
+				bindMaterial(commandBuffer, *batch.material, renderFlags, pipelineLayout, bindImageSet);
+				const uint32_t lastCommand = batch.firstCommand + batch.commandCount;
+				if (!drawList.indirect) {
+					for (uint32_t i = batch.firstCommand; i < lastCommand; i++) {
+						const VkDrawIndexedIndirectCommand &command = drawList.commands[i];
+						if (command.instanceCount > 0) {
+							if (commandBuffer != VK_NULL_HANDLE) {
+								vkCmdDrawIndexed(commandBuffer, command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset, command.firstInstance);
+							}
+							drawStatistics.drawCalls++;
+						}
+					}
+					continue;
+				}
+				for (uint32_t first = batch.firstCommand; first < lastCommand; first += drawList.maxDrawCount) {
+					const uint32_t drawCount = std::min(lastCommand - first, drawList.maxDrawCount);
+					if ((drawCount == 1) && (drawList.commands[first].instanceCount == 0)) {
+						continue;
+					}
+					if (commandBuffer != VK_NULL_HANDLE) {
+						vkCmdDrawIndexedIndirect(commandBuffer, drawList.buffer, first * sizeof(VkDrawIndexedIndirectCommand), drawCount, sizeof(VkDrawIndexedIndirectCommand));
+					}
+					drawStatistics.drawCalls++;
+				}
 			}
 		}
 
@@ -1152,6 +2858,87 @@ namespace vkglTF
 			dimensions.radius = glm::distance(dimensions.min, dimensions.max) / 2.0f;
 		}
 
+		/*
+			Find the keyframe interval containing time, starting at the cursor of the previous update
+			Returns the index of the last keyframe at or before time (0 if time is before the first one)
+		*/
+		static uint32_t findKeyframe(const float *times, uint32_t keyCount, float time, uint32_t cursor)
+		{
+			if (cursor + 1 < keyCount) {
+				if ((time >= times[cursor]) && (time < times[cursor + 1])) {
+					return cursor;
+				}
+				if ((cursor + 2 < keyCount) && (time >= times[cursor + 1]) && (time < times[cursor + 2])) {
+					return cursor + 1;
+				}
+			}
+			// Time jumped (e.g. looped or seeked), so search the whole range
+			const float *upper = std::upper_bound(times, times + keyCount, time);
+			return (upper > times) ? static_cast<uint32_t>(upper - times) - 1 : 0;
+		}
+
+		/*
+			Sample the value of an animation channel at the given time (times outside of the keyframes are clamped)
+			Rotations are returned as (x, y, z, w), cursor is the keyframe interval of the previous call and is updated
+			Returns false if the channel's sampler has no (or incomplete) data
+		*/
+		static bool sampleChannel(const Animation &animation, const AnimationChannel &channel, float time, uint32_t &cursor, glm::vec4 &value)
+		{
+			const vkglTF::AnimationSampler &sampler = animation.samplers[channel.samplerIndex];
+			const uint32_t valuesPerKey = (sampler.interpolation == AnimationSampler::InterpolationType::CUBICSPLINE) ? 3 : 1;
+			if ((sampler.keyCount == 0) || (sampler.outputCount < sampler.keyCount * valuesPerKey)) {
+				return false;
+			}
+			const float *times = &animation.inputs[sampler.inputOffset];
+			const glm::vec4 *outputs = &animation.outputs[sampler.outputOffset];
+
+			const uint32_t key = findKeyframe(times, sampler.keyCount, time, cursor);
+			cursor = key;
+
+			if ((key + 1 >= sampler.keyCount) || (time <= times[key])) {
+				// Cubic spline outputs start with the in-tangent
+				value = outputs[key * valuesPerKey + (valuesPerKey == 3 ? 1 : 0)];
+			}
+			else {
+				const float delta = times[key + 1] - times[key];
+				const float u = (time - times[key]) / delta;
+				switch (sampler.interpolation) {
+				case vkglTF::AnimationSampler::InterpolationType::STEP: {
+					value = outputs[key];
+					break;
+				}
+				case vkglTF::AnimationSampler::InterpolationType::LINEAR: {
+					if (channel.path == vkglTF::AnimationChannel::PathType::ROTATION) {
+						glm::quat q1(outputs[key].w, outputs[key].x, outputs[key].y, outputs[key].z);
+						glm::quat q2(outputs[key + 1].w, outputs[key + 1].x, outputs[key + 1].y, outputs[key + 1].z);
+						glm::quat q = glm::slerp(q1, q2, u);
+						value = glm::vec4(q.x, q.y, q.z, q.w);
+					}
+					else {
+						value = glm::mix(outputs[key], outputs[key + 1], u);
+					}
+					break;
+				}
+				case vkglTF::AnimationSampler::InterpolationType::CUBICSPLINE: {
+					// Hermite spline with tangents scaled by the keyframe interval (glTF 2.0 spec, appendix C)
+					const float u2 = u * u;
+					const float u3 = u2 * u;
+					const glm::vec4 &v0 = outputs[key * 3 + 1];
+					const glm::vec4 &b0 = outputs[key * 3 + 2];
+					const glm::vec4 &a1 = outputs[(key + 1) * 3];
+					const glm::vec4 &v1 = outputs[(key + 1) * 3 + 1];
+					value = (2.0f * u3 - 3.0f * u2 + 1.0f) * v0 + delta * (u3 - 2.0f * u2 + u) * b0 + (-2.0f * u3 + 3.0f * u2) * v1 + delta * (u3 - u2) * a1;
+					break;
+				}
+				}
+			}
+			return true;
+		}
+
+		/*
+			Sample an animation at the given time
+			Times outside of a sampler's keyframes are clamped to its first and last value
+		*/
 		void updateAnimation(uint32_t index, float time) 
 		{
 			if (index > static_cast<uint32_t>(animations.size()) - 1) {
@@ -1160,55 +2947,151 @@ namespace vkglTF
 			}
 			Animation &animation = animations[index];
 
-			bool updated = false;
 			for (auto& channel : animation.channels) {
-				vkglTF::AnimationSampler &sampler = animation.samplers[channel.samplerIndex];
-				if (sampler.inputs.size() > sampler.outputsVec4.size()) {
+				glm::vec4 value;
+				if (!sampleChannel(animation, channel, time, channel.keyCursor, value)) {
 					continue;
 				}
 
-				for (auto i = 0; i < sampler.inputs.size() - 1; i++) {
-					if ((time >= sampler.inputs[i]) && (time <= sampler.inputs[i + 1])) {
-						float u = std::max(0.0f, time - sampler.inputs[i]) / (sampler.inputs[i + 1] - sampler.inputs[i]);
-						if (u <= 1.0f) {
-							switch (channel.path) {
-							case vkglTF::AnimationChannel::PathType::TRANSLATION: {
-								glm::vec4 trans = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], u);
-								channel.node->translation = glm::vec3(trans);
-								break;
-							}
-							case vkglTF::AnimationChannel::PathType::SCALE: {
-								glm::vec4 trans = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], u);
-								channel.node->scale = glm::vec3(trans);
-								break;
-							}
-							case vkglTF::AnimationChannel::PathType::ROTATION: {
-								glm::quat q1;
-								q1.x = sampler.outputsVec4[i].x;
-								q1.y = sampler.outputsVec4[i].y;
-								q1.z = sampler.outputsVec4[i].z;
-								q1.w = sampler.outputsVec4[i].w;
-								glm::quat q2;
-								q2.x = sampler.outputsVec4[i + 1].x;
-								q2.y = sampler.outputsVec4[i + 1].y;
-								q2.z = sampler.outputsVec4[i + 1].z;
-								q2.w = sampler.outputsVec4[i + 1].w;
-								channel.node->rotation = glm::normalize(glm::slerp(q1, q2, u));
-								break;
-							}
-							}
-							updated = true;
+				switch (channel.path) {
+				case vkglTF::AnimationChannel::PathType::TRANSLATION:
+					channel.node->setTranslation(glm::vec3(value));
+					break;
+				case vkglTF::AnimationChannel::PathType::SCALE:
+					channel.node->setScale(glm::vec3(value));
+					break;
+				case vkglTF::AnimationChannel::PathType::ROTATION:
+					channel.node->setRotation(glm::normalize(glm::quat(value.w, value.x, value.y, value.z)));
+					break;
+				}
+			}
+			// Only meshes attached to (or skinned by) changed subtrees need new uniforms
+			// This includes changes recalculated by other updates of the hierarchy since the last call (e.g. getMatrix or culled draws)
+			hierarchy.update();
+			if (hierarchy.anyChanged) {
+				for (auto &node : linearNodes) {
+					if (node->mesh && node->transformChanged()) {
+						node->updateMesh();
+					}
+				}
+				hierarchy.clearChanged();
+			}
+		}
+
+		/*
+			Blend the animation states of an instance and write the resulting joint matrices (in model space) to palette
+		*/
+		void evaluateInstance(AnimationInstance &instance, InstancePose &pose, glm::mat4 *palette)
+		{
+			const size_t nodeCount = hierarchy.parents.size();
+			pose.translations.assign(nodeCount, glm::vec3(0.0f));
+			pose.rotations.assign(nodeCount, glm::vec4(0.0f));
+			pose.scales.assign(nodeCount, glm::vec3(0.0f));
+			// Accumulated weights for translation, rotation and scale
+			pose.weights.assign(nodeCount, glm::vec3(0.0f));
+			pose.worldMatrices.resize(nodeCount);
+
+			for (auto &state : instance.states) {
+				if ((state.weight <= 0.0f) || (state.animation >= animations.size())) {
+					continue;
+				}
+				const Animation &animation = animations[state.animation];
+				state.keyCursors.resize(animation.channels.size(), 0);
+				for (size_t i = 0; i < animation.channels.size(); i++) {
+					const AnimationChannel &channel = animation.channels[i];
+					glm::vec4 value;
+					if (!sampleChannel(animation, channel, state.time, state.keyCursors[i], value)) {
+						continue;
+					}
+					const uint32_t node = channel.node->hierarchyIndex;
+					switch (channel.path) {
+					case vkglTF::AnimationChannel::PathType::TRANSLATION:
+						pose.translations[node] += glm::vec3(value) * state.weight;
+						pose.weights[node].x += state.weight;
+						break;
+					case vkglTF::AnimationChannel::PathType::ROTATION:
+						// Keep all rotations in the same hemisphere as the first one, so they don't cancel out
+						if (glm::dot(pose.rotations[node], value) < 0.0f) {
+							value = -value;
 						}
+						pose.rotations[node] += value * state.weight;
+						pose.weights[node].y += state.weight;
+						break;
+					case vkglTF::AnimationChannel::PathType::SCALE:
+						pose.scales[node] += glm::vec3(value) * state.weight;
+						pose.weights[node].z += state.weight;
+						break;
 					}
 				}
 			}
-			if (updated) {
-				for (auto &node : nodes) {
-					node->update();
+
+			// Parents come first in the flattened hierarchy, so world matrices can be calculated in a single pass
+			for (size_t i = 0; i < nodeCount; i++) {
+				const glm::vec3 &weight = pose.weights[i];
+				const glm::vec3 translation = (weight.x > 0.0f) ? pose.translations[i] / weight.x : hierarchy.translations[i];
+				const glm::quat rotation = (weight.y > 0.0f) ? glm::normalize(glm::quat(pose.rotations[i].w, pose.rotations[i].x, pose.rotations[i].y, pose.rotations[i].z)) : hierarchy.rotations[i];
+				const glm::vec3 scale = (weight.z > 0.0f) ? pose.scales[i] / weight.z : hierarchy.scales[i];
+				glm::mat4 local = glm::mat4_cast(rotation);
+				local[0] *= scale.x;
+				local[1] *= scale.y;
+				local[2] *= scale.z;
+				local[3] = glm::vec4(translation, 1.0f);
+				local = local * hierarchy.matrices[i];
+				const int32_t parent = hierarchy.parents[i];
+				pose.worldMatrices[i] = (parent > -1) ? pose.worldMatrices[parent] * local : local;
+			}
+
+			for (auto skin : skins) {
+				for (size_t i = 0; i < skin->joints.size(); i++) {
+					palette[skin->paletteOffset + i] = pose.worldMatrices[skin->joints[i]->hierarchyIndex] * skin->inverseBindMatrices[i];
 				}
 			}
 		}
 
+		/*
+			Evaluate the poses of many instances of this model and write their joint palettes
+			palettes must have room for instances.size() * jointPaletteSize matrices (e.g. a mapped storage buffer, see createJointPaletteBuffer)
+			Joint matrices are in model space, so the transform of the skinned mesh's node is not applied (as required by the glTF spec)
+			If a job system is passed, the instances are distributed across its workers
+		*/
+		void evaluateInstances(std::vector<AnimationInstance> &instances, glm::mat4 *palettes, vks::JobSystem *jobSystem = nullptr)
+		{
+			if ((jointPaletteSize == 0) || instances.empty()) {
+				return;
+			}
+			if (!jobSystem) {
+				if (instancePoses.empty()) {
+					instancePoses.resize(1);
+				}
+				for (size_t i = 0; i < instances.size(); i++) {
+					evaluateInstance(instances[i], instancePoses[0], palettes + i * jointPaletteSize);
+				}
+				return;
+			}
+			if (instancePoses.size() < jobSystem->getWorkerCount()) {
+				instancePoses.resize(jobSystem->getWorkerCount());
+			}
+			jobSystem->parallelFor(static_cast<uint32_t>(instances.size()), [this, &instances, palettes, jobSystem](uint32_t first, uint32_t last) {
+				InstancePose &pose = instancePoses[jobSystem->getWorkerIndex()];
+				for (uint32_t i = first; i < last; i++) {
+					evaluateInstance(instances[i], pose, palettes + i * jointPaletteSize);
+				}
+			});
+		}
+
+		/*
+			Create a host visible storage buffer that holds the joint palettes of instanceCount instances, the buffer is persistently mapped
+		*/
+		void createJointPaletteBuffer(uint32_t instanceCount, vks::Buffer *buffer)
+		{
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				buffer,
+				static_cast<VkDeviceSize>(instanceCount) * std::max(jointPaletteSize, 1u) * sizeof(glm::mat4)));
+			VK_CHECK_RESULT(buffer->map());
+		}
+
 		/*
 			Helper functions
 		*/
@@ -1236,29 +3119,5 @@ namespace vkglTF
 			}
 			return nodeFound;
 		}
-
-		void prepareNodeDescriptor(vkglTF::Node *node, VkDescriptorSetLayout descriptorSetLayout) {
-			if (node->mesh) {
-				VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
-				descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-				descriptorSetAllocInfo.descriptorPool = descriptorPool;
-				descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayout;
-				descriptorSetAllocInfo.descriptorSetCount = 1;
-				VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &descriptorSetAllocInfo, &node->mesh->uniformBuffer.descriptorSet));
-
-				VkWriteDescriptorSet writeDescriptorSet{};
-				writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-				writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-				writeDescriptorSet.descriptorCount = 1;
-				writeDescriptorSet.dstSet = node->mesh->uniformBuffer.descriptorSet;
-				writeDescriptorSet.dstBinding = 0;
-				writeDescriptorSet.pBufferInfo = &node->mesh->uniformBuffer.descriptor;
-
-				vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
-			}
-			for (auto& child : node->children) {
-				prepareNodeDescriptor(child, descriptorSetLayout);
-			}
-		}
 	};
 }
\ No newline at end of file
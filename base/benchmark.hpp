@@ -23,6 +23,8 @@ namespace vks
 	public:
 		bool active = false;
 		bool outputFrameTimes = false;
+		// Run once per number of frames in flight (see runFramesInFlight)
+		bool framesInFlightSweep = false;
 		uint32_t warmup = 1;
 		uint32_t duration = 10;
 		std::vector<double> frameTimes;
@@ -31,6 +33,13 @@ namespace vks
 		double runtime = 0.0;
 		uint32_t frameCount = 0;
 
+		struct FramesInFlightResult {
+			uint32_t framesInFlight;
+			double runtime;
+			uint32_t frameCount;
+		};
+		std::vector<FramesInFlightResult> framesInFlightResults;
+
 		void run(std::function<void()> renderFunc, VkPhysicalDeviceProperties deviceProps) {
 			active = true;
 			this->deviceProps = deviceProps;
@@ -70,6 +79,25 @@ namespace vks
 			}
 		}
 
+		// Runs the benchmark for 1, 2 and 3 frames in flight and compares the throughput
+		// Runs the benchmark for 1 up to maxFramesInFlight (at most 3) frames in flight
+		void runFramesInFlight(std::function<void()> renderFunc, std::function<void(uint32_t)> setFramesInFlight, uint32_t maxFramesInFlight, VkPhysicalDeviceProperties deviceProps) {
+			framesInFlightResults.clear();
+			for (uint32_t framesInFlight = 1; framesInFlight <= std::min(maxFramesInFlight, 3u); framesInFlight++) {
+				setFramesInFlight(framesInFlight);
+				runtime = 0.0;
+				frameCount = 0;
+				frameTimes.clear();
+				std::cout << "frames in flight: " << framesInFlight << std::endl;
+				run(renderFunc, deviceProps);
+				framesInFlightResults.push_back({ framesInFlight, runtime, frameCount });
+			}
+			std::cout << "frames in flight | fps" << std::endl;
+			for (auto &result : framesInFlightResults) {
+				std::cout << std::setw(16) << result.framesInFlight << " | " << result.frameCount / (result.runtime / 1000.0) << std::endl;
+			}
+		}
+
 		void saveResults() {
 			std::ofstream result(filename, std::ios::out);
 			if (result.is_open()) {
@@ -78,6 +106,13 @@ namespace vks
 				result << "device,driverversion,duration (ms),frames,fps" << std::endl;
 				result << deviceProps.deviceName << "," << deviceProps.driverVersion << "," << runtime << "," << frameCount << "," << frameCount / (runtime / 1000.0) << std::endl;
 
+				if (!framesInFlightResults.empty()) {
+					result << std::endl << "frames in flight,duration (ms),frames,fps" << std::endl;
+					for (auto &fif : framesInFlightResults) {
+						result << fif.framesInFlight << "," << fif.runtime << "," << fif.frameCount << "," << fif.frameCount / (fif.runtime / 1000.0) << std::endl;
+					}
+				}
+
 				if (outputFrameTimes) {
 					result << std::endl << "frame,ms" << std::endl;
 					for (size_t i = 0; i < frameTimes.size(); i++) {
@@ -6,12 +6,86 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#pragma once
+
 #include <array>
+#include <vector>
 #include <math.h>
+#include <stdint.h>
 #include <glm/glm.hpp>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define VKS_FRUSTUM_SSE
+#include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+#define VKS_FRUSTUM_AVX
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 namespace vks
 {
+	/** @brief Bounding spheres stored as one array per component for the batch culling functions */
+	struct SphereBounds
+	{
+		std::vector<float> x, y, z, radius;
+
+		void push_back(const glm::vec3 &center, float r)
+		{
+			x.push_back(center.x);
+			y.push_back(center.y);
+			z.push_back(center.z);
+			radius.push_back(r);
+		}
+
+		void clear()
+		{
+			x.clear();
+			y.clear();
+			z.clear();
+			radius.clear();
+		}
+
+		size_t size() const
+		{
+			return x.size();
+		}
+	};
+
+	/** @brief Axis aligned bounding boxes stored as one array per component for the batch culling functions */
+	struct BoxBounds
+	{
+		std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+
+		void push_back(const glm::vec3 &min, const glm::vec3 &max)
+		{
+			minX.push_back(min.x);
+			minY.push_back(min.y);
+			minZ.push_back(min.z);
+			maxX.push_back(max.x);
+			maxY.push_back(max.y);
+			maxZ.push_back(max.z);
+		}
+
+		void clear()
+		{
+			minX.clear();
+			minY.clear();
+			minZ.clear();
+			maxX.clear();
+			maxY.clear();
+			maxZ.clear();
+		}
+
+		size_t size() const
+		{
+			return minX.size();
+		}
+	};
+
 	class Frustum
 	{
 	public:
@@ -56,17 +130,196 @@ namespace vks
 				planes[i] /= length;
 			}
 		}
-		
-		bool checkSphere(glm::vec3 pos, float radius)
+
+		bool checkSphere(glm::vec3 pos, float radius) const
 		{
 			for (auto i = 0; i < planes.size(); i++)
 			{
-				if ((planes[i].x * pos.x) + (planes[i].y * pos.y) + (planes[i].z * pos.z) + planes[i].w <= -radius)
+				// Same order of operations as the batch tests, so all paths give the same result for the same sphere
+				float d = planes[i].x * pos.x + planes[i].w;
+				d += planes[i].y * pos.y;
+				d += planes[i].z * pos.z;
+				if (d <= -radius)
 				{
 					return false;
 				}
 			}
 			return true;
 		}
+
+		/** @brief Returns false if the box is completely outside of at least one plane (may return true for boxes near frustum corners) */
+		bool checkBox(glm::vec3 min, glm::vec3 max) const
+		{
+			for (auto i = 0; i < planes.size(); i++)
+			{
+				// Corner of the box that lies furthest along the plane normal
+				glm::vec3 p(planes[i].x > 0.0f ? max.x : min.x, planes[i].y > 0.0f ? max.y : min.y, planes[i].z > 0.0f ? max.z : min.z);
+				// Same order of operations as the batch tests and the culling compute shader (data/shaders/base/cull.comp)
+				float d = planes[i].x * p.x + planes[i].w;
+				d += planes[i].y * p.y;
+				d += planes[i].z * p.z;
+				if (d < 0.0f)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		/**
+		* Test many spheres against the frustum
+		*
+		* @param bounds Spheres to test
+		* @param visibilityMask Returns one bit per sphere (bit i % 32 of element i / 32), set if the sphere is visible
+		*/
+		void checkSpheres(const SphereBounds &bounds, std::vector<uint32_t> &visibilityMask) const
+		{
+			const size_t count = bounds.size();
+			visibilityMask.assign((count + 31) / 32, 0);
+			size_t i = 0;
+#if defined(VKS_FRUSTUM_AVX)
+			for (; i + 8 <= count; i += 8)
+			{
+				const __m256 x = _mm256_loadu_ps(&bounds.x[i]);
+				const __m256 y = _mm256_loadu_ps(&bounds.y[i]);
+				const __m256 z = _mm256_loadu_ps(&bounds.z[i]);
+				const __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&bounds.radius[i]));
+				__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+				for (auto &plane : planes)
+				{
+					__m256 d = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), x), _mm256_set1_ps(plane.w));
+					d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(plane.y), y));
+					d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(plane.z), z));
+					inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negRadius, _CMP_GT_OQ));
+				}
+				visibilityMask[i / 32] |= static_cast<uint32_t>(_mm256_movemask_ps(inside)) << (i % 32);
+			}
+#endif
+#if defined(VKS_FRUSTUM_SSE)
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128 x = _mm_loadu_ps(&bounds.x[i]);
+				const __m128 y = _mm_loadu_ps(&bounds.y[i]);
+				const __m128 z = _mm_loadu_ps(&bounds.z[i]);
+				const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&bounds.radius[i]));
+				__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				for (auto &plane : planes)
+				{
+					__m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), x), _mm_set1_ps(plane.w));
+					d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane.y), y));
+					d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane.z), z));
+					inside = _mm_and_ps(inside, _mm_cmpgt_ps(d, negRadius));
+				}
+				visibilityMask[i / 32] |= static_cast<uint32_t>(_mm_movemask_ps(inside)) << (i % 32);
+			}
+#endif
+			for (; i < count; i++)
+			{
+				if (checkSphere(glm::vec3(bounds.x[i], bounds.y[i], bounds.z[i]), bounds.radius[i]))
+				{
+					visibilityMask[i / 32] |= 1u << (i % 32);
+				}
+			}
+		}
+
+		/**
+		* Test many axis aligned boxes against the frustum
+		*
+		* @param bounds Boxes to test
+		* @param visibilityMask Returns one bit per box (bit i % 32 of element i / 32), set if the box is visible
+		*/
+		void checkBoxes(const BoxBounds &bounds, std::vector<uint32_t> &visibilityMask) const
+		{
+			const size_t count = bounds.size();
+			visibilityMask.assign((count + 31) / 32, 0);
+			size_t i = 0;
+			// The corner furthest along a plane's normal is picked per plane, so it's the same for all lanes
+			const float *cornerX[6], *cornerY[6], *cornerZ[6];
+			for (size_t p = 0; p < planes.size(); p++)
+			{
+				cornerX[p] = planes[p].x > 0.0f ? bounds.maxX.data() : bounds.minX.data();
+				cornerY[p] = planes[p].y > 0.0f ? bounds.maxY.data() : bounds.minY.data();
+				cornerZ[p] = planes[p].z > 0.0f ? bounds.maxZ.data() : bounds.minZ.data();
+			}
+#if defined(VKS_FRUSTUM_AVX)
+			for (; i + 8 <= count; i += 8)
+			{
+				__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+				for (size_t p = 0; p < planes.size(); p++)
+				{
+					__m256 d = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[p].x), _mm256_loadu_ps(cornerX[p] + i)), _mm256_set1_ps(planes[p].w));
+					d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(planes[p].y), _mm256_loadu_ps(cornerY[p] + i)));
+					d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(planes[p].z), _mm256_loadu_ps(cornerZ[p] + i)));
+					inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_GE_OQ));
+				}
+				visibilityMask[i / 32] |= static_cast<uint32_t>(_mm256_movemask_ps(inside)) << (i % 32);
+			}
+#endif
+#if defined(VKS_FRUSTUM_SSE)
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				for (size_t p = 0; p < planes.size(); p++)
+				{
+					__m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p].x), _mm_loadu_ps(cornerX[p] + i)), _mm_set1_ps(planes[p].w));
+					d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(planes[p].y), _mm_loadu_ps(cornerY[p] + i)));
+					d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(planes[p].z), _mm_loadu_ps(cornerZ[p] + i)));
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(d, _mm_setzero_ps()));
+				}
+				visibilityMask[i / 32] |= static_cast<uint32_t>(_mm_movemask_ps(inside)) << (i % 32);
+			}
+#endif
+			for (; i < count; i++)
+			{
+				if (checkBox(glm::vec3(bounds.minX[i], bounds.minY[i], bounds.minZ[i]), glm::vec3(bounds.maxX[i], bounds.maxY[i], bounds.maxZ[i])))
+				{
+					visibilityMask[i / 32] |= 1u << (i % 32);
+				}
+			}
+		}
+
+		/**
+		* Convert a visibility mask into a list of the visible indices
+		*
+		* @param visibilityMask Mask written by checkSpheres or checkBoxes
+		* @param visibleIndices Returns the indices of all set bits in ascending order
+		*/
+		static void compactVisible(const std::vector<uint32_t> &visibilityMask, std::vector<uint32_t> &visibleIndices)
+		{
+			visibleIndices.clear();
+			for (size_t w = 0; w < visibilityMask.size(); w++)
+			{
+				uint32_t bits = visibilityMask[w];
+				while (bits)
+				{
+#if defined(_MSC_VER)
+					unsigned long bit;
+					_BitScanForward(&bit, bits);
+#else
+					uint32_t bit = static_cast<uint32_t>(__builtin_ctz(bits));
+#endif
+					visibleIndices.push_back(static_cast<uint32_t>(w * 32 + bit));
+					bits &= bits - 1;
+				}
+			}
+		}
+
+		/** @brief Test many spheres against the frustum and return the indices of the visible ones */
+		void cullSpheres(const SphereBounds &bounds, std::vector<uint32_t> &visibleIndices)
+		{
+			checkSpheres(bounds, visibilityMask);
+			compactVisible(visibilityMask, visibleIndices);
+		}
+
+		/** @brief Test many axis aligned boxes against the frustum and return the indices of the visible ones */
+		void cullBoxes(const BoxBounds &bounds, std::vector<uint32_t> &visibleIndices)
+		{
+			checkBoxes(bounds, visibilityMask);
+			compactVisible(visibilityMask, visibleIndices);
+		}
+
+	private:
+		// Scratch mask for cullSpheres and cullBoxes
+		std::vector<uint32_t> visibilityMask;
 	};
 }
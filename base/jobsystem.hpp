@@ -0,0 +1,513 @@
+/*
+* Work stealing job system
+*
+* Each worker owns a lock-free deque (Chase-Lev) it pushes and pops jobs at the bottom of,
+* idle workers steal from the top of other workers' deques
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <stdexcept>
+#include <new>
+#include <type_traits>
+#include <algorithm>
+#include <assert.h>
+#include <stdint.h>
+
+namespace vks
+{
+	/*
+		A unit of work, jobs are allocated from a per thread ring buffer and referenced by pointer ("job handle")
+		unfinishedJobs counts the job itself plus all of its unfinished children, a job is complete once it reaches zero
+	*/
+	struct Job
+	{
+		typedef void (*Function)(void *data);
+
+		Function function;
+		Job *parent;
+		std::atomic<int32_t> unfinishedJobs;
+		// Small callables are stored in place, larger ones are moved to the heap and only their pointer is stored here
+		static const size_t dataSize = 128 - sizeof(Function) - sizeof(Job*) - sizeof(std::atomic<int32_t>) - sizeof(int32_t);
+		typename std::aligned_storage<dataSize, sizeof(void*)>::type data;
+	};
+
+	class JobSystem
+	{
+	private:
+		// Number of jobs each thread can have in flight, a job handle is reused once the job has completed
+		static const uint32_t maxJobsPerThread = 4096;
+
+		/*
+			Lock-free work stealing deque, only the owning thread calls push and pop, all other threads steal
+			Based on "Dynamic Circular Work-Stealing Deque" (Chase, Lev) with a fixed capacity
+		*/
+		class JobQueue
+		{
+		private:
+			std::atomic<int64_t> top;
+			std::atomic<int64_t> bottom;
+			std::atomic<Job*> jobs[maxJobsPerThread];
+
+		public:
+			JobQueue() : top(0), bottom(0)
+			{
+				for (auto &job : jobs)
+				{
+					job.store(nullptr, std::memory_order_relaxed);
+				}
+			}
+
+			void push(Job *job)
+			{
+				int64_t b = bottom.load(std::memory_order_relaxed);
+				jobs[b & (maxJobsPerThread - 1)].store(job, std::memory_order_relaxed);
+				// Publishes the job (and the data it points to) to stealing threads
+				bottom.store(b + 1, std::memory_order_release);
+			}
+
+			Job* pop()
+			{
+				int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+				bottom.store(b, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				int64_t t = top.load(std::memory_order_relaxed);
+				if (t > b)
+				{
+					// Empty
+					bottom.store(b + 1, std::memory_order_relaxed);
+					return nullptr;
+				}
+				Job *job = jobs[b & (maxJobsPerThread - 1)].load(std::memory_order_relaxed);
+				if (t != b)
+				{
+					return job;
+				}
+				// Last job in the queue, race against concurrent steals
+				if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				{
+					job = nullptr;
+				}
+				bottom.store(b + 1, std::memory_order_relaxed);
+				return job;
+			}
+
+			Job* steal()
+			{
+				int64_t t = top.load(std::memory_order_acquire);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				int64_t b = bottom.load(std::memory_order_acquire);
+				if (t >= b)
+				{
+					return nullptr;
+				}
+				Job *job = jobs[t & (maxJobsPerThread - 1)].load(std::memory_order_relaxed);
+				if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				{
+					// Another thread was faster
+					return nullptr;
+				}
+				return job;
+			}
+		};
+
+		struct Worker
+		{
+			JobQueue queue;
+			std::vector<Job> jobPool;
+			uint32_t allocatedJobs = 0;
+			// Jobs created by this thread that have not been passed to run yet
+			uint32_t unqueuedJobs = 0;
+			uint32_t randomState = 0;
+			// All slots of jobPool were in flight the last time a job was allocated
+			bool poolExhausted = false;
+
+			Worker() : jobPool(maxJobsPerThread) {};
+		};
+
+		std::vector<std::unique_ptr<Worker>> workers;
+		std::vector<std::thread> threads;
+		std::atomic<bool> stopping;
+		std::atomic<uint32_t> sleepingThreads;
+		// Jobs passed to run that have not been taken from a queue yet, may briefly drop below zero while a job is taken right after its push
+		std::atomic<int32_t> queuedJobs;
+		std::mutex wakeMutex;
+		std::condition_variable wakeCondition;
+
+		struct ThreadContext
+		{
+			JobSystem *system = nullptr;
+			uint32_t workerIndex = 0;
+		};
+		// Context of the creating thread before this job system was created, restored on destruction
+		ThreadContext previousContext;
+
+		static ThreadContext& threadContext()
+		{
+			static thread_local ThreadContext context;
+			return context;
+		}
+
+		Worker& currentWorker()
+		{
+			// Jobs can only be created and run from the thread that created the job system and from its worker threads
+			assert(threadContext().system == this);
+			return *workers[threadContext().workerIndex];
+		}
+
+		template<typename F>
+		static void invokeInPlace(void *data)
+		{
+			F *function = reinterpret_cast<F*>(data);
+			(*function)();
+			function->~F();
+		}
+
+		template<typename F>
+		static void invokeOnHeap(void *data)
+		{
+			F *function = *reinterpret_cast<F**>(data);
+			(*function)();
+			delete function;
+		}
+
+		template<typename F>
+		static void storeFunction(Job *job, F &&function, std::true_type)
+		{
+			typedef typename std::decay<F>::type Callable;
+			new (&job->data) Callable(std::forward<F>(function));
+			job->function = &invokeInPlace<Callable>;
+		}
+
+		template<typename F>
+		static void storeFunction(Job *job, F &&function, std::false_type)
+		{
+			typedef typename std::decay<F>::type Callable;
+			*reinterpret_cast<Callable**>(&job->data) = new Callable(std::forward<F>(function));
+			job->function = &invokeOnHeap<Callable>;
+		}
+
+		Job* getJob()
+		{
+			Worker &worker = currentWorker();
+			Job *job = worker.queue.pop();
+			if (job)
+			{
+				queuedJobs.fetch_sub(1);
+				return job;
+			}
+			if (workers.size() < 2)
+			{
+				return nullptr;
+			}
+			// Start stealing at a random worker, so idle threads don't all hammer the same queue
+			worker.randomState ^= worker.randomState << 13;
+			worker.randomState ^= worker.randomState >> 17;
+			worker.randomState ^= worker.randomState << 5;
+			const uint32_t start = worker.randomState % workers.size();
+			for (uint32_t i = 0; i < workers.size(); i++)
+			{
+				Worker &victim = *workers[(start + i) % workers.size()];
+				if (&victim == &worker)
+				{
+					continue;
+				}
+				job = victim.queue.steal();
+				if (job)
+				{
+					queuedJobs.fetch_sub(1);
+					return job;
+				}
+			}
+			return nullptr;
+		}
+
+		/*
+			Get an unused job from the calling thread's pool, slots of jobs that are still in flight (e.g. a long running parent) are skipped
+			Once all slots are in flight, the thread executes a queued job for every new one and reuses that job's slot
+			Throws if all slots hold jobs that have not been passed to run, as none of them could ever complete
+		*/
+		Job* allocateJob()
+		{
+			Worker &worker = currentWorker();
+			while (true)
+			{
+				// Searching a full pool for every new job is slow, so go straight to helping out while it stays full
+				if (worker.poolExhausted)
+				{
+					Job *job = executeQueuedJob(worker);
+					if (job)
+					{
+						return job;
+					}
+				}
+				for (uint32_t i = 0; i < maxJobsPerThread; i++)
+				{
+					Job *job = &worker.jobPool[worker.allocatedJobs++ & (maxJobsPerThread - 1)];
+					if (isComplete(job))
+					{
+						worker.poolExhausted = false;
+						return job;
+					}
+				}
+				if (worker.unqueuedJobs == maxJobsPerThread)
+				{
+					throw std::runtime_error("All jobs of the thread have been created but not run");
+				}
+				// All jobs of this thread are in flight, help out until one of them has finished
+				worker.poolExhausted = true;
+				Job *job = executeQueuedJob(worker);
+				if (job)
+				{
+					return job;
+				}
+			}
+		}
+
+		/*
+			Execute a queued (or stolen) job, returns it if its slot belongs to the worker's pool and can be reused right away
+		*/
+		Job* executeQueuedJob(Worker &worker)
+		{
+			Job *job = getJob();
+			if (!job)
+			{
+				std::this_thread::yield();
+				return nullptr;
+			}
+			execute(job);
+			if ((job >= worker.jobPool.data()) && (job < worker.jobPool.data() + maxJobsPerThread) && isComplete(job))
+			{
+				return job;
+			}
+			return nullptr;
+		}
+
+		void finish(Job *job)
+		{
+			// Read before the decrement, the slot may be reused as soon as the job is complete
+			Job *parent = job->parent;
+			const int32_t unfinishedJobs = job->unfinishedJobs.fetch_sub(1, std::memory_order_acq_rel) - 1;
+			if ((unfinishedJobs == 0) && parent)
+			{
+				finish(parent);
+			}
+		}
+
+		void execute(Job *job)
+		{
+			job->function(&job->data);
+			finish(job);
+		}
+
+		void workerLoop(uint32_t workerIndex)
+		{
+			threadContext().system = this;
+			threadContext().workerIndex = workerIndex;
+			while (!stopping.load(std::memory_order_acquire))
+			{
+				Job *job = getJob();
+				if (job)
+				{
+					execute(job);
+					continue;
+				}
+				// Sleep until new work is pushed, run sees either this thread sleeping or the worker sees the queued job (both sides are sequentially consistent)
+				std::unique_lock<std::mutex> lock(wakeMutex);
+				sleepingThreads.fetch_add(1);
+				wakeCondition.wait(lock, [this] { return (queuedJobs.load() > 0) || stopping.load(); });
+				sleepingThreads.fetch_sub(1);
+			}
+		}
+
+	public:
+		/*
+			Create a job system
+			The calling thread becomes worker 0 and takes part in executing jobs while it waits for them
+			threadCount is the number of additional worker threads (defaults to one less than the number of hardware threads)
+		*/
+		JobSystem(uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 1u) - 1) : stopping(false), sleepingThreads(0), queuedJobs(0)
+		{
+			for (uint32_t i = 0; i <= threadCount; i++)
+			{
+				workers.push_back(std::unique_ptr<Worker>(new Worker()));
+				workers.back()->randomState = 0x9e3779b9u * (i + 1);
+			}
+			previousContext = threadContext();
+			threadContext().system = this;
+			threadContext().workerIndex = 0;
+			for (uint32_t i = 1; i <= threadCount; i++)
+			{
+				threads.push_back(std::thread(&JobSystem::workerLoop, this, i));
+			}
+		}
+
+		/*
+			All jobs must have been waited for before the job system is destroyed
+		*/
+		~JobSystem()
+		{
+			{
+				std::lock_guard<std::mutex> lock(wakeMutex);
+				stopping.store(true);
+			}
+			wakeCondition.notify_all();
+			for (auto &thread : threads)
+			{
+				thread.join();
+			}
+			if (threadContext().system == this)
+			{
+				threadContext() = previousContext;
+			}
+		}
+
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+
+		/*
+			Number of threads executing jobs, including the thread that created the job system
+		*/
+		uint32_t getWorkerCount() const
+		{
+			return static_cast<uint32_t>(workers.size());
+		}
+
+		/*
+			Index of the calling thread in [0, getWorkerCount()), e.g. to select per thread scratch data inside of jobs
+		*/
+		uint32_t getWorkerIndex() const
+		{
+			assert(threadContext().system == this);
+			return threadContext().workerIndex;
+		}
+
+		/*
+			Create a job that calls function once it's run
+			If a parent is passed, the parent is not complete before this job has finished
+			The job has to be passed to run, it's not executed before
+		*/
+		template<typename F>
+		Job* createJob(F &&function, Job *parent = nullptr)
+		{
+			Job *job = allocateJob();
+			currentWorker().unqueuedJobs++;
+			job->parent = parent;
+			job->unfinishedJobs.store(1, std::memory_order_relaxed);
+			if (parent)
+			{
+				parent->unfinishedJobs.fetch_add(1, std::memory_order_relaxed);
+			}
+			typedef typename std::decay<F>::type Callable;
+			storeFunction(job, std::forward<F>(function), std::integral_constant<bool, (sizeof(Callable) <= Job::dataSize) && (std::alignment_of<Callable>::value <= sizeof(void*))>());
+			return job;
+		}
+
+		/*
+			Create a job without any work of its own, e.g. as a parent to wait on a group of jobs
+		*/
+		Job* createGroup(Job *parent = nullptr)
+		{
+			return createJob([] {}, parent);
+		}
+
+		/*
+			Queue a job for execution on this thread's deque, other workers may steal it
+			Jobs must be run on the thread that created them
+		*/
+		void run(Job *job)
+		{
+			Worker &worker = currentWorker();
+			assert(worker.unqueuedJobs > 0);
+			worker.unqueuedJobs--;
+			worker.queue.push(job);
+			queuedJobs.fetch_add(1);
+			if (sleepingThreads.load() > 0)
+			{
+				// A sleeping thread holds the lock until it waits, so it can't miss the notification
+				{
+					std::lock_guard<std::mutex> lock(wakeMutex);
+				}
+				wakeCondition.notify_one();
+			}
+		}
+
+		bool isComplete(const Job *job) const
+		{
+			return job->unfinishedJobs.load(std::memory_order_acquire) == 0;
+		}
+
+		/*
+			Execute queued (or stolen) jobs until the given job and all of its children have finished
+		*/
+		void wait(const Job *job)
+		{
+			while (!isComplete(job))
+			{
+				Job *next = getJob();
+				if (next)
+				{
+					execute(next);
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+
+		/*
+			Call function(begin, end) for consecutive ranges covering [0, count) and wait for all of them
+			Ranges are split in halves until they are no larger than batchSize, so idle workers can steal large parts of the work
+			A batchSize of zero picks one that gives each worker a few ranges
+		*/
+		template<typename F>
+		void parallelFor(uint32_t count, const F &function, uint32_t batchSize = 0)
+		{
+			if (count == 0)
+			{
+				return;
+			}
+			if (batchSize == 0)
+			{
+				batchSize = std::max(count / (getWorkerCount() * 4), 1u);
+			}
+			if ((count <= batchSize) || (getWorkerCount() == 1))
+			{
+				function(0u, count);
+				return;
+			}
+			Job *root = createGroup();
+			runRange(root, function, 0, count, batchSize);
+			run(root);
+			wait(root);
+		}
+
+	private:
+		template<typename F>
+		void runRange(Job *root, const F &function, uint32_t begin, uint32_t end, uint32_t batchSize)
+		{
+			const F *f = &function;
+			Job *job = createJob([this, root, f, begin, end, batchSize] {
+				uint32_t rangeEnd = end;
+				// Hand off upper halves until the remaining range is small enough, then work on it directly
+				while (rangeEnd - begin > batchSize)
+				{
+					const uint32_t middle = begin + (rangeEnd - begin) / 2;
+					runRange(root, *f, middle, rangeEnd, batchSize);
+					rangeEnd = middle;
+				}
+				(*f)(begin, rangeEnd);
+			}, root);
+			run(job);
+		}
+	};
+}
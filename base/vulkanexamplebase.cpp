@@ -116,6 +116,21 @@ void VulkanExampleBase::createCommandBuffers() {
 }
 
 void VulkanExampleBase::destroyCommandBuffers() {
+  // Secondary command buffers recorded for the destroyed primaries, new
+  // primaries may reuse their handles
+  for (auto it = secondaryCommandBuffers.begin();
+       it != secondaryCommandBuffers.end();) {
+    if (std::find(drawCmdBuffers.begin(), drawCmdBuffers.end(),
+                  it->primary) == drawCmdBuffers.end()) {
+      ++it;
+      continue;
+    }
+    for (size_t slot = 0; slot < it->commandBuffers.size(); slot++) {
+      vkFreeCommandBuffers(device, recordCommandPools[slot], 1,
+                           &it->commandBuffers[slot]);
+    }
+    it = secondaryCommandBuffers.erase(it);
+  }
   vkFreeCommandBuffers(device, cmdPool,
                        static_cast<uint32_t>(drawCmdBuffers.size()),
                        drawCmdBuffers.data());
@@ -164,11 +179,97 @@ void VulkanExampleBase::flushCommandBuffer(VkCommandBuffer commandBuffer,
   }
 }
 
+std::string VulkanExampleBase::getPipelineCacheFilename() {
+  // Pipelines differ between examples, so each executable gets its own cache
+  std::string exeName = name;
+  if (!args.empty()) {
+    exeName = args[0];
+    size_t pos = exeName.find_last_of("/\\");
+    if (pos != std::string::npos) {
+      exeName = exeName.substr(pos + 1);
+    }
+  }
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+  return std::string(androidApp->activity->internalDataPath) + "/" + exeName +
+         ".pipelinecache";
+#else
+  return exeName + ".pipelinecache";
+#endif
+}
+
+bool VulkanExampleBase::isPipelineCacheCompatible(
+    const std::vector<char>& data) {
+  // Layout of VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+  struct {
+    uint32_t headerSize;
+    uint32_t headerVersion;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+  } header;
+  if (data.size() < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, data.data(), sizeof(header));
+  return (header.headerSize >= sizeof(header)) &&
+         (header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE) &&
+         (header.vendorID == deviceProperties.vendorID) &&
+         (header.deviceID == deviceProperties.deviceID) &&
+         (memcmp(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID,
+                 VK_UUID_SIZE) == 0);
+}
+
 void VulkanExampleBase::createPipelineCache() {
+  std::vector<char> cacheData;
+  if (settings.pipelineCache) {
+    std::string filename = getPipelineCacheFilename();
+    std::ifstream is(filename, std::ios::binary | std::ios::ate);
+    if (is.is_open()) {
+      cacheData.resize(static_cast<size_t>(is.tellg()));
+      is.seekg(0, std::ios::beg);
+      is.read(cacheData.data(), cacheData.size());
+      is.close();
+      // Data written by another driver or device would be ignored (or worse)
+      // by the implementation, so start cold instead
+      if (!isPipelineCacheCompatible(cacheData)) {
+        std::cout << "Pipeline cache \"" << filename
+                  << "\" does not match the current device, ignoring it"
+                  << std::endl;
+        cacheData.clear();
+      }
+    }
+  }
+  pipelineCacheLoadedSize = cacheData.size();
+
   VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
   pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  pipelineCacheCreateInfo.initialDataSize = cacheData.size();
+  pipelineCacheCreateInfo.pInitialData =
+      cacheData.empty() ? nullptr : cacheData.data();
   VK_CHECK_RESULT(vkCreatePipelineCache(device, &pipelineCacheCreateInfo,
                                         nullptr, &pipelineCache));
+  pipelineCacheCreated = std::chrono::high_resolution_clock::now();
+}
+
+void VulkanExampleBase::savePipelineCache() {
+  size_t dataSize = 0;
+  VK_CHECK_RESULT(
+      vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr));
+  if (dataSize == 0) {
+    return;
+  }
+  std::vector<char> cacheData(dataSize);
+  VK_CHECK_RESULT(vkGetPipelineCacheData(device, pipelineCache, &dataSize,
+                                         cacheData.data()));
+  std::string filename = getPipelineCacheFilename();
+  std::ofstream os(filename, std::ios::binary | std::ios::trunc);
+  if (os.is_open()) {
+    os.write(cacheData.data(), dataSize);
+    os.close();
+  } else {
+    std::cerr << "Could not write pipeline cache to \"" << filename << "\""
+              << std::endl;
+  }
 }
 
 void VulkanExampleBase::prepare() {
@@ -194,6 +295,7 @@ void VulkanExampleBase::prepare() {
         loadShader(getAssetPath() + "shaders/base/uioverlay.frag.spv",
                    VK_SHADER_STAGE_FRAGMENT_BIT),
     };
+    UIOverlay.regionCount = swapChain.imageCount;
     UIOverlay.prepareResources();
     UIOverlay.preparePipeline(pipelineCache, renderPass);
   }
@@ -258,7 +360,13 @@ void VulkanExampleBase::renderFrame() {
 
 void VulkanExampleBase::renderLoop() {
   if (benchmark.active) {
-    benchmark.run([=] { render(); }, vulkanDevice->properties);
+    if (benchmark.framesInFlightSweep) {
+      benchmark.runFramesInFlight(
+          [=] { render(); }, [=](uint32_t count) { setFramesInFlight(count); },
+          maxFramesInFlight, vulkanDevice->properties);
+    } else {
+      benchmark.run([=] { render(); }, vulkanDevice->properties);
+    }
     vkDeviceWaitIdle(device);
     if (benchmark.filename != "") {
       benchmark.saveResults();
@@ -549,6 +657,13 @@ void VulkanExampleBase::updateOverlay() {
   ImGui::PopStyleVar();
   ImGui::Render();
 
+  // The overlay's vertex and index buffers are shared by all frames, so they
+  // may only be reallocated (and the command buffers binding them rebuilt)
+  // once no frame in flight reads them anymore. Their contents are written
+  // per swap chain image in prepareFrame().
+  if (UIOverlay.bufferResizeRequired() || UIOverlay.updated) {
+    waitFramesInFlight();
+  }
   if (UIOverlay.update() || UIOverlay.updated) {
     buildCommandBuffers();
     UIOverlay.updated = false;
@@ -561,7 +676,8 @@ void VulkanExampleBase::updateOverlay() {
 #endif
 }
 
-void VulkanExampleBase::drawUI(const VkCommandBuffer commandBuffer) {
+void VulkanExampleBase::drawUI(const VkCommandBuffer commandBuffer,
+                               uint32_t imageIndex) {
   if (settings.overlay) {
     const VkViewport viewport = vks::initializers::viewport(
         (float)viewportWidth, (float)viewportHeight, 0.0f, 1.0f);
@@ -570,11 +686,130 @@ void VulkanExampleBase::drawUI(const VkCommandBuffer commandBuffer) {
     vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-    UIOverlay.draw(commandBuffer);
+    UIOverlay.draw(commandBuffer, imageIndex);
+  }
+}
+
+void VulkanExampleBase::recordSecondaryCommandBuffers(
+    VkCommandBuffer primary,
+    VkRenderPass renderPass,
+    uint32_t subpass,
+    VkFramebuffer framebuffer,
+    uint32_t drawCount,
+    const std::function<void(VkCommandBuffer, uint32_t, uint32_t)>& record) {
+  if (!recordJobs) {
+    // Created here, so the thread that records the primary command buffers
+    // takes part in recording the secondaries
+    recordJobs.reset(new vks::JobSystem(getRecordThreadCount() - 1));
+  }
+  const uint32_t slotCount =
+      std::max(std::min(recordJobs->getWorkerCount(), drawCount), 1u);
+
+  while (recordCommandPools.size() < slotCount) {
+    VkCommandPoolCreateInfo cmdPoolInfo =
+        vks::initializers::commandPoolCreateInfo();
+    cmdPoolInfo.queueFamilyIndex = swapChain.queueNodeIndex;
+    cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    VkCommandPool commandPool;
+    VK_CHECK_RESULT(
+        vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &commandPool));
+    recordCommandPools.push_back(commandPool);
+  }
+
+  SecondaryCommandBuffers* secondaries = nullptr;
+  for (auto& entry : secondaryCommandBuffers) {
+    if ((entry.primary == primary) && (entry.renderPass == renderPass) &&
+        (entry.subpass == subpass)) {
+      secondaries = &entry;
+      break;
+    }
+  }
+  if (!secondaries) {
+    secondaryCommandBuffers.push_back({primary, renderPass, subpass, {}});
+    secondaries = &secondaryCommandBuffers.back();
+  }
+  while (secondaries->commandBuffers.size() < slotCount) {
+    VkCommandBufferAllocateInfo cmdBufAllocateInfo =
+        vks::initializers::commandBufferAllocateInfo(
+            recordCommandPools[secondaries->commandBuffers.size()],
+            VK_COMMAND_BUFFER_LEVEL_SECONDARY, 1);
+    VkCommandBuffer commandBuffer;
+    VK_CHECK_RESULT(
+        vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &commandBuffer));
+    secondaries->commandBuffers.push_back(commandBuffer);
+  }
+
+  VkCommandBufferInheritanceInfo inheritanceInfo =
+      vks::initializers::commandBufferInheritanceInfo();
+  inheritanceInfo.renderPass = renderPass;
+  inheritanceInfo.subpass = subpass;
+  inheritanceInfo.framebuffer = framebuffer;
+
+  // Each slot is recorded by exactly one job, jobs for different slots run
+  // concurrently on the workers
+  const std::vector<VkCommandBuffer>& commandBuffers =
+      secondaries->commandBuffers;
+  recordJobs->parallelFor(
+      slotCount,
+      [&](uint32_t firstSlot, uint32_t lastSlot) {
+        for (uint32_t slot = firstSlot; slot < lastSlot; slot++) {
+          VkCommandBufferBeginInfo cmdBufInfo =
+              vks::initializers::commandBufferBeginInfo();
+          cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+          cmdBufInfo.pInheritanceInfo = &inheritanceInfo;
+          VK_CHECK_RESULT(
+              vkBeginCommandBuffer(commandBuffers[slot], &cmdBufInfo));
+          const uint32_t first = static_cast<uint32_t>(
+              static_cast<uint64_t>(drawCount) * slot / slotCount);
+          const uint32_t last = static_cast<uint32_t>(
+              static_cast<uint64_t>(drawCount) * (slot + 1) / slotCount);
+          record(commandBuffers[slot], first, last);
+          VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffers[slot]));
+        }
+      },
+      1);
+
+  vkCmdExecuteCommands(primary, slotCount, commandBuffers.data());
+}
+
+uint32_t VulkanExampleBase::getRecordThreadCount() {
+  if (settings.recordThreads > 0) {
+    return settings.recordThreads;
   }
+  return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+void VulkanExampleBase::setRecordThreadCount(uint32_t count) {
+  settings.recordThreads = count;
+  // Recreated with the new thread count on the next recording, command pools
+  // and secondary command buffers of additional slots are kept for reuse
+  recordJobs.reset();
 }
 
 void VulkanExampleBase::prepareFrame() {
+  if (!startupTimeLogged) {
+    // Covers everything the example prepares after the pipeline cache has
+    // been created, run once with and once without a cache file to compare
+    auto tDiff = std::chrono::duration<double, std::milli>(
+                     std::chrono::high_resolution_clock::now() -
+                     pipelineCacheCreated)
+                     .count();
+    std::cout << "Startup ("
+              << (pipelineCacheLoadedSize > 0 ? "warm" : "cold")
+              << " pipeline cache, " << pipelineCacheLoadedSize
+              << " bytes loaded): " << tDiff
+              << " ms from pipeline cache creation to first frame"
+              << std::endl;
+    startupTimeLogged = true;
+  }
+  FrameResources& frame = frames[currentFrame];
+  // Usually a no-op, submitFrame() already waited for this frame's fence
+  VK_CHECK_RESULT(
+      vkWaitForFences(device, 1, &frame.fence, VK_TRUE, UINT64_MAX));
+  // Examples reference these through submitInfo
+  semaphores.presentComplete = frame.presentComplete;
+  semaphores.renderComplete = frame.renderComplete;
+
   // Acquire the next image from the swap chain
   VkResult err =
       swapChain.acquireNextImage(semaphores.presentComplete, &currentBuffer);
@@ -585,9 +820,36 @@ void VulkanExampleBase::prepareFrame() {
   } else {
     VK_CHECK_RESULT(err);
   }
+
+  // The command buffers in drawCmdBuffers are per swap chain image, so an
+  // image that is acquired again may still be in use by an older frame
+  if ((imageFences[currentBuffer] != VK_NULL_HANDLE) &&
+      (imageFences[currentBuffer] != frame.fence)) {
+    VK_CHECK_RESULT(vkWaitForFences(device, 1, &imageFences[currentBuffer],
+                                    VK_TRUE, UINT64_MAX));
+  }
+  imageFences[currentBuffer] = frame.fence;
+
+  // No frame in flight renders to this image anymore, so its region of the
+  // overlay's geometry can be rewritten
+  if (settings.overlay) {
+    UIOverlay.upload(currentBuffer);
+  }
 }
 
 void VulkanExampleBase::submitFrame() {
+  // An empty submission signals the fence once all work previously submitted
+  // to the queue (including this frame's command buffers) has completed
+  FrameResources& frame = frames[currentFrame];
+  VK_CHECK_RESULT(vkResetFences(device, 1, &frame.fence));
+  VK_CHECK_RESULT(vkQueueSubmit(queue, 0, nullptr, frame.fence));
+
+  // Only block if the CPU would get more than framesInFlight frames ahead
+  // With a single frame in flight this waits for the frame just submitted
+  currentFrame = (currentFrame + 1) % static_cast<uint32_t>(frames.size());
+  VK_CHECK_RESULT(vkWaitForFences(device, 1, &frames[currentFrame].fence,
+                                  VK_TRUE, UINT64_MAX));
+
   VkResult res =
       swapChain.queuePresent(queue, currentBuffer, semaphores.renderComplete);
   if (!((res == VK_SUCCESS) || (res == VK_SUBOPTIMAL_KHR))) {
@@ -600,7 +862,6 @@ void VulkanExampleBase::submitFrame() {
       VK_CHECK_RESULT(res);
     }
   }
-  VK_CHECK_RESULT(vkQueueWaitIdle(queue));
 }
 
 VulkanExampleBase::VulkanExampleBase(bool enableValidation) {
@@ -699,6 +960,47 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation) {
         (args[i] == std::string("--benchframetimes"))) {
       benchmark.outputFrameTimes = true;
     }
+    // Run the benchmark once for each supported number of frames in flight
+    if ((args[i] == std::string("-bfif")) ||
+        (args[i] == std::string("--benchframesinflight"))) {
+      benchmark.framesInFlightSweep = true;
+    }
+    // Don't load or store the pipeline cache (always start cold)
+    if ((args[i] == std::string("-npc")) ||
+        (args[i] == std::string("--nopipelinecache"))) {
+      settings.pipelineCache = false;
+    }
+    // Always load models from their source files and don't write baked caches
+    if ((args[i] == std::string("-nmc")) ||
+        (args[i] == std::string("--nomodelcache"))) {
+      vks::modelcache::enabled() = false;
+    }
+    // Number of threads recording secondary command buffers
+    if ((args[i] == std::string("-rt")) ||
+        (args[i] == std::string("--recordthreads"))) {
+      if (args.size() > i + 1) {
+        uint32_t num = strtol(args[i + 1], &numConvPtr, 10);
+        if ((numConvPtr != args[i + 1]) && (num > 0)) {
+          settings.recordThreads = num;
+        } else {
+          std::cerr << "Record threads must be specified as a number > 0!"
+                    << std::endl;
+        }
+      }
+    }
+    // Number of frames the GPU may work on while the CPU records the next one
+    if ((args[i] == std::string("-fif")) ||
+        (args[i] == std::string("--framesinflight"))) {
+      if (args.size() > i + 1) {
+        uint32_t num = strtol(args[i + 1], &numConvPtr, 10);
+        if ((numConvPtr != args[i + 1]) && (num > 0)) {
+          settings.framesInFlight = num;
+        } else {
+          std::cerr << "Frames in flight must be specified as a number > 0!"
+                    << std::endl;
+        }
+      }
+    }
   }
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
@@ -742,15 +1044,19 @@ VulkanExampleBase::~VulkanExampleBase() {
   vkDestroyImage(device, depthStencil.image, nullptr);
   vkFreeMemory(device, depthStencil.mem, nullptr);
 
+  if (settings.pipelineCache) {
+    savePipelineCache();
+  }
   vkDestroyPipelineCache(device, pipelineCache, nullptr);
 
-  vkDestroyCommandPool(device, cmdPool, nullptr);
+  destroySynchronizationPrimitives();
 
-  vkDestroySemaphore(device, semaphores.presentComplete, nullptr);
-  vkDestroySemaphore(device, semaphores.renderComplete, nullptr);
-  for (auto& fence : waitFences) {
-    vkDestroyFence(device, fence, nullptr);
+  recordJobs.reset();
+  // Also frees all secondary command buffers allocated from them
+  for (auto& commandPool : recordCommandPools) {
+    vkDestroyCommandPool(device, commandPool, nullptr);
   }
+  vkDestroyCommandPool(device, cmdPool, nullptr);
 
   if (settings.overlay) {
     UIOverlay.freeResources();
@@ -922,22 +1228,9 @@ bool VulkanExampleBase::initVulkan() {
 
   swapChain.connect(instance, physicalDevice, device);
 
-  // Create synchronization objects
-  VkSemaphoreCreateInfo semaphoreCreateInfo =
-      vks::initializers::semaphoreCreateInfo();
-  // Create a semaphore used to synchronize image presentation
-  // Ensures that the image is displayed before we start submitting new commands
-  // to the queu
-  VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr,
-                                    &semaphores.presentComplete));
-  // Create a semaphore used to synchronize command submission
-  // Ensures that the image is not presented until all commands have been
-  // sumbitted and executed
-  VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr,
-                                    &semaphores.renderComplete));
-
   // Set up submit info structure
-  // Semaphores will stay the same during application lifetime
+  // The semaphores are owned by the frames in flight (see
+  // createSynchronizationPrimitives) and switched by prepareFrame()
   // Command buffer submission info is set by each example
   submitInfo = vks::initializers::submitInfo();
   submitInfo.pWaitDstStageMask = &submitPipelineStages;
@@ -1888,6 +2181,64 @@ void VulkanExampleBase::createSynchronizationPrimitives() {
   for (auto& fence : waitFences) {
     VK_CHECK_RESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &fence));
   }
+
+  // Per frame in flight fence, semaphores and command buffer
+  settings.framesInFlight =
+      std::max(1u, std::min(settings.framesInFlight, maxFramesInFlight));
+  frames.resize(settings.framesInFlight);
+  VkSemaphoreCreateInfo semaphoreCreateInfo =
+      vks::initializers::semaphoreCreateInfo();
+  VkCommandBufferAllocateInfo cmdBufAllocateInfo =
+      vks::initializers::commandBufferAllocateInfo(
+          cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+  for (auto& frame : frames) {
+    // Fences start signaled so the first use of a frame does not block
+    VK_CHECK_RESULT(
+        vkCreateFence(device, &fenceCreateInfo, nullptr, &frame.fence));
+    // Ensures that the image is displayed before we start submitting new
+    // commands to the queue
+    VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr,
+                                      &frame.presentComplete));
+    // Ensures that the image is not presented until all commands have been
+    // submitted and executed
+    VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr,
+                                      &frame.renderComplete));
+    VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo,
+                                             &frame.commandBuffer));
+  }
+  currentFrame = 0;
+  semaphores.presentComplete = frames[0].presentComplete;
+  semaphores.renderComplete = frames[0].renderComplete;
+  imageFences.assign(swapChain.imageCount, VK_NULL_HANDLE);
+}
+
+void VulkanExampleBase::destroySynchronizationPrimitives() {
+  for (auto& fence : waitFences) {
+    vkDestroyFence(device, fence, nullptr);
+  }
+  waitFences.clear();
+  for (auto& frame : frames) {
+    vkDestroyFence(device, frame.fence, nullptr);
+    vkDestroySemaphore(device, frame.presentComplete, nullptr);
+    vkDestroySemaphore(device, frame.renderComplete, nullptr);
+    vkFreeCommandBuffers(device, cmdPool, 1, &frame.commandBuffer);
+  }
+  frames.clear();
+  imageFences.clear();
+}
+
+void VulkanExampleBase::setFramesInFlight(uint32_t count) {
+  vkDeviceWaitIdle(device);
+  destroySynchronizationPrimitives();
+  settings.framesInFlight = count;
+  createSynchronizationPrimitives();
+}
+
+void VulkanExampleBase::waitFramesInFlight() {
+  for (auto& frame : frames) {
+    VK_CHECK_RESULT(
+        vkWaitForFences(device, 1, &frame.fence, VK_TRUE, UINT64_MAX));
+  }
 }
 
 void VulkanExampleBase::createCommandPool() {
@@ -2067,6 +2418,8 @@ void VulkanExampleBase::windowResize() {
   viewportWidth = destWidth;
   viewportHeight = destHeight;
   setupSwapChain();
+  // The image count may have changed and all frames have finished
+  imageFences.assign(swapChain.imageCount, VK_NULL_HANDLE);
 
   // Recreate the frame buffers
   vkDestroyImageView(device, depthStencil.view, nullptr);
@@ -2081,6 +2434,9 @@ void VulkanExampleBase::windowResize() {
   if ((viewportWidth > 0.0f) && (viewportHeight > 0.0f)) {
     if (settings.overlay) {
       UIOverlay.resize(viewportWidth, viewportHeight);
+      // The overlay's buffers are recreated with the new image count by the
+      // next updateOverlay()
+      UIOverlay.regionCount = swapChain.imageCount;
     }
   }
 
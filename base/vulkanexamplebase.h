@@ -37,7 +37,9 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #define GLM_ENABLE_EXPERIMENTAL
 #include <array>
+#include <functional>
 #include <glm/glm.hpp>
+#include <memory>
 #include <numeric>
 #include <string>
 
@@ -50,9 +52,11 @@
 
 #include "VulkanDevice.hpp"
 #include "VulkanInitializers.hpp"
+#include "VulkanModelCache.hpp"
 #include "VulkanSwapChain.hpp"
 #include "benchmark.hpp"
 #include "camera.hpp"
+#include "jobsystem.hpp"
 
 class VulkanExampleBase {
  private:
@@ -125,10 +129,18 @@ class VulkanExampleBase {
   std::vector<VkShaderModule> shaderModules;
   // Pipeline cache object
   VkPipelineCache pipelineCache;
+  // Size of the pipeline cache data loaded from disk (0 = cold start)
+  size_t pipelineCacheLoadedSize = 0;
+  // Used to log the startup time from pipeline cache creation to the first
+  // frame
+  std::chrono::time_point<std::chrono::high_resolution_clock>
+      pipelineCacheCreated;
+  bool startupTimeLogged = false;
   // Wraps the swap chain to present images (framebuffers) to the windowing
   // system
   VulkanSwapChain swapChain;
   // Synchronization semaphores
+  // Set by prepareFrame() to the semaphores of the current frame in flight
   struct {
     // Swap chain image presentation
     VkSemaphore presentComplete;
@@ -136,6 +148,48 @@ class VulkanExampleBase {
     VkSemaphore renderComplete;
   } semaphores;
   std::vector<VkFence> waitFences;
+  /** @brief Synchronization objects and command buffer owned by one frame in
+   * flight */
+  struct FrameResources {
+    // Signaled once all work submitted for this frame has been executed
+    VkFence fence = VK_NULL_HANDLE;
+    VkSemaphore presentComplete = VK_NULL_HANDLE;
+    VkSemaphore renderComplete = VK_NULL_HANDLE;
+    // Primary command buffer for examples that record their work per frame,
+    // free to re-record once prepareFrame() returns
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+  };
+  std::vector<FrameResources> frames;
+  // Index into frames for the frame currently being recorded
+  uint32_t currentFrame = 0;
+  // Fence of the last frame that rendered to each swap chain image
+  std::vector<VkFence> imageFences;
+  /**
+   * @brief Upper limit for settings.framesInFlight
+   *
+   * @note Examples opt in to more frames in flight by raising this in their
+   * constructor, once nothing the GPU reads is rewritten while an earlier
+   * frame may still use it (e.g. uniform data in a vks::FrameUniformAllocator
+   * region per frame and command buffers recorded per frame, see
+   * projection_perspective_mesh_sphere). The UI overlay is safe, its geometry
+   * is kept per swap chain image.
+   */
+  uint32_t maxFramesInFlight = 1;
+  /** @brief Secondary command buffers recorded into one render pass instance
+   * of a primary command buffer (see recordSecondaryCommandBuffers) */
+  struct SecondaryCommandBuffers {
+    VkCommandBuffer primary;
+    VkRenderPass renderPass;
+    uint32_t subpass;
+    // One per recording slot, allocated from that slot's command pool
+    std::vector<VkCommandBuffer> commandBuffers;
+  };
+  std::vector<SecondaryCommandBuffers> secondaryCommandBuffers;
+  // One command pool per recording slot, each slot is recorded by a single
+  // worker at a time so the pools don't need to be synchronized
+  std::vector<VkCommandPool> recordCommandPools;
+  // Workers for recordSecondaryCommandBuffers, created on first use
+  std::unique_ptr<vks::JobSystem> recordJobs;
 
  public:
   bool prepared = false;
@@ -169,6 +223,15 @@ class VulkanExampleBase {
     bool vsync = false;
     /** @brief Enable UI overlay */
     bool overlay = false;
+    /** @brief Number of frames the GPU may still be working on while the CPU
+     * records the next one (1 = CPU and GPU run in lockstep) */
+    uint32_t framesInFlight = 1;
+    /** @brief Load the pipeline cache from disk at startup and store it at
+     * exit */
+    bool pipelineCache = true;
+    /** @brief Number of threads recording secondary command buffers (0 = one
+     * per hardware thread) */
+    uint32_t recordThreads = 0;
   } settings;
 
   VkClearColorValue defaultClearColor = {{1.0f, 1.0f, 1.0f, 1.0f}};
@@ -406,6 +469,12 @@ class VulkanExampleBase {
   virtual void buildCommandBuffers();
 
   void createSynchronizationPrimitives();
+  // Destroy the per-frame fences, semaphores and command buffers
+  void destroySynchronizationPrimitives();
+  // Change the number of frames in flight at runtime (waits for the device)
+  void setFramesInFlight(uint32_t count);
+  // Block until all frames currently in flight have been executed
+  void waitFramesInFlight();
 
   // Creates a new (graphics) command pool object storing command buffers
   void createCommandPool();
@@ -447,7 +516,15 @@ class VulkanExampleBase {
                           bool free);
 
   // Create a cache pool for rendering pipelines
+  // Initialized from the file written by savePipelineCache() if its header
+  // matches the current device
   void createPipelineCache();
+  // Write the pipeline cache data to disk
+  void savePipelineCache();
+  // Returns the file the pipeline cache is stored in (one per executable)
+  std::string getPipelineCacheFilename();
+  // Check that a stored pipeline cache was created by this device and driver
+  bool isPipelineCacheCompatible(const std::vector<char>& data);
 
   // Prepare commonly used Vulkan functions
   virtual void prepare();
@@ -463,7 +540,28 @@ class VulkanExampleBase {
   void renderFrame();
 
   void updateOverlay();
-  void drawUI(const VkCommandBuffer commandBuffer);
+  // Draw the UI overlay into a command buffer that renders to the given swap
+  // chain image
+  void drawUI(const VkCommandBuffer commandBuffer, uint32_t imageIndex);
+
+  // Record the draw commands of a render pass into secondary command buffers
+  // on multiple threads and execute them from the primary command buffer
+  // - The render pass must have been begun with
+  //   VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+  // - record(commandBuffer, first, last) is called once per thread with
+  //   consecutive ranges of [0, drawCount) and has to set all dynamic state
+  //   (viewport, scissor, ...) itself, as it's not inherited from the primary
+  void recordSecondaryCommandBuffers(
+      VkCommandBuffer primary,
+      VkRenderPass renderPass,
+      uint32_t subpass,
+      VkFramebuffer framebuffer,
+      uint32_t drawCount,
+      const std::function<void(VkCommandBuffer, uint32_t, uint32_t)>& record);
+  // Number of threads used by recordSecondaryCommandBuffers
+  uint32_t getRecordThreadCount();
+  // Change the number of recording threads, takes effect on the next recording
+  void setRecordThreadCount(uint32_t count);
 
   // Prepare the frame for workload submission
   // - Acquires the next image from the swap chain
@@ -471,6 +569,8 @@ class VulkanExampleBase {
   void prepareFrame();
 
   // Submit the frames' workload
+  // - Signals the current frame's fence and presents the image
+  // - Only blocks if more than settings.framesInFlight frames are pending
   void submitFrame();
 
   /** @brief (Virtual) Called when the UI overlay is updating, can be used to
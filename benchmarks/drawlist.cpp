@@ -0,0 +1,115 @@
+/*
+* Draw list benchmark
+*
+* Compares the draw calls and material binds of drawing a vkglTF::Model in node order with drawing its
+* material sorted draw list, with and without frustum culling
+* No Vulkan device is created, the draw functions are passed VK_NULL_HANDLE and only update the model's draw statistics
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <random>
+#include <vector>
+#include <memory>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "VulkanglTFModel.hpp"
+#include "microbenchmark.hpp"
+
+const uint32_t materialCount = 64;
+const uint32_t nodeCount = 4096;
+const uint32_t maxPrimitivesPerNode = 4;
+
+static void reportCounts(const std::string &name, const vkglTF::Model &model)
+{
+	std::cout << std::left << std::setw(40) << name << std::right << std::setw(8) << model.drawStatistics.drawCalls << " draw calls" << std::setw(8) << model.drawStatistics.materialBinds << " material binds" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> position(-256.0f, 256.0f);
+	std::uniform_real_distribution<float> extent(0.5f, 4.0f);
+
+	// Most materials are opaque, a few are masked or blended
+	vkglTF::Model model;
+	model.materials.resize(materialCount);
+	for (uint32_t i = 0; i < materialCount; i++)
+	{
+		if (i % 8 == 6)
+		{
+			model.materials[i].alphaMode = vkglTF::Material::ALPHAMODE_MASK;
+		}
+		else if (i % 8 == 7)
+		{
+			model.materials[i].alphaMode = vkglTF::Material::ALPHAMODE_BLEND;
+		}
+	}
+
+	// Nodes are spread around the camera with primitives of random materials, as in a scene exported without any sorting
+	std::vector<std::unique_ptr<vkglTF::Primitive>> primitives;
+	uint32_t primitiveCount = 0;
+	for (uint32_t i = 0; i < nodeCount; i++)
+	{
+		vkglTF::Node *node = new vkglTF::Node{};
+		node->index = i;
+		node->hierarchy = &model.hierarchy;
+		node->hierarchyIndex = model.hierarchy.add(-1, glm::vec3(position(rng), position(rng), position(rng)), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f), glm::mat4(1.0f));
+		node->mesh = new vkglTF::Mesh();
+		node->mesh->index = i;
+		const uint32_t count = 1 + rng() % maxPrimitivesPerNode;
+		for (uint32_t p = 0; p < count; p++)
+		{
+			primitives.push_back(std::unique_ptr<vkglTF::Primitive>(new vkglTF::Primitive(primitiveCount * 36, 36, model.materials[rng() % materialCount])));
+			const glm::vec3 halfExtent(extent(rng), extent(rng), extent(rng));
+			primitives.back()->setDimensions(-halfExtent, halfExtent);
+			node->mesh->primitives.push_back(primitives.back().get());
+			primitiveCount++;
+		}
+		model.nodes.push_back(node);
+		model.linearNodes.push_back(node);
+	}
+	model.hierarchy.update();
+	model.buildDrawList();
+
+	std::cout << nodeCount << " nodes with " << primitiveCount << " primitives using " << materialCount << " materials" << std::endl;
+
+	const uint32_t renderFlags = vkglTF::BindImages;
+
+	model.draw(VK_NULL_HANDLE, renderFlags);
+	reportCounts("node order", model);
+	model.drawIndirect(VK_NULL_HANDLE, renderFlags);
+	reportCounts("draw list, direct draws", model);
+	// Counts as on a device with multiDrawIndirect and drawIndirectFirstInstance
+	model.drawList.indirect = true;
+	model.drawList.maxDrawCount = primitiveCount;
+	model.drawIndirect(VK_NULL_HANDLE, renderFlags);
+	reportCounts("draw list, multi draw indirect", model);
+
+	vks::Frustum frustum;
+	frustum.update(glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 256.0f) * glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+
+	double ms = microbenchmark::measure([&]() {
+		model.draw(VK_NULL_HANDLE, frustum, renderFlags);
+	});
+	reportCounts("node order, culled", model);
+	const uint32_t culledNodeOrderDraws = model.drawStatistics.drawnPrimitives;
+	microbenchmark::report("node order, culled", ms, primitiveCount);
+
+	ms = microbenchmark::measure([&]() {
+		model.cullDrawList(frustum);
+		model.drawIndirect(VK_NULL_HANDLE, renderFlags);
+	});
+	reportCounts("draw list, culled", model);
+	microbenchmark::report("draw list, culled", ms, primitiveCount);
+
+	// Both paths have to draw the same primitives
+	if (model.drawStatistics.drawnPrimitives != culledNodeOrderDraws)
+	{
+		std::cout << "The culled draw list draws " << model.drawStatistics.drawnPrimitives << " primitives instead of " << culledNodeOrderDraws << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,93 @@
+/*
+* Frustum culling benchmark
+*
+* Compares the batch sphere and box tests of vks::Frustum with testing every object on its own through
+* checkSphere and checkBox, for the SIMD width the benchmark was compiled with (scalar, SSE2 or AVX)
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "frustum.hpp"
+#include "microbenchmark.hpp"
+
+int main(int argc, char *argv[])
+{
+#if defined(VKS_FRUSTUM_AVX)
+	std::cout << "Batch tests use AVX" << std::endl;
+#elif defined(VKS_FRUSTUM_SSE)
+	std::cout << "Batch tests use SSE2" << std::endl;
+#else
+	std::cout << "Batch tests use the scalar fallback" << std::endl;
+#endif
+
+	vks::Frustum frustum;
+	frustum.update(glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 256.0f) * glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+
+	// Objects are spread around the camera so about a sixth of them is visible
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> position(-256.0f, 256.0f);
+	std::uniform_real_distribution<float> extent(0.5f, 8.0f);
+
+	const uint32_t counts[] = { 10000, 100000, 1000000 };
+	for (uint32_t count : counts)
+	{
+		vks::SphereBounds spheres;
+		vks::BoxBounds boxes;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const glm::vec3 center(position(rng), position(rng), position(rng));
+			const glm::vec3 halfExtent(extent(rng), extent(rng), extent(rng));
+			spheres.push_back(center, glm::length(halfExtent));
+			boxes.push_back(center - halfExtent, center + halfExtent);
+		}
+
+		std::cout << count << " objects" << std::endl;
+		std::vector<uint32_t> scalarMask, batchMask;
+		const uint32_t runs = 2000000 / count + 3;
+
+		double ms = microbenchmark::measure([&]() {
+			scalarMask.assign((count + 31) / 32, 0);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				if (frustum.checkSphere(glm::vec3(spheres.x[i], spheres.y[i], spheres.z[i]), spheres.radius[i]))
+				{
+					scalarMask[i / 32] |= 1u << (i % 32);
+				}
+			}
+		}, runs);
+		microbenchmark::report("  checkSphere", ms, count);
+		ms = microbenchmark::measure([&]() { frustum.checkSpheres(spheres, batchMask); }, runs);
+		microbenchmark::report("  checkSpheres", ms, count);
+		if (scalarMask != batchMask)
+		{
+			std::cout << "checkSpheres doesn't match checkSphere" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		ms = microbenchmark::measure([&]() {
+			scalarMask.assign((count + 31) / 32, 0);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				if (frustum.checkBox(glm::vec3(boxes.minX[i], boxes.minY[i], boxes.minZ[i]), glm::vec3(boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i])))
+				{
+					scalarMask[i / 32] |= 1u << (i % 32);
+				}
+			}
+		}, runs);
+		microbenchmark::report("  checkBox", ms, count);
+		ms = microbenchmark::measure([&]() { frustum.checkBoxes(boxes, batchMask); }, runs);
+		microbenchmark::report("  checkBoxes", ms, count);
+		if (scalarMask != batchMask)
+		{
+			std::cout << "checkBoxes doesn't match checkBox" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,229 @@
+/*
+* Heightmap benchmark
+*
+* Times the vertex generation of vks::HeightMap for synthetic heightmaps (4096 x 4096 and 16384 x 16384 by default,
+* other sizes can be passed as arguments), single threaded and on a job system, and compares the vertices of the
+* smaller sizes with the per vertex getHeight generator loadFromFile used before
+*
+* Also times the batched surface queries (HeightMap::queryHeights) with and without normals and checks them
+* against single queries (which take the scalar path) and against the generated vertices
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include <new>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "VulkanHeightmap.hpp"
+#include "microbenchmark.hpp"
+
+// The reference generator takes seconds at 4096 x 4096, larger heightmaps are only timed
+const uint32_t maxReferenceDim = 4096;
+
+// Number of random positions for the surface queries
+const uint32_t queryCount = 1 << 20;
+
+// Physical memory of the machine in bytes, 0 if unknown
+static uint64_t physicalMemory()
+{
+#if defined(_WIN32)
+	MEMORYSTATUSEX status;
+	status.dwLength = sizeof(status);
+	return GlobalMemoryStatusEx(&status) ? status.ullTotalPhys : 0;
+#elif defined(_SC_PHYS_PAGES) && defined(_SC_PAGESIZE)
+	const long pages = sysconf(_SC_PHYS_PAGES);
+	const long pageSize = sysconf(_SC_PAGESIZE);
+	return ((pages > 0) && (pageSize > 0)) ? static_cast<uint64_t>(pages) * static_cast<uint64_t>(pageSize) : 0;
+#else
+	return 0;
+#endif
+}
+
+// Vertex generation of loadFromFile before it was done row by row, reads every height through getHeight
+static void generateReference(vks::HeightMap &heightMap, uint32_t patchsize, glm::vec3 scale, vks::HeightMap::Vertex *vertices)
+{
+	for (uint32_t x = 0; x < patchsize; x++)
+	{
+		for (uint32_t y = 0; y < patchsize; y++)
+		{
+			const uint32_t index = x + y * patchsize;
+			vertices[index].pos[0] = (x * 2.0f + 1.0f - (float)patchsize) * scale.x;
+			vertices[index].pos[1] = -heightMap.getHeight(x, y);
+			vertices[index].pos[2] = (y * 2.0f + 1.0f - (float)patchsize) * scale.z;
+			vertices[index].uv = glm::vec2((float)x / patchsize, (float)y / patchsize) * heightMap.uvScale;
+		}
+	}
+	for (uint32_t y = 0; y < patchsize; y++)
+	{
+		for (uint32_t x = 0; x < patchsize; x++)
+		{
+			float dx = heightMap.getHeight(x < patchsize - 1 ? x + 1 : x, y) - heightMap.getHeight(x > 0 ? x - 1 : x, y);
+			if (x == 0 || x == patchsize - 1)
+				dx *= 2.0f;
+			float dy = heightMap.getHeight(x, y < patchsize - 1 ? y + 1 : y) - heightMap.getHeight(x, y > 0 ? y - 1 : y);
+			if (y == 0 || y == patchsize - 1)
+				dy *= 2.0f;
+			const glm::vec3 normal = (glm::normalize(glm::cross(glm::vec3(1.0f, 0.0f, dx), glm::vec3(0.0f, 1.0f, dy))) + 1.0f) * 0.5f;
+			vertices[x + y * patchsize].normal = glm::vec3(normal.x, normal.z, normal.y);
+		}
+	}
+}
+
+static bool nearlyEqual(const glm::vec3 &a, const glm::vec3 &b)
+{
+	const float epsilon = 1e-5f;
+	return (fabs(a.x - b.x) <= epsilon * std::max(1.0f, fabs(a.x))) && (fabs(a.y - b.y) <= epsilon * std::max(1.0f, fabs(a.y))) && (fabs(a.z - b.z) <= epsilon * std::max(1.0f, fabs(a.z)));
+}
+
+// Time queryHeights on random positions across the terrain, returns false if the batched and single queries disagree or the vertex heights aren't reproduced
+static bool benchmarkQueries(const vks::HeightMap &heightMap, const std::vector<vks::HeightMap::Vertex> &vertices, uint32_t dim, glm::vec3 scale)
+{
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> x(-(dim * scale.x), dim * scale.x);
+	std::uniform_real_distribution<float> z(-(dim * scale.z), dim * scale.z);
+	std::vector<glm::vec3> positions(queryCount);
+	for (auto &position : positions)
+	{
+		position = glm::vec3(x(rng), 0.0f, z(rng));
+	}
+	std::vector<float> heights(queryCount), singleHeights(queryCount);
+	std::vector<glm::vec3> normals(queryCount), singleNormals(queryCount);
+
+	double ms = microbenchmark::measure([&]() { heightMap.queryHeights(positions.data(), queryCount, heights.data(), normals.data()); });
+	microbenchmark::report("  queryHeights with normals", ms, queryCount);
+	ms = microbenchmark::measure([&]() { heightMap.queryHeights(positions.data(), queryCount, heights.data()); });
+	microbenchmark::report("  queryHeights", ms, queryCount);
+	ms = microbenchmark::measure([&]() {
+		for (uint32_t i = 0; i < queryCount; i++)
+		{
+			heightMap.queryHeights(&positions[i], 1, &singleHeights[i], &singleNormals[i]);
+		}
+	});
+	microbenchmark::report("  single queries with normals", ms, queryCount);
+
+	for (uint32_t i = 0; i < queryCount; i++)
+	{
+		if ((fabs(heights[i] - singleHeights[i]) > 1e-5f * std::max(1.0f, fabs(heights[i]))) || !nearlyEqual(normals[i], singleNormals[i]))
+		{
+			std::cout << "Batched query " << i << " differs from the single query" << std::endl;
+			return false;
+		}
+	}
+
+	// Queries at the vertices have to return the vertex heights
+	for (size_t i = 0; i < vertices.size(); i += vertices.size() / queryCount + 1)
+	{
+		float height;
+		heightMap.queryHeights(&vertices[i].pos, 1, &height);
+		if (fabs(height - vertices[i].pos.y) > 1e-5f * std::max(1.0f, fabs(height)))
+		{
+			std::cout << "Query at vertex " << i << " doesn't match its height" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<uint32_t> dims;
+	for (int i = 1; i < argc; i++)
+	{
+		dims.push_back(static_cast<uint32_t>(atoi(argv[i])));
+	}
+	if (dims.empty())
+	{
+		dims = { 4096, 16384 };
+	}
+
+	vks::JobSystem jobSystem;
+	std::cout << jobSystem.getWorkerCount() << " job system workers" << std::endl;
+	const uint64_t memory = physicalMemory();
+	const glm::vec3 scale(1.0f, 64.0f, 1.0f);
+
+	for (uint32_t dim : dims)
+	{
+		const uint64_t texels = static_cast<uint64_t>(dim) * dim;
+		const bool reference = dim <= maxReferenceDim;
+		// Raw heights, float height field and vertices, plus a second vertex array to compare against
+		const uint64_t requiredBytes = texels * (sizeof(uint16_t) * 2 + sizeof(float) + sizeof(vks::HeightMap::Vertex) * (reference ? 2 : 1));
+		std::cout << dim << " x " << dim << " heightmap, " << requiredBytes / (1024 * 1024) << " MB required";
+		if (memory > 0)
+		{
+			std::cout << " (" << memory / (1024 * 1024) << " MB physical memory)";
+		}
+		std::cout << std::endl;
+		if ((dim < 2) || (texels > UINT32_MAX) || ((memory > 0) && (requiredBytes > memory)))
+		{
+			std::cout << "  Skipped, doesn't fit into memory or the 32 bit vertex indices" << std::endl;
+			continue;
+		}
+
+		std::vector<vks::HeightMap::Vertex> vertices, referenceVertices;
+		vks::HeightMap heightMap(nullptr, VK_NULL_HANDLE);
+		try
+		{
+			// Smooth hills with some high frequency detail, so the normals aren't all the same
+			std::vector<uint16_t> heights(texels);
+			for (uint32_t y = 0; y < dim; y++)
+			{
+				for (uint32_t x = 0; x < dim; x++)
+				{
+					const float h = 0.5f + 0.25f * sinf(x * 0.01f) * cosf(y * 0.013f) + 0.05f * sinf((x ^ y) * 0.3f);
+					heights[x + static_cast<size_t>(y) * dim] = static_cast<uint16_t>(h * 65535.0f);
+				}
+			}
+			heightMap.setHeights(heights.data(), dim, dim, scale);
+			vertices.resize(texels);
+			if (reference)
+			{
+				referenceVertices.resize(texels);
+			}
+		}
+		catch (const std::bad_alloc &)
+		{
+			std::cout << "  Skipped, allocating the heights and vertices failed" << std::endl;
+			continue;
+		}
+
+		const uint32_t runs = (dim <= 4096) ? 5 : 1;
+		if (reference)
+		{
+			const double ms = microbenchmark::measure([&]() { generateReference(heightMap, dim, scale, referenceVertices.data()); }, runs);
+			microbenchmark::report("  getHeight per vertex (previous)", ms, static_cast<double>(texels));
+		}
+		double ms = microbenchmark::measure([&]() { heightMap.generateVertices(vertices.data()); }, runs);
+		microbenchmark::report("  generateVertices, single thread", ms, static_cast<double>(texels));
+		if (jobSystem.getWorkerCount() > 1)
+		{
+			ms = microbenchmark::measure([&]() { heightMap.generateVertices(vertices.data(), &jobSystem); }, runs);
+			microbenchmark::report("  generateVertices, job system", ms, static_cast<double>(texels));
+		}
+
+		if (reference)
+		{
+			for (size_t i = 0; i < vertices.size(); i++)
+			{
+				if (!nearlyEqual(vertices[i].pos, referenceVertices[i].pos) || !nearlyEqual(vertices[i].normal, referenceVertices[i].normal) || (vertices[i].uv.x != referenceVertices[i].uv.x) || (vertices[i].uv.y != referenceVertices[i].uv.y))
+				{
+					std::cout << "Vertex " << i << " differs from the previous generator" << std::endl;
+					return EXIT_FAILURE;
+				}
+			}
+		}
+
+		if (!benchmarkQueries(heightMap, vertices, dim, scale))
+		{
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+/*
+* Job system benchmark
+*
+* Runs batches of small jobs through vks::JobSystem and through vks::ThreadPool, which the glTF loader used before,
+* to compare their scheduling overhead
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <vector>
+#include <numeric>
+
+#include "threadpool.hpp"
+#include "jobsystem.hpp"
+#include "microbenchmark.hpp"
+
+// Work of a single job, small enough for the scheduling to dominate
+const uint32_t jobSize = 256;
+
+static uint64_t work(const uint32_t *data)
+{
+	uint64_t sum = 0;
+	for (uint32_t i = 0; i < jobSize; i++)
+	{
+		sum += data[i] * data[i];
+	}
+	return sum;
+}
+
+int main(int argc, char *argv[])
+{
+	const uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	std::cout << threadCount << " threads" << std::endl;
+
+	const uint32_t jobCounts[] = { 1000, 4000, 16000 };
+	for (uint32_t jobCount : jobCounts)
+	{
+		std::vector<uint32_t> data(jobCount * jobSize);
+		std::iota(data.begin(), data.end(), 0);
+		std::vector<uint64_t> reference(jobCount), results(jobCount);
+		for (uint32_t i = 0; i < jobCount; i++)
+		{
+			reference[i] = work(&data[i * jobSize]);
+		}
+		std::cout << jobCount << " jobs" << std::endl;
+
+		{
+			vks::ThreadPool threadPool;
+			threadPool.setThreadCount(threadCount);
+			std::fill(results.begin(), results.end(), 0);
+			const double ms = microbenchmark::measure([&]() {
+				for (uint32_t i = 0; i < jobCount; i++)
+				{
+					threadPool.threads[i % threadCount]->addJob([&data, &results, i] { results[i] = work(&data[i * jobSize]); });
+				}
+				threadPool.wait();
+			});
+			microbenchmark::report("  ThreadPool", ms, jobCount);
+			if (results != reference)
+			{
+				std::cout << "ThreadPool results are wrong" << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+
+		// The calling thread executes jobs too, so the job system gets one thread less
+		vks::JobSystem jobSystem(threadCount - 1);
+		std::fill(results.begin(), results.end(), 0);
+		double ms = microbenchmark::measure([&]() {
+			vks::Job *root = jobSystem.createGroup();
+			for (uint32_t i = 0; i < jobCount; i++)
+			{
+				jobSystem.run(jobSystem.createJob([&data, &results, i] { results[i] = work(&data[i * jobSize]); }, root));
+			}
+			jobSystem.run(root);
+			jobSystem.wait(root);
+		});
+		microbenchmark::report("  JobSystem, one job each", ms, jobCount);
+		if (results != reference)
+		{
+			std::cout << "JobSystem results are wrong" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		std::fill(results.begin(), results.end(), 0);
+		ms = microbenchmark::measure([&]() {
+			jobSystem.parallelFor(jobCount, [&data, &results](uint32_t first, uint32_t last) {
+				for (uint32_t i = first; i < last; i++)
+				{
+					results[i] = work(&data[i * jobSize]);
+				}
+			}, 1);
+		});
+		microbenchmark::report("  JobSystem, parallelFor", ms, jobCount);
+		if (results != reference)
+		{
+			std::cout << "JobSystem::parallelFor results are wrong" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
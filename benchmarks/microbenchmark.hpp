@@ -0,0 +1,40 @@
+/*
+* Timing helpers shared by the micro benchmarks
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <stdint.h>
+
+namespace microbenchmark
+{
+	/** @brief Run a function once to warm up caches, then repeatedly and return the fastest run in milliseconds */
+	inline double measure(const std::function<void()> &func, uint32_t runs = 10)
+	{
+		func();
+		double best = std::numeric_limits<double>::max();
+		for (uint32_t i = 0; i < runs; i++)
+		{
+			auto tStart = std::chrono::high_resolution_clock::now();
+			func();
+			best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count());
+		}
+		return best;
+	}
+
+	/** @brief Print one result line, throughput is given in items per millisecond */
+	inline void report(const std::string &name, double ms, double items)
+	{
+		std::cout << std::fixed << std::setprecision(3);
+		std::cout << std::left << std::setw(40) << name << std::right << std::setw(12) << ms << " ms" << std::setw(16) << std::setprecision(0) << items / ms << " /ms" << std::endl;
+	}
+}
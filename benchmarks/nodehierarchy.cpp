@@ -0,0 +1,95 @@
+/*
+* Node hierarchy benchmark
+*
+* Compares the world matrix update of vkglTF::NodeHierarchy with walking the parent chain of every node,
+* which is what vkglTF::Node::getMatrix did before the hierarchy was flattened
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <random>
+#include <vector>
+
+#include <glm/gtc/quaternion.hpp>
+
+#include "VulkanglTFModel.hpp"
+#include "microbenchmark.hpp"
+
+// Skeletons of jointCount nodes, each joint is attached to one of the few joints added right before it
+const uint32_t characterCount = 256;
+const uint32_t jointCount = 64;
+
+int main(int argc, char *argv[])
+{
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+
+	vkglTF::NodeHierarchy hierarchy;
+	for (uint32_t c = 0; c < characterCount; c++)
+	{
+		const uint32_t first = static_cast<uint32_t>(hierarchy.parents.size());
+		for (uint32_t j = 0; j < jointCount; j++)
+		{
+			int32_t parent = -1;
+			if (j > 0)
+			{
+				const uint32_t range = std::min(j, 4u);
+				parent = static_cast<int32_t>(first + j - 1 - (rng() % range));
+			}
+			const glm::quat rotation = glm::angleAxis(offset(rng), glm::normalize(glm::vec3(offset(rng), offset(rng), 1.0f)));
+			hierarchy.add(parent, glm::vec3(offset(rng), offset(rng), offset(rng)), rotation, glm::vec3(1.0f), glm::mat4(1.0f));
+		}
+	}
+	const uint32_t nodeCount = static_cast<uint32_t>(hierarchy.parents.size());
+	hierarchy.update();
+
+	std::cout << nodeCount << " nodes in " << characterCount << " skeletons" << std::endl;
+
+	// Previous approach, every node multiplies the local matrices along its parent chain
+	std::vector<glm::mat4> walked(nodeCount);
+	double ms = microbenchmark::measure([&]() {
+		for (uint32_t i = 0; i < nodeCount; i++)
+		{
+			glm::mat4 m = hierarchy.localMatrix(i);
+			int32_t p = hierarchy.parents[i];
+			while (p > -1)
+			{
+				m = hierarchy.localMatrix(p) * m;
+				p = hierarchy.parents[p];
+			}
+			walked[i] = m;
+		}
+	});
+	microbenchmark::report("parent chain walk", ms, nodeCount);
+
+	// Flattened hierarchy with a share of the nodes animated per update
+	const float dirtyShares[] = { 1.0f, 0.1f, 0.01f };
+	for (float share : dirtyShares)
+	{
+		const uint32_t step = std::max(1u, static_cast<uint32_t>(1.0f / share));
+		ms = microbenchmark::measure([&]() {
+			for (uint32_t i = 0; i < nodeCount; i += step)
+			{
+				hierarchy.markDirty(i);
+			}
+			hierarchy.update();
+		});
+		microbenchmark::report("hierarchy update, " + std::to_string(static_cast<uint32_t>(share * 100.0f)) + "% dirty", ms, nodeCount);
+	}
+
+	// Both have to produce the same world matrices
+	for (uint32_t i = 0; i < nodeCount; i++)
+	{
+		for (int32_t k = 0; k < 16; k++)
+		{
+			const float a = walked[i][k / 4][k % 4];
+			const float b = hierarchy.worldMatrices[i][k / 4][k % 4];
+			if (fabs(a - b) > 1e-4f * std::max(1.0f, fabs(a)))
+			{
+				std::cout << "World matrix of node " << i << " differs from the parent chain walk" << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+	}
+	return EXIT_SUCCESS;
+}
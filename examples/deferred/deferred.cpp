@@ -15,6 +15,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <chrono>
 #include <vector>
 
 #define GLM_FORCE_RADIANS
@@ -24,6 +25,7 @@
 
 #include <vulkan/vulkan.h>
 #include "VulkanBuffer.hpp"
+#include "VulkanFrameUniformAllocator.hpp"
 #include "VulkanModel.hpp"
 #include "VulkanTexture.hpp"
 #include "vulkanexamplebase.h"
@@ -92,11 +94,14 @@ class VulkanExample : public VulkanExampleBase {
     glm::vec4 viewPos;
   } uboFragmentLights;
 
+  // All uniform blocks are written to a single buffer every frame and bound
+  // with dynamic offsets
+  vks::FrameUniformAllocator uniformAllocator;
   struct {
-    vks::Buffer vsFullScreen;
-    vks::Buffer vsOffscreen;
-    vks::Buffer fsLights;
-  } uniformBuffers;
+    uint32_t vsFullScreen;
+    uint32_t vsOffscreen;
+    uint32_t fsLights;
+  } uniformOffsets;
 
   struct {
     VkPipeline deferred;
@@ -140,6 +145,10 @@ class VulkanExample : public VulkanExampleBase {
   // Semaphore used to synchronize between offscreen and final scene rendering
   VkSemaphore offscreenSemaphore = VK_NULL_HANDLE;
 
+  // CPU time spent on recording the G-Buffer command buffer (in ms)
+  float recordTime = 0.0f;
+  int32_t recordThreadCount = 1;
+
   VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION) {
     title = "Deferred shading (2016 by Sascha Willems)";
     camera.type = Camera::CameraType::firstperson;
@@ -196,10 +205,7 @@ class VulkanExample : public VulkanExampleBase {
     models.floor.destroy();
     models.quad.destroy();
 
-    // Uniform buffers
-    uniformBuffers.vsOffscreen.destroy();
-    uniformBuffers.vsFullScreen.destroy();
-    uniformBuffers.fsLights.destroy();
+    uniformAllocator.destroy();
 
     vkFreeCommandBuffers(device, cmdPool, 1, &offScreenCmdBuffer);
 
@@ -445,11 +451,13 @@ class VulkanExample : public VulkanExampleBase {
           VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
     }
 
-    // Create a semaphore used to synchronize offscreen rendering and usage
-    VkSemaphoreCreateInfo semaphoreCreateInfo =
-        vks::initializers::semaphoreCreateInfo();
-    VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr,
-                                      &offscreenSemaphore));
+    if (offscreenSemaphore == VK_NULL_HANDLE) {
+      // Create a semaphore used to synchronize offscreen rendering and usage
+      VkSemaphoreCreateInfo semaphoreCreateInfo =
+          vks::initializers::semaphoreCreateInfo();
+      VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr,
+                                        &offscreenSemaphore));
+    }
 
     VkCommandBufferBeginInfo cmdBufInfo =
         vks::initializers::commandBufferBeginInfo();
@@ -471,60 +479,95 @@ class VulkanExample : public VulkanExampleBase {
         static_cast<uint32_t>(clearValues.size());
     renderPassBeginInfo.pClearValues = clearValues.data();
 
+    auto tStart = std::chrono::high_resolution_clock::now();
+
     VK_CHECK_RESULT(vkBeginCommandBuffer(offScreenCmdBuffer, &cmdBufInfo));
 
     vkCmdBeginRenderPass(offScreenCmdBuffer, &renderPassBeginInfo,
-                         VK_SUBPASS_CONTENTS_INLINE);
-
-    VkViewport viewport = vks::initializers::viewport(
-        (float)offScreenFrameBuf.width, (float)offScreenFrameBuf.height, 0.0f,
-        1.0f);
-    vkCmdSetViewport(offScreenCmdBuffer, 0, 1, &viewport);
-
-    VkRect2D scissor = vks::initializers::rect2D(
-        offScreenFrameBuf.width, offScreenFrameBuf.height, 0, 0);
-    vkCmdSetScissor(offScreenCmdBuffer, 0, 1, &scissor);
-
-    vkCmdBindPipeline(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                      pipelines.offscreen);
-
-    VkDeviceSize offsets[1] = {0};
-
-    // Background
-    vkCmdBindDescriptorSets(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            pipelineLayouts.offscreen, 0, 1,
-                            &descriptorSets.floor, 0, NULL);
-    vkCmdBindVertexBuffers(offScreenCmdBuffer, VERTEX_BUFFER_BIND_ID, 1,
-                           &models.floor.vertices.buffer, offsets);
-    vkCmdBindIndexBuffer(offScreenCmdBuffer, models.floor.indices.buffer, 0,
-                         VK_INDEX_TYPE_UINT32);
-    vkCmdDrawIndexed(offScreenCmdBuffer, models.floor.indexCount, 1, 0, 0, 0);
-
-    // Object
-    vkCmdBindDescriptorSets(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            pipelineLayouts.offscreen, 0, 1,
-                            &descriptorSets.model, 0, NULL);
-    vkCmdBindVertexBuffers(offScreenCmdBuffer, VERTEX_BUFFER_BIND_ID, 1,
-                           &models.model.vertices.buffer, offsets);
-    vkCmdBindIndexBuffer(offScreenCmdBuffer, models.model.indices.buffer, 0,
-                         VK_INDEX_TYPE_UINT32);
-    vkCmdDrawIndexed(offScreenCmdBuffer, models.model.indexCount, 3, 0, 0, 0);
+                         VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+    // Draws are the parts of the background followed by those of the object,
+    // split across the recording threads
+    const uint32_t floorPartCount =
+        static_cast<uint32_t>(models.floor.parts.size());
+    const uint32_t drawCount =
+        floorPartCount + static_cast<uint32_t>(models.model.parts.size());
+    recordSecondaryCommandBuffers(
+        offScreenCmdBuffer, offScreenFrameBuf.renderPass, 0,
+        offScreenFrameBuf.frameBuffer, drawCount,
+        [&](VkCommandBuffer commandBuffer, uint32_t first, uint32_t last) {
+          VkViewport viewport = vks::initializers::viewport(
+              (float)offScreenFrameBuf.width, (float)offScreenFrameBuf.height,
+              0.0f, 1.0f);
+          vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+          VkRect2D scissor = vks::initializers::rect2D(
+              offScreenFrameBuf.width, offScreenFrameBuf.height, 0, 0);
+          vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+          vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            pipelines.offscreen);
+
+          VkDeviceSize offsets[1] = {0};
+          // Binding 4 (lights) is part of the shared layout, but not read by
+          // the offscreen shaders
+          const uint32_t dynamicOffsets[2] = {uniformOffsets.vsOffscreen,
+                                              uniformOffsets.fsLights};
+          const vks::Model* boundModel = nullptr;
+          for (uint32_t i = first; i < last; i++) {
+            // Background
+            const vks::Model* model = &models.floor;
+            const VkDescriptorSet* descriptorSet = &descriptorSets.floor;
+            uint32_t instanceCount = 1;
+            uint32_t part = i;
+            // Object
+            if (i >= floorPartCount) {
+              model = &models.model;
+              descriptorSet = &descriptorSets.model;
+              instanceCount = 3;
+              part = i - floorPartCount;
+            }
+            if (model != boundModel) {
+              vkCmdBindDescriptorSets(
+                  commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                  pipelineLayouts.offscreen, 0, 1, descriptorSet, 2,
+                  dynamicOffsets);
+              vkCmdBindVertexBuffers(commandBuffer, VERTEX_BUFFER_BIND_ID, 1,
+                                     &model->vertices.buffer, offsets);
+              vkCmdBindIndexBuffer(commandBuffer, model->indices.buffer, 0,
+                                   model->indexType);
+              boundModel = model;
+            }
+            vkCmdDrawIndexed(commandBuffer, model->parts[part].indexCount,
+                             instanceCount, model->parts[part].indexBase, 0, 0);
+          }
+        });
 
     vkCmdEndRenderPass(offScreenCmdBuffer);
 
     VK_CHECK_RESULT(vkEndCommandBuffer(offScreenCmdBuffer));
+
+    recordTime = std::chrono::duration<float, std::milli>(
+                     std::chrono::high_resolution_clock::now() - tStart)
+                     .count();
   }
 
   void loadAssets() {
+    // All model and texture uploads are recorded into a single command buffer
+    // that is submitted once at the end of this function
+    vks::UploadBatch uploads(vulkanDevice, queue);
+
     models.model.loadFromFile(getAssetPath() + "models/armor/armor.dae",
-                              vertexLayout, 1.0f, vulkanDevice, queue);
+                              vertexLayout, 1.0f, vulkanDevice, queue,
+                              vks::Model::defaultFlags, &uploads);
 
     vks::ModelCreateInfo modelCreateInfo;
     modelCreateInfo.scale = glm::vec3(2.0f);
     modelCreateInfo.uvscale = glm::vec2(4.0f);
     modelCreateInfo.center = glm::vec3(0.0f, 2.35f, 0.0f);
     models.floor.loadFromFile(getAssetPath() + "models/plane.obj", vertexLayout,
-                              &modelCreateInfo, vulkanDevice, queue);
+                              &modelCreateInfo, vulkanDevice, queue,
+                              vks::Model::defaultFlags, &uploads);
 
     // Textures
     std::string texFormatSuffix;
@@ -547,18 +590,24 @@ class VulkanExample : public VulkanExampleBase {
 
     textures.model.colorMap.loadFromFile(
         getAssetPath() + "models/armor/color" + texFormatSuffix + ".ktx",
-        texFormat, vulkanDevice, queue);
+        texFormat, vulkanDevice, queue, VK_IMAGE_USAGE_SAMPLED_BIT,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, &uploads);
     textures.model.normalMap.loadFromFile(
         getAssetPath() + "models/armor/normal" + texFormatSuffix + ".ktx",
-        texFormat, vulkanDevice, queue);
-    textures.floor.colorMap.loadFromFile(getAssetPath() +
-                                             "textures/stonefloor01_color" +
-                                             texFormatSuffix + ".ktx",
-                                         texFormat, vulkanDevice, queue);
-    textures.floor.normalMap.loadFromFile(getAssetPath() +
-                                              "textures/stonefloor01_normal" +
-                                              texFormatSuffix + ".ktx",
-                                          texFormat, vulkanDevice, queue);
+        texFormat, vulkanDevice, queue, VK_IMAGE_USAGE_SAMPLED_BIT,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, &uploads);
+    textures.floor.colorMap.loadFromFile(
+        getAssetPath() + "textures/stonefloor01_color" + texFormatSuffix +
+            ".ktx",
+        texFormat, vulkanDevice, queue, VK_IMAGE_USAGE_SAMPLED_BIT,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, &uploads);
+    textures.floor.normalMap.loadFromFile(
+        getAssetPath() + "textures/stonefloor01_normal" + texFormatSuffix +
+            ".ktx",
+        texFormat, vulkanDevice, queue, VK_IMAGE_USAGE_SAMPLED_BIT,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, &uploads);
+
+    uploads.flush();
   }
 
   void reBuildCommandBuffers() {
@@ -605,9 +654,11 @@ class VulkanExample : public VulkanExampleBase {
       vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
       VkDeviceSize offsets[1] = {0};
+      const uint32_t dynamicOffsets[2] = {uniformOffsets.vsFullScreen,
+                                          uniformOffsets.fsLights};
       vkCmdBindDescriptorSets(
           drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-          pipelineLayouts.deferred, 0, 1, &descriptorSet, 0, NULL);
+          pipelineLayouts.deferred, 0, 1, &descriptorSet, 2, dynamicOffsets);
 
       if (debugDisplay) {
         vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
@@ -615,7 +666,7 @@ class VulkanExample : public VulkanExampleBase {
         vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1,
                                &models.quad.vertices.buffer, offsets);
         vkCmdBindIndexBuffer(drawCmdBuffers[i], models.quad.indices.buffer, 0,
-                             VK_INDEX_TYPE_UINT32);
+                             models.quad.indexType);
         vkCmdDrawIndexed(drawCmdBuffers[i], models.quad.indexCount, 1, 0, 0, 1);
         // Move viewport to display final composition in lower right corner
         viewport.x = viewport.width * 0.5f;
@@ -631,10 +682,10 @@ class VulkanExample : public VulkanExampleBase {
       vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1,
                              &models.quad.vertices.buffer, offsets);
       vkCmdBindIndexBuffer(drawCmdBuffers[i], models.quad.indices.buffer, 0,
-                           VK_INDEX_TYPE_UINT32);
+                           models.quad.indexType);
       vkCmdDrawIndexed(drawCmdBuffers[i], 6, 1, 0, 0, 1);
 
-      drawUI(drawCmdBuffers[i]);
+      drawUI(drawCmdBuffers[i], i);
 
       vkCmdEndRenderPass(drawCmdBuffers[i]);
 
@@ -686,8 +737,8 @@ class VulkanExample : public VulkanExampleBase {
         VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        vertexBuffer.size() * sizeof(Vertex), &models.quad.vertices.buffer,
-        &models.quad.vertices.memory, vertexBuffer.data()));
+        &models.quad.vertices, vertexBuffer.size() * sizeof(Vertex),
+        vertexBuffer.data()));
 
     // Setup indices
     std::vector<uint32_t> indexBuffer = {0, 1, 2, 2, 3, 0};
@@ -703,8 +754,8 @@ class VulkanExample : public VulkanExampleBase {
         VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        indexBuffer.size() * sizeof(uint32_t), &models.quad.indices.buffer,
-        &models.quad.indices.memory, indexBuffer.data()));
+        &models.quad.indices, indexBuffer.size() * sizeof(uint32_t),
+        indexBuffer.data()));
 
     models.quad.device = device;
   }
@@ -758,8 +809,8 @@ class VulkanExample : public VulkanExampleBase {
 
   void setupDescriptorPool() {
     std::vector<VkDescriptorPoolSize> poolSizes = {
-        vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                                              8),
+        vks::initializers::descriptorPoolSize(
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 8),
         vks::initializers::descriptorPoolSize(
             VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 9)};
 
@@ -776,7 +827,8 @@ class VulkanExample : public VulkanExampleBase {
     std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
         // Binding 0 : Vertex shader uniform buffer
         vks::initializers::descriptorSetLayoutBinding(
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            VK_SHADER_STAGE_VERTEX_BIT, 0),
         // Binding 1 : Position texture target / Scene colormap
         vks::initializers::descriptorSetLayoutBinding(
             VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
@@ -791,7 +843,8 @@ class VulkanExample : public VulkanExampleBase {
             VK_SHADER_STAGE_FRAGMENT_BIT, 3),
         // Binding 4 : Fragment shader uniform buffer
         vks::initializers::descriptorSetLayoutBinding(
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 4),
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            VK_SHADER_STAGE_FRAGMENT_BIT, 4),
     };
 
     VkDescriptorSetLayoutCreateInfo descriptorLayout =
@@ -841,11 +894,17 @@ class VulkanExample : public VulkanExampleBase {
             colorSampler, offScreenFrameBuf.albedo.view,
             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
+    // Uniform blocks are selected by the dynamic offsets passed when binding
+    VkDescriptorBufferInfo vsDescriptor =
+        uniformAllocator.getDescriptor(sizeof(uboVS));
+    VkDescriptorBufferInfo fsLightsDescriptor =
+        uniformAllocator.getDescriptor(sizeof(uboFragmentLights));
+
     writeDescriptorSets = {
         // Binding 0 : Vertex shader uniform buffer
         vks::initializers::writeDescriptorSet(
-            descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0,
-            &uniformBuffers.vsFullScreen.descriptor),
+            descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 0,
+            &vsDescriptor),
         // Binding 1 : Position texture target
         vks::initializers::writeDescriptorSet(
             descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
@@ -860,8 +919,8 @@ class VulkanExample : public VulkanExampleBase {
             &texDescriptorAlbedo),
         // Binding 4 : Fragment shader uniform buffer
         vks::initializers::writeDescriptorSet(
-            descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4,
-            &uniformBuffers.fsLights.descriptor),
+            descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 4,
+            &fsLightsDescriptor),
     };
 
     vkUpdateDescriptorSets(device,
@@ -876,8 +935,8 @@ class VulkanExample : public VulkanExampleBase {
     writeDescriptorSets = {
         // Binding 0: Vertex shader uniform buffer
         vks::initializers::writeDescriptorSet(
-            descriptorSets.model, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0,
-            &uniformBuffers.vsOffscreen.descriptor),
+            descriptorSets.model, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 0,
+            &vsDescriptor),
         // Binding 1: Color map
         vks::initializers::writeDescriptorSet(
             descriptorSets.model, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
@@ -896,8 +955,8 @@ class VulkanExample : public VulkanExampleBase {
     writeDescriptorSets = {
         // Binding 0: Vertex shader uniform buffer
         vks::initializers::writeDescriptorSet(
-            descriptorSets.floor, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0,
-            &uniformBuffers.vsOffscreen.descriptor),
+            descriptorSets.floor, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 0,
+            &vsDescriptor),
         // Binding 1: Color map
         vks::initializers::writeDescriptorSet(
             descriptorSets.floor, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
@@ -1023,31 +1082,15 @@ class VulkanExample : public VulkanExampleBase {
 
   // Prepare and initialize uniform buffer containing shader uniforms
   void prepareUniformBuffers() {
-    // Fullscreen vertex shader
-    VK_CHECK_RESULT(vulkanDevice->createBuffer(
-        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        &uniformBuffers.vsFullScreen, sizeof(uboVS)));
-
-    // Deferred vertex shader
-    VK_CHECK_RESULT(vulkanDevice->createBuffer(
-        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        &uniformBuffers.vsOffscreen, sizeof(uboOffscreenVS)));
-
-    // Deferred fragment shader
-    VK_CHECK_RESULT(vulkanDevice->createBuffer(
-        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        &uniformBuffers.fsLights, sizeof(uboFragmentLights)));
-
-    // Map persistent
-    VK_CHECK_RESULT(uniformBuffers.vsFullScreen.map());
-    VK_CHECK_RESULT(uniformBuffers.vsOffscreen.map());
-    VK_CHECK_RESULT(uniformBuffers.fsLights.map());
+    // Command buffers are only recorded once, so every frame has to place its
+    // uniform blocks at the same offsets (the example only has a single frame
+    // in flight)
+    const VkDeviceSize alignment =
+        vulkanDevice->properties.limits.minUniformBufferOffsetAlignment;
+    uniformAllocator.create(vulkanDevice,
+                            sizeof(uboVS) + sizeof(uboOffscreenVS) +
+                                sizeof(uboFragmentLights) + 3 * alignment,
+                            1);
 
     // Init some values
     uboOffscreenVS.instancePos[0] = glm::vec4(0.0f);
@@ -1058,6 +1101,15 @@ class VulkanExample : public VulkanExampleBase {
     updateUniformBuffersScreen();
     updateUniformBufferDeferredMatrices();
     updateUniformBufferDeferredLights();
+    updateUniformBuffers();
+  }
+
+  // Write all uniform blocks for the current frame
+  void updateUniformBuffers() {
+    uniformAllocator.beginFrame(0);
+    uniformOffsets.vsFullScreen = uniformAllocator.push(uboVS);
+    uniformOffsets.vsOffscreen = uniformAllocator.push(uboOffscreenVS);
+    uniformOffsets.fsLights = uniformAllocator.push(uboFragmentLights);
   }
 
   void updateUniformBuffersScreen() {
@@ -1067,17 +1119,12 @@ class VulkanExample : public VulkanExampleBase {
       uboVS.projection = glm::ortho(0.0f, 1.0f, 0.0f, 1.0f, -1.0f, 1.0f);
     }
     uboVS.model = glm::mat4(1.0f);
-
-    memcpy(uniformBuffers.vsFullScreen.mapped, &uboVS, sizeof(uboVS));
   }
 
   void updateUniformBufferDeferredMatrices() {
     uboOffscreenVS.projection = camera.matrices.perspective;
     uboOffscreenVS.view = camera.matrices.view;
     uboOffscreenVS.model = glm::mat4(1.0f);
-
-    memcpy(uniformBuffers.vsOffscreen.mapped, &uboOffscreenVS,
-           sizeof(uboOffscreenVS));
   }
 
   // Update fragment shader light position uniform block
@@ -1135,14 +1182,14 @@ class VulkanExample : public VulkanExampleBase {
     // Current view position
     uboFragmentLights.viewPos =
         glm::vec4(camera.position, 0.0f) * glm::vec4(-1.0f, 1.0f, -1.0f, 1.0f);
-
-    memcpy(uniformBuffers.fsLights.mapped, &uboFragmentLights,
-           sizeof(uboFragmentLights));
   }
 
   void draw() {
     VulkanExampleBase::prepareFrame();
 
+    // The previous frame has finished reading the uniform buffer
+    updateUniformBuffers();
+
     // The scene render command buffer has to wait for the offscreen
     // rendering to be finished before we can use the framebuffer
     // color image for sampling during final rendering
@@ -1191,6 +1238,7 @@ class VulkanExample : public VulkanExampleBase {
     preparePipelines();
     setupDescriptorPool();
     setupDescriptorSet();
+    recordThreadCount = static_cast<int32_t>(getRecordThreadCount());
     buildCommandBuffers();
     buildDeferredCommandBuffer();
     prepared = true;
@@ -1212,6 +1260,15 @@ class VulkanExample : public VulkanExampleBase {
         updateUniformBuffersScreen();
       }
     }
+    if (overlay->header("Command buffer recording")) {
+      if (overlay->sliderInt("Threads", &recordThreadCount, 1,
+                             std::max(std::thread::hardware_concurrency(),
+                                      1u))) {
+        setRecordThreadCount(static_cast<uint32_t>(recordThreadCount));
+        buildDeferredCommandBuffer();
+      }
+      overlay->text("G-Buffer pass: %.3f ms", recordTime);
+    }
   }
 };
 
@@ -156,7 +156,7 @@ class VulkanExample : public VulkanExampleBase {
 
     vkUnmapMemory(device, particles.memory);
     vkDestroyBuffer(device, particles.buffer, nullptr);
-    vkFreeMemory(device, particles.memory, nullptr);
+    vulkanDevice->freeMemory(particles.memory);
 
     uniformBuffers.environment.destroy();
     uniformBuffers.fire.destroy();
@@ -212,7 +212,7 @@ class VulkanExample : public VulkanExampleBase {
       pipelines.environment); vkCmdBindVertexBuffers(drawCmdBuffers[i],
       VERTEX_BUFFER_BIND_ID, 1, &models.environment.vertices.buffer, offsets);
       vkCmdBindIndexBuffer(drawCmdBuffers[i], models.environment.indices.buffer,
-      0, VK_INDEX_TYPE_UINT32); vkCmdDrawIndexed(drawCmdBuffers[i],
+      0, models.environment.indexType); vkCmdDrawIndexed(drawCmdBuffers[i],
       models.environment.indexCount, 1, 0, 0, 0);
       */
 
@@ -226,7 +226,7 @@ class VulkanExample : public VulkanExampleBase {
                              &particles.buffer, offsets);
       vkCmdDraw(drawCmdBuffers[i], PARTICLE_COUNT, 1, 0, 0);
 
-      drawUI(drawCmdBuffers[i]);
+      drawUI(drawCmdBuffers[i], i);
 
       vkCmdEndRenderPass(drawCmdBuffers[i]);
 
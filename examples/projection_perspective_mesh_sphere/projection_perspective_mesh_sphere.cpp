@@ -10,6 +10,7 @@
  */
 
 #include <assert.h>
+#include <float.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,6 +28,9 @@
 #include <assimp/Importer.hpp>
 
 #include <vulkan/vulkan.h>
+#include "VulkanFrameUniformAllocator.hpp"
+#include "VulkanGpuCulling.hpp"
+#include "VulkanMeshOptimizer.hpp"
 #include "VulkanTexture.hpp"
 #include "vulkanexamplebase.h"
 
@@ -76,21 +80,26 @@ class VulkanExample : public VulkanExampleBase {
     } vertices;
     struct {
       int count;
+      // 16 bit if all indices fit, see loadModel
+      VkIndexType type = VK_INDEX_TYPE_UINT32;
       VkBuffer buffer;
       VkDeviceMemory memory;
     } indices;
+    // Model space bounds of all vertices
+    glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+    glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
     // Destroys all Vulkan resources created for this model
-    void destroy(VkDevice device) {
-      vkDestroyBuffer(device, vertices.buffer, nullptr);
-      vkFreeMemory(device, vertices.memory, nullptr);
-      vkDestroyBuffer(device, indices.buffer, nullptr);
-      vkFreeMemory(device, indices.memory, nullptr);
+    void destroy(vks::VulkanDevice* device) {
+      vkDestroyBuffer(device->logicalDevice, vertices.buffer, nullptr);
+      device->freeMemory(vertices.memory);
+      vkDestroyBuffer(device->logicalDevice, indices.buffer, nullptr);
+      device->freeMemory(indices.memory);
     };
   } model;
 
-  struct {
-    vks::Buffer scene;
-  } uniformBuffers;
+  // The uniform data is written once per frame into the region of the frame in
+  // flight, so frames still executing keep their own copy
+  vks::FrameUniformAllocator uniformAllocator;
 
   struct {
     glm::mat4 projection;
@@ -110,6 +119,12 @@ class VulkanExample : public VulkanExampleBase {
   VkDescriptorSet descriptorSet;
   VkDescriptorSetLayout descriptorSetLayout;
 
+  // The mesh is frustum culled on the GPU and drawn indirectly if the culling
+  // shader has been generated
+  vks::GpuCulling gpuCulling;
+  bool gpuCullingAvailable = false;
+  bool gpuCullingEnabled = true;
+
   VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION) {
     zoom = 0.0f;
     zoomSpeed = 2.5f;
@@ -118,6 +133,8 @@ class VulkanExample : public VulkanExampleBase {
     cameraPos = {0.0f, 0.0f, 0.0f};
     title = "Sphere texture mapping";
     settings.overlay = true;
+    // Uniform data and command buffers are per frame in flight
+    maxFramesInFlight = 3;
   }
 
   ~VulkanExample() {
@@ -131,10 +148,11 @@ class VulkanExample : public VulkanExampleBase {
     vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
     vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
-    model.destroy(device);
+    model.destroy(vulkanDevice);
 
     textures.colorMap.destroy();
-    uniformBuffers.scene.destroy();
+    uniformAllocator.destroy();
+    gpuCulling.destroy();
   }
 
   virtual void getEnabledFeatures() {
@@ -144,9 +162,13 @@ class VulkanExample : public VulkanExampleBase {
     };
   }
 
-  void buildCommandBuffers() {
+  // Recorded every frame into the command buffer of the frame in flight
+  void recordCommandBuffer(VkCommandBuffer commandBuffer,
+                           uint32_t imageIndex,
+                           uint32_t dynamicOffset) {
     VkCommandBufferBeginInfo cmdBufInfo =
         vks::initializers::commandBufferBeginInfo();
+    cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
     VkClearValue clearValues[2];
     clearValues[0].color = defaultClearColor;
@@ -161,46 +183,53 @@ class VulkanExample : public VulkanExampleBase {
     renderPassBeginInfo.renderArea.extent.height = viewportHeight;
     renderPassBeginInfo.clearValueCount = 2;
     renderPassBeginInfo.pClearValues = clearValues;
+    renderPassBeginInfo.framebuffer = frameBuffers[imageIndex];
 
-    for (int32_t i = 0; i < drawCmdBuffers.size(); ++i) {
-      // Set target frame buffer
-      renderPassBeginInfo.framebuffer = frameBuffers[i];
-
-      VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
-
-      vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo,
-                           VK_SUBPASS_CONTENTS_INLINE);
+    VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
 
-      VkViewport viewport = vks::initializers::viewport(
-          (float)viewportWidth, (float)viewportHeight, 0.0f, 1.0f);
-      vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-
-      VkRect2D scissor =
-          vks::initializers::rect2D(viewportWidth, viewportHeight, 0, 0);
-      vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-      vkCmdBindDescriptorSets(drawCmdBuffers[i],
-                              VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
-                              0, 1, &descriptorSet, 0, NULL);
-      vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                        wireframe ? pipelines.wireframe : pipelines.solid);
+    const bool culled = gpuCullingAvailable && gpuCullingEnabled;
+    // Culling has to be dispatched outside of the render pass
+    if (culled) {
+      gpuCulling.recordCulling(commandBuffer, currentFrame);
+    }
 
-      VkDeviceSize offsets[1] = {0};
-      // Bind mesh vertex buffer
-      vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1,
-                             &model.vertices.buffer, offsets);
-      // Bind mesh index buffer
-      vkCmdBindIndexBuffer(drawCmdBuffers[i], model.indices.buffer, 0,
-                           VK_INDEX_TYPE_UINT32);
-      // Render mesh vertex buffer using it's indices
-      vkCmdDrawIndexed(drawCmdBuffers[i], model.indices.count, 1, 0, 0, 0);
+    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo,
+                         VK_SUBPASS_CONTENTS_INLINE);
+
+    VkViewport viewport = vks::initializers::viewport(
+        (float)viewportWidth, (float)viewportHeight, 0.0f, 1.0f);
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor =
+        vks::initializers::rect2D(viewportWidth, viewportHeight, 0, 0);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            pipelineLayout, 0, 1, &descriptorSet, 1,
+                            &dynamicOffset);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      wireframe ? pipelines.wireframe : pipelines.solid);
+
+    VkDeviceSize offsets[1] = {0};
+    // Bind mesh vertex buffer
+    vkCmdBindVertexBuffers(commandBuffer, VERTEX_BUFFER_BIND_ID, 1,
+                           &model.vertices.buffer, offsets);
+    // Bind mesh index buffer
+    vkCmdBindIndexBuffer(commandBuffer, model.indices.buffer, 0,
+                         model.indices.type);
+    // Render mesh vertex buffer using it's indices
+    if (culled) {
+      // Draws nothing if the culling found the mesh outside of the frustum
+      gpuCulling.draw(commandBuffer, currentFrame);
+    } else {
+      vkCmdDrawIndexed(commandBuffer, model.indices.count, 1, 0, 0, 0);
+    }
 
-      drawUI(drawCmdBuffers[i]);
+    drawUI(commandBuffer, imageIndex);
 
-      vkCmdEndRenderPass(drawCmdBuffers[i]);
+    vkCmdEndRenderPass(commandBuffer);
 
-      VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
-    }
+    VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
   }
 
   // Load a model from file using the ASSIMP model loader and generate all
@@ -259,6 +288,9 @@ class VulkanExample : public VulkanExampleBase {
                            ? glm::make_vec3(&scene->mMeshes[m]->mColors[0][v].r)
                            : glm::vec3(1.0f);
 
+        model.boundsMin = glm::min(model.boundsMin, vertex.pos);
+        model.boundsMax = glm::max(model.boundsMax, vertex.pos);
+
         if (vertex.pos.x > xBiggest)
           xBiggest = vertex.pos.x;
         if (vertex.pos.x < xSmallest)
@@ -298,8 +330,18 @@ class VulkanExample : public VulkanExampleBase {
       }
     }
     size_t indexBufferSize = indexBuffer.size() * sizeof(uint32_t);
+    void* indexData = indexBuffer.data();
     model.indices.count = static_cast<uint32_t>(indexBuffer.size());
 
+    // Use 16 bit indices if all of them fit, which halves the index buffer
+    std::vector<uint16_t> shortIndexBuffer(indexBuffer.size());
+    if (vks::meshopt::packIndices16(indexBuffer.data(), indexBuffer.size(), 0,
+                                    shortIndexBuffer.data())) {
+      model.indices.type = VK_INDEX_TYPE_UINT16;
+      indexBufferSize = shortIndexBuffer.size() * sizeof(uint16_t);
+      indexData = shortIndexBuffer.data();
+    }
+
     // Static mesh should always be device local
 
     bool useStaging = true;
@@ -324,7 +366,7 @@ class VulkanExample : public VulkanExampleBase {
                                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
                                      indexBufferSize, &indexStaging.buffer,
-                                     &indexStaging.memory, indexBuffer.data()));
+                                     &indexStaging.memory, indexData));
 
       // Create device local buffers
       // Vertex buffer
@@ -355,9 +397,9 @@ class VulkanExample : public VulkanExampleBase {
       VulkanExampleBase::flushCommandBuffer(copyCmd, queue, true);
 
       vkDestroyBuffer(device, vertexStaging.buffer, nullptr);
-      vkFreeMemory(device, vertexStaging.memory, nullptr);
+      vulkanDevice->freeMemory(vertexStaging.memory);
       vkDestroyBuffer(device, indexStaging.buffer, nullptr);
-      vkFreeMemory(device, indexStaging.memory, nullptr);
+      vulkanDevice->freeMemory(indexStaging.memory);
     } else {
       // Vertex buffer
       VK_CHECK_RESULT(vulkanDevice->createBuffer(
@@ -368,7 +410,7 @@ class VulkanExample : public VulkanExampleBase {
       VK_CHECK_RESULT(vulkanDevice->createBuffer(
           VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
           indexBufferSize, &model.indices.buffer, &model.indices.memory,
-          indexBuffer.data()));
+          indexData));
     }
   }
 
@@ -441,10 +483,10 @@ class VulkanExample : public VulkanExampleBase {
   }
 
   void setupDescriptorPool() {
-    // Example uses one ubo and one combined image sampler
+    // Example uses one dynamic ubo and one combined image sampler
     std::vector<VkDescriptorPoolSize> poolSizes = {
-        vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                                              1),
+        vks::initializers::descriptorPoolSize(
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1),
         vks::initializers::descriptorPoolSize(
             VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1),
     };
@@ -461,7 +503,8 @@ class VulkanExample : public VulkanExampleBase {
     std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
         // Binding 0 : Vertex shader uniform buffer
         vks::initializers::descriptorSetLayoutBinding(
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            VK_SHADER_STAGE_VERTEX_BIT, 0),
         // Binding 1 : Fragment shader combined sampler
         vks::initializers::descriptorSetLayoutBinding(
             VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
@@ -496,11 +539,14 @@ class VulkanExample : public VulkanExampleBase {
                                                textures.colorMap.view,
                                                VK_IMAGE_LAYOUT_GENERAL);
 
+    VkDescriptorBufferInfo uniformDescriptor =
+        uniformAllocator.getDescriptor(sizeof(uboVS));
+
     std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
         // Binding 0 : Vertex shader uniform buffer
         vks::initializers::writeDescriptorSet(
-            descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0,
-            &uniformBuffers.scene.descriptor),
+            descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 0,
+            &uniformDescriptor),
         // Binding 1 : Color map
         vks::initializers::writeDescriptorSet(
             descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
@@ -587,21 +633,56 @@ class VulkanExample : public VulkanExampleBase {
     }
   }
 
-  // Prepare and initialize uniform buffer containing shader uniforms
+  // Prepare the uniform buffer regions containing shader uniforms
   void prepareUniformBuffers() {
-    // Vertex shader uniform buffer block
-    VK_CHECK_RESULT(
-        vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                   &uniformBuffers.scene, sizeof(uboVS)));
-
-    // Map persistent
-    VK_CHECK_RESULT(uniformBuffers.scene.map());
+    // One vertex shader uniform block per frame in flight
+    uniformAllocator.create(vulkanDevice, sizeof(uboVS), maxFramesInFlight);
 
     updateUniformBuffers();
   }
 
+  // Bounds and draw parameters of the mesh for the GPU culling
+  vks::GpuCulling::Object cullObject() {
+    vks::GpuCulling::Object object{};
+    object.boundsMin = model.boundsMin;
+    object.boundsMax = model.boundsMax;
+    object.indexCount = model.indices.count;
+    object.instanceCount = 1;
+    return object;
+  }
+
+  // Frustum of the model space the mesh bounds are in
+  vks::Frustum cullFrustum() {
+    vks::Frustum frustum;
+    frustum.update(uboVS.projection * uboVS.model);
+    return frustum;
+  }
+
+  void prepareGpuCulling() {
+    // The SPIR-V of the culling shader is not shipped, see
+    // data/shaders/base/generate-spirv.bat
+    const std::string shaderFile = getAssetPath() + "shaders/base/cull.comp.spv";
+    if (!vks::tools::fileExists(shaderFile)) {
+      std::cout << "GPU culling disabled, " << shaderFile << " not found"
+                << std::endl;
+      return;
+    }
+    gpuCulling.create(vulkanDevice, 1, maxFramesInFlight,
+                      loadShader(shaderFile, VK_SHADER_STAGE_COMPUTE_BIT),
+                      pipelineCache);
+    const vks::GpuCulling::Object object = cullObject();
+    gpuCulling.setObjects(&object, 1, queue);
+    // Compare the shader with the CPU culling once before it's used
+    const uint32_t mismatches = gpuCulling.verify(&object, cullFrustum(), queue);
+    if (mismatches > 0) {
+      std::cout << "GPU culling disabled, the shader disagrees with the CPU on "
+                << mismatches << " objects" << std::endl;
+      gpuCulling.destroy();
+      return;
+    }
+    gpuCullingAvailable = true;
+  }
+
   void updateUniformBuffers() {
     uboVS.projection = glm::perspective(
         glm::radians(60.0f), (float)viewportWidth / (float)viewportHeight, 0.1f,
@@ -619,16 +700,24 @@ class VulkanExample : public VulkanExampleBase {
                               glm::vec3(0.0f, 1.0f, 0.0f));
     uboVS.model = glm::rotate(uboVS.model, glm::radians(rotation.z),
                               glm::vec3(0.0f, 0.0f, 1.0f));
-
-    memcpy(uniformBuffers.scene.mapped, &uboVS, sizeof(uboVS));
   }
 
   void draw() {
     VulkanExampleBase::prepareFrame();
 
+    // The previous submission of this frame in flight has completed, so its
+    // uniform region and command buffer can be rewritten
+    uniformAllocator.beginFrame(currentFrame);
+    const uint32_t dynamicOffset = uniformAllocator.push(uboVS);
+    if (gpuCullingAvailable) {
+      gpuCulling.update(currentFrame, cullFrustum());
+    }
+    VkCommandBuffer commandBuffer = frames[currentFrame].commandBuffer;
+    recordCommandBuffer(commandBuffer, currentBuffer, dynamicOffset);
+
     // Command buffer to be sumitted to the queue
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
+    submitInfo.pCommandBuffers = &commandBuffer;
 
     // Submit to queue
     VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
@@ -645,7 +734,7 @@ class VulkanExample : public VulkanExampleBase {
     preparePipelines();
     setupDescriptorPool();
     setupDescriptorSet();
-    buildCommandBuffers();
+    prepareGpuCulling();
     prepared = true;
   }
 
@@ -660,8 +749,10 @@ class VulkanExample : public VulkanExampleBase {
 
   virtual void OnUpdateUIOverlay(vks::UIOverlay* overlay) {
     if (overlay->header("Settings")) {
-      if (overlay->checkBox("Wireframe", &wireframe)) {
-        buildCommandBuffers();
+      // Takes effect with the next recorded frame
+      overlay->checkBox("Wireframe", &wireframe);
+      if (gpuCullingAvailable) {
+        overlay->checkBox("GPU frustum culling", &gpuCullingEnabled);
       }
     }
   }
@@ -359,7 +359,7 @@ public:
 
       // Bind triangle index buffer
       vkCmdBindIndexBuffer(drawCmdBuffers[i], indices.buffer, 0,
-                           VK_INDEX_TYPE_UINT32);
+                           VK_INDEX_TYPE_UINT16);
 
       // Draw indexed triangle
       vkCmdDrawIndexed(drawCmdBuffers[i], indices.count, 1, 0, 0, 1);
@@ -490,10 +490,10 @@ public:
         static_cast<uint32_t>(vertexBuffer.size()) * sizeof(Vertex);
 
     // Setup indices
-    std::vector<uint32_t> indexBuffer = {0, 1, 2, 0, 2, 3};
-    // std::vector<uint32_t> indexBuffer = {2, 1, 0, 3, 2, 0};
+    std::vector<uint16_t> indexBuffer = {0, 1, 2, 0, 2, 3};
+    // std::vector<uint16_t> indexBuffer = {2, 1, 0, 3, 2, 0};
     indices.count = static_cast<uint32_t>(indexBuffer.size());
-    uint32_t indexBufferSize = indices.count * sizeof(uint32_t);
+    uint32_t indexBufferSize = indices.count * sizeof(uint16_t);
 
     VkMemoryAllocateInfo memAlloc = {};
     memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
@@ -547,7 +547,7 @@ class VulkanExample : public VulkanExampleBase {
       // vkCmdDrawIndexed(drawCmdBuffers[i], indexCount, 1, 0, 0, 0);
       vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
 
-      // drawUI(drawCmdBuffers[i]);
+      // drawUI(drawCmdBuffers[i], i);
 
       vkCmdEndRenderPass(drawCmdBuffers[i]);
 
@@ -569,11 +569,11 @@ class VulkanExample : public VulkanExampleBase {
       vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1,
                              &vertexBuffer.buffer, offsets);
       vkCmdBindIndexBuffer(drawCmdBuffers[i], indexBuffer.buffer, 0,
-                           VK_INDEX_TYPE_UINT32);
+                           VK_INDEX_TYPE_UINT16);
 
       vkCmdDrawIndexed(drawCmdBuffers[i], indexCount, 1, 0, 0, 0);
 
-      // drawUI(drawCmdBuffers[i]);
+      // drawUI(drawCmdBuffers[i], i);
 
       vkCmdEndRenderPass(drawCmdBuffers[i]);
 
@@ -771,7 +771,7 @@ class VulkanExample : public VulkanExampleBase {
       };
     }
     // Setup indices
-    std::vector<uint32_t> indices = {0, 1, 2, 0, 2, 3};
+    std::vector<uint16_t> indices = {0, 1, 2, 0, 2, 3};
     indexCount = static_cast<uint32_t>(indices.size());
 
     // Create buffers
@@ -787,7 +787,7 @@ class VulkanExample : public VulkanExampleBase {
         VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        &indexBuffer, indices.size() * sizeof(uint32_t), indices.data()));
+        &indexBuffer, indices.size() * sizeof(uint16_t), indices.data()));
   }
 
   void setupVertexDescriptions() {
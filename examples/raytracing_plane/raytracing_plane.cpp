@@ -180,19 +180,10 @@ class VulkanExample : public VulkanExampleBase {
         VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
     imageCreateInfo.flags = 0;
 
-    VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-    VkMemoryRequirements memReqs;
-
     VK_CHECK_RESULT(
         vkCreateImage(device, &imageCreateInfo, nullptr, &tex->image));
-    vkGetImageMemoryRequirements(device, tex->image, &memReqs);
-    memAllocInfo.allocationSize = memReqs.size;
-    memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(
-        memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    VK_CHECK_RESULT(
-        vkAllocateMemory(device, &memAllocInfo, nullptr, &tex->deviceMemory));
-    VK_CHECK_RESULT(
-        vkBindImageMemory(device, tex->image, tex->deviceMemory, 0));
+    VK_CHECK_RESULT(vulkanDevice->allocateImageMemory(
+        tex->image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &tex->allocation));
 
     VkCommandBuffer layoutCmd = VulkanExampleBase::createCommandBuffer(
         VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
@@ -302,7 +293,7 @@ class VulkanExample : public VulkanExampleBase {
                         graphics.pipeline);
       vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
 
-      // drawUI(drawCmdBuffers[i]);
+      // drawUI(drawCmdBuffers[i], i);
 
       vkCmdEndRenderPass(drawCmdBuffers[i]);
 
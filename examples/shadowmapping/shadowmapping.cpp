@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <chrono>
 #include <vector>
 
 #define GLM_FORCE_RADIANS
@@ -146,6 +147,13 @@ class VulkanExample : public VulkanExampleBase {
     VkSemaphore semaphore = VK_NULL_HANDLE;
   } offscreenPass;
 
+  // CPU time spent on recording the command buffers of both passes (in ms)
+  struct {
+    float offscreen = 0.0f;
+    float scene = 0.0f;
+  } recordTimes;
+  int32_t recordThreadCount = 1;
+
   VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION) {
     zoom = -20.0f;
     rotation = {-15.0f, -390.0f, 0.0f};
@@ -386,43 +394,60 @@ class VulkanExample : public VulkanExampleBase {
     renderPassBeginInfo.clearValueCount = 2;
     renderPassBeginInfo.pClearValues = clearValues;
 
+    auto tStart = std::chrono::high_resolution_clock::now();
+
     VK_CHECK_RESULT(
         vkBeginCommandBuffer(offscreenPass.commandBuffer, &cmdBufInfo));
 
-    VkViewport viewport = vks::initializers::viewport(
-        (float)offscreenPass.width, (float)offscreenPass.height, 0.0f, 1.0f);
-    vkCmdSetViewport(offscreenPass.commandBuffer, 0, 1, &viewport);
-
-    VkRect2D scissor = vks::initializers::rect2D(offscreenPass.width,
-                                                 offscreenPass.height, 0, 0);
-    vkCmdSetScissor(offscreenPass.commandBuffer, 0, 1, &scissor);
-
-    // Set depth bias (aka "Polygon offset")
-    // Required to avoid shadow mapping artefacts
-    vkCmdSetDepthBias(offscreenPass.commandBuffer, depthBiasConstant, 0.0f,
-                      depthBiasSlope);
-
     vkCmdBeginRenderPass(offscreenPass.commandBuffer, &renderPassBeginInfo,
-                         VK_SUBPASS_CONTENTS_INLINE);
-
-    vkCmdBindPipeline(offscreenPass.commandBuffer,
-                      VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.offscreen);
-    vkCmdBindDescriptorSets(
-        offscreenPass.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-        pipelineLayouts.offscreen, 0, 1, &descriptorSets.offscreen, 0, NULL);
-
-    VkDeviceSize offsets[1] = {0};
-    vkCmdBindVertexBuffers(offscreenPass.commandBuffer, VERTEX_BUFFER_BIND_ID,
-                           1, &scenes[sceneIndex].vertices.buffer, offsets);
-    vkCmdBindIndexBuffer(offscreenPass.commandBuffer,
-                         scenes[sceneIndex].indices.buffer, 0,
-                         VK_INDEX_TYPE_UINT32);
-    vkCmdDrawIndexed(offscreenPass.commandBuffer, scenes[sceneIndex].indexCount,
-                     1, 0, 0, 0);
+                         VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+    // The parts of the scene are split across the recording threads
+    const vks::Model& scene = scenes[sceneIndex];
+    recordSecondaryCommandBuffers(
+        offscreenPass.commandBuffer, offscreenPass.renderPass, 0,
+        offscreenPass.frameBuffer, static_cast<uint32_t>(scene.parts.size()),
+        [&](VkCommandBuffer commandBuffer, uint32_t first, uint32_t last) {
+          VkViewport viewport = vks::initializers::viewport(
+              (float)offscreenPass.width, (float)offscreenPass.height, 0.0f,
+              1.0f);
+          vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+          VkRect2D scissor = vks::initializers::rect2D(
+              offscreenPass.width, offscreenPass.height, 0, 0);
+          vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+          // Set depth bias (aka "Polygon offset")
+          // Required to avoid shadow mapping artefacts
+          vkCmdSetDepthBias(commandBuffer, depthBiasConstant, 0.0f,
+                            depthBiasSlope);
+
+          vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            pipelines.offscreen);
+          vkCmdBindDescriptorSets(
+              commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+              pipelineLayouts.offscreen, 0, 1, &descriptorSets.offscreen, 0,
+              NULL);
+
+          VkDeviceSize offsets[1] = {0};
+          vkCmdBindVertexBuffers(commandBuffer, VERTEX_BUFFER_BIND_ID, 1,
+                                 &scene.vertices.buffer, offsets);
+          vkCmdBindIndexBuffer(commandBuffer, scene.indices.buffer, 0,
+                               scene.indexType);
+          for (uint32_t i = first; i < last; i++) {
+            vkCmdDrawIndexed(commandBuffer, scene.parts[i].indexCount, 1,
+                             scene.parts[i].indexBase, 0, 0);
+          }
+        });
 
     vkCmdEndRenderPass(offscreenPass.commandBuffer);
 
     VK_CHECK_RESULT(vkEndCommandBuffer(offscreenPass.commandBuffer));
+
+    recordTimes.offscreen = std::chrono::duration<float, std::milli>(
+                                std::chrono::high_resolution_clock::now() -
+                                tStart)
+                                .count();
   }
 
   void buildCommandBuffers() {
@@ -443,6 +468,11 @@ class VulkanExample : public VulkanExampleBase {
     renderPassBeginInfo.clearValueCount = 2;
     renderPassBeginInfo.pClearValues = clearValues;
 
+    auto tStart = std::chrono::high_resolution_clock::now();
+
+    const vks::Model& scene = scenes[sceneIndex];
+    const uint32_t drawCount = static_cast<uint32_t>(scene.parts.size());
+
     for (int32_t i = 0; i < drawCmdBuffers.size(); ++i) {
       // Set target frame buffer
       renderPassBeginInfo.framebuffer = frameBuffers[i];
@@ -450,61 +480,81 @@ class VulkanExample : public VulkanExampleBase {
       VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
       vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo,
-                           VK_SUBPASS_CONTENTS_INLINE);
-
-      VkViewport viewport = vks::initializers::viewport(
-          (float)viewportWidth, (float)viewportHeight, 0.0f, 1.0f);
-      vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-
-      VkRect2D scissor =
-          vks::initializers::rect2D(viewportWidth, viewportHeight, 0, 0);
-      vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-      VkDeviceSize offsets[1] = {0};
-
-      // Visualize shadow map
-      if (displayShadowMap) {
-        vkCmdBindDescriptorSets(
-            drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-            pipelineLayouts.quad, 0, 1, &descriptorSet, 0, NULL);
-        vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                          pipelines.quad);
-        vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1,
-                               &models.quad.vertices.buffer, offsets);
-        vkCmdBindIndexBuffer(drawCmdBuffers[i], models.quad.indices.buffer, 0,
-                             VK_INDEX_TYPE_UINT32);
-        vkCmdDrawIndexed(drawCmdBuffers[i], models.quad.indexCount, 1, 0, 0, 0);
-      }
-
-      // 3D scene
-      vkCmdBindDescriptorSets(
-          drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-          pipelineLayouts.quad, 0, 1, &descriptorSets.scene, 0, NULL);
-      vkCmdBindPipeline(
-          drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-          (filterPCF) ? pipelines.sceneShadowPCF : pipelines.sceneShadow);
-
-      vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1,
-                             &scenes[sceneIndex].vertices.buffer, offsets);
-      vkCmdBindIndexBuffer(drawCmdBuffers[i], scenes[sceneIndex].indices.buffer,
-                           0, VK_INDEX_TYPE_UINT32);
-      vkCmdDrawIndexed(drawCmdBuffers[i], scenes[sceneIndex].indexCount, 1, 0,
-                       0, 0);
-
-      drawUI(drawCmdBuffers[i]);
+                           VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+      recordSecondaryCommandBuffers(
+          drawCmdBuffers[i], renderPass, 0, frameBuffers[i], drawCount,
+          [&](VkCommandBuffer commandBuffer, uint32_t first, uint32_t last) {
+            VkViewport viewport = vks::initializers::viewport(
+                (float)viewportWidth, (float)viewportHeight, 0.0f, 1.0f);
+            vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+            VkRect2D scissor =
+                vks::initializers::rect2D(viewportWidth, viewportHeight, 0, 0);
+            vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+            VkDeviceSize offsets[1] = {0};
+
+            // Visualize shadow map
+            if (displayShadowMap && (first == 0)) {
+              vkCmdBindDescriptorSets(
+                  commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                  pipelineLayouts.quad, 0, 1, &descriptorSet, 0, NULL);
+              vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                pipelines.quad);
+              vkCmdBindVertexBuffers(commandBuffer, VERTEX_BUFFER_BIND_ID, 1,
+                                     &models.quad.vertices.buffer, offsets);
+              vkCmdBindIndexBuffer(commandBuffer, models.quad.indices.buffer,
+                                   0, models.quad.indexType);
+              vkCmdDrawIndexed(commandBuffer, models.quad.indexCount, 1, 0, 0,
+                               0);
+            }
+
+            // 3D scene
+            vkCmdBindDescriptorSets(
+                commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                pipelineLayouts.quad, 0, 1, &descriptorSets.scene, 0, NULL);
+            vkCmdBindPipeline(
+                commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                (filterPCF) ? pipelines.sceneShadowPCF : pipelines.sceneShadow);
+
+            vkCmdBindVertexBuffers(commandBuffer, VERTEX_BUFFER_BIND_ID, 1,
+                                   &scene.vertices.buffer, offsets);
+            vkCmdBindIndexBuffer(commandBuffer, scene.indices.buffer, 0,
+                                 scene.indexType);
+            for (uint32_t part = first; part < last; part++) {
+              vkCmdDrawIndexed(commandBuffer, scene.parts[part].indexCount, 1,
+                               scene.parts[part].indexBase, 0, 0);
+            }
+
+            // The render pass only takes secondary command buffers, so the UI
+            // is drawn by the one recording the last range
+            if (last == drawCount) {
+              drawUI(commandBuffer, i);
+            }
+          });
 
       vkCmdEndRenderPass(drawCmdBuffers[i]);
 
       VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
     }
+
+    recordTimes.scene = std::chrono::duration<float, std::milli>(
+                            std::chrono::high_resolution_clock::now() - tStart)
+                            .count();
   }
 
   void loadAssets() {
+    // Both scenes are uploaded with a single submission
+    vks::UploadBatch uploads(vulkanDevice, queue);
     scenes.resize(2);
     scenes[0].loadFromFile(getAssetPath() + "models/vulkanscene_shadow.dae",
-                           vertexLayout, 4.0f, vulkanDevice, queue);
+                           vertexLayout, 4.0f, vulkanDevice, queue,
+                           vks::Model::defaultFlags, &uploads);
     scenes[1].loadFromFile(getAssetPath() + "models/samplescene.dae",
-                           vertexLayout, 0.25f, vulkanDevice, queue);
+                           vertexLayout, 0.25f, vulkanDevice, queue,
+                           vks::Model::defaultFlags, &uploads);
+    uploads.flush();
     sceneNames = {"Vulkan scene", "Teapots and pillars"};
   }
 
@@ -529,8 +579,8 @@ class VulkanExample : public VulkanExampleBase {
         VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        vertexBuffer.size() * sizeof(Vertex), &models.quad.vertices.buffer,
-        &models.quad.vertices.memory, vertexBuffer.data()));
+        &models.quad.vertices, vertexBuffer.size() * sizeof(Vertex),
+        vertexBuffer.data()));
 
     // Setup indices
     std::vector<uint32_t> indexBuffer = {0, 1, 2, 2, 3, 0};
@@ -540,8 +590,8 @@ class VulkanExample : public VulkanExampleBase {
         VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        indexBuffer.size() * sizeof(uint32_t), &models.quad.indices.buffer,
-        &models.quad.indices.memory, indexBuffer.data()));
+        &models.quad.indices, indexBuffer.size() * sizeof(uint32_t),
+        indexBuffer.data()));
 
     models.quad.device = device;
   }
@@ -948,6 +998,7 @@ class VulkanExample : public VulkanExampleBase {
     preparePipelines();
     setupDescriptorPool();
     setupDescriptorSets();
+    recordThreadCount = static_cast<int32_t>(getRecordThreadCount());
     buildCommandBuffers();
     buildOffscreenCommandBuffer();
     prepared = true;
@@ -983,6 +1034,17 @@ class VulkanExample : public VulkanExampleBase {
         buildCommandBuffers();
       }
     }
+    if (overlay->header("Command buffer recording")) {
+      if (overlay->sliderInt("Threads", &recordThreadCount, 1,
+                             std::max(std::thread::hardware_concurrency(),
+                                      1u))) {
+        setRecordThreadCount(static_cast<uint32_t>(recordThreadCount));
+        buildCommandBuffers();
+        buildOffscreenCommandBuffer();
+      }
+      overlay->text("Shadow pass: %.3f ms", recordTimes.offscreen);
+      overlay->text("Scene pass: %.3f ms", recordTimes.scene);
+    }
   }
 };
 
@@ -27,6 +27,7 @@
 #include <assimp/Importer.hpp>
 
 #include <vulkan/vulkan.h>
+#include "VulkanMeshOptimizer.hpp"
 #include "VulkanTexture.hpp"
 #include "vulkanexamplebase.h"
 
@@ -70,15 +71,17 @@ class VulkanExample : public VulkanExampleBase {
     } vertices;
     struct {
       int count;
+      // 16 bit if all indices fit, see loadModel
+      VkIndexType type = VK_INDEX_TYPE_UINT32;
       VkBuffer buffer;
       VkDeviceMemory memory;
     } indices;
     // Destroys all Vulkan resources created for this model
-    void destroy(VkDevice device) {
-      vkDestroyBuffer(device, vertices.buffer, nullptr);
-      vkFreeMemory(device, vertices.memory, nullptr);
-      vkDestroyBuffer(device, indices.buffer, nullptr);
-      vkFreeMemory(device, indices.memory, nullptr);
+    void destroy(vks::VulkanDevice* device) {
+      vkDestroyBuffer(device->logicalDevice, vertices.buffer, nullptr);
+      device->freeMemory(vertices.memory);
+      vkDestroyBuffer(device->logicalDevice, indices.buffer, nullptr);
+      device->freeMemory(indices.memory);
     };
   } model;
 
@@ -122,7 +125,7 @@ class VulkanExample : public VulkanExampleBase {
     vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
     vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
-    model.destroy(device);
+    model.destroy(vulkanDevice);
 
     textures.colorMap.destroy();
     uniformBuffers.scene.destroy();
@@ -182,11 +185,11 @@ class VulkanExample : public VulkanExampleBase {
                              &model.vertices.buffer, offsets);
       // Bind mesh index buffer
       vkCmdBindIndexBuffer(drawCmdBuffers[i], model.indices.buffer, 0,
-                           VK_INDEX_TYPE_UINT32);
+                           model.indices.type);
       // Render mesh vertex buffer using it's indices
       vkCmdDrawIndexed(drawCmdBuffers[i], model.indices.count, 1, 0, 0, 0);
 
-      // drawUI(drawCmdBuffers[i]);
+      // drawUI(drawCmdBuffers[i], i);
 
       vkCmdEndRenderPass(drawCmdBuffers[i]);
 
@@ -275,8 +278,18 @@ class VulkanExample : public VulkanExampleBase {
       }
     }
     size_t indexBufferSize = indexBuffer.size() * sizeof(uint32_t);
+    void* indexData = indexBuffer.data();
     model.indices.count = static_cast<uint32_t>(indexBuffer.size());
 
+    // Use 16 bit indices if all of them fit, which halves the index buffer
+    std::vector<uint16_t> shortIndexBuffer(indexBuffer.size());
+    if (vks::meshopt::packIndices16(indexBuffer.data(), indexBuffer.size(), 0,
+                                    shortIndexBuffer.data())) {
+      model.indices.type = VK_INDEX_TYPE_UINT16;
+      indexBufferSize = shortIndexBuffer.size() * sizeof(uint16_t);
+      indexData = shortIndexBuffer.data();
+    }
+
     // Static mesh should always be device local
 
     bool useStaging = true;
@@ -301,7 +314,7 @@ class VulkanExample : public VulkanExampleBase {
                                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
                                      indexBufferSize, &indexStaging.buffer,
-                                     &indexStaging.memory, indexBuffer.data()));
+                                     &indexStaging.memory, indexData));
 
       // Create device local buffers
       // Vertex buffer
@@ -332,9 +345,9 @@ class VulkanExample : public VulkanExampleBase {
       VulkanExampleBase::flushCommandBuffer(copyCmd, queue, true);
 
       vkDestroyBuffer(device, vertexStaging.buffer, nullptr);
-      vkFreeMemory(device, vertexStaging.memory, nullptr);
+      vulkanDevice->freeMemory(vertexStaging.memory);
       vkDestroyBuffer(device, indexStaging.buffer, nullptr);
-      vkFreeMemory(device, indexStaging.memory, nullptr);
+      vulkanDevice->freeMemory(indexStaging.memory);
     } else {
       // Vertex buffer
       VK_CHECK_RESULT(vulkanDevice->createBuffer(
@@ -345,7 +358,7 @@ class VulkanExample : public VulkanExampleBase {
       VK_CHECK_RESULT(vulkanDevice->createBuffer(
           VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
           indexBufferSize, &model.indices.buffer, &model.indices.memory,
-          indexBuffer.data()));
+          indexData));
     }
   }
 
@@ -725,6 +725,19 @@ enum SectionCheck {
   REQUIRE_ALL = 0x3f
 };
 
+///
+/// Decodes image data referenced by a glTF image (see TinyGLTF::SetImageLoader).
+/// `req_width`/`req_height` are 0 if the image does not specify a size.
+///
+typedef bool (*LoadImageDataFunction)(Image *image, std::string *err,
+                                      int req_width, int req_height,
+                                      const unsigned char *bytes, int size,
+                                      void *user_data);
+
+bool LoadImageData(Image *image, std::string *err, int req_width,
+                   int req_height, const unsigned char *bytes, int size,
+                   void *user_data);
+
 
 class TinyGLTF {
  public:
@@ -734,7 +747,12 @@ class TinyGLTF {
 #pragma clang diagnostic ignored "-Wc++98-compat"
 #endif
 
-  TinyGLTF() : bin_data_(nullptr), bin_size_(0), is_binary_(false) {
+  TinyGLTF()
+      : bin_data_(nullptr),
+        bin_size_(0),
+        is_binary_(false),
+        LoadImageData(tinygltf::LoadImageData),
+        load_image_user_data_(nullptr) {
   }
 
 #ifdef __clang__
@@ -743,6 +761,12 @@ class TinyGLTF {
 
   ~TinyGLTF() {}
 
+  ///
+  /// Replaces the stb_image based decoder used for images, e.g. to keep the
+  /// encoded data and decode it later on.
+  ///
+  void SetImageLoader(LoadImageDataFunction LoadImageData, void *user_data);
+
   ///
   /// Loads glTF ASCII asset from a file.
   /// Returns false and set error string to `err` if there's an error.
@@ -801,6 +825,9 @@ class TinyGLTF {
   const unsigned char *bin_data_;
   size_t bin_size_;
   bool is_binary_;
+
+  LoadImageDataFunction LoadImageData;
+  void *load_image_user_data_;
 };
 
 #ifdef __clang__
@@ -1159,9 +1186,9 @@ static bool LoadExternalFile(std::vector<unsigned char> *out, std::string *err,
   return true;
 }
 
-static bool LoadImageData(Image *image, std::string *err, int req_width,
-                          int req_height, const unsigned char *bytes,
-                          int size) {
+bool LoadImageData(Image *image, std::string *err, int req_width,
+                   int req_height, const unsigned char *bytes, int size,
+                   void *) {
   //std::cout << "size " << size << std::endl;
 
   int w, h, comp;
@@ -1587,7 +1614,8 @@ static bool ParseAsset(Asset *asset, std::string *err,
 static bool ParseImage(Image *image, std::string *err,
                        const json &o, const std::string &basedir,
                        bool is_binary, const unsigned char *bin_data,
-                       size_t bin_size) {
+                       size_t bin_size, LoadImageDataFunction LoadImageData,
+                       void *load_image_user_data) {
   // A glTF image must either reference a bufferView or an image uri
   double bufferView = -1;
   bool isEmbedded =
@@ -1680,7 +1708,7 @@ static bool ParseImage(Image *image, std::string *err,
   }
 
   return LoadImageData(image, err, 0, 0, &img.at(0),
-                       static_cast<int>(img.size()));
+                       static_cast<int>(img.size()), load_image_user_data);
 }
 
 static bool ParseTexture(Texture *texture, std::string *err,
@@ -1781,6 +1809,8 @@ static bool ParseBuffer(Buffer *buffer, std::string *err,
 
   ParseStringProperty(&buffer->name, err, o, "name", false);
 
+  buffer->uri = uri;
+
   return true;
 }
 
@@ -2488,6 +2518,11 @@ static bool ParseCamera(Camera *camera, std::string *err,
   return true;
 }
 
+void TinyGLTF::SetImageLoader(LoadImageDataFunction func, void *user_data) {
+  LoadImageData = func;
+  load_image_user_data_ = user_data;
+}
+
 bool TinyGLTF::LoadFromString(Model *model, std::string *err, const char *str,
                               unsigned int length, const std::string &base_dir,
                               unsigned int check_sections) {
@@ -2853,7 +2888,8 @@ bool TinyGLTF::LoadFromString(Model *model, std::string *err, const char *str,
         }
         Image image;
         if (!ParseImage(&image, err, it.value(), base_dir,
-                        is_binary_, bin_data_, bin_size_)) {
+                        is_binary_, bin_data_, bin_size_, LoadImageData,
+                        load_image_user_data_)) {
           return false;
         }
 
@@ -2875,7 +2911,8 @@ bool TinyGLTF::LoadFromString(Model *model, std::string *err, const char *str,
 
           bool ret = LoadImageData(&image, err, image.width, image.height,
                                    &buffer.data[bufferView.byteOffset],
-                                   static_cast<int>(bufferView.byteLength));
+                                   static_cast<int>(bufferView.byteLength),
+                                   load_image_user_data_);
           if (!ret) {
             return false;
           }